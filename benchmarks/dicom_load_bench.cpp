@@ -0,0 +1,231 @@
+// Times reading a DICOM series, on a synthetic thin-slice CT or on real series.
+//
+//   dicom_load_bench              256x256x1000 int16 series, written once
+//   dicom_load_bench X Y Z        synthetic series of that size
+//   dicom_load_bench dir [dir2]   the series in the given directories
+//
+// "series reader" is what NiftiImage::loadDicomSeries used to do: ITK's
+// ImageSeriesReader over the sorted file list, one slice after another.
+// "parallel" is NiftiImage::load as it is now. Both must agree on every voxel
+// and on the geometry, otherwise the timing is meaningless.
+#include "NiftiImage.h"
+
+#include <itkGDCMImageIO.h>
+#include <itkGDCMSeriesFileNames.h>
+#include <itkImage.h>
+#include <itkImageFileWriter.h>
+#include <itkImageSeriesReader.h>
+#include <itkMetaDataObject.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+using FloatImage = itk::Image<float, 3>;
+using SliceImage = itk::Image<int16_t, 3>;
+using Clock = std::chrono::steady_clock;
+
+double secondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// One file per slice, all in one series, positioned 1 mm apart along Z.
+bool writeSyntheticSeries(const std::string &dir, int sx, int sy, int sz)
+{
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+
+    const std::string studyUid = "1.2.826.0.1.3680043.2.1125.1.1";
+    const std::string seriesUid = "1.2.826.0.1.3680043.2.1125.1.1.1";
+    try
+    {
+        for (int z = 0; z < sz; ++z)
+        {
+            SliceImage::Pointer slice = SliceImage::New();
+            SliceImage::SizeType size;
+            size[0] = sx;
+            size[1] = sy;
+            size[2] = 1;
+            slice->SetRegions(size);
+            SliceImage::SpacingType spacing;
+            spacing[0] = 0.7;
+            spacing[1] = 0.7;
+            spacing[2] = 1.0;
+            slice->SetSpacing(spacing);
+            SliceImage::PointType origin;
+            origin[0] = -90.0;
+            origin[1] = -90.0;
+            origin[2] = static_cast<double>(z);
+            slice->SetOrigin(origin);
+            slice->Allocate();
+            int16_t *pixels = slice->GetBufferPointer();
+            for (int y = 0; y < sy; ++y)
+                for (int x = 0; x < sx; ++x)
+                {
+                    const int dx = x - sx / 2, dy = y - sy / 2;
+                    const bool body = dx * dx + dy * dy < (sx * sx) / 6;
+                    pixels[static_cast<size_t>(y) * sx + x] =
+                        static_cast<int16_t>(body ? 40 + ((x * 7 + y * 3 + z) & 255) : -1000);
+                }
+
+            itk::GDCMImageIO::Pointer io = itk::GDCMImageIO::New();
+            io->KeepOriginalUIDOn();
+            itk::MetaDataDictionary &dict = io->GetMetaDataDictionary();
+            itk::EncapsulateMetaData<std::string>(dict, "0008|0060", "CT");
+            itk::EncapsulateMetaData<std::string>(dict, "0020|000d", studyUid);
+            itk::EncapsulateMetaData<std::string>(dict, "0020|000e", seriesUid);
+            itk::EncapsulateMetaData<std::string>(dict, "0008|0018", seriesUid + "." + std::to_string(z + 1));
+            itk::EncapsulateMetaData<std::string>(dict, "0020|0013", std::to_string(z + 1));
+
+            using WriterType = itk::ImageFileWriter<SliceImage>;
+            WriterType::Pointer writer = WriterType::New();
+            writer->SetImageIO(io);
+            char name[32];
+            std::snprintf(name, sizeof(name), "slice_%05d.dcm", z);
+            writer->SetFileName((std::filesystem::path(dir) / name).string());
+            writer->SetInput(slice);
+            writer->Update();
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::printf("could not write the series: %s\n", e.what());
+        return false;
+    }
+    return true;
+}
+
+// The removed load path, kept here only as the baseline.
+FloatImage::Pointer readWithSeriesReader(const std::string &dir)
+{
+    itk::GDCMSeriesFileNames::Pointer names = itk::GDCMSeriesFileNames::New();
+    names->SetUseSeriesDetails(true);
+    names->SetDirectory(dir);
+    const std::vector<std::string> &uids = names->GetSeriesUIDs();
+    if (uids.empty())
+        return nullptr;
+    using ReaderType = itk::ImageSeriesReader<FloatImage>;
+    ReaderType::Pointer reader = ReaderType::New();
+    reader->SetImageIO(itk::GDCMImageIO::New());
+    reader->SetFileNames(names->GetFileNames(uids.front()));
+    reader->Update();
+    return reader->GetOutput();
+}
+
+size_t countMismatches(const FloatImage *reference, const NiftiImage &image)
+{
+    const auto size = reference->GetLargestPossibleRegion().GetSize();
+    if (image.getSizeX() != size[0] || image.getSizeY() != size[1] || image.getSizeZ() != size[2])
+        return static_cast<size_t>(-1);
+    const float *ref = reference->GetBufferPointer();
+    size_t mismatches = 0;
+    size_t i = 0;
+    for (unsigned int z = 0; z < size[2]; ++z)
+        for (unsigned int y = 0; y < size[1]; ++y)
+            for (unsigned int x = 0; x < size[0]; ++x, ++i)
+                if (ref[i] != image.getVoxelValue(x, y, z))
+                    ++mismatches;
+    return mismatches;
+}
+
+bool benchSeries(const std::string &dir)
+{
+    std::printf("%s\n", dir.c_str());
+    try
+    {
+        Clock::time_point start = Clock::now();
+        FloatImage::Pointer reference = readWithSeriesReader(dir);
+        const double serialSeconds = secondsSince(start);
+        if (!reference)
+        {
+            std::printf("  no DICOM series found\n");
+            return false;
+        }
+
+        start = Clock::now();
+        NiftiImage parallel;
+        const bool loaded = parallel.load(dir);
+        const double parallelSeconds = secondsSince(start);
+        if (!loaded)
+        {
+            std::printf("  NiftiImage::load failed\n");
+            return false;
+        }
+
+        const auto size = reference->GetLargestPossibleRegion().GetSize();
+        const double mvox = static_cast<double>(size[0]) * size[1] * size[2] / 1e6;
+        std::printf("  %lux%lux%lu (%.1f Mvoxels), %u hardware threads\n", static_cast<unsigned long>(size[0]),
+                    static_cast<unsigned long>(size[1]), static_cast<unsigned long>(size[2]), mvox,
+                    std::thread::hardware_concurrency());
+        std::printf("  %-14s %8.3f s  %7.1f slices/s\n", "series reader", serialSeconds, size[2] / serialSeconds);
+        std::printf("  %-14s %8.3f s  %7.1f slices/s  (%.2fx)\n", "parallel", parallelSeconds,
+                    size[2] / parallelSeconds, serialSeconds / parallelSeconds);
+
+        const auto spacing = reference->GetSpacing();
+        const bool spacingMatches = std::abs(parallel.getSpacingX() - std::abs(spacing[0])) < 1e-6 &&
+                                    std::abs(parallel.getSpacingY() - std::abs(spacing[1])) < 1e-6 &&
+                                    std::abs(parallel.getSpacingZ() - std::abs(spacing[2])) < 1e-4;
+        const size_t mismatches = countMismatches(reference, parallel);
+        std::printf("  voxels match: %s, spacing matches: %s\n", mismatches == 0 ? "yes" : "NO",
+                    spacingMatches ? "yes" : "NO");
+        return mismatches == 0 && spacingMatches;
+    }
+    catch (const std::exception &e)
+    {
+        std::printf("  failed: %s\n", e.what());
+        return false;
+    }
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    std::vector<std::string> dirs;
+    int sx = 256, sy = 256, sz = 1000;
+    if (argc == 4 && std::atoi(argv[1]) > 0 && std::atoi(argv[2]) > 0 && std::atoi(argv[3]) > 0)
+    {
+        sx = std::atoi(argv[1]);
+        sy = std::atoi(argv[2]);
+        sz = std::atoi(argv[3]);
+    }
+    else
+    {
+        for (int i = 1; i < argc; ++i)
+            dirs.push_back(argv[i]);
+    }
+
+    std::string synthetic;
+    if (dirs.empty())
+    {
+        synthetic = (std::filesystem::temp_directory_path() / "dicom_load_bench_series").string();
+        std::error_code ec;
+        std::filesystem::remove_all(synthetic, ec);
+        std::printf("writing a %dx%dx%d int16 series to %s\n", sx, sy, sz, synthetic.c_str());
+        if (!writeSyntheticSeries(synthetic, sx, sy, sz))
+            return 1;
+        dirs.push_back(synthetic);
+    }
+
+    bool allMatch = true;
+    for (const std::string &dir : dirs)
+        allMatch = benchSeries(dir) && allMatch;
+
+    if (!synthetic.empty())
+    {
+        std::error_code ec;
+        std::filesystem::remove_all(synthetic, ec);
+    }
+    return allMatch ? 0 : 1;
+}
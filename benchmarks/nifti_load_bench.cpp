@@ -0,0 +1,221 @@
+// Times the ways a .nii.gz can be opened, on a synthetic CT or on real files.
+//
+//   nifti_load_bench                      512x512x400 int16 volume, written once
+//   nifti_load_bench X Y Z                synthetic volume of that size
+//   nifti_load_bench a.nii.gz [b.nii.gz]  the given files
+//
+// "temp file" is what NiftiImage::load used to do: gunzip to <tmp>/*.nii in
+// 32 KB chunks and read that back through NiftiImageIO. "ITK gz" lets ITK read
+// the compressed file itself. "streaming" is NiftiImage::load as it is now. All
+// three must agree voxel for voxel, otherwise the timing is meaningless.
+#include "NiftiImage.h"
+
+#include <itkImage.h>
+#include <itkImageFileReader.h>
+#include <itkNiftiImageIO.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+namespace
+{
+
+using FloatImage = itk::Image<float, 3>;
+using Clock = std::chrono::steady_clock;
+
+double secondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// A CT-like int16 ramp with some structure, so deflate has real work to do.
+bool writeSyntheticCt(const std::string &path, int sx, int sy, int sz)
+{
+    std::vector<unsigned char> header(352, 0);
+    auto put16 = [&](size_t at, int16_t v) { std::memcpy(header.data() + at, &v, 2); };
+    auto put32 = [&](size_t at, int32_t v) { std::memcpy(header.data() + at, &v, 4); };
+    auto putF = [&](size_t at, float v) { std::memcpy(header.data() + at, &v, 4); };
+    put32(0, 348);
+    const int16_t dims[8] = {3, static_cast<int16_t>(sx), static_cast<int16_t>(sy), static_cast<int16_t>(sz), 1, 1, 1, 1};
+    for (int i = 0; i < 8; ++i)
+        put16(40 + 2 * i, dims[i]);
+    put16(70, 4);  // int16
+    put16(72, 16); // bitpix
+    const float pixdim[4] = {1.0f, 0.7f, 0.7f, 1.0f};
+    for (int i = 0; i < 4; ++i)
+        putF(76 + 4 * i, pixdim[i]);
+    putF(108, 352.0f);
+    std::memcpy(header.data() + 344, "n+1\0", 4);
+
+    gzFile out = gzopen(path.c_str(), "wb6");
+    if (!out)
+        return false;
+    bool ok = gzwrite(out, header.data(), static_cast<unsigned int>(header.size())) ==
+              static_cast<int>(header.size());
+    std::vector<int16_t> slice(static_cast<size_t>(sx) * sy);
+    for (int z = 0; z < sz && ok; ++z)
+    {
+        for (int y = 0; y < sy; ++y)
+            for (int x = 0; x < sx; ++x)
+            {
+                const int dx = x - sx / 2, dy = y - sy / 2;
+                const bool body = dx * dx + dy * dy < (sx * sx) / 6;
+                slice[static_cast<size_t>(y) * sx + x] =
+                    static_cast<int16_t>(body ? 40 + ((x * 7 + y * 3 + z) & 255) : -1000);
+            }
+        const unsigned int bytes = static_cast<unsigned int>(slice.size() * sizeof(int16_t));
+        ok = gzwrite(out, slice.data(), bytes) == static_cast<int>(bytes);
+    }
+    return gzclose(out) == Z_OK && ok;
+}
+
+FloatImage::Pointer readWithItk(const std::string &path)
+{
+    using ReaderType = itk::ImageFileReader<FloatImage>;
+    ReaderType::Pointer reader = ReaderType::New();
+    reader->SetImageIO(itk::NiftiImageIO::New());
+    reader->SetFileName(path);
+    reader->Update();
+    return reader->GetOutput();
+}
+
+// The removed load path, kept here only as the baseline.
+FloatImage::Pointer readViaTempFile(const std::string &path)
+{
+    const std::string temp =
+        (std::filesystem::temp_directory_path() / "nifti_load_bench_decompressed.nii").string();
+    gzFile in = gzopen(path.c_str(), "rb");
+    FILE *out = in ? std::fopen(temp.c_str(), "wb") : nullptr;
+    if (!out)
+    {
+        if (in)
+            gzclose(in);
+        return nullptr;
+    }
+    std::vector<char> buffer(32768);
+    int got = 0;
+    while ((got = gzread(in, buffer.data(), static_cast<unsigned int>(buffer.size()))) > 0)
+        std::fwrite(buffer.data(), 1, static_cast<size_t>(got), out);
+    gzclose(in);
+    std::fclose(out);
+    FloatImage::Pointer image = readWithItk(temp);
+    std::error_code ec;
+    std::filesystem::remove(temp, ec);
+    return image;
+}
+
+size_t countMismatches(const FloatImage *reference, const NiftiImage &image)
+{
+    const auto size = reference->GetLargestPossibleRegion().GetSize();
+    if (image.getSizeX() != size[0] || image.getSizeY() != size[1] || image.getSizeZ() != size[2])
+        return static_cast<size_t>(-1);
+    const float *ref = reference->GetBufferPointer();
+    size_t mismatches = 0;
+    size_t i = 0;
+    for (unsigned int z = 0; z < size[2]; ++z)
+        for (unsigned int y = 0; y < size[1]; ++y)
+            for (unsigned int x = 0; x < size[0]; ++x, ++i)
+                if (ref[i] != image.getVoxelValue(x, y, z))
+                    ++mismatches;
+    return mismatches;
+}
+
+bool benchFile(const std::string &path)
+{
+    std::printf("%s\n", path.c_str());
+    try
+    {
+        Clock::time_point start = Clock::now();
+        FloatImage::Pointer viaTemp = readViaTempFile(path);
+        const double tempSeconds = secondsSince(start);
+        if (!viaTemp)
+        {
+            std::printf("  could not decompress to a temp file\n");
+            return false;
+        }
+
+        start = Clock::now();
+        FloatImage::Pointer direct = readWithItk(path);
+        const double itkSeconds = secondsSince(start);
+
+        start = Clock::now();
+        NiftiImage streamed;
+        const bool loaded = streamed.load(path);
+        const double streamSeconds = secondsSince(start);
+        if (!loaded)
+        {
+            std::printf("  NiftiImage::load failed\n");
+            return false;
+        }
+
+        const auto size = viaTemp->GetLargestPossibleRegion().GetSize();
+        const double mvox = static_cast<double>(size[0]) * size[1] * size[2] / 1e6;
+        std::printf("  %lux%lux%lu (%.1f Mvoxels)\n", static_cast<unsigned long>(size[0]),
+                    static_cast<unsigned long>(size[1]), static_cast<unsigned long>(size[2]), mvox);
+        std::printf("  %-12s %8.3f s  %7.1f Mvox/s\n", "temp file", tempSeconds, mvox / tempSeconds);
+        std::printf("  %-12s %8.3f s  %7.1f Mvox/s\n", "ITK gz", itkSeconds, mvox / itkSeconds);
+        std::printf("  %-12s %8.3f s  %7.1f Mvox/s  (%.2fx vs temp file)\n", "streaming", streamSeconds,
+                    mvox / streamSeconds, tempSeconds / streamSeconds);
+
+        const size_t mismatches = std::max(countMismatches(viaTemp, streamed), countMismatches(direct, streamed));
+        std::printf("  voxels match: %s\n", mismatches == 0 ? "yes" : "NO");
+        return mismatches == 0;
+    }
+    catch (const std::exception &e)
+    {
+        std::printf("  failed: %s\n", e.what());
+        return false;
+    }
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    std::vector<std::string> files;
+    int sx = 512, sy = 512, sz = 400;
+    if (argc == 4 && std::atoi(argv[1]) > 0 && std::atoi(argv[2]) > 0 && std::atoi(argv[3]) > 0)
+    {
+        sx = std::atoi(argv[1]);
+        sy = std::atoi(argv[2]);
+        sz = std::atoi(argv[3]);
+    }
+    else
+    {
+        for (int i = 1; i < argc; ++i)
+            files.push_back(argv[i]);
+    }
+
+    std::string synthetic;
+    if (files.empty())
+    {
+        synthetic = (std::filesystem::temp_directory_path() / "nifti_load_bench_ct.nii.gz").string();
+        std::printf("writing a %dx%dx%d int16 volume to %s\n", sx, sy, sz, synthetic.c_str());
+        if (!writeSyntheticCt(synthetic, sx, sy, sz))
+        {
+            std::printf("could not write %s\n", synthetic.c_str());
+            return 1;
+        }
+        files.push_back(synthetic);
+    }
+
+    bool allMatch = true;
+    for (const std::string &path : files)
+        allMatch = benchFile(path) && allMatch;
+
+    if (!synthetic.empty())
+    {
+        std::error_code ec;
+        std::filesystem::remove(synthetic, ec);
+    }
+    return allMatch ? 0 : 1;
+}
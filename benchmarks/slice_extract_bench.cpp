@@ -0,0 +1,229 @@
+// Times slice extraction per plane, on a synthetic CT or on real files.
+//
+//   slice_extract_bench              512x512x400 int16 volume, written once
+//   slice_extract_bench X Y Z        synthetic volume of that size
+//   slice_extract_bench a.nii [b]    the given files
+//
+// Each plane is timed over evenly spaced slices three ways: the original path
+// (a getVoxelValue() per voxel, windowed afterwards), the RGB accessors the
+// views use on the plain volume (the current kernels, strided for sagittal),
+// and the same accessors after buildSagittalLayout(). The last two must
+// produce identical slices; the original path is only timed.
+#include "NiftiImage.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+double secondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Uncompressed int16 NIfTI with some structure in every direction.
+bool writeSyntheticCt(const std::string &path, int sx, int sy, int sz)
+{
+    std::vector<unsigned char> header(352, 0);
+    auto put16 = [&](size_t at, int16_t v) { std::memcpy(header.data() + at, &v, 2); };
+    auto put32 = [&](size_t at, int32_t v) { std::memcpy(header.data() + at, &v, 4); };
+    auto putF = [&](size_t at, float v) { std::memcpy(header.data() + at, &v, 4); };
+    put32(0, 348);
+    const int16_t dims[8] = {3, static_cast<int16_t>(sx), static_cast<int16_t>(sy), static_cast<int16_t>(sz), 1, 1, 1, 1};
+    for (int i = 0; i < 8; ++i)
+        put16(40 + 2 * i, dims[i]);
+    put16(70, 4);  // int16
+    put16(72, 16); // bitpix
+    const float pixdim[4] = {1.0f, 0.7f, 0.7f, 1.0f};
+    for (int i = 0; i < 4; ++i)
+        putF(76 + 4 * i, pixdim[i]);
+    putF(108, 352.0f);
+    std::memcpy(header.data() + 344, "n+1\0", 4);
+
+    std::ofstream out(path, std::ios::binary);
+    out.write(reinterpret_cast<const char *>(header.data()), static_cast<std::streamsize>(header.size()));
+    std::vector<int16_t> row(static_cast<size_t>(sx));
+    for (int z = 0; z < sz; ++z)
+        for (int y = 0; y < sy; ++y)
+        {
+            for (int x = 0; x < sx; ++x)
+            {
+                const int dx = x - sx / 2, dy = y - sy / 2;
+                const bool body = dx * dx + dy * dy < (sx * sx) / 6;
+                row[static_cast<size_t>(x)] = static_cast<int16_t>(body ? 40 + ((x * 7 + y * 3 + z * 5) & 511) : -1000);
+            }
+            out.write(reinterpret_cast<const char *>(row.data()), static_cast<std::streamsize>(row.size() * 2));
+        }
+    return static_cast<bool>(out);
+}
+
+enum class Plane
+{
+    Axial,
+    Sagittal,
+    Coronal
+};
+
+std::vector<unsigned char> extract(const NiftiImage &image, Plane plane, unsigned int index, float lo, float hi)
+{
+    switch (plane)
+    {
+    case Plane::Axial: return image.getAxialSliceAsRGB(index, lo, hi);
+    case Plane::Sagittal: return image.getSagittalSliceAsRGB(index, lo, hi);
+    default: return image.getCoronalSliceAsRGB(index, lo, hi);
+    }
+}
+
+// The slice as the viewer read it before the typed kernels: one voxel at a
+// time into a float slice, then windowed into grey RGB.
+std::vector<unsigned char> extractPerVoxel(const NiftiImage &image, Plane plane, unsigned int index, float lo,
+                                           float hi)
+{
+    const unsigned int w = plane == Plane::Sagittal ? image.getSizeY() : image.getSizeX();
+    const unsigned int h = plane == Plane::Axial ? image.getSizeY() : image.getSizeZ();
+    std::vector<float> slice(size_t(w) * h);
+    for (unsigned int v = 0; v < h; ++v)
+        for (unsigned int u = 0; u < w; ++u)
+            slice[size_t(v) * w + u] = plane == Plane::Axial      ? image.getVoxelValue(u, v, index)
+                                       : plane == Plane::Sagittal ? image.getVoxelValue(index, u, v)
+                                                                  : image.getVoxelValue(u, index, v);
+    std::vector<unsigned char> out(slice.size() * 3);
+    const float denom = hi - lo != 0.0f ? hi - lo : 1.0f;
+    for (size_t i = 0; i < slice.size(); ++i)
+    {
+        const float v = std::min(std::max(slice[i], lo), hi);
+        const unsigned char c = static_cast<unsigned char>(255.0f * (v - lo) / denom);
+        out[i * 3 + 0] = c;
+        out[i * 3 + 1] = c;
+        out[i * 3 + 2] = c;
+    }
+    return out;
+}
+
+// Milliseconds per slice over up to 64 evenly spaced slices; the slices are
+// appended to `out` for the comparison between runs.
+double timePlane(const NiftiImage &image, Plane plane, float lo, float hi, std::vector<unsigned char> &out,
+                 bool perVoxel = false)
+{
+    const unsigned int count = plane == Plane::Axial      ? image.getSizeZ()
+                               : plane == Plane::Sagittal ? image.getSizeX()
+                                                          : image.getSizeY();
+    const unsigned int samples = std::min(64u, count);
+    const Clock::time_point start = Clock::now();
+    for (unsigned int i = 0; i < samples; ++i)
+    {
+        const std::vector<unsigned char> rgb = perVoxel ? extractPerVoxel(image, plane, i * count / samples, lo, hi)
+                                                        : extract(image, plane, i * count / samples, lo, hi);
+        out.insert(out.end(), rgb.begin(), rgb.end());
+    }
+    return secondsSince(start) * 1000.0 / samples;
+}
+
+bool benchFile(const std::string &path)
+{
+    std::printf("%s\n", path.c_str());
+    NiftiImage image;
+    if (!image.load(path))
+    {
+        std::printf("  could not load\n");
+        return false;
+    }
+    const float lo = image.getGlobalMin();
+    const float hi = image.getGlobalMax();
+    std::printf("  %ux%ux%u\n", image.getSizeX(), image.getSizeY(), image.getSizeZ());
+
+    // One untimed pass, so the first timed run does not pay for paging in.
+    std::vector<unsigned char> warm;
+    timePlane(image, Plane::Axial, lo, hi, warm);
+
+    const Plane planes[3] = {Plane::Axial, Plane::Sagittal, Plane::Coronal};
+    const char *names[3] = {"axial", "sagittal", "coronal"};
+    std::vector<unsigned char> original, before[3], after[3];
+    double originalMs[3], beforeMs[3], afterMs[3];
+    for (int p = 0; p < 3; ++p)
+    {
+        originalMs[p] = timePlane(image, planes[p], lo, hi, original, true);
+        original.clear();
+        beforeMs[p] = timePlane(image, planes[p], lo, hi, before[p]);
+    }
+
+    const Clock::time_point start = Clock::now();
+    const bool built = image.buildSagittalLayout();
+    std::printf("  sagittal layout: %s in %.3f s\n", built ? "built" : "NOT built", secondsSince(start));
+
+    for (int p = 0; p < 3; ++p)
+        afterMs[p] = timePlane(image, planes[p], lo, hi, after[p]);
+
+    bool allMatch = built;
+    std::printf("  %-10s %12s %12s %12s\n", "plane", "per-voxel ms", "kernel ms", "layout ms");
+    for (int p = 0; p < 3; ++p)
+    {
+        const bool match = before[p] == after[p];
+        allMatch = allMatch && match;
+        std::printf("  %-10s %12.3f %12.3f %12.3f%s\n", names[p], originalMs[p], beforeMs[p], afterMs[p],
+                    match ? "" : "  MISMATCH");
+    }
+    return allMatch;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    std::vector<std::string> files;
+    int sx = 512, sy = 512, sz = 400;
+    if (argc == 4 && std::atoi(argv[1]) > 0 && std::atoi(argv[2]) > 0 && std::atoi(argv[3]) > 0)
+    {
+        sx = std::atoi(argv[1]);
+        sy = std::atoi(argv[2]);
+        sz = std::atoi(argv[3]);
+    }
+    else
+    {
+        for (int i = 1; i < argc; ++i)
+            files.push_back(argv[i]);
+    }
+
+    std::string synthetic;
+    if (files.empty())
+    {
+        synthetic = (std::filesystem::temp_directory_path() / "slice_extract_bench.nii").string();
+        std::printf("writing a %dx%dx%d int16 volume to %s\n", sx, sy, sz, synthetic.c_str());
+        if (!writeSyntheticCt(synthetic, sx, sy, sz))
+            return 1;
+        files.push_back(synthetic);
+    }
+
+    bool allMatch = true;
+    for (const std::string &file : files)
+    {
+        try
+        {
+            allMatch = benchFile(file) && allMatch;
+        }
+        catch (const std::exception &e)
+        {
+            std::printf("  failed: %s\n", e.what());
+            allMatch = false;
+        }
+    }
+
+    if (!synthetic.empty())
+    {
+        std::error_code ec;
+        std::filesystem::remove(synthetic, ec);
+    }
+    return allMatch ? 0 : 1;
+}
@@ -11,6 +11,7 @@
  * They remain member functions of ManualSeedSelector.
  */
 
+#include "GzipWriter.h"
 #include "ManualSeedSelector.h"
 #include "UiUtils.h"
 
@@ -778,8 +779,9 @@ void ManualSeedSelector::runVesselGraph()
         ensureActiveMaskLoaded();
 
     const bool maskEmpty = (m_maskData.empty() ||
-                            std::none_of(m_maskData.begin(), m_maskData.end(), [](int v)
-                                         { return v > 0; }));
+                            m_maskData.visit([&](const auto *labels)
+                                             { return std::none_of(labels, labels + m_maskData.size(), [](auto v)
+                                                                   { return v > 0; }); }));
     if (!segmentFromCt)
     {
         if (maskEmpty)
@@ -856,7 +858,7 @@ void ManualSeedSelector::runVesselGraph()
     if (!segmentFromCt)
     {
         tmpMask = QDir(tmpDir.path()).filePath("vessel_graph_domain.nii.gz");
-        if (!saveMaskToFile(tmpMask.toStdString()))
+        if (!saveMaskToFile(tmpMask.toStdString(), gzip::kFastLevel))
             return;
     }
 
@@ -0,0 +1,185 @@
+#include "GzipWriter.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <thread>
+#include <zlib.h>
+
+namespace gzip
+{
+
+namespace
+{
+
+// pigz's defaults: 128 KiB blocks, each primed with the 32 KiB deflate window
+// that precedes it.
+constexpr size_t kBlockSize = size_t(128) << 10;
+constexpr size_t kWindowSize = size_t(32) << 10;
+// Blocks compressed per round for each thread; a round is written out before
+// the next starts, which bounds the memory held in compressed blocks.
+constexpr size_t kBlocksPerThread = 4;
+
+struct Block
+{
+    const unsigned char *data = nullptr;
+    size_t size = 0;
+    size_t dictionary = 0; // bytes before `data` to prime the window with
+    bool last = false;
+    std::vector<unsigned char> out;
+    uLong crc = 0;
+    bool ok = false;
+};
+
+void setError(std::string *error, const std::string &message)
+{
+    if (error)
+        *error = message;
+}
+
+// Raw deflate of one block. All but the last end on a sync flush, which leaves
+// the stream byte-aligned and unterminated so the next block can follow it.
+void deflateBlock(Block &block, int level)
+{
+    z_stream strm{};
+    if (deflateInit2(&strm, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return;
+    bool ok = true;
+    if (block.dictionary > 0)
+        ok = deflateSetDictionary(&strm, block.data - block.dictionary, static_cast<uInt>(block.dictionary)) == Z_OK;
+
+    // Room for the sync flush marker on top of the bound for a finished stream.
+    block.out.resize(deflateBound(&strm, static_cast<uLong>(block.size)) + 16);
+    strm.next_in = const_cast<Bytef *>(block.data);
+    strm.avail_in = static_cast<uInt>(block.size);
+    const int flush = block.last ? Z_FINISH : Z_SYNC_FLUSH;
+    size_t written = 0;
+    while (ok)
+    {
+        strm.next_out = block.out.data() + written;
+        strm.avail_out = static_cast<uInt>(block.out.size() - written);
+        const int status = deflate(&strm, flush);
+        written = block.out.size() - strm.avail_out;
+        if (status == Z_STREAM_END || (flush == Z_SYNC_FLUSH && status == Z_OK && strm.avail_out > 0))
+            break;
+        if (status != Z_OK && status != Z_BUF_ERROR)
+            ok = false;
+        else
+            block.out.resize(block.out.size() * 2);
+    }
+    deflateEnd(&strm);
+    block.out.resize(written);
+    block.crc = crc32(crc32(0L, Z_NULL, 0), block.data, static_cast<uInt>(block.size));
+    block.ok = ok;
+}
+
+void putLittleEndian32(unsigned char *p, uint32_t value)
+{
+    for (int b = 0; b < 4; ++b)
+        p[b] = static_cast<unsigned char>(value >> (8 * b));
+}
+
+} // namespace
+
+bool writeFile(const std::string &path, const std::vector<Piece> &pieces, int level, std::string *error,
+               unsigned threads)
+{
+    if (level < -1 || level > 9)
+    {
+        setError(error, "invalid compression level " + std::to_string(level));
+        return false;
+    }
+
+    std::vector<Block> blocks;
+    uint64_t total = 0;
+    for (const Piece &piece : pieces)
+    {
+        const unsigned char *bytes = static_cast<const unsigned char *>(piece.data);
+        for (size_t offset = 0; offset < piece.size; offset += kBlockSize)
+        {
+            Block block;
+            block.data = bytes + offset;
+            block.size = std::min(kBlockSize, piece.size - offset);
+            block.dictionary = std::min(kWindowSize, offset);
+            blocks.push_back(std::move(block));
+        }
+        total += piece.size;
+    }
+    // An empty input still needs one finished (empty) deflate stream.
+    if (blocks.empty())
+        blocks.emplace_back();
+    blocks.back().last = true;
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out)
+    {
+        setError(error, "could not open '" + path + "' for writing");
+        return false;
+    }
+
+    // Fixed header: no name or timestamp, OS "unix" as gzip itself writes.
+    const unsigned char header[10] = {0x1f, 0x8b, 8, 0, 0, 0, 0, 0,
+                                      static_cast<unsigned char>(level == 1 ? 4 : (level == 9 ? 2 : 0)), 3};
+    out.write(reinterpret_cast<const char *>(header), sizeof(header));
+
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = static_cast<unsigned>(std::min<size_t>(threads, blocks.size()));
+    const size_t round = threads * kBlocksPerThread;
+    uLong crc = crc32(0L, Z_NULL, 0);
+    std::string failure;
+    bool ok = static_cast<bool>(out);
+    for (size_t first = 0; ok && first < blocks.size(); first += round)
+    {
+        const size_t last = std::min(blocks.size(), first + round);
+        std::atomic<size_t> next{first};
+        auto work = [&]()
+        {
+            for (size_t i = next++; i < last; i = next++)
+                deflateBlock(blocks[i], level);
+        };
+        std::vector<std::thread> helpers;
+        const size_t helperCount = std::min<size_t>(threads, last - first) - 1;
+        for (size_t t = 0; t < helperCount; ++t)
+            helpers.emplace_back(work);
+        work();
+        for (std::thread &helper : helpers)
+            helper.join();
+
+        for (size_t i = first; ok && i < last; ++i)
+        {
+            Block &block = blocks[i];
+            if (!block.ok)
+            {
+                failure = "deflate failed";
+                ok = false;
+                break;
+            }
+            out.write(reinterpret_cast<const char *>(block.out.data()), static_cast<std::streamsize>(block.out.size()));
+            crc = crc32_combine(crc, block.crc, static_cast<z_off_t>(block.size));
+            std::vector<unsigned char>().swap(block.out);
+            ok = static_cast<bool>(out);
+        }
+    }
+
+    if (ok)
+    {
+        unsigned char trailer[8];
+        putLittleEndian32(trailer, static_cast<uint32_t>(crc));
+        putLittleEndian32(trailer + 4, static_cast<uint32_t>(total)); // ISIZE is the length mod 2^32
+        out.write(reinterpret_cast<const char *>(trailer), sizeof(trailer));
+        out.close();
+        ok = !out.fail();
+    }
+    if (!ok)
+    {
+        setError(error, failure.empty() ? "could not write '" + path + "'" : failure);
+        out.close();
+        std::remove(path.c_str());
+    }
+    return ok;
+}
+
+} // namespace gzip
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// A gzip writer that deflates on every core, the way pigz does: the input is
+// cut into blocks that are compressed side by side, each primed with the 32 KiB
+// before it so the ratio stays close to a single-threaded deflate. The blocks
+// are byte-aligned with a sync flush and joined into one ordinary gzip member,
+// so any zlib reader (ITK, nibabel, SimpleITK, gunzip) reads the result.
+namespace gzip
+{
+
+// zlib's levels: 1 is the fastest, 9 the smallest, -1 its default (6).
+constexpr int kFastLevel = 1;
+constexpr int kDefaultLevel = -1;
+constexpr int kBestLevel = 9;
+
+// One run of bytes; a file is the concatenation of its pieces in order.
+struct Piece
+{
+    const void *data = nullptr;
+    size_t size = 0;
+};
+
+/// Compress `pieces` into `path` as one gzip member. `threads` 0 means one per
+/// core. On failure the partial file is removed and `error` says why.
+bool writeFile(const std::string &path, const std::vector<Piece> &pieces, int level, std::string *error,
+               unsigned threads = 0);
+
+} // namespace gzip
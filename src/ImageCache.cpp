@@ -0,0 +1,92 @@
+#include "ImageCache.h"
+
+#include <iterator>
+#include <utility>
+
+void ImageCache::setBudget(std::size_t budgetBytes)
+{
+    m_budget = budgetBytes;
+    evictToFit(0);
+}
+
+const ImageCache::Entry *ImageCache::find(const std::string &key)
+{
+    auto it = m_entries.find(key);
+    if (it == m_entries.end())
+        return nullptr;
+    m_order.splice(m_order.begin(), m_order, it->second.position);
+    return &it->second.entry;
+}
+
+bool ImageCache::insert(const std::string &key, std::shared_ptr<NiftiImage> image, const NpzImportOptions &options)
+{
+    erase(key);
+    if (!image)
+        return false;
+    const std::size_t bytes = image->memoryBytes();
+    if (bytes > m_budget)
+        return false;
+
+    evictToFit(bytes);
+    m_order.push_front(key);
+    Slot slot;
+    slot.entry.image = std::move(image);
+    slot.entry.options = options;
+    slot.entry.bytes = bytes;
+    slot.position = m_order.begin();
+    m_entries.emplace(key, std::move(slot));
+    m_used += bytes;
+    return true;
+}
+
+bool ImageCache::refresh(const std::string &key)
+{
+    auto it = m_entries.find(key);
+    if (it == m_entries.end())
+        return false;
+    Entry &entry = it->second.entry;
+    const std::size_t bytes = entry.image->memoryBytes();
+    m_used = m_used - entry.bytes + bytes;
+    entry.bytes = bytes;
+    if (bytes > m_budget)
+    {
+        erase(key);
+        return false;
+    }
+    // `key` alone fits, so this stops before it is the only entry left.
+    while (m_used > m_budget)
+    {
+        auto oldest = std::prev(m_order.end());
+        if (*oldest == key)
+            --oldest;
+        const std::string victim = *oldest;
+        erase(victim);
+    }
+    return true;
+}
+
+void ImageCache::erase(const std::string &key)
+{
+    auto it = m_entries.find(key);
+    if (it == m_entries.end())
+        return;
+    m_used -= it->second.entry.bytes;
+    m_order.erase(it->second.position);
+    m_entries.erase(it);
+}
+
+void ImageCache::clear()
+{
+    m_entries.clear();
+    m_order.clear();
+    m_used = 0;
+}
+
+void ImageCache::evictToFit(std::size_t incoming)
+{
+    while (!m_order.empty() && m_used + incoming > m_budget)
+    {
+        const std::string oldest = m_order.back();
+        erase(oldest);
+    }
+}
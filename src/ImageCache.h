@@ -0,0 +1,66 @@
+#pragma once
+
+/**
+ * ImageCache.h — recently viewed volumes, kept for switching back to them.
+ *
+ * Stepping through a cohort in the image list reloads every case from disk.
+ * The cache keeps the NiftiImage instances that were loaded (or prefetched)
+ * under a memory budget, least recently used first out, so reselecting one is
+ * a pointer swap. It is used from the GUI thread only: background loads hand
+ * their results over through queued calls before anything is inserted.
+ */
+
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "NiftiImage.h"
+
+class ImageCache
+{
+public:
+    struct Entry
+    {
+        std::shared_ptr<NiftiImage> image;
+        // The numpy options the volume was read with, automatic choices
+        // resolved, so a cache hit can write them back like a load does.
+        NpzImportOptions options;
+        std::size_t bytes = 0;
+    };
+
+    explicit ImageCache(std::size_t budgetBytes = 0) : m_budget(budgetBytes) {}
+
+    /// 0 disables the cache. Shrinking evicts down to the new budget.
+    void setBudget(std::size_t budgetBytes);
+    std::size_t budget() const { return m_budget; }
+    std::size_t usedBytes() const { return m_used; }
+    std::size_t size() const { return m_order.size(); }
+
+    /// The entry for `key`, now the most recently used; null when absent.
+    const Entry *find(const std::string &key);
+    bool contains(const std::string &key) const { return m_entries.count(key) != 0; }
+    /// Store (or replace) `key`, evicting the least recently used entries
+    /// until it fits. False when the image alone is larger than the budget.
+    bool insert(const std::string &key, std::shared_ptr<NiftiImage> image, const NpzImportOptions &options);
+    /// Count `key` again after its image grew (a sagittal layout built on a
+    /// shared copy), evicting other entries, oldest first, until the budget
+    /// holds. False, with `key` dropped, when the image alone no longer fits.
+    bool refresh(const std::string &key);
+    void erase(const std::string &key);
+    void clear();
+
+private:
+    void evictToFit(std::size_t incoming);
+
+    std::size_t m_budget = 0;
+    std::size_t m_used = 0;
+    std::list<std::string> m_order; // most recently used first
+    struct Slot
+    {
+        Entry entry;
+        std::list<std::string>::iterator position;
+    };
+    std::unordered_map<std::string, Slot> m_entries;
+};
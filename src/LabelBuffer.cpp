@@ -0,0 +1,170 @@
+#include "LabelBuffer.h"
+
+#include <algorithm>
+#include <set>
+#include <utility>
+
+namespace
+{
+
+// Copy `count` voxels into a fresh vector of `Out` and release the source.
+template <typename Out, typename In>
+void convertInto(std::vector<In> &from, std::vector<Out> &to, std::size_t count)
+{
+    to.assign(from.begin(), from.begin() + static_cast<std::ptrdiff_t>(count));
+    std::vector<In>().swap(from);
+}
+
+// Distinct non-zero values of a narrow buffer, by marking each in a table
+// the size of the type's range.
+template <typename T>
+std::vector<int> distinctNarrow(const T *data, std::size_t count)
+{
+    std::vector<unsigned char> seen(std::size_t(1) << (8 * sizeof(T)), 0);
+    for (std::size_t i = 0; i < count; ++i)
+        seen[data[i]] = 1;
+    std::vector<int> labels;
+    for (std::size_t value = 1; value < seen.size(); ++value)
+    {
+        if (seen[value])
+            labels.push_back(static_cast<int>(value));
+    }
+    return labels;
+}
+
+} // namespace
+
+LabelBuffer::LabelBuffer(std::size_t count, int value)
+{
+    assign(count, value);
+}
+
+LabelBuffer::LabelBuffer(LabelBuffer &&other) noexcept
+{
+    *this = std::move(other);
+}
+
+LabelBuffer &LabelBuffer::operator=(LabelBuffer &&other) noexcept
+{
+    if (this == &other)
+        return *this;
+    m_u8 = std::move(other.m_u8);
+    m_u16 = std::move(other.m_u16);
+    m_i32 = std::move(other.m_i32);
+    m_width = other.m_width;
+    m_size = other.m_size;
+    other.clear();
+    return *this;
+}
+
+LabelBuffer::Width LabelBuffer::widthFor(int label)
+{
+    if (label >= 0 && label <= 0xFF)
+        return Width::Bits8;
+    if (label >= 0 && label <= 0xFFFF)
+        return Width::Bits16;
+    return Width::Bits32;
+}
+
+void LabelBuffer::clear()
+{
+    std::vector<uint8_t>().swap(m_u8);
+    std::vector<uint16_t>().swap(m_u16);
+    std::vector<int32_t>().swap(m_i32);
+    m_width = Width::Bits8;
+    m_size = 0;
+}
+
+void LabelBuffer::assign(std::size_t count, int value, Width width)
+{
+    clear();
+    m_width = std::max(width, widthFor(value));
+    switch (m_width)
+    {
+    case Width::Bits8:
+        m_u8.assign(count, static_cast<uint8_t>(value));
+        break;
+    case Width::Bits16:
+        m_u16.assign(count, static_cast<uint16_t>(value));
+        break;
+    default:
+        m_i32.assign(count, value);
+        break;
+    }
+    m_size = count;
+}
+
+void LabelBuffer::assign(const int32_t *values, std::size_t count)
+{
+    Width width = Width::Bits8;
+    if (count > 0)
+    {
+        const auto range = std::minmax_element(values, values + count);
+        width = std::max(widthFor(*range.first), widthFor(*range.second));
+    }
+    assign(count, 0, width);
+    visit([&](auto *data) { std::copy(values, values + count, data); });
+}
+
+void LabelBuffer::widen(Width width)
+{
+    if (width <= m_width)
+        return;
+    if (m_width == Width::Bits8 && width == Width::Bits16)
+        convertInto(m_u8, m_u16, m_size);
+    else if (m_width == Width::Bits8)
+        convertInto(m_u8, m_i32, m_size);
+    else
+        convertInto(m_u16, m_i32, m_size);
+    m_width = width;
+}
+
+void LabelBuffer::shrinkToFit()
+{
+    if (m_width == Width::Bits8 || m_size == 0)
+        return;
+    const Width width = visit(
+        [&](const auto *data)
+        {
+            const auto range = std::minmax_element(data, data + m_size);
+            return std::max(widthFor(static_cast<int>(*range.first)), widthFor(static_cast<int>(*range.second)));
+        });
+    if (width >= m_width)
+        return;
+    if (m_width == Width::Bits16)
+        convertInto(m_u16, m_u8, m_size);
+    else if (width == Width::Bits16)
+        convertInto(m_i32, m_u16, m_size);
+    else
+        convertInto(m_i32, m_u8, m_size);
+    m_width = width;
+}
+
+std::vector<int> LabelBuffer::distinctLabels() const
+{
+    switch (m_width)
+    {
+    case Width::Bits8:
+        return distinctNarrow(m_u8.data(), m_size);
+    case Width::Bits16:
+        return distinctNarrow(m_u16.data(), m_size);
+    default:
+        break;
+    }
+    std::set<int> present;
+    for (std::size_t i = 0; i < m_size; ++i)
+    {
+        if (m_i32[i] != 0)
+            present.insert(m_i32[i]);
+    }
+    return std::vector<int>(present.begin(), present.end());
+}
+
+bool LabelBuffer::operator==(const LabelBuffer &other) const
+{
+    if (m_size != other.m_size)
+        return false;
+    return visit(
+        [&](const auto *a)
+        { return other.visit([&](const auto *b) { return std::equal(a, a + m_size, b); }); });
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+/**
+ * LabelBuffer.h — the voxels of a label volume, stored as narrow as its labels allow.
+ *
+ * Masks rarely carry more than a handful of labels, so a buffer holds one byte
+ * per voxel until a label that does not fit is written. It is then widened in
+ * place, to 16 bits, or to 32 for labels above 65535 or below zero, and never
+ * narrowed behind the caller's back. Single voxels go through operator[] and
+ * set(); loops over whole rows (the overlay blend, the 3D merge, saving) go
+ * through visit(), which hands them a pointer of the stored type.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class LabelBuffer
+{
+public:
+    /// Bytes per voxel.
+    enum class Width
+    {
+        Bits8 = 1,
+        Bits16 = 2,
+        Bits32 = 4,
+    };
+
+    LabelBuffer() = default;
+    /// @p count voxels of @p value.
+    LabelBuffer(std::size_t count, int value);
+    LabelBuffer(const LabelBuffer &) = default;
+    LabelBuffer &operator=(const LabelBuffer &) = default;
+    /// Moving leaves the source empty, at 8 bits.
+    LabelBuffer(LabelBuffer &&other) noexcept;
+    LabelBuffer &operator=(LabelBuffer &&other) noexcept;
+
+    /// The narrowest width that holds @p label.
+    static Width widthFor(int label);
+
+    std::size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+    Width width() const { return m_width; }
+    /// Memory held by the voxels.
+    std::size_t bytes() const { return m_size * static_cast<std::size_t>(m_width); }
+
+    /// No voxels, memory released, back to 8 bits.
+    void clear();
+    /// @p count voxels of @p value, at @p width or the narrowest that holds @p value.
+    void assign(std::size_t count, int value = 0, Width width = Width::Bits8);
+    /// A copy of @p values, at the narrowest width that holds all of them.
+    void assign(const int32_t *values, std::size_t count);
+    /// Widen (never narrow) to at least @p width, keeping every voxel.
+    void widen(Width width);
+    /// Narrow to the smallest width that holds every voxel.
+    void shrinkToFit();
+
+    int operator[](std::size_t index) const
+    {
+        switch (m_width)
+        {
+        case Width::Bits8:
+            return m_u8[index];
+        case Width::Bits16:
+            return m_u16[index];
+        default:
+            return m_i32[index];
+        }
+    }
+    /// Write one voxel, widening the buffer first when @p label does not fit.
+    void set(std::size_t index, int label)
+    {
+        if (widthFor(label) > m_width)
+            widen(widthFor(label));
+        switch (m_width)
+        {
+        case Width::Bits8:
+            m_u8[index] = static_cast<uint8_t>(label);
+            break;
+        case Width::Bits16:
+            m_u16[index] = static_cast<uint16_t>(label);
+            break;
+        default:
+            m_i32[index] = label;
+            break;
+        }
+    }
+
+    /// Calls @p f with a pointer to the voxels as stored: const uint8_t *,
+    /// const uint16_t * or const int32_t *. Every instantiation must return
+    /// the same type.
+    template <typename F>
+    decltype(auto) visit(F &&f) const
+    {
+        switch (m_width)
+        {
+        case Width::Bits8:
+            return f(static_cast<const uint8_t *>(m_u8.data()));
+        case Width::Bits16:
+            return f(static_cast<const uint16_t *>(m_u16.data()));
+        default:
+            return f(static_cast<const int32_t *>(m_i32.data()));
+        }
+    }
+    /// As above, writable. Values written must fit the width; widen() first.
+    template <typename F>
+    decltype(auto) visit(F &&f)
+    {
+        switch (m_width)
+        {
+        case Width::Bits8:
+            return f(m_u8.data());
+        case Width::Bits16:
+            return f(m_u16.data());
+        default:
+            return f(m_i32.data());
+        }
+    }
+
+    /// Distinct non-zero labels, ascending.
+    std::vector<int> distinctLabels() const;
+
+    /// Same voxels, whatever the widths.
+    bool operator==(const LabelBuffer &other) const;
+    bool operator!=(const LabelBuffer &other) const { return !(*this == other); }
+
+private:
+    // One vector per width, only the one for m_width in use: each keeps its
+    // own element type, so no voxel is ever read through another type.
+    std::vector<uint8_t> m_u8;
+    std::vector<uint16_t> m_u16;
+    std::vector<int32_t> m_i32;
+    Width m_width = Width::Bits8;
+    std::size_t m_size = 0;
+};
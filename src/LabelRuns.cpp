@@ -0,0 +1,136 @@
+#include "LabelRuns.h"
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <set>
+#include <thread>
+#include <type_traits>
+
+bool LabelRuns::encode(const LabelBuffer &labels, unsigned int dimX, unsigned int dimY, unsigned int dimZ,
+                       std::size_t maxBytes)
+{
+    clear();
+    const std::size_t rows = static_cast<std::size_t>(dimY) * dimZ;
+    if (dimX == 0 || rows == 0 || labels.size() != rows * dimX)
+        return false;
+    const std::size_t indexBytes = (rows + 1) * sizeof(uint32_t);
+    if (indexBytes > maxBytes)
+        return false;
+    const std::size_t maxRuns =
+        std::min<std::size_t>((maxBytes - indexBytes) / sizeof(Run), std::numeric_limits<uint32_t>::max());
+
+    // Each slice's runs are collected apart, on whichever core takes it, and
+    // joined in order afterwards. All workers stop once the budget is gone.
+    std::vector<std::vector<Run>> sliceRuns(dimZ);
+    std::vector<uint32_t> rowCounts(rows, 0);
+    std::atomic<unsigned int> next{0};
+    std::atomic<std::size_t> total{0};
+    std::atomic<bool> over{false};
+    auto work = [&]()
+    {
+        labels.visit(
+            [&](const auto *data)
+            {
+                for (unsigned int z = next++; z < dimZ && !over; z = next++)
+                {
+                    std::vector<Run> &runs = sliceRuns[z];
+                    for (unsigned int y = 0; y < dimY; ++y)
+                    {
+                        const auto *line = data + (static_cast<std::size_t>(z) * dimY + y) * dimX;
+                        const std::size_t before = runs.size();
+                        for (unsigned int x = 0; x < dimX;)
+                        {
+                            const auto label = line[x];
+                            unsigned int end = x + 1;
+                            while (end < dimX && line[end] == label)
+                                ++end;
+                            if (label != 0)
+                                runs.push_back(Run{x, end, static_cast<int32_t>(label)});
+                            x = end;
+                        }
+                        rowCounts[static_cast<std::size_t>(z) * dimY + y] =
+                            static_cast<uint32_t>(runs.size() - before);
+                    }
+                    if ((total += runs.size()) > maxRuns)
+                        over = true;
+                }
+            });
+    };
+    const std::size_t hardware = std::max(1u, std::thread::hardware_concurrency());
+    const std::size_t threads = std::max<std::size_t>(1, std::min<std::size_t>(hardware, labels.size() >> 22));
+    std::vector<std::thread> helpers;
+    for (std::size_t t = 1; t < threads; ++t)
+        helpers.emplace_back(work);
+    work();
+    for (std::thread &helper : helpers)
+        helper.join();
+    if (over)
+        return false;
+
+    m_runs.reserve(total);
+    for (std::vector<Run> &runs : sliceRuns)
+    {
+        m_runs.insert(m_runs.end(), runs.begin(), runs.end());
+        std::vector<Run>().swap(runs);
+    }
+    m_rowStart.resize(rows + 1);
+    m_rowStart[0] = 0;
+    for (std::size_t r = 0; r < rows; ++r)
+        m_rowStart[r + 1] = m_rowStart[r] + rowCounts[r];
+    m_dimX = dimX;
+    m_dimY = dimY;
+    m_dimZ = dimZ;
+    m_width = labels.width();
+    return true;
+}
+
+void LabelRuns::decode(LabelBuffer &out) const
+{
+    out.assign(static_cast<std::size_t>(m_dimX) * m_dimY * m_dimZ, 0, m_width);
+    out.visit(
+        [&](auto *data)
+        {
+            using Label = std::remove_pointer_t<decltype(data)>;
+            for (std::size_t r = 0; r + 1 < m_rowStart.size(); ++r)
+            {
+                Label *line = data + r * m_dimX;
+                for (uint32_t i = m_rowStart[r]; i < m_rowStart[r + 1]; ++i)
+                    std::fill(line + m_runs[i].begin, line + m_runs[i].end, static_cast<Label>(m_runs[i].label));
+            }
+        });
+}
+
+void LabelRuns::clear()
+{
+    std::vector<Run>().swap(m_runs);
+    std::vector<uint32_t>().swap(m_rowStart);
+    m_dimX = m_dimY = m_dimZ = 0;
+    m_width = LabelBuffer::Width::Bits8;
+}
+
+void LabelRuns::decodeRow(unsigned int y, unsigned int z, int *out) const
+{
+    std::fill(out, out + m_dimX, 0);
+    for (const Run *run = rowBegin(y, z); run != rowEnd(y, z); ++run)
+        std::fill(out + run->begin, out + run->end, run->label);
+}
+
+int LabelRuns::at(unsigned int x, unsigned int y, unsigned int z) const
+{
+    const Run *first = rowBegin(y, z);
+    const Run *after =
+        std::upper_bound(first, rowEnd(y, z), x, [](unsigned int value, const Run &run) { return value < run.begin; });
+    if (after == first)
+        return 0;
+    const Run &run = after[-1];
+    return x < run.end ? run.label : 0;
+}
+
+std::vector<int> LabelRuns::distinctLabels() const
+{
+    std::set<int> present;
+    for (const Run &run : m_runs)
+        present.insert(run.label);
+    return std::vector<int>(present.begin(), present.end());
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+/**
+ * LabelRuns.h — a label volume stored as runs along X, for masks that are drawn but not edited.
+ *
+ * An organ mask is mostly background, so a drawn layer keeps only the runs of
+ * equal non-zero labels in each row, with an index to the first run of every
+ * row. Any row, and so any slice in any plane, decodes without touching the
+ * rest of the volume: decodeRow() for X rows (axial and coronal), at() for
+ * single voxels (sagittal columns). Background costs nothing but the index.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "LabelBuffer.h"
+
+class LabelRuns
+{
+public:
+    /// Voxels [begin, end) of one row hold `label`; never 0.
+    struct Run
+    {
+        uint32_t begin = 0;
+        uint32_t end = 0;
+        int32_t label = 0;
+    };
+
+    /// Encode @p labels, a dimX x dimY x dimZ volume with X fastest, on every
+    /// core. False (and nothing kept) when the runs would take more than
+    /// @p maxBytes — a noisy volume is better left dense.
+    bool encode(const LabelBuffer &labels, unsigned int dimX, unsigned int dimY, unsigned int dimZ,
+                std::size_t maxBytes = SIZE_MAX);
+    /// The whole volume, at the width it was encoded from.
+    void decode(LabelBuffer &out) const;
+    void clear();
+
+    bool empty() const { return m_rowStart.empty(); }
+    unsigned int dimX() const { return m_dimX; }
+    unsigned int dimY() const { return m_dimY; }
+    unsigned int dimZ() const { return m_dimZ; }
+    std::size_t runCount() const { return m_runs.size(); }
+    /// Memory held by the runs and the row index.
+    std::size_t bytes() const { return m_runs.size() * sizeof(Run) + m_rowStart.size() * sizeof(uint32_t); }
+
+    /// The runs of row (y, z), in X order.
+    const Run *rowBegin(unsigned int y, unsigned int z) const { return m_runs.data() + m_rowStart[row(y, z)]; }
+    const Run *rowEnd(unsigned int y, unsigned int z) const { return m_runs.data() + m_rowStart[row(y, z) + 1]; }
+    /// dimX labels of row (y, z) into @p out.
+    void decodeRow(unsigned int y, unsigned int z, int *out) const;
+    /// One voxel, by binary search in its row.
+    int at(unsigned int x, unsigned int y, unsigned int z) const;
+
+    /// Distinct non-zero labels, ascending.
+    std::vector<int> distinctLabels() const;
+
+private:
+    std::size_t row(unsigned int y, unsigned int z) const { return static_cast<std::size_t>(z) * m_dimY + y; }
+
+    std::vector<Run> m_runs;
+    // dimY * dimZ + 1 entries: row r's runs are [m_rowStart[r], m_rowStart[r + 1]).
+    std::vector<uint32_t> m_rowStart;
+    unsigned int m_dimX = 0;
+    unsigned int m_dimY = 0;
+    unsigned int m_dimZ = 0;
+    LabelBuffer::Width m_width = LabelBuffer::Width::Bits8;
+};
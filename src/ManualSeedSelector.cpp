@@ -11,8 +11,10 @@
 #include "SectionGroup.h"
 #include "SegmentationRunner.h"
 #include "ColorUtils.h"
+#include "GzipWriter.h"
 #include "Mask3DView.h"
 #include "MaskListDelegate.h"
+#include "NiftiHeader.h"
 #include "RangeSlider.h"
 
 #include <QColorDialog>
@@ -83,6 +85,7 @@
 #include <fstream>
 #include <iostream>
 #include <set>
+#include <sstream>
 #include <unordered_set>
 #include <utility>
 #include <filesystem>
@@ -104,9 +107,8 @@
 
 #include <itkImage.h>
 #include <itkImageFileReader.h>
-#include <itkImageRegionConstIterator.h>
-#include <itkImageRegionIterator.h>
 #include <itkImageFileWriter.h>
+#include <itkImageRegionConstIterator.h>
 #include <itkNiftiImageIO.h>
 #include <zlib.h>
 
@@ -123,69 +125,28 @@ ManualSeedSelector::ManualSeedSelector(const std::string &niftiPath, QWidget *pa
     setupUi();
     if (!niftiPath.empty())
     {
-        if (!m_image.load(niftiPath))
-        {
-            std::cerr << "Failed to load " << niftiPath << std::endl;
-        }
-        else
-        {
-            // Add initial image to the list
-            ImageData imgData;
-            imgData.imagePath = niftiPath;
-            imgData.color = getColorForImageIndex(0);
-            m_images.push_back(imgData);
-
-            std::string filename = std::filesystem::path(niftiPath).filename().string();
-            QListWidgetItem *niftiItem = new QListWidgetItem(QString::fromStdString(filename));
-            niftiItem->setData(Qt::UserRole, QFileInfo(QString::fromStdString(niftiPath)).absoluteFilePath());
-            m_niftiList->addItem(niftiItem);
-            renumberNiftiListItems();
-            m_niftiList->setCurrentRow(0);
-            m_currentImageIndex = 0;
+        // Selecting the entry starts its load in the background, like a click.
+        ImageData imgData;
+        imgData.imagePath = niftiPath;
+        imgData.color = getColorForImageIndex(0);
+        m_images.push_back(imgData);
 
-            // Clear any previously loaded mask data when a new image is loaded
-            if (!m_maskData.empty())
-            {
-                std::cerr << "ManualSeedSelector: clearing existing mask buffer due to new image load" << std::endl;
-                m_maskData.clear();
-                m_maskDimX = 0;
-                m_maskDimY = 0;
-                m_maskDimZ = 0;
-                m_mask3DDirty = true;
-            }
-            m_maskSpacingX = m_image.getSpacingX();
-            m_maskSpacingY = m_image.getSpacingY();
-            m_maskSpacingZ = m_image.getSpacingZ();
-            // Update slider ranges
-            m_axialSlider->setRange(0, static_cast<int>(m_image.getSizeZ()) - 1);
-            m_axialSlider->setValue(static_cast<int>(m_image.getSizeZ()) / 2);
-
-            m_sagittalSlider->setRange(0, static_cast<int>(m_image.getSizeX()) - 1);
-            m_sagittalSlider->setValue(static_cast<int>(m_image.getSizeX()) / 2);
-
-            m_coronalSlider->setRange(0, static_cast<int>(m_image.getSizeY()) - 1);
-            m_coronalSlider->setValue(static_cast<int>(m_image.getSizeY()) / 2);
-
-            // Window/level setup
-            float gmin = m_image.getGlobalMin();
-            float gmax = m_image.getGlobalMax();
-            configureWindowControls(gmin, gmax,
-                                    m_windowSlider,
-                                    m_windowLevelSpin,
-                                    m_windowWidthSpin,
-                                    &m_windowGlobalMin,
-                                    &m_windowGlobalMax,
-                                    &m_windowLow,
-                                    &m_windowHigh);
-
-            clearRulerMeasurements();
-            updateViews();
-        }
+        std::string filename = std::filesystem::path(niftiPath).filename().string();
+        QListWidgetItem *niftiItem = new QListWidgetItem(QString::fromStdString(filename));
+        niftiItem->setData(Qt::UserRole, QFileInfo(QString::fromStdString(niftiPath)).absoluteFilePath());
+        m_niftiList->addItem(niftiItem);
+        renumberNiftiListItems();
+        queueMetadataScan(m_images);
+        m_niftiList->setCurrentRow(0);
     }
 }
 
 ManualSeedSelector::~ManualSeedSelector()
 {
+    cancelPyramidBuild();
+    cancelImagePrefetch(true);
+    cancelImageLoad(true);
+    cancelMetadataScan(true);
     stopSegmentationWorker(true);
 }
 
@@ -680,6 +641,66 @@ void ManualSeedSelector::setupUi()
         m_toolSections.push_back(sec);
     }
 
+    // ---- Section: Image Threshold ----
+    // Replaces voxels above a threshold in the image itself. With Preview on,
+    // only the three visible slices show the result while the value is
+    // dragged; the volume changes on Apply.
+    SectionGroup *thresholdGroup = new SectionGroup("Image Threshold");
+    QGridLayout *thresholdGrid = new QGridLayout(thresholdGroup);
+    thresholdGrid->setSpacing(4);
+
+    m_thresholdSlider = new QSlider(Qt::Horizontal);
+    m_thresholdSlider->setRange(0, kWindowSliderTicks);
+    m_thresholdSlider->setToolTip("Voxels above this intensity are replaced");
+    thresholdGrid->addWidget(m_thresholdSlider, 0, 0, 1, 4);
+
+    thresholdGrid->addWidget(new QLabel("Above:"), 1, 0);
+    m_thresholdSpin = new QDoubleSpinBox();
+    m_thresholdSpin->setDecimals(1);
+    m_thresholdSpin->setToolTip("Threshold intensity");
+    thresholdGrid->addWidget(m_thresholdSpin, 1, 1);
+
+    thresholdGrid->addWidget(new QLabel("Set to:"), 1, 2);
+    m_thresholdValueSpin = new QDoubleSpinBox();
+    m_thresholdValueSpin->setDecimals(1);
+    m_thresholdValueSpin->setRange(-1e6, 1e6);
+    m_thresholdValueSpin->setToolTip("Value written into the voxels above the threshold");
+    thresholdGrid->addWidget(m_thresholdValueSpin, 1, 3);
+
+    thresholdGrid->addWidget(new QLabel("Region:"), 2, 0);
+    m_thresholdRegionCombo = new QComboBox();
+    m_thresholdRegionCombo->addItem("Whole volume");      // kThresholdWholeVolume
+    m_thresholdRegionCombo->addItem("Inside mask");       // kThresholdInsideMask
+    m_thresholdRegionCombo->addItem("Mask bounding box"); // kThresholdMaskBox
+    m_thresholdRegionCombo->setToolTip("Limit the threshold to the active mask or to the box around it");
+    thresholdGrid->addWidget(m_thresholdRegionCombo, 2, 1, 1, 3);
+
+    m_thresholdPreviewCheck = new QCheckBox("Preview");
+    m_thresholdPreviewCheck->setToolTip("Show the threshold on the visible slices; only Apply changes the volume");
+    thresholdGrid->addWidget(m_thresholdPreviewCheck, 3, 0, 1, 2);
+
+    QPushButton *btnApplyThreshold = new QPushButton("Apply");
+    btnApplyThreshold->setToolTip("Threshold the whole region");
+    connect(btnApplyThreshold, &QPushButton::clicked, this, &ManualSeedSelector::applyImageThreshold);
+    thresholdGrid->addWidget(btnApplyThreshold, 3, 2);
+
+    m_btnUndoThreshold = new QPushButton("Undo");
+    m_btnUndoThreshold->setToolTip("Undo the last applied threshold");
+    m_btnUndoThreshold->setEnabled(false);
+    connect(m_btnUndoThreshold, &QPushButton::clicked, this, &ManualSeedSelector::undoImageThreshold);
+    thresholdGrid->addWidget(m_btnUndoThreshold, 3, 3);
+
+    {
+        CollapsibleSection *sec = new CollapsibleSection("Image Threshold", "imageThreshold");
+        QVBoxLayout *secLayout = new QVBoxLayout();
+        secLayout->setContentsMargins(0, 0, 0, 0);
+        secLayout->setSpacing(6);
+        secLayout->addWidget(thresholdGroup);
+        sec->setContentLayout(secLayout);
+        toolSidebarLayout->addWidget(sec);
+        m_toolSections.push_back(sec);
+    }
+
     // ---- Section: Seeds ----
     SectionGroup *seedModeGroup = new SectionGroup("Drawing Mode");
     QHBoxLayout *seedModeLayout = new QHBoxLayout(seedModeGroup);
@@ -909,7 +930,7 @@ void ManualSeedSelector::setupUi()
             {
         QString f = QFileDialog::getSaveFileName(this, "Save Mask", "", "NIfTI files (*.nii *.nii.gz)");
         if (!f.isEmpty())
-            saveMaskToFile(f.toStdString()); });
+            saveMaskToFile(f.toStdString(), saveCompressionLevel()); });
     maskFileLayout->addWidget(btnMaskSave);
 
     QPushButton *btnMaskLoad = new QPushButton("Load");
@@ -1596,11 +1617,15 @@ void ManualSeedSelector::setupUi()
             {
         int currentRow = m_niftiList->currentRow();
         if (currentRow >= 0 && currentRow < static_cast<int>(m_images.size())) {
+            // A load still running is for the entry being removed.
+            cancelImageLoad(false);
+            m_imageCache.erase(m_images[currentRow].imagePath);
             m_images.erase(m_images.begin() + currentRow);
             delete m_niftiList->takeItem(currentRow);
             renumberNiftiListItems();
             if (currentRow == m_currentImageIndex) {
                 m_currentImageIndex = -1;
+                cancelPyramidBuild();
                 m_image = NiftiImage();
                 m_path.clear();
                 m_maskSpacingX = 1.0;
@@ -1633,9 +1658,14 @@ void ManualSeedSelector::setupUi()
         if (answer != QMessageBox::Yes)
             return;
 
+        cancelImageLoad(false);
+        cancelImagePrefetch(false);
+        cancelMetadataScan(false);
+        m_imageCache.clear();
         m_images.clear();
         m_niftiList->clear();
         m_currentImageIndex = -1;
+        cancelPyramidBuild();
         m_image = NiftiImage();
         m_path.clear();
         clearMaskLayers();
@@ -1691,86 +1721,129 @@ void ManualSeedSelector::setupUi()
         } });
     niftiListLayout->addWidget(m_autoDetectAssociationsCheck);
 
-    // Connect item selection to load the image
+    // Recently viewed images, and the neighbours read ahead while the user
+    // stays on one, are kept up to this much memory. 0 turns both off.
+    QHBoxLayout *imageCacheLayout = new QHBoxLayout();
+    imageCacheLayout->setContentsMargins(0, 0, 0, 0);
+    imageCacheLayout->addWidget(new QLabel("Image cache:"));
+    m_imageCacheSpin = new QSpinBox();
+    m_imageCacheSpin->setRange(0, 65536);
+    m_imageCacheSpin->setSingleStep(256);
+    m_imageCacheSpin->setSuffix(" MB");
+    m_imageCacheSpin->setToolTip("Memory for keeping recently viewed images and reading the next and previous "
+                                 "ones ahead, so switching between them is instant. 0 disables it.");
+    m_imageCacheSpin->setValue(QSettings().value("cache/imageBudgetMB", 2048).toInt());
+    m_imageCache.setBudget(static_cast<size_t>(m_imageCacheSpin->value()) << 20);
+    connect(m_imageCacheSpin, QOverload<int>::of(&QSpinBox::valueChanged), this, [this](int megabytes)
+            {
+        m_imageCache.setBudget(static_cast<size_t>(megabytes) << 20);
+        QSettings().setValue("cache/imageBudgetMB", megabytes);
+        if (megabytes == 0)
+            cancelImagePrefetch(false); });
+    imageCacheLayout->addWidget(m_imageCacheSpin, 1);
+    niftiListLayout->addLayout(imageCacheLayout);
+
+    // Decoded .nii.gz, DICOM and numpy volumes are kept on disk up to this
+    // size, so reopening one in a later session maps it instead of decoding.
+    QHBoxLayout *diskCacheLayout = new QHBoxLayout();
+    diskCacheLayout->setContentsMargins(0, 0, 0, 0);
+    diskCacheLayout->addWidget(new QLabel("Disk cache:"));
+    m_diskCacheSpin = new QSpinBox();
+    m_diskCacheSpin->setRange(0, 1 << 20);
+    m_diskCacheSpin->setSingleStep(1024);
+    m_diskCacheSpin->setSuffix(" MB");
+    QSettings cacheSettings;
+    const QString defaultCacheDir =
+        QDir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation)).filePath("volumes");
+    m_volumeCache.setDirectory(cacheSettings.value("cache/diskDirectory", defaultCacheDir).toString().toStdString());
+    m_volumeCache.setCompression(cacheSettings.value("cache/diskCompress", false).toBool());
+    m_diskCacheSpin->setValue(cacheSettings.value("cache/diskBudgetMB", 8192).toInt());
+    m_volumeCache.setBudget(static_cast<size_t>(m_diskCacheSpin->value()) << 20);
+    auto updateDiskCacheTip = [this]()
+    {
+        m_diskCacheSpin->setToolTip(QString("Disk space for decoded copies of compressed and DICOM images, kept "
+                                            "between sessions so reopening them is fast. 0 disables it.\n"
+                                            "Folder: %1")
+                                        .arg(QString::fromStdString(m_volumeCache.directory())));
+    };
+    updateDiskCacheTip();
+    connect(m_diskCacheSpin, QOverload<int>::of(&QSpinBox::valueChanged), this, [this](int megabytes)
+            {
+        m_volumeCache.setBudget(static_cast<size_t>(megabytes) << 20);
+        QSettings().setValue("cache/diskBudgetMB", megabytes); });
+    diskCacheLayout->addWidget(m_diskCacheSpin, 1);
+
+    QToolButton *diskCacheOptions = new QToolButton();
+    diskCacheOptions->setText("...");
+    diskCacheOptions->setToolTip("Disk cache folder and format");
+    diskCacheOptions->setPopupMode(QToolButton::InstantPopup);
+    QMenu *diskCacheMenu = new QMenu(diskCacheOptions);
+    QAction *chooseDirAction = diskCacheMenu->addAction("Choose Folder...");
+    connect(chooseDirAction, &QAction::triggered, this, [this, updateDiskCacheTip]()
+            {
+        const QString dir = QFileDialog::getExistingDirectory(this, "Disk Cache Folder",
+                                                              QString::fromStdString(m_volumeCache.directory()));
+        if (dir.isEmpty())
+            return;
+        m_volumeCache.setDirectory(dir.toStdString());
+        QSettings().setValue("cache/diskDirectory", dir);
+        updateDiskCacheTip(); });
+    QAction *compressAction = diskCacheMenu->addAction("Compress Cached Volumes");
+    compressAction->setCheckable(true);
+    compressAction->setChecked(m_volumeCache.compression());
+    compressAction->setToolTip("Smaller entries, but read back rather than mapped");
+    connect(compressAction, &QAction::toggled, this, [this](bool enabled)
+            {
+        m_volumeCache.setCompression(enabled);
+        QSettings().setValue("cache/diskCompress", enabled); });
+    QAction *clearAction = diskCacheMenu->addAction("Clear");
+    connect(clearAction, &QAction::triggered, this, [this]()
+            {
+        m_volumeCache.clear();
+        if (m_statusLabel)
+            m_statusLabel->setText("Disk cache cleared."); });
+    diskCacheOptions->setMenu(diskCacheMenu);
+    diskCacheLayout->addWidget(diskCacheOptions);
+    niftiListLayout->addLayout(diskCacheLayout);
+
+    // How hard saved .nii.gz images and masks are compressed. Every level is
+    // deflated on all cores; the choice trades file size for time.
+    QHBoxLayout *compressionLayout = new QHBoxLayout();
+    compressionLayout->setContentsMargins(0, 0, 0, 0);
+    compressionLayout->addWidget(new QLabel("Save compression:"));
+    m_compressionCombo = new QComboBox();
+    m_compressionCombo->addItem("Fast", gzip::kFastLevel);
+    m_compressionCombo->addItem("Default", 6);
+    m_compressionCombo->addItem("Smallest", gzip::kBestLevel);
+    m_compressionCombo->setToolTip("zlib level for saved .nii.gz files. Fast writes several times quicker "
+                                   "for somewhat larger files; any level reads back the same everywhere.");
+    const int savedLevel = QSettings().value("save/compressionLevel", 6).toInt();
+    m_compressionCombo->setCurrentIndex(std::max(0, m_compressionCombo->findData(savedLevel)));
+    connect(m_compressionCombo, QOverload<int>::of(&QComboBox::currentIndexChanged), this, [this](int)
+            { QSettings().setValue("save/compressionLevel", saveCompressionLevel()); });
+    compressionLayout->addWidget(m_compressionCombo, 1);
+    niftiListLayout->addLayout(compressionLayout);
+
+    // Selecting an entry starts a background load; the image is swapped in
+    // by finishImageLoad() once it has been read.
     connect(m_niftiList, &QListWidget::currentRowChanged, [this](int row)
             {
         if (row >= 0 && row < static_cast<int>(m_images.size())) {
-            const Mask3DView::CameraState preservedCamera = (m_mask3DView != nullptr)
-                                                                ? m_mask3DView->captureCameraState()
-                                                                : Mask3DView::CameraState{};
             // Persist current slice positions before switching images.
             if (m_currentImageIndex >= 0 && m_currentImageIndex < static_cast<int>(m_images.size())) {
                 m_images[m_currentImageIndex].lastAxialSlice = m_axialSlider->value();
                 m_images[m_currentImageIndex].lastSagittalSlice = m_sagittalSlider->value();
                 m_images[m_currentImageIndex].lastCoronalSlice = m_coronalSlider->value();
             }
-
-            const std::string &path = m_images[row].imagePath;
-            if (loadImageData(m_images[row])) {
-                m_currentImageIndex = row;
-                m_path = path;
+            // Switching to a cached image is a pointer swap; anything else
+            // is read in the background.
+            cancelImagePrefetch(false);
+            if (const ImageCache::Entry *cached = m_imageCache.find(m_images[row].imagePath)) {
+                cancelImageLoad(false);
                 autoDetectAssociatedFilesForImage(row, false);
-                
-                // Clear mask and seed data when switching images: masks drawn
-                // for the old image sit on a grid the new one does not share.
-                clearMaskLayers();
-                m_unsavedMaskStyle = MaskLayer();
-                m_loadedMaskPath.clear();
-                m_pendingActiveMaskPath.clear();
-                m_maskData.clear();
-                m_maskDimX = 0;
-                m_maskDimY = 0;
-                m_maskDimZ = 0;
-                m_seeds.clear();
-                m_maskSpacingX = m_image.getSpacingX();
-                m_maskSpacingY = m_image.getSpacingY();
-                m_maskSpacingZ = m_image.getSpacingZ();
-                m_mask3DDirty = true;
-                clearRulerMeasurements();
-                m_locatedPoint = LocatedPoint{};
-
-                // Update slider ranges and restore last saved position for this image.
-                const int axialMax = std::max(0, static_cast<int>(m_image.getSizeZ()) - 1);
-                const int sagittalMax = std::max(0, static_cast<int>(m_image.getSizeX()) - 1);
-                const int coronalMax = std::max(0, static_cast<int>(m_image.getSizeY()) - 1);
-
-                m_axialSlider->setRange(0, axialMax);
-                m_sagittalSlider->setRange(0, sagittalMax);
-                m_coronalSlider->setRange(0, coronalMax);
-
-                int axialValue = m_images[row].lastAxialSlice;
-                int sagittalValue = m_images[row].lastSagittalSlice;
-                int coronalValue = m_images[row].lastCoronalSlice;
-
-                if (axialValue < 0)
-                    axialValue = axialMax / 2;
-                if (sagittalValue < 0)
-                    sagittalValue = sagittalMax / 2;
-                if (coronalValue < 0)
-                    coronalValue = coronalMax / 2;
-
-                m_axialSlider->setValue(std::min(std::max(axialValue, 0), axialMax));
-                m_sagittalSlider->setValue(std::min(std::max(sagittalValue, 0), sagittalMax));
-                m_coronalSlider->setValue(std::min(std::max(coronalValue, 0), coronalMax));
-                
-                // Window/level setup
-                float gmin = m_image.getGlobalMin();
-                float gmax = m_image.getGlobalMax();
-                configureWindowControls(gmin, gmax,
-                                        m_windowSlider,
-                                        m_windowLevelSpin,
-                                        m_windowWidthSpin,
-                                        &m_windowGlobalMin,
-                                        &m_windowGlobalMax,
-                                        &m_windowLow,
-                                        &m_windowHigh);
-                
-                // Update mask and seed lists for this image
-                updateMaskSeedLists();
-                updateViews();
-                if (m_mask3DView && preservedCamera.valid)
-                    m_mask3DView->restoreCameraState(preservedCamera, true);
-                m_statusLabel->setText(QString("Loaded: %1").arg(QString::fromStdString(path)));
+                applyLoadedImage(row, *cached->image, cached->options);
+            } else {
+                startImageLoad(row);
             }
         } });
 
@@ -2030,6 +2103,26 @@ void ManualSeedSelector::setupUi()
     maskButtonsLayout->addStretch(1);
     maskListLayout->addLayout(maskButtonsLayout);
 
+    // Masks read from multi-channel numpy arrays (a network's per-class
+    // probabilities) take each voxel's most likely class; this keeps the
+    // voxels where even that is unlikely as background.
+    QHBoxLayout *minProbabilityLayout = new QHBoxLayout();
+    minProbabilityLayout->setContentsMargins(0, 0, 0, 0);
+    minProbabilityLayout->addWidget(new QLabel("Min. probability:"));
+    m_maskMinProbabilitySpin = new QDoubleSpinBox();
+    m_maskMinProbabilitySpin->setRange(0.0, 1.0);
+    m_maskMinProbabilitySpin->setSingleStep(0.05);
+    m_maskMinProbabilitySpin->setDecimals(2);
+    m_maskMinProbabilitySpin->setSpecialValueText("Off");
+    m_maskMinProbabilitySpin->setToolTip("For masks read from multi-channel .npy/.npz probabilities: each voxel "
+                                         "takes its most likely class,\nor stays background when that class is "
+                                         "less likely than this. Applies to masks read from now on.");
+    m_maskMinProbabilitySpin->setValue(QSettings().value("mask/minProbability", 0.0).toDouble());
+    connect(m_maskMinProbabilitySpin, QOverload<double>::of(&QDoubleSpinBox::valueChanged), this, [](double value)
+            { QSettings().setValue("mask/minProbability", value); });
+    minProbabilityLayout->addWidget(m_maskMinProbabilitySpin, 1);
+    maskListLayout->addLayout(minProbabilityLayout);
+
     // Selecting a row picks which mask is editable. It does not put it on
     // screen — the eye does that — and it does not read the file either: the
     // voxels are fetched by the first operation that needs them, so clicking
@@ -2367,6 +2460,14 @@ void ManualSeedSelector::setupUi()
     m_statusLabel->setWordWrap(false);
     bottomStatusLayout->addWidget(m_statusLabel, 1);
 
+    m_imageLoadProgressBar = new QProgressBar();
+    m_imageLoadProgressBar->setObjectName("progressBar");
+    m_imageLoadProgressBar->setRange(0, 100);
+    m_imageLoadProgressBar->setTextVisible(true);
+    m_imageLoadProgressBar->setVisible(false);
+    m_imageLoadProgressBar->setMinimumWidth(240);
+    bottomStatusLayout->addWidget(m_imageLoadProgressBar, 0);
+
     m_segmentationProgressBar = new QProgressBar();
     m_segmentationProgressBar->setObjectName("progressBar");
     m_segmentationProgressBar->setRange(0, 0);
@@ -2391,6 +2492,21 @@ void ManualSeedSelector::setupUi()
     m_mainSplitter->setSizes({760, 150});
     mainLayout->addWidget(m_mainSplitter, 1);
 
+    m_prefetchTimer = new QTimer(this);
+    m_prefetchTimer->setSingleShot(true);
+    m_prefetchTimer->setInterval(400); // long enough to skip images stepped past
+    connect(m_prefetchTimer, &QTimer::timeout, this, &ManualSeedSelector::startImagePrefetch);
+
+    m_sharpenTimer = new QTimer(this);
+    m_sharpenTimer->setSingleShot(true);
+    m_sharpenTimer->setInterval(150); // a held slider counts as idle after this
+    connect(m_sharpenTimer, &QTimer::timeout, this, [this]()
+            {
+        if (!m_coarseViews)
+            return;
+        m_coarseViews = false;
+        updateViews(); });
+
     m_viewUpdateTimer = new QTimer(this);
     m_viewUpdateTimer->setSingleShot(true);
     m_viewUpdateTimer->setInterval(33); // ~30 FPS for interactive drawing
@@ -2410,18 +2526,32 @@ void ManualSeedSelector::setupUi()
             {
         m_axialLabel->setText(QString("Axial: %1/%2").arg(v).arg(m_axialSlider->maximum()));
         m_locatedPoint = LocatedPoint{};
+        noteSliceScroll(m_axialSlider);
         updateViews(); });
     connect(m_sagittalSlider, &QSlider::valueChanged, [this](int v)
             {
         m_sagittalLabel->setText(QString("Sagittal: %1/%2").arg(v).arg(m_sagittalSlider->maximum()));
         m_locatedPoint = LocatedPoint{};
+        noteSliceScroll(m_sagittalSlider);
         updateViews(); });
     connect(m_coronalSlider, &QSlider::valueChanged, [this](int v)
             {
         m_coronalLabel->setText(QString("Coronal: %1/%2").arg(v).arg(m_coronalSlider->maximum()));
         m_locatedPoint = LocatedPoint{};
+        noteSliceScroll(m_coronalSlider);
         updateViews(); });
 
+    // Letting go of a slider sharpens the views drawn from the pyramid.
+    for (QSlider *slider : {m_axialSlider, m_sagittalSlider, m_coronalSlider})
+        connect(slider, &QSlider::sliderReleased, m_sharpenTimer, [this]()
+                {
+            m_sharpenTimer->stop();
+            if (m_coarseViews)
+            {
+                m_coarseViews = false;
+                updateViews();
+            } });
+
     // Window/Level controls
     connect(m_windowSlider, &RangeSlider::rangeChanged, [this](int low, int high)
             {
@@ -2446,6 +2576,40 @@ void ManualSeedSelector::setupUi()
         float hi = static_cast<float>(level + width / 2.0);
         applyWindowFromValues(lo, hi, false); });
 
+    // Image threshold controls: the slider and the spin box follow each other,
+    // and anything that changes the result redraws a running preview.
+    connect(m_thresholdSlider, &QSlider::valueChanged, [this](int tick)
+            {
+        const bool wasBlocked = m_thresholdSpin->blockSignals(true);
+        m_thresholdSpin->setValue(sliderTickToWindowValue(tick, m_windowGlobalMin, m_windowGlobalMax));
+        m_thresholdSpin->blockSignals(wasBlocked);
+        if (m_thresholdPreviewCheck->isChecked())
+            updateViews(); });
+    connect(m_thresholdSpin, QOverload<double>::of(&QDoubleSpinBox::valueChanged), [this](double value)
+            {
+        const bool wasBlocked = m_thresholdSlider->blockSignals(true);
+        m_thresholdSlider->setValue(windowValueToSliderTick(static_cast<float>(value), m_windowGlobalMin, m_windowGlobalMax));
+        m_thresholdSlider->blockSignals(wasBlocked);
+        if (m_thresholdPreviewCheck->isChecked())
+            updateViews(); });
+    connect(m_thresholdValueSpin, QOverload<double>::of(&QDoubleSpinBox::valueChanged), [this](double)
+            {
+        if (m_thresholdPreviewCheck->isChecked())
+            updateViews(); });
+    connect(m_thresholdRegionCombo, QOverload<int>::of(&QComboBox::currentIndexChanged), [this](int)
+            {
+        m_thresholdBoxValid = false;
+        if (m_thresholdPreviewCheck->isChecked())
+        {
+            loadThresholdPreviewMask();
+            updateViews();
+        } });
+    connect(m_thresholdPreviewCheck, &QCheckBox::toggled, [this](bool)
+            {
+        m_thresholdBoxValid = false;
+        loadThresholdPreviewMask();
+        updateViews(); });
+
     connect(m_show3DCheck, &QCheckBox::toggled, [this](bool checked)
             {
         m_enable3DView = checked;
@@ -2671,13 +2835,50 @@ void ManualSeedSelector::setupUi()
 // IMAGE I/O
 // =============================================================================
 
-bool ManualSeedSelector::loadImageData(ImageData &data)
-{
+bool ManualSeedSelector::loadImageData(NiftiImage &image, ImageData &data, VolumeCache &cache,
+                                       const std::function<bool()> &keepGoing)
+{
+    // A numpy file read with other options is another volume, so they are
+    // part of the cache key; what "Automatic" resolved to rides along as the
+    // entry's note.
+    std::string variant;
+    if (data.isNumpy)
+    {
+        const NpzImportOptions &o = data.npzOptions;
+        std::ostringstream out;
+        out.precision(17);
+        out << "npz " << o.arrayName << '|' << o.channel << '|' << static_cast<int>(o.axisOrder) << '|' << o.flip[0]
+            << o.flip[1] << o.flip[2] << '|' << o.spacing[0] << ' ' << o.spacing[1] << ' ' << o.spacing[2] << '|'
+            << o.referencePath;
+        variant = out.str();
+    }
+    const bool cacheable = VolumeCache::worthCaching(data.imagePath);
+    std::string note;
+    if (cacheable && cache.load(data.imagePath, variant, image, &note))
+    {
+        int axisOrder = 0;
+        int flip[3] = {0, 0, 0};
+        std::istringstream in(note);
+        if (data.isNumpy && (in >> axisOrder >> flip[0] >> flip[1] >> flip[2]))
+        {
+            data.npzOptions.axisOrder = static_cast<NpzImportOptions::AxisOrder>(axisOrder);
+            for (int i = 0; i < 3; ++i)
+                data.npzOptions.flip[i] = flip[i] != 0;
+        }
+        return true;
+    }
+
     if (!data.isNumpy)
-        return m_image.load(data.imagePath);
+    {
+        if (!image.load(data.imagePath))
+            return false;
+        if (cacheable)
+            cache.store(data.imagePath, variant, image, std::string(), keepGoing);
+        return true;
+    }
 
     NpzImportReport report;
-    if (!m_image.loadNumpy(data.imagePath, data.npzOptions, &report))
+    if (!image.loadNumpy(data.imagePath, data.npzOptions, &report))
         return false;
 
     // Pin down whatever "Automatic" resolved to. Masks loaded next inherit it,
@@ -2685,26 +2886,602 @@ bool ManualSeedSelector::loadImageData(ImageData &data)
     data.npzOptions.axisOrder = report.axisOrder;
     for (int i = 0; i < 3; ++i)
         data.npzOptions.flip[i] = report.flip[i];
+    std::ostringstream resolved;
+    resolved << static_cast<int>(report.axisOrder) << ' ' << report.flip[0] << ' ' << report.flip[1] << ' '
+             << report.flip[2];
+    cache.store(data.imagePath, variant, image, resolved.str(), keepGoing);
     return true;
 }
 
+// Window a decoded slice to its own range for the loading preview; the real
+// window/level is only known once the whole volume has been read.
+static QImage previewSliceImage(const std::vector<float> &slice, unsigned int width, unsigned int height)
+{
+    if (slice.empty() || slice.size() != size_t(width) * size_t(height))
+        return QImage();
+    const auto range = std::minmax_element(slice.begin(), slice.end());
+    const float lo = *range.first;
+    const float span = std::max(*range.second - lo, 1e-6f);
+    QImage preview(static_cast<int>(width), static_cast<int>(height), QImage::Format_Grayscale8);
+    for (unsigned int y = 0; y < height; ++y)
+    {
+        uchar *row = preview.scanLine(static_cast<int>(y));
+        const float *src = slice.data() + size_t(y) * width;
+        for (unsigned int x = 0; x < width; ++x)
+            row[x] = static_cast<uchar>(std::clamp((src[x] - lo) / span * 255.0f, 0.0f, 255.0f));
+    }
+    return preview;
+}
+
+void ManualSeedSelector::startImageLoad(int row)
+{
+    cancelImageLoad(false);
+    const unsigned int generation = ++m_imageLoadGeneration;
+    ImageData data = m_images[static_cast<size_t>(row)];
+
+    const QString fileName = QFileInfo(QString::fromStdString(data.imagePath)).fileName();
+    if (m_imageLoadProgressBar)
+    {
+        m_imageLoadProgressBar->setRange(0, 100);
+        m_imageLoadProgressBar->setValue(0);
+        m_imageLoadProgressBar->setFormat(QString("Loading %1 (%p%)").arg(fileName));
+        m_imageLoadProgressBar->setVisible(true);
+    }
+    if (m_statusLabel)
+        m_statusLabel->setText(QString("Loading: %1").arg(QString::fromStdString(data.imagePath)));
+
+    // The worker reads into its own NiftiImage and a copy of the list entry;
+    // nothing it touches is shared with the GUI thread until finishImageLoad().
+    auto finished = std::make_shared<std::atomic<bool>>(false);
+    m_imageLoadFinished = finished;
+    m_imageLoadWorker = std::thread([this, row, generation, data, finished]() mutable
+                                    {
+        auto image = std::make_shared<NiftiImage>();
+        NiftiImage::LoadMonitor monitor;
+        monitor.progress = [this, generation, lastPercent = -1](float fraction) mutable
+        {
+            if (m_imageLoadGeneration.load() != generation)
+                return false;
+            const int percent = static_cast<int>(std::clamp(fraction, 0.0f, 1.0f) * 100.0f);
+            if (percent != lastPercent)
+            {
+                lastPercent = percent;
+                QMetaObject::invokeMethod(this,
+                                          [this, generation, percent]()
+                                          {
+                                              if (generation == m_imageLoadGeneration.load() && m_imageLoadProgressBar)
+                                                  m_imageLoadProgressBar->setValue(percent);
+                                          },
+                                          Qt::QueuedConnection);
+            }
+            return true;
+        };
+        monitor.centralSlice = [this, generation](const std::vector<float> &slice, unsigned int width, unsigned int height)
+        {
+            const QImage preview = previewSliceImage(slice, width, height);
+            QMetaObject::invokeMethod(this,
+                                      [this, generation, preview]() { showImageLoadPreview(generation, preview); },
+                                      Qt::QueuedConnection);
+        };
+        image->setLoadMonitor(std::move(monitor));
+        const bool ok = loadImageData(*image, data, m_volumeCache,
+                                      [this, generation]() { return m_imageLoadGeneration.load() == generation; });
+        image->setLoadMonitor({});
+        QMetaObject::invokeMethod(this,
+                                  [this, row, generation, image, data, ok]()
+                                  { finishImageLoad(row, generation, image, data, ok); },
+                                  Qt::QueuedConnection);
+        *finished = true; });
+
+    // The mask/seed directory scan needs only the path, so it runs while the
+    // worker reads voxels.
+    autoDetectAssociatedFilesForImage(row, false);
+}
+
+void ManualSeedSelector::cancelImageLoad(bool waitForJoin)
+{
+    // A superseded load stops at its next progress report; its queued
+    // callbacks see the new generation and drop their results. Joining it
+    // here would hold the GUI until then, so it is retired instead.
+    ++m_imageLoadGeneration;
+    if (m_imageLoadWorker.joinable())
+        m_retiredImageLoads.push_back(RetiredWorker{std::move(m_imageLoadWorker), std::move(m_imageLoadFinished)});
+    m_imageLoadFinished.reset();
+    reapImageLoads(waitForJoin);
+    if (m_imageLoadProgressBar)
+        m_imageLoadProgressBar->setVisible(false);
+}
+
+void ManualSeedSelector::reapImageLoads(bool waitForAll)
+{
+    for (auto it = m_retiredImageLoads.begin(); it != m_retiredImageLoads.end();)
+    {
+        if (waitForAll || it->finished->load())
+        {
+            it->worker.join();
+            it = m_retiredImageLoads.erase(it);
+        }
+        else
+            ++it;
+    }
+}
+
+void ManualSeedSelector::showImageLoadPreview(unsigned int generation, const QImage &preview)
+{
+    if (generation != m_imageLoadGeneration.load() || preview.isNull())
+        return;
+    m_axialView->setImage(preview);
+    m_sagittalView->setImage(QImage());
+    m_coronalView->setImage(QImage());
+}
+
+void ManualSeedSelector::finishImageLoad(int row, unsigned int generation, std::shared_ptr<NiftiImage> image,
+                                         const ImageData &data, bool ok)
+{
+    if (generation != m_imageLoadGeneration.load())
+        return;
+    if (m_imageLoadWorker.joinable())
+        m_imageLoadWorker.join();
+    m_imageLoadFinished.reset();
+    reapImageLoads(false);
+    if (m_imageLoadProgressBar)
+        m_imageLoadProgressBar->setVisible(false);
+
+    const std::string &path = data.imagePath;
+    if (!ok || row < 0 || row >= static_cast<int>(m_images.size()) || m_images[row].imagePath != path)
+    {
+        std::cerr << "Failed to load " << path << std::endl;
+        if (m_statusLabel)
+            m_statusLabel->setText(QString("Failed to load: %1").arg(QString::fromStdString(path)));
+        // Put back the views of the image that stays loaded, over any preview.
+        updateViews();
+        return;
+    }
+
+    m_imageCache.insert(path, image, data.npzOptions);
+    applyLoadedImage(row, *image, data.npzOptions);
+}
+
+void ManualSeedSelector::applyLoadedImage(int row, const NiftiImage &image, const NpzImportOptions &options)
+{
+    const std::string path = m_images[row].imagePath;
+    const Mask3DView::CameraState preservedCamera = (m_mask3DView != nullptr)
+                                                        ? m_mask3DView->captureCameraState()
+                                                        : Mask3DView::CameraState{};
+    m_image = image;
+    startPyramidBuild();
+    // Keep what an automatic numpy axis order resolved to (see loadImageData).
+    m_images[row].npzOptions = options;
+    m_currentImageIndex = row;
+    m_path = path;
+
+    // Clear mask and seed data when switching images: masks drawn
+    // for the old image sit on a grid the new one does not share.
+    clearMaskLayers();
+    m_unsavedMaskStyle = MaskLayer();
+    m_loadedMaskPath.clear();
+    m_pendingActiveMaskPath.clear();
+    m_maskData.clear();
+    m_maskDimX = 0;
+    m_maskDimY = 0;
+    m_maskDimZ = 0;
+    m_seeds.clear();
+    m_maskSpacingX = m_image.getSpacingX();
+    m_maskSpacingY = m_image.getSpacingY();
+    m_maskSpacingZ = m_image.getSpacingZ();
+    m_mask3DDirty = true;
+    clearRulerMeasurements();
+    m_locatedPoint = LocatedPoint{};
+
+    // Update slider ranges and restore last saved position for this image.
+    const int axialMax = std::max(0, static_cast<int>(m_image.getSizeZ()) - 1);
+    const int sagittalMax = std::max(0, static_cast<int>(m_image.getSizeX()) - 1);
+    const int coronalMax = std::max(0, static_cast<int>(m_image.getSizeY()) - 1);
+
+    m_axialSlider->setRange(0, axialMax);
+    m_sagittalSlider->setRange(0, sagittalMax);
+    m_coronalSlider->setRange(0, coronalMax);
+
+    int axialValue = m_images[row].lastAxialSlice;
+    int sagittalValue = m_images[row].lastSagittalSlice;
+    int coronalValue = m_images[row].lastCoronalSlice;
+
+    if (axialValue < 0)
+        axialValue = axialMax / 2;
+    if (sagittalValue < 0)
+        sagittalValue = sagittalMax / 2;
+    if (coronalValue < 0)
+        coronalValue = coronalMax / 2;
+
+    m_axialSlider->setValue(std::min(std::max(axialValue, 0), axialMax));
+    m_sagittalSlider->setValue(std::min(std::max(sagittalValue, 0), sagittalMax));
+    m_coronalSlider->setValue(std::min(std::max(coronalValue, 0), coronalMax));
+
+    // Window/level setup
+    float gmin = m_image.getGlobalMin();
+    float gmax = m_image.getGlobalMax();
+    configureWindowControls(gmin, gmax,
+                            m_windowSlider,
+                            m_windowLevelSpin,
+                            m_windowWidthSpin,
+                            &m_windowGlobalMin,
+                            &m_windowGlobalMax,
+                            &m_windowLow,
+                            &m_windowHigh);
+    configureThresholdControls();
+
+    // Update mask and seed lists for this image
+    updateMaskSeedLists();
+    updateViews();
+    if (m_mask3DView && preservedCamera.valid)
+        m_mask3DView->restoreCameraState(preservedCamera, true);
+    m_statusLabel->setText(QString("Loaded: %1").arg(QString::fromStdString(path)));
+
+    // Read the neighbours once the user has stayed on this image for a while.
+    if (m_prefetchTimer)
+        m_prefetchTimer->start();
+}
+
+void ManualSeedSelector::startImagePrefetch()
+{
+    // Foreground loads come first, and a disabled cache has nowhere to put
+    // what would be read.
+    if (m_imageLoadWorker.joinable() || m_imageCache.budget() == 0)
+        return;
+    if (m_currentImageIndex < 0 || m_currentImageIndex >= static_cast<int>(m_images.size()))
+        return;
+
+    std::vector<ImageData> entries;
+    for (const int row : {m_currentImageIndex + 1, m_currentImageIndex - 1})
+    {
+        if (row >= 0 && row < static_cast<int>(m_images.size()) && !m_imageCache.contains(m_images[row].imagePath))
+            entries.push_back(m_images[row]);
+    }
+    if (entries.empty())
+        return;
+
+    cancelImagePrefetch(false);
+    const unsigned int generation = ++m_prefetchGeneration;
+    auto finished = std::make_shared<std::atomic<bool>>(false);
+    m_prefetchFinished = finished;
+    m_prefetchWorker = std::thread([this, generation, entries, finished]() mutable
+                                   {
+        for (ImageData &data : entries)
+        {
+            if (generation != m_prefetchGeneration.load())
+                break;
+            auto image = std::make_shared<NiftiImage>();
+            NiftiImage::LoadMonitor monitor;
+            monitor.progress = [this, generation](float) { return generation == m_prefetchGeneration.load(); };
+            image->setLoadMonitor(std::move(monitor));
+            const bool ok = loadImageData(*image, data, m_volumeCache,
+                                          [this, generation]() { return generation == m_prefetchGeneration.load(); });
+            image->setLoadMonitor({});
+            if (!ok)
+                continue;
+            QMetaObject::invokeMethod(this,
+                                      [this, generation, image, data]()
+                                      {
+                                          if (generation == m_prefetchGeneration.load())
+                                              m_imageCache.insert(data.imagePath, image, data.npzOptions);
+                                      },
+                                      Qt::QueuedConnection);
+        }
+        *finished = true; });
+}
+
+void ManualSeedSelector::cancelImagePrefetch(bool waitForJoin)
+{
+    // Retired like a superseded load: the worker notices at its next progress
+    // report and exits on its own, and is joined once it has.
+    ++m_prefetchGeneration;
+    if (m_prefetchTimer)
+        m_prefetchTimer->stop();
+    if (m_prefetchWorker.joinable())
+        m_retiredImageLoads.push_back(RetiredWorker{std::move(m_prefetchWorker), std::move(m_prefetchFinished)});
+    m_prefetchFinished.reset();
+    reapImageLoads(waitForJoin);
+}
+
+void ManualSeedSelector::queueMetadataScan(const std::vector<ImageData> &entries)
+{
+    if (entries.empty())
+        return;
+    std::set<QString> imagePaths;
+    for (const ImageData &image : m_images)
+        imagePaths.insert(QDir::cleanPath(QFileInfo(QString::fromStdString(image.imagePath)).absoluteFilePath()));
+    bool start = false;
+    {
+        std::lock_guard<std::mutex> lock(m_metadataMutex);
+        m_metadataQueue.insert(m_metadataQueue.end(), entries.begin(), entries.end());
+        m_metadataImagePaths = std::move(imagePaths);
+        ++m_metadataImagePathsVersion;
+        start = !m_metadataScanning;
+        m_metadataScanning = true;
+    }
+    if (!start)
+        return;
+
+    // A worker that found the queue empty has already let go of the lock and
+    // is returning, so this join does not wait on any header.
+    if (m_metadataWorker.joinable())
+        m_metadataWorker.join();
+    m_metadataWorker = std::thread([this]()
+                                   {
+        MetadataScanContext context;
+        for (;;)
+        {
+            ImageData data;
+            {
+                std::lock_guard<std::mutex> lock(m_metadataMutex);
+                if (m_metadataQueue.empty())
+                {
+                    m_metadataScanning = false;
+                    return;
+                }
+                data = std::move(m_metadataQueue.front());
+                m_metadataQueue.pop_front();
+                if (context.imagePathsVersion != m_metadataImagePathsVersion)
+                {
+                    context.imagePaths = m_metadataImagePaths;
+                    context.imagePathsVersion = m_metadataImagePathsVersion;
+                }
+            }
+            const MetadataResult result = scanImageMetadata(data, context);
+            const QString path = QDir::cleanPath(QFileInfo(QString::fromStdString(data.imagePath)).absoluteFilePath());
+            QMetaObject::invokeMethod(this, [this, path, result]() { applyImageMetadata(path, result); },
+                                      Qt::QueuedConnection);
+        } });
+}
+
+void ManualSeedSelector::cancelMetadataScan(bool waitForJoin)
+{
+    // The worker finishes the header in hand and then finds the queue empty.
+    {
+        std::lock_guard<std::mutex> lock(m_metadataMutex);
+        m_metadataQueue.clear();
+    }
+    if (waitForJoin && m_metadataWorker.joinable())
+        m_metadataWorker.join();
+}
+
+ManualSeedSelector::MetadataResult ManualSeedSelector::scanImageMetadata(const ImageData &data,
+                                                                         MetadataScanContext &context)
+{
+    MetadataResult result;
+    result.ok = NiftiImage::readMetadata(data.imagePath, data.npzOptions, result.image, &result.error);
+    if (!result.ok)
+        return result;
+
+    // The entry's own masks, plus those beside it named after the image and a
+    // separator ("case01_liver.nii.gz" for "case01.nii.gz", but not
+    // "case010.nii.gz"). Every mask in the folder would also match other
+    // images' masks, which differ by design, and no list entry is a mask.
+    std::vector<std::string> maskPaths = data.maskPaths;
+    const QFileInfo imageInfo(QString::fromStdString(data.imagePath));
+    const QString baseName = stripImageSuffix(imageInfo.fileName()).trimmed().toLower();
+    if (!baseName.isEmpty() && !imageInfo.isDir())
+    {
+        const QString directory = QDir::cleanPath(imageInfo.absolutePath());
+        auto listing = context.listings.find(directory);
+        if (listing == context.listings.end())
+            listing = context.listings
+                          .emplace(directory, QDir(directory).entryInfoList(QDir::Files | QDir::Readable, QDir::Name))
+                          .first;
+        for (const QFileInfo &file : listing->second)
+        {
+            const QString fileName = file.fileName();
+            const QString candidate = stripImageSuffix(fileName).trimmed().toLower();
+            if (candidate.size() <= baseName.size() || !candidate.startsWith(baseName) ||
+                !QString("_-.").contains(candidate[baseName.size()]) || !isMaskFilenameCandidate(fileName))
+                continue;
+            const QString cleanPath = QDir::cleanPath(file.absoluteFilePath());
+            if (context.imagePaths.count(cleanPath) != 0)
+                continue;
+            const std::string path = cleanPath.toStdString();
+            if (std::find(maskPaths.begin(), maskPaths.end(), path) == maskPaths.end())
+                maskPaths.push_back(path);
+        }
+    }
+    for (const std::string &maskPath : maskPaths)
+    {
+        ImageMetadata mask;
+        if (NiftiImage::readMetadata(maskPath, data.npzOptions, mask))
+            result.masks.emplace_back(maskPath, mask);
+    }
+    return result;
+}
+
+void ManualSeedSelector::applyImageMetadata(const QString &path, const MetadataResult &result)
+{
+    QListWidgetItem *item = nullptr;
+    for (int i = 0; i < m_niftiList->count() && !item; ++i)
+    {
+        if (QDir::cleanPath(m_niftiList->item(i)->data(Qt::UserRole).toString()) == path)
+            item = m_niftiList->item(i);
+    }
+    if (!item)
+        return; // removed while its header was read
+
+    QStringList lines;
+    lines << path;
+    if (!result.ok)
+    {
+        lines << QString("Header unreadable: %1").arg(QString::fromStdString(result.error));
+        item->setToolTip(lines.join('\n'));
+        item->setForeground(QColor(Theme::kFlag));
+        return;
+    }
+
+    const ImageMetadata &image = result.image;
+    auto sizeText = [](const ImageMetadata &m)
+    { return QString("%1 × %2 × %3").arg(m.size[0]).arg(m.size[1]).arg(m.size[2]); };
+    lines << QString("%1, %2, %3")
+                 .arg(QString::fromStdString(image.format), sizeText(image), QString::fromStdString(image.dtype));
+    lines << QString("Spacing %1 × %2 × %3 mm")
+                 .arg(image.spacing[0], 0, 'g', 4)
+                 .arg(image.spacing[1], 0, 'g', 4)
+                 .arg(image.spacing[2], 0, 'g', 4);
+    QString onDisk = QString("%1 MB on disk").arg(static_cast<double>(image.bytesOnDisk) / (1024.0 * 1024.0), 0, 'f', 1);
+    if (image.files > 1)
+        onDisk += QString(" in %1 files").arg(image.files);
+    lines << onDisk;
+
+    // Masks are drawn voxel for voxel over the image, so a different grid
+    // means a mask from another series or resampling.
+    int mismatched = 0;
+    for (const auto &[maskPath, mask] : result.masks)
+    {
+        bool sameSpacing = true;
+        for (int axis = 0; axis < 3; ++axis)
+            sameSpacing = sameSpacing && std::abs(mask.spacing[axis] - image.spacing[axis]) <= 1e-3 * image.spacing[axis];
+        const bool sameSize = mask.size[0] == image.size[0] && mask.size[1] == image.size[1] && mask.size[2] == image.size[2];
+        if (sameSize && sameSpacing)
+            continue;
+        ++mismatched;
+        lines << QString("Mask %1 does not match: %2, spacing %3 × %4 × %5 mm")
+                     .arg(QFileInfo(QString::fromStdString(maskPath)).fileName(), sizeText(mask))
+                     .arg(mask.spacing[0], 0, 'g', 4)
+                     .arg(mask.spacing[1], 0, 'g', 4)
+                     .arg(mask.spacing[2], 0, 'g', 4);
+    }
+    if (!result.masks.empty() && mismatched == 0)
+        lines << QString("%1 mask(s) match").arg(result.masks.size());
+
+    m_metadataSummaries[path] = QString("%1×%2×%3 %4")
+                                    .arg(image.size[0])
+                                    .arg(image.size[1])
+                                    .arg(image.size[2])
+                                    .arg(QString::fromStdString(image.dtype)) +
+                                (mismatched > 0 ? QString(", mask differs") : QString());
+    item->setToolTip(lines.join('\n'));
+    if (mismatched > 0)
+        item->setForeground(QColor(Theme::kFlag));
+    else
+        item->setData(Qt::ForegroundRole, QVariant());
+    renumberNiftiListItems();
+}
+
+namespace
+{
+// Planes this large are drawn from the pyramid while scrolling, and the level
+// used is the first whose largest plane is no bigger than kPyramidTargetPlaneVoxels.
+constexpr size_t kPyramidMinPlaneVoxels = size_t(1024) * 1024;
+constexpr size_t kPyramidTargetPlaneVoxels = size_t(512) * 512;
+// Entries of the image threshold's region combo box.
+constexpr int kThresholdWholeVolume = 0;
+constexpr int kThresholdInsideMask = 1;
+constexpr int kThresholdMaskBox = 2;
+// Rows at least this wide make sagittal extraction stride past a cache line
+// per voxel; the X-major copy doubles the memory, so huge volumes go without.
+constexpr unsigned int kSagittalLayoutMinWidth = 256;
+constexpr size_t kSagittalLayoutMaxBytes = size_t(2) << 30;
+
+size_t largestPlaneVoxels(const NiftiImage &image)
+{
+    const size_t x = image.getSizeX(), y = image.getSizeY(), z = image.getSizeZ();
+    return std::max({x * y, y * z, x * z});
+}
+} // namespace
+
+void ManualSeedSelector::startPyramidBuild()
+{
+    cancelPyramidBuild();
+    const bool wantPyramid = largestPlaneVoxels(m_image) >= kPyramidMinPlaneVoxels;
+    const bool wantSagittal = m_image.getSizeX() >= kSagittalLayoutMinWidth &&
+                              m_image.memoryBytes() <= kSagittalLayoutMaxBytes;
+    if (!wantPyramid && !wantSagittal)
+        return;
+
+    // The worker holds a shallow copy: the voxels are shared with m_image,
+    // which is replaced on the next load, and edited in place only after
+    // cancelPyramidBuild() (see applyImageThreshold()).
+    const unsigned int generation = ++m_pyramidGeneration;
+    const NiftiImage source = m_image;
+    m_pyramidWorker = std::thread([this, generation, source, wantPyramid, wantSagittal]()
+                                  {
+        const auto keepGoing = [this, generation]() { return generation == m_pyramidGeneration.load(); };
+        const NiftiImage *previous = &source;
+        std::shared_ptr<const NiftiImage> level;
+        for (int i = 0; i < 2 && wantPyramid && keepGoing(); ++i)
+        {
+            auto next = std::make_shared<NiftiImage>(previous->downsampled(2, keepGoing));
+            if (next->getSizeX() == 0)
+                return;
+            level = next;
+            previous = level.get();
+            QMetaObject::invokeMethod(this,
+                                      [this, generation, level]()
+                                      {
+                                          if (generation == m_pyramidGeneration.load())
+                                              m_pyramid.push_back(level);
+                                      },
+                                      Qt::QueuedConnection);
+        }
+        // The layout is shared with m_image and with its image cache entry,
+        // which now holds twice the voxels and is counted again.
+        if (wantSagittal && source.buildSagittalLayout(keepGoing))
+            QMetaObject::invokeMethod(this,
+                                      [this, generation]()
+                                      {
+                                          if (generation == m_pyramidGeneration.load())
+                                              m_imageCache.refresh(m_path);
+                                      },
+                                      Qt::QueuedConnection); });
+}
+
+void ManualSeedSelector::cancelPyramidBuild()
+{
+    ++m_pyramidGeneration;
+    if (m_pyramidWorker.joinable())
+        m_pyramidWorker.join();
+    m_pyramid.clear();
+    m_coarseViews = false;
+    if (m_sharpenTimer)
+        m_sharpenTimer->stop();
+}
+
+void ManualSeedSelector::noteSliceScroll(const QSlider *slider)
+{
+    if (m_pyramid.empty() || !slider->isSliderDown())
+        return;
+    m_coarseViews = true;
+    m_sharpenTimer->start();
+}
+
+const NiftiImage &ManualSeedSelector::viewSource(unsigned int &factor) const
+{
+    factor = 1;
+    if (!m_coarseViews || m_pyramid.empty())
+        return m_image;
+    size_t index = 0;
+    while (index + 1 < m_pyramid.size() && largestPlaneVoxels(*m_pyramid[index]) > kPyramidTargetPlaneVoxels)
+        ++index;
+    factor = 2u << index;
+    return *m_pyramid[index];
+}
+
 std::string ManualSeedSelector::nativeImagePath()
 {
-    if (m_path.empty() || !NiftiImage::isNumpyPath(m_path))
+    // A thresholded image is exported whatever its format, so the tools see
+    // the same voxels as the views.
+    if (m_path.empty() || (!NiftiImage::isNumpyPath(m_path) && !m_image.isEdited()))
         return m_path;
 
-    // Reuse the export while the same image stays loaded.
+    // Reuse the export while the same image stays loaded and unedited.
     if (m_nativeImageSource == m_path && !m_nativeImagePath.empty() &&
         QFileInfo::exists(QString::fromStdString(m_nativeImagePath)))
         return m_nativeImagePath;
 
     const QString baseName = stripImageSuffix(QFileInfo(QString::fromStdString(m_path)).fileName());
-    const QString exportPath = QDir::temp().filePath(QString("roift_npz_%1.nii.gz").arg(baseName));
-    if (!m_image.save(exportPath.toStdString()))
-    {
-        QMessageBox::warning(this, "NumPy image",
-                             "Could not export this NumPy volume to a temporary NIfTI file, which the "
-                             "segmentation tools need in order to read it.");
+    const QString exportPath = QDir::temp().filePath(QString("roift_export_%1.nii.gz").arg(baseName));
+    // Read once by the tool and thrown away, so size matters less than speed.
+    if (!m_image.save(exportPath.toStdString(), gzip::kFastLevel))
+    {
+        QMessageBox::warning(this, "Image export",
+                             "Could not export this image to a temporary NIfTI file, which the "
+                             "segmentation tools need in order to read it. They will read the file "
+                             "as it is on disk.");
         return m_path;
     }
 
@@ -2730,6 +3507,8 @@ NpzImportOptions ManualSeedSelector::numpyOptionsForMask() const
                 options.flip[i] = current.npzOptions.flip[i];
         }
     }
+    if (m_maskMinProbabilitySpin)
+        options.minProbability = static_cast<float>(m_maskMinProbabilitySpin->value());
     if (m_image.getSizeX() > 0)
     {
         options.spacing[0] = m_image.getSpacingX();
@@ -2926,7 +3705,10 @@ int ManualSeedSelector::addImagesToList(const QStringList &paths, int *duplicate
     }
 
     if (added > 0)
+    {
         renumberNiftiListItems();
+        queueMetadataScan(std::vector<ImageData>(m_images.end() - added, m_images.end()));
+    }
 
     if (added > 0 && firstAddedIndex >= 0)
         m_niftiList->setCurrentRow(firstAddedIndex);
@@ -2965,6 +3747,7 @@ bool ManualSeedSelector::appendNiftiImagePath(const QString &path, bool *isDupli
     item->setData(Qt::UserRole, normalized);
     m_niftiList->addItem(item);
     renumberNiftiListItems();
+    queueMetadataScan({m_images.back()});
     return true;
 }
 
@@ -2981,7 +3764,11 @@ void ManualSeedSelector::renumberNiftiListItems()
         const QString path = QFileInfo(item->data(Qt::UserRole).toString()).absoluteFilePath();
         const QString fileName = QFileInfo(path).fileName();
         const QString baseText = fileName.isEmpty() ? path : fileName;
-        item->setText(QString("%1. %2").arg(i + 1).arg(displayNameForPath(path, baseText)));
+        QString text = QString("%1. %2").arg(i + 1).arg(displayNameForPath(path, baseText));
+        const auto summary = m_metadataSummaries.find(QDir::cleanPath(path));
+        if (summary != m_metadataSummaries.end())
+            text += "  " + summary->second;
+        item->setText(text);
     }
 }
 
@@ -3402,7 +4189,7 @@ bool ManualSeedSelector::autoLoadAnatomyMasksForCurrentImage(QString *summary)
                 for (size_t i = 0; i < imageTotal; ++i)
                 {
                     if (srcMask[i] != 0)
-                        m_maskData[i] = labelValue;
+                        m_maskData.set(i, labelValue);
                 }
             }
             else
@@ -3415,7 +4202,7 @@ bool ManualSeedSelector::autoLoadAnatomyMasksForCurrentImage(QString *summary)
                     for (size_t i = 0; i < imagePlane; ++i)
                     {
                         if (srcMask[srcOffset + i] != 0)
-                            m_maskData[dstOffset + i] = labelValue;
+                            m_maskData.set(dstOffset + i, labelValue);
                     }
                 }
             }
@@ -3491,7 +4278,7 @@ bool ManualSeedSelector::saveImageToFile(const std::string &path)
         outpath += ".nii.gz";
     }
 
-    if (!m_image.save(outpath))
+    if (!m_image.save(outpath, saveCompressionLevel()))
     {
         QMessageBox::critical(this, "Save Image", "Failed to save image.");
         return false;
@@ -3499,6 +4286,11 @@ bool ManualSeedSelector::saveImageToFile(const std::string &path)
     return true;
 }
 
+int ManualSeedSelector::saveCompressionLevel() const
+{
+    return m_compressionCombo ? m_compressionCombo->currentData().toInt() : gzip::kDefaultLevel;
+}
+
 // =============================================================================
 // SEEDS I/O
 // =============================================================================
@@ -4346,28 +5138,173 @@ void ManualSeedSelector::applyWindowFromValues(float low, float high, bool fromS
 }
 
 // =============================================================================
-// VIEW UPDATES
+// IMAGE THRESHOLD
 // =============================================================================
 
-static QImage makeQImageFromRGB(const std::vector<unsigned char> &rgb, int w, int h)
+void ManualSeedSelector::configureThresholdControls()
+{
+    // Nothing is above the maximum, so a fresh image starts unchanged.
+    const bool sliderBlocked = m_thresholdSlider->blockSignals(true);
+    const bool spinBlocked = m_thresholdSpin->blockSignals(true);
+    const bool valueBlocked = m_thresholdValueSpin->blockSignals(true);
+    m_thresholdSpin->setRange(m_windowGlobalMin, m_windowGlobalMax);
+    m_thresholdSpin->setValue(m_windowGlobalMax);
+    m_thresholdSlider->setValue(kWindowSliderTicks);
+    m_thresholdValueSpin->setValue(m_windowGlobalMin);
+    m_thresholdSlider->blockSignals(sliderBlocked);
+    m_thresholdSpin->blockSignals(spinBlocked);
+    m_thresholdValueSpin->blockSignals(valueBlocked);
+    m_thresholdBoxValid = false;
+    m_btnUndoThreshold->setEnabled(m_image.undoLevels() > 0);
+}
+
+bool ManualSeedSelector::thresholdRegion(ThresholdRegion &region) const
 {
-    size_t expected = size_t(w) * size_t(h) * 3;
-    if (rgb.size() < expected)
+    region = ThresholdRegion();
+    const int scope = m_thresholdRegionCombo ? m_thresholdRegionCombo->currentIndex() : kThresholdWholeVolume;
+    if (scope == kThresholdWholeVolume)
+        return true;
+    // Both mask scopes index the mask voxel for voxel, so it has to be the image's size.
+    const unsigned int sx = m_image.getSizeX(), sy = m_image.getSizeY(), sz = m_image.getSizeZ();
+    if (m_maskDimX != sx || m_maskDimY != sy || m_maskDimZ != sz || m_maskData.size() != size_t(sx) * sy * sz)
+        return false;
+    if (scope == kThresholdInsideMask)
     {
-        std::cerr << "[ERROR] makeQImageFromRGB: rgb buffer too small\n";
-        return QImage();
+        region.mask = &m_maskData;
+        return true;
+    }
+    if (!m_thresholdBoxValid)
+    {
+        // An empty mask leaves an empty box, which thresholds nothing.
+        ThresholdRegion box;
+        box.begin[0] = sx;
+        box.begin[1] = sy;
+        box.begin[2] = sz;
+        box.end[0] = box.end[1] = box.end[2] = 0;
+        size_t i = 0;
+        for (unsigned int z = 0; z < sz; ++z)
+            for (unsigned int y = 0; y < sy; ++y)
+                for (unsigned int x = 0; x < sx; ++x, ++i)
+                {
+                    if (m_maskData[i] == 0)
+                        continue;
+                    const unsigned int at[3] = {x, y, z};
+                    for (int axis = 0; axis < 3; ++axis)
+                    {
+                        box.begin[axis] = std::min(box.begin[axis], at[axis]);
+                        box.end[axis] = std::max(box.end[axis], at[axis] + 1);
+                    }
+                }
+        m_thresholdBox = box;
+        m_thresholdBoxValid = true;
     }
-    QImage img(w, h, QImage::Format_RGB888);
-    int bpl = img.bytesPerLine();
-    const unsigned char *src = rgb.data();
-    unsigned char *dst = img.bits();
-    for (int y = 0; y < h; ++y)
+    region = m_thresholdBox;
+    return true;
+}
+
+void ManualSeedSelector::previewThreshold(QImage &slice, SlicePlane plane, int sliceIndex, float lo, float hi) const
+{
+    ThresholdRegion region;
+    if (!m_thresholdPreviewCheck || !m_thresholdPreviewCheck->isChecked() || !thresholdRegion(region))
+        return;
+    const int planeIndex = plane == SlicePlane::Axial ? 0 : plane == SlicePlane::Sagittal ? 1 : 2;
+    std::vector<unsigned char> changed;
+    if (!m_image.thresholdPreview(planeIndex, static_cast<unsigned int>(sliceIndex),
+                                  static_cast<float>(m_thresholdSpin->value()), region, changed))
+        return;
+
+    // Draw the replacement value under the current window where it would land.
+    const float value = static_cast<float>(m_thresholdValueSpin->value());
+    const float span = (hi - lo != 0.0f) ? (hi - lo) : 1.0f;
+    const unsigned char grey =
+        static_cast<unsigned char>((std::min(std::max(value, lo), hi) - lo) * (255.0f / span));
+    const int width = slice.width();
+    for (int y = 0; y < slice.height(); ++y)
+    {
+        uchar *line = slice.scanLine(y);
+        const unsigned char *row = changed.data() + size_t(y) * width;
+        for (int x = 0; x < width; ++x)
+        {
+            if (!row[x])
+                continue;
+            line[3 * x] = grey;
+            line[3 * x + 1] = grey;
+            line[3 * x + 2] = grey;
+        }
+    }
+}
+
+void ManualSeedSelector::loadThresholdPreviewMask()
+{
+    if (!m_thresholdPreviewCheck || !m_thresholdPreviewCheck->isChecked() || !m_thresholdRegionCombo ||
+        m_thresholdRegionCombo->currentIndex() == kThresholdWholeVolume || !activeMaskPending())
+        return;
+    m_thresholdBoxValid = false;
+    ensureActiveMaskLoaded();
+}
+
+void ManualSeedSelector::applyImageThreshold()
+{
+    if (!hasImage())
+    {
+        QMessageBox::information(this, "Image Threshold", "Load an image before applying a threshold.");
+        return;
+    }
+    const bool needsMask = m_thresholdRegionCombo->currentIndex() != kThresholdWholeVolume;
+    m_thresholdBoxValid = false;
+    ThresholdRegion region;
+    if ((needsMask && !ensureActiveMaskLoaded()) || !thresholdRegion(region))
     {
-        std::memcpy(dst + size_t(y) * bpl, src + size_t(y) * w * 3, size_t(w * 3));
+        QMessageBox::warning(this, "Image Threshold",
+                             "Limiting the threshold to a mask requires an active mask with the image's dimensions.");
+        return;
     }
-    return img;
+
+    const float threshold = static_cast<float>(m_thresholdSpin->value());
+    const float value = static_cast<float>(m_thresholdValueSpin->value());
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    // The pyramid worker reads these voxels, and its levels would show the old ones.
+    cancelPyramidBuild();
+    m_image.applyThreshold(threshold, value, region);
+    QApplication::restoreOverrideCursor();
+
+    // The preview has become the image.
+    const bool previewBlocked = m_thresholdPreviewCheck->blockSignals(true);
+    m_thresholdPreviewCheck->setChecked(false);
+    m_thresholdPreviewCheck->blockSignals(previewBlocked);
+    noteImageEdited();
+    if (m_statusLabel)
+        m_statusLabel->setText(QString("Image threshold applied: intensities above %1 set to %2.")
+                                   .arg(threshold, 0, 'f', 1)
+                                   .arg(value, 0, 'f', 1));
+}
+
+void ManualSeedSelector::undoImageThreshold()
+{
+    if (m_image.undoLevels() == 0)
+        return;
+    cancelPyramidBuild();
+    m_image.undo();
+    noteImageEdited();
+    if (m_statusLabel)
+        m_statusLabel->setText(QString("Image threshold undone (%1 more level(s) kept).").arg(m_image.undoLevels()));
 }
 
+void ManualSeedSelector::noteImageEdited()
+{
+    // The cache entry shares the edited voxels but describes the file, and
+    // any export for the external tools was written before the edit.
+    m_imageCache.erase(m_path);
+    m_nativeImageSource.clear();
+    m_btnUndoThreshold->setEnabled(m_image.undoLevels() > 0);
+    startPyramidBuild();
+    updateViews();
+}
+
+// =============================================================================
+// VIEW UPDATES
+// =============================================================================
+
 void ManualSeedSelector::requestViewUpdate(bool immediate)
 {
     if (immediate || !m_viewUpdateTimer)
@@ -4581,28 +5518,56 @@ void ManualSeedSelector::updateViews()
     m_sagittalView->setPixelAspect(pixelAspect(spZ, spY));
     m_coronalView->setPixelAspect(pixelAspect(spZ, spX));
 
+    // While a slider is dragged over a large volume the slices come from a
+    // pyramid level, so the cost per frame does not grow with the matrix.
+    // The views keep full-size coordinates either way.
+    unsigned int step = 1;
+    const NiftiImage &source = viewSource(step);
+    const auto levelIndex = [step](int index, unsigned int levelSize)
+    { return std::min(static_cast<unsigned int>(index) / step, levelSize - 1); };
+    const int levelX = int(source.getSizeX());
+    const int levelY = int(source.getSizeY());
+    const int levelZ = int(source.getSizeZ());
+
+    // Each slice is windowed straight into the QImage the view will show; a
+    // slice that cannot be rendered stays black.
+    const auto blackUnlessRendered = [](QImage &image, bool rendered)
+    {
+        if (!rendered)
+            image.fill(Qt::black);
+    };
+
     // Axial view
-    auto axial_rgb = m_image.getAxialSliceAsRGB(z, lo, hi);
+    QImage axial(levelX, levelY, QImage::Format_RGB888);
+    blackUnlessRendered(axial,
+                        source.renderAxialSlice(levelIndex(z, levelZ), lo, hi, axial.bits(), axial.bytesPerLine()));
+    if (step == 1)
+        previewThreshold(axial, SlicePlane::Axial, z, lo, hi);
     if (m_enableAxialMask)
-        blendMaskOverlays(axial_rgb, SlicePlane::Axial, z);
-    QImage axial = makeQImageFromRGB(axial_rgb, int(sizeX), int(sizeY));
-    m_axialView->setImage(axial);
+        blendMaskOverlays(axial, SlicePlane::Axial, z, step);
+    m_axialView->setImage(axial, QSize(int(sizeX), int(sizeY)));
 
     // Sagittal view
     int sagX = m_sagittalSlider->value();
-    auto sagittal_rgb = m_image.getSagittalSliceAsRGB(sagX, lo, hi);
+    QImage sagittal(levelY, levelZ, QImage::Format_RGB888);
+    blackUnlessRendered(sagittal, source.renderSagittalSlice(levelIndex(sagX, levelX), lo, hi, sagittal.bits(),
+                                                             sagittal.bytesPerLine()));
+    if (step == 1)
+        previewThreshold(sagittal, SlicePlane::Sagittal, sagX, lo, hi);
     if (m_enableSagittalMask)
-        blendMaskOverlays(sagittal_rgb, SlicePlane::Sagittal, sagX);
-    QImage sagittal = makeQImageFromRGB(sagittal_rgb, int(sizeY), int(sizeZ));
-    m_sagittalView->setImage(sagittal);
+        blendMaskOverlays(sagittal, SlicePlane::Sagittal, sagX, step);
+    m_sagittalView->setImage(sagittal, QSize(int(sizeY), int(sizeZ)));
 
     // Coronal view
     int corY = m_coronalSlider->value();
-    auto coronal_rgb = m_image.getCoronalSliceAsRGB(corY, lo, hi);
+    QImage coronal(levelX, levelZ, QImage::Format_RGB888);
+    blackUnlessRendered(coronal, source.renderCoronalSlice(levelIndex(corY, levelY), lo, hi, coronal.bits(),
+                                                           coronal.bytesPerLine()));
+    if (step == 1)
+        previewThreshold(coronal, SlicePlane::Coronal, corY, lo, hi);
     if (m_enableCoronalMask)
-        blendMaskOverlays(coronal_rgb, SlicePlane::Coronal, corY);
-    QImage coronal = makeQImageFromRGB(coronal_rgb, int(sizeX), int(sizeZ));
-    m_coronalView->setImage(coronal);
+        blendMaskOverlays(coronal, SlicePlane::Coronal, corY, step);
+    m_coronalView->setImage(coronal, QSize(int(sizeX), int(sizeZ)));
 
     // Seed overlays (visual declutter only; does not modify m_seeds)
     const int minPixelSpacing = std::max(1, m_seedDisplayMinPixelSpacing);
@@ -4949,7 +5914,8 @@ void ManualSeedSelector::releaseActiveMaskLayer()
         // Drawn: the layer takes the voxels over, and stays on screen while the
         // buffer goes to whichever mask is loaded next. They move rather than
         // copy — a thorax mask is hundreds of MB — so the buffer is left empty
-        // here and every caller assigns or clears it straight after.
+        // here and every caller assigns or clears it straight after. No longer
+        // edited, they are kept as runs.
         it->volume.data = std::move(m_maskData);
         m_maskData.clear();
         it->volume.dimX = m_maskDimX;
@@ -4959,6 +5925,7 @@ void ManualSeedSelector::releaseActiveMaskLayer()
         it->volume.spacingY = m_maskSpacingY;
         it->volume.spacingZ = m_maskSpacingZ;
         it->labels = it->volume.distinctLabels();
+        it->volume.compress();
         return;
     }
 }
@@ -5030,16 +5997,16 @@ bool ManualSeedSelector::maskVolumeCoregisters(const MaskVolume &volume, QString
     return false;
 }
 
-bool ManualSeedSelector::confirmMaskLayerMemory(std::size_t additionalVoxels)
+bool ManualSeedSelector::confirmMaskLayerMemory(std::size_t additionalBytes)
 {
-    // Every drawn mask is a full label volume; a thorax CT is ~100M voxels, so
-    // a handful of eyes adds up fast enough to be worth a question.
-    constexpr std::size_t kBytesPerVoxel = sizeof(int);
+    // Drawn masks are held as runs, a small fraction of the dense volume for
+    // an organ. A noisy one stays dense (a thorax CT is ~100M voxels), and a
+    // few of those add up fast enough to be worth a question.
     constexpr std::size_t kWarnBytes = std::size_t(1536) * 1024 * 1024;
 
-    std::size_t bytes = additionalVoxels * kBytesPerVoxel;
+    std::size_t bytes = additionalBytes;
     for (const MaskLayer &layer : m_maskLayers)
-        bytes += layer.volume.data.size() * kBytesPerVoxel;
+        bytes += layer.volume.bytes();
     if (bytes <= kWarnBytes)
         return true;
 
@@ -5105,7 +6072,8 @@ void ManualSeedSelector::toggleMaskVisible(const QString &absolutePath)
             return;
         }
 
-        if (!confirmMaskLayerMemory(volume.voxelCount()))
+        volume.compress();
+        if (!confirmMaskLayerMemory(volume.bytes()))
             return;
 
         MaskLayer created;
@@ -5169,6 +6137,7 @@ void ManualSeedSelector::selectActiveMask(const QString &absolutePath)
             m_maskSpacingY = layer->volume.spacingY;
             m_maskSpacingZ = layer->volume.spacingZ;
         }
+        layer->volume.expand();
         m_maskData = std::move(layer->volume.data);
         m_pendingActiveMaskPath.clear();
     }
@@ -5187,6 +6156,8 @@ void ManualSeedSelector::selectActiveMask(const QString &absolutePath)
     adoptActiveMaskLayer(key);
     m_mask3DDirty = true;
     rebuildMaskLabelFilter();
+    m_thresholdBoxValid = false;
+    loadThresholdPreviewMask();
 }
 
 bool ManualSeedSelector::ensureActiveMaskLoaded()
@@ -5366,7 +6337,10 @@ std::vector<ManualSeedSelector::MaskRenderItem> ManualSeedSelector::visibleMaskR
         if (!layer.visible || !layer.volume.isValid())
             continue;
         MaskRenderItem item;
-        item.data = &layer.volume.data;
+        if (layer.volume.runs.empty())
+            item.data = &layer.volume.data;
+        else
+            item.runs = &layer.volume.runs;
         item.dimX = layer.volume.dimX;
         item.dimY = layer.volume.dimY;
         item.dimZ = layer.volume.dimZ;
@@ -5396,9 +6370,10 @@ std::vector<ManualSeedSelector::MaskRenderItem> ManualSeedSelector::visibleMaskR
     return items;
 }
 
-void ManualSeedSelector::blendMaskOverlays(std::vector<unsigned char> &rgb,
+void ManualSeedSelector::blendMaskOverlays(QImage &slice,
                                            SlicePlane plane,
-                                           int sliceIndex) const
+                                           int sliceIndex,
+                                           unsigned int step) const
 {
     const unsigned int sizeX = m_image.getSizeX();
     const unsigned int sizeY = m_image.getSizeY();
@@ -5411,30 +6386,33 @@ void ManualSeedSelector::blendMaskOverlays(std::vector<unsigned char> &rgb,
         return;
 
     // Which image axes span the slice buffer, and which one the slider indexes.
+    // A pyramid slice has one pixel per `step` voxels along each of them.
+    step = std::max(1u, step);
+    const auto levelSize = [step](unsigned int size) { return (size + step - 1) / step; };
     unsigned int outW = 0;
     unsigned int outH = 0;
     unsigned int sliceLimit = 0;
     switch (plane)
     {
     case SlicePlane::Axial:
-        outW = sizeX;
-        outH = sizeY;
+        outW = levelSize(sizeX);
+        outH = levelSize(sizeY);
         sliceLimit = sizeZ;
         break;
     case SlicePlane::Sagittal:
-        outW = sizeY;
-        outH = sizeZ;
+        outW = levelSize(sizeY);
+        outH = levelSize(sizeZ);
         sliceLimit = sizeX;
         break;
     case SlicePlane::Coronal:
-        outW = sizeX;
-        outH = sizeZ;
+        outW = levelSize(sizeX);
+        outH = levelSize(sizeZ);
         sliceLimit = sizeY;
         break;
     }
     if (static_cast<unsigned int>(sliceIndex) >= sliceLimit)
         return;
-    if (rgb.size() < size_t(outW) * size_t(outH) * 3)
+    if (slice.format() != QImage::Format_RGB888 || slice.width() < int(outW) || slice.height() < int(outH))
         return;
 
     const float opacity = std::max(0.0f, std::min(1.0f, m_maskOpacity));
@@ -5446,46 +6424,83 @@ void ManualSeedSelector::blendMaskOverlays(std::vector<unsigned char> &rgb,
             continue; // cannot be co-registered with what is on screen
 
         LabelColorTable colors(*item.style);
-        const std::vector<int> &data = *item.data;
         const size_t maskPlane = size_t(item.dimX) * size_t(item.dimY);
 
+        // Pixel (u, v) of the output shows voxel (x, y, z).
+        const auto voxelFor = [&](unsigned int u, unsigned int v, unsigned int &x, unsigned int &y, unsigned int &z)
+        {
+            switch (plane)
+            {
+            case SlicePlane::Axial:
+                x = u * step;
+                y = v * step;
+                z = static_cast<unsigned int>(sliceIndex);
+                break;
+            case SlicePlane::Sagittal:
+                x = static_cast<unsigned int>(sliceIndex);
+                y = u * step;
+                z = v * step;
+                break;
+            case SlicePlane::Coronal:
+                x = u * step;
+                y = static_cast<unsigned int>(sliceIndex);
+                z = v * step;
+                break;
+            }
+            z = mapDepthIndex(z, sizeZ, item.dimZ);
+        };
+
+        // One output row of labels at a time, read at the stored width, or
+        // decoded from the runs: an X row whole, a sagittal column voxel by
+        // voxel.
+        std::vector<int> labels(outW);
+        std::vector<int> decodedRow;
         for (unsigned int v = 0; v < outH; ++v)
         {
-            for (unsigned int u = 0; u < outW; ++u)
+            unsigned int x = 0;
+            unsigned int y = 0;
+            unsigned int z = 0;
+            if (item.runs && plane != SlicePlane::Sagittal)
+            {
+                voxelFor(0, v, x, y, z);
+                decodedRow.resize(item.dimX);
+                item.runs->decodeRow(y, z, decodedRow.data());
+                for (unsigned int u = 0; u < outW; ++u)
+                    labels[u] = decodedRow[size_t(u) * step];
+            }
+            else if (item.runs)
             {
-                unsigned int x = 0;
-                unsigned int y = 0;
-                unsigned int z = 0;
-                switch (plane)
+                for (unsigned int u = 0; u < outW; ++u)
                 {
-                case SlicePlane::Axial:
-                    x = u;
-                    y = v;
-                    z = static_cast<unsigned int>(sliceIndex);
-                    break;
-                case SlicePlane::Sagittal:
-                    x = static_cast<unsigned int>(sliceIndex);
-                    y = u;
-                    z = v;
-                    break;
-                case SlicePlane::Coronal:
-                    x = u;
-                    y = static_cast<unsigned int>(sliceIndex);
-                    z = v;
-                    break;
+                    voxelFor(u, v, x, y, z);
+                    labels[u] = item.runs->at(x, y, z);
                 }
+            }
+            else
+            {
+                item.data->visit(
+                    [&](const auto *data)
+                    {
+                        for (unsigned int u = 0; u < outW; ++u)
+                        {
+                            voxelFor(u, v, x, y, z);
+                            labels[u] = data[size_t(x) + size_t(y) * item.dimX + size_t(z) * maskPlane];
+                        }
+                    });
+            }
 
-                const unsigned int mappedZ = mapDepthIndex(z, sizeZ, item.dimZ);
-                const int label = data[size_t(x) + size_t(y) * item.dimX + size_t(mappedZ) * maskPlane];
+            for (unsigned int u = 0; u < outW; ++u)
+            {
+                const int label = labels[u];
                 if (label == 0)
                     continue;
                 if (item.active && !maskLabelVisible(label))
                     continue;
 
                 const unsigned char *color = colors.colorFor(label);
-                const size_t pix = (size_t(v) * outW + u) * 3;
+                uchar *pix = slice.scanLine(int(v)) + size_t(u) * 3;
                 for (int c = 0; c < 3; ++c)
-                    rgb[pix + c] = static_cast<unsigned char>(opacity * color[c] + inverse * rgb[pix + c]);
+                    pix[c] = static_cast<unsigned char>(opacity * color[c] + inverse * pix[c]);
             }
         }
     }
@@ -5526,14 +6541,23 @@ void ManualSeedSelector::update3DMaskView()
                                   first.dimX == targetX && first.dimY == targetY && first.dimZ == targetZ &&
                                   !(first.active && maskHasHiddenLabels()));
 
-        if (passThrough)
+        if (passThrough && first.runs)
+        {
+            // The surface is contoured from a dense volume; decoded only for
+            // as long as it takes the view to copy it.
+            LabelBuffer decoded;
+            first.runs->decode(decoded);
+            m_mask3DView->setMaskData(decoded, targetX, targetY, targetZ,
+                                      targetSpacingX, targetSpacingY, targetSpacingZ);
+        }
+        else if (passThrough)
         {
             m_mask3DView->setMaskData(*first.data, targetX, targetY, targetZ,
                                       targetSpacingX, targetSpacingY, targetSpacingZ);
         }
         else
         {
-            std::vector<int> merged(size_t(targetX) * size_t(targetY) * size_t(targetZ), 0);
+            LabelBuffer merged(size_t(targetX) * size_t(targetY) * size_t(targetZ), 0);
             std::map<int, QColor> mergedColors;
             std::map<int, QString> mergedNames;
             int nextId = 0;
@@ -5557,27 +6581,57 @@ void ManualSeedSelector::update3DMaskView()
                     }
                 }
 
-                const std::vector<int> &data = *item.data;
+                // The merged ids widen the buffer only once there are more
+                // of them than its width holds. Runs are copied a run at a
+                // time, so a layer's background costs nothing here.
                 const size_t sourcePlane = size_t(item.dimX) * size_t(item.dimY);
                 const size_t targetPlane = size_t(targetX) * size_t(targetY);
-                for (unsigned int z = 0; z < targetZ; ++z)
+                if (item.runs)
                 {
-                    const size_t srcOffset = size_t(mapDepthIndex(z, targetZ, item.dimZ)) * sourcePlane;
-                    const size_t dstOffset = size_t(z) * targetPlane;
-                    for (size_t i = 0; i < targetPlane; ++i)
+                    for (unsigned int z = 0; z < targetZ; ++z)
                     {
-                        const int label = data[srcOffset + i];
-                        if (label == 0)
-                            continue;
-                        if (item.active && !maskLabelVisible(label))
-                            continue;
-                        const int id = mergeLabels ? ids.idFor(label) : label;
-                        if (id == 0)
-                            continue;
-                        merged[dstOffset + i] = id;
-                        anyVoxel = true;
+                        const unsigned int srcZ = mapDepthIndex(z, targetZ, item.dimZ);
+                        for (unsigned int y = 0; y < targetY; ++y)
+                        {
+                            const size_t dstRow = size_t(z) * targetPlane + size_t(y) * targetX;
+                            for (const LabelRuns::Run *run = item.runs->rowBegin(y, srcZ);
+                                 run != item.runs->rowEnd(y, srcZ); ++run)
+                            {
+                                if (item.active && !maskLabelVisible(run->label))
+                                    continue;
+                                const int id = mergeLabels ? ids.idFor(run->label) : run->label;
+                                if (id == 0)
+                                    continue;
+                                for (uint32_t x = run->begin; x < run->end; ++x)
+                                    merged.set(dstRow + x, id);
+                                anyVoxel = true;
+                            }
+                        }
                     }
+                    continue;
                 }
+                item.data->visit(
+                    [&](const auto *data)
+                    {
+                        for (unsigned int z = 0; z < targetZ; ++z)
+                        {
+                            const size_t srcOffset = size_t(mapDepthIndex(z, targetZ, item.dimZ)) * sourcePlane;
+                            const size_t dstOffset = size_t(z) * targetPlane;
+                            for (size_t i = 0; i < targetPlane; ++i)
+                            {
+                                const int label = data[srcOffset + i];
+                                if (label == 0)
+                                    continue;
+                                if (item.active && !maskLabelVisible(label))
+                                    continue;
+                                const int id = mergeLabels ? ids.idFor(label) : label;
+                                if (id == 0)
+                                    continue;
+                                merged.set(dstOffset + i, id);
+                                anyVoxel = true;
+                            }
+                        }
+                    });
             }
 
             if (!anyVoxel)
@@ -5851,7 +6905,7 @@ void ManualSeedSelector::filterActiveMaskByThreshold()
                     continue;
                 if (m_image.getVoxelValue(x, y, z) >= static_cast<float>(threshold))
                 {
-                    m_maskData[maskIdx] = 0;
+                    m_maskData.set(maskIdx, 0);
                     ++removedCount;
                 }
             }
@@ -5877,104 +6931,111 @@ void ManualSeedSelector::filterActiveMaskByThreshold()
     }
 }
 
-bool ManualSeedSelector::saveMaskToFile(const std::string &path)
+bool ManualSeedSelector::saveMaskToFile(const std::string &path, int compressionLevel)
 {
     // Writing before the deferred read would save a blank volume over a mask
     // the user only meant to select.
     if (activeMaskPending())
         ensureActiveMaskLoaded();
 
-    try
-    {
-        using PixelType = int16_t;
-        using ImageType = itk::Image<PixelType, 3>;
-        using WriterType = itk::ImageFileWriter<ImageType>;
-
-        ImageType::Pointer out = ImageType::New();
-        ImageType::RegionType region;
-        ImageType::IndexType start;
-        start.Fill(0);
-        ImageType::SizeType size;
-        unsigned int sx = m_image.getSizeX();
-        unsigned int sy = m_image.getSizeY();
-        unsigned int sz = m_image.getSizeZ();
-        if (sx == 0 || sy == 0 || sz == 0)
-        {
-            QMessageBox::warning(this, "Save Mask", "No image loaded.");
-            return false;
-        }
-        size[0] = static_cast<ImageType::SizeValueType>(sx);
-        size[1] = static_cast<ImageType::SizeValueType>(sy);
-        size[2] = static_cast<ImageType::SizeValueType>(sz);
-        region.SetIndex(start);
-        region.SetSize(size);
-        out->SetRegions(region);
-        out->Allocate();
-
-        if (m_maskData.empty())
-        {
-            m_maskData.assign(size_t(sx) * size_t(sy) * size_t(sz), 0);
-            m_maskDimX = sx;
-            m_maskDimY = sy;
-            m_maskDimZ = sz;
-        }
+    using PixelType = int16_t;
+    const unsigned int sx = m_image.getSizeX();
+    const unsigned int sy = m_image.getSizeY();
+    const unsigned int sz = m_image.getSizeZ();
+    if (sx == 0 || sy == 0 || sz == 0)
+    {
+        QMessageBox::warning(this, "Save Mask", "No image loaded.");
+        return false;
+    }
 
-        const bool maskDimsKnown = (m_maskDimX > 0 && m_maskDimY > 0 && m_maskDimZ > 0);
-        const size_t expectedMaskTotal = maskDimsKnown ? (size_t(m_maskDimX) * size_t(m_maskDimY) * size_t(m_maskDimZ)) : 0;
-        const bool canSampleMask = (!m_maskData.empty() &&
-                                    maskDimsKnown &&
-                                    m_maskData.size() == expectedMaskTotal &&
-                                    m_maskDimX == sx &&
-                                    m_maskDimY == sy);
-
-        itk::ImageRegionIterator<ImageType> it(out, region);
-        size_t idx = 0;
-        const size_t imagePlaneStride = size_t(sx) * size_t(sy);
-        const size_t maskPlaneStride = size_t(m_maskDimX) * size_t(m_maskDimY);
-        for (it.GoToBegin(); !it.IsAtEnd(); ++it, ++idx)
-        {
-            int v = 0;
-            if (canSampleMask)
+    if (m_maskData.empty())
+    {
+        m_maskData.assign(size_t(sx) * size_t(sy) * size_t(sz), 0);
+        m_maskDimX = sx;
+        m_maskDimY = sy;
+        m_maskDimZ = sz;
+    }
+
+    const bool maskDimsKnown = (m_maskDimX > 0 && m_maskDimY > 0 && m_maskDimZ > 0);
+    const size_t expectedMaskTotal = maskDimsKnown ? (size_t(m_maskDimX) * size_t(m_maskDimY) * size_t(m_maskDimZ)) : 0;
+    const bool canSampleMask = (!m_maskData.empty() &&
+                                maskDimsKnown &&
+                                m_maskData.size() == expectedMaskTotal &&
+                                m_maskDimX == sx &&
+                                m_maskDimY == sy);
+
+    std::vector<PixelType> out(size_t(sx) * size_t(sy) * size_t(sz), 0);
+    if (canSampleMask)
+    {
+        const size_t planeStride = size_t(sx) * size_t(sy);
+        m_maskData.visit(
+            [&](const auto *labels)
             {
-                const unsigned int x = static_cast<unsigned int>(idx % sx);
-                const unsigned int y = static_cast<unsigned int>((idx / sx) % sy);
-                const unsigned int z = static_cast<unsigned int>(idx / imagePlaneStride);
-                const unsigned int mappedZ = mapDepthIndex(z, sz, m_maskDimZ);
-                const size_t maskIdx = size_t(x) + size_t(y) * m_maskDimX + size_t(mappedZ) * maskPlaneStride;
-                v = m_maskData[maskIdx];
-            }
-            if (v < std::numeric_limits<PixelType>::min())
-                v = std::numeric_limits<PixelType>::min();
-            if (v > std::numeric_limits<PixelType>::max())
-                v = std::numeric_limits<PixelType>::max();
-            it.Set(static_cast<PixelType>(v));
-        }
+                for (unsigned int z = 0; z < sz; ++z)
+                {
+                    const auto *src = labels + size_t(mapDepthIndex(z, sz, m_maskDimZ)) * planeStride;
+                    PixelType *dst = out.data() + size_t(z) * planeStride;
+                    for (size_t i = 0; i < planeStride; ++i)
+                        dst[i] = static_cast<PixelType>(std::clamp<int>(src[i], std::numeric_limits<PixelType>::min(),
+                                                                        std::numeric_limits<PixelType>::max()));
+                }
+            });
+    }
 
-        std::string outpath = path;
-        auto has_suffix = [](const std::string &p, const std::string &suf)
+    std::string outpath = path;
+    auto has_suffix = [](const std::string &p, const std::string &suf)
+    {
+        if (p.size() < suf.size())
+            return false;
+        return p.compare(p.size() - suf.size(), suf.size(), suf) == 0;
+    };
+    if (!has_suffix(outpath, ".nii") && !has_suffix(outpath, ".nii.gz"))
+    {
+        outpath += ".nii.gz";
+    }
+
+    // Unit spacing at the origin, as masks have always been written.
+    const size_t size[3] = {sx, sy, sz};
+    const double spacing[3] = {1.0, 1.0, 1.0};
+    const double origin[3] = {0.0, 0.0, 0.0};
+    const double direction[3][3] = {{1.0, 0.0, 0.0}, {0.0, 1.0, 0.0}, {0.0, 0.0, 1.0}};
+    std::vector<unsigned char> header;
+    if (!nifti::makeHeader(size, nifti::kInt16, spacing, origin, direction, header))
+    {
+        // Too large for NIfTI-1's 16-bit dimensions; ITK picks the format,
+        // writing straight from `out`.
+        try
         {
-            if (p.size() < suf.size())
-                return false;
-            return p.compare(p.size() - suf.size(), suf.size(), suf) == 0;
-        };
-        if (!has_suffix(outpath, ".nii") && !has_suffix(outpath, ".nii.gz"))
+            using ImageType = itk::Image<PixelType, 3>;
+            ImageType::Pointer image = ImageType::New();
+            ImageType::IndexType start;
+            start.Fill(0);
+            ImageType::SizeType itkSize;
+            for (int axis = 0; axis < 3; ++axis)
+                itkSize[axis] = static_cast<ImageType::SizeValueType>(size[axis]);
+            image->SetRegions(ImageType::RegionType(start, itkSize));
+            image->GetPixelContainer()->SetImportPointer(out.data(), out.size(), false);
+            using WriterType = itk::ImageFileWriter<ImageType>;
+            WriterType::Pointer writer = WriterType::New();
+            writer->SetImageIO(itk::NiftiImageIO::New());
+            writer->SetFileName(outpath);
+            writer->SetInput(image);
+            writer->Update();
+        }
+        catch (const std::exception &e)
         {
-            outpath += ".nii.gz";
+            QMessageBox::critical(this, "Save Mask", QString("Failed: %1").arg(e.what()));
+            return false;
         }
-
-        WriterType::Pointer writer = WriterType::New();
-        itk::NiftiImageIO::Pointer nio = itk::NiftiImageIO::New();
-        writer->SetImageIO(nio);
-        writer->SetFileName(outpath);
-        writer->SetInput(out);
-        writer->Update();
         return true;
     }
-    catch (const std::exception &e)
+    std::string error;
+    if (!nifti::writeVolume(outpath, header, out.data(), out.size() * sizeof(PixelType), compressionLevel, &error))
     {
-        QMessageBox::critical(this, "Save Mask", QString("Failed: %1").arg(e.what()));
+        QMessageBox::critical(this, "Save Mask", QString("Failed: %1").arg(QString::fromStdString(error)));
         return false;
     }
+    return true;
 }
 
 bool ManualSeedSelector::loadMaskFromFile(const std::string &path)
@@ -6145,11 +7206,11 @@ void ManualSeedSelector::applyBrushToMask(const std::array<int, 3> &center, cons
                 if (erase)
                 {
                     if (m_maskData[idx] == labelValue)
-                        m_maskData[idx] = 0;
+                        m_maskData.set(idx, 0);
                 }
                 else
                 {
-                    m_maskData[idx] = labelValue;
+                    m_maskData.set(idx, labelValue);
                 }
             }
         }
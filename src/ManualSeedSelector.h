@@ -7,19 +7,24 @@
 #include <QLabel>
 #include <QPushButton>
 #include <QColor>
+#include <QFileInfo>
 #include <QStringList>
 #include <functional>
 #include <deque>
 #include <cstdint>
 #include <atomic>
 #include <map>
+#include <memory>
 #include <mutex>
+#include <set>
 #include <thread>
 #include <vector>
+#include "ImageCache.h"
 #include "MaskLayers.h"
 #include "NiftiImage.h"
 #include "OrthogonalView.h"
 #include "RangeSlider.h"
+#include "VolumeCache.h"
 
 class QDoubleSpinBox;
 class QCheckBox;
@@ -85,7 +90,8 @@ public:
     // A path the native binaries and Python helpers can actually read. Those
     // consume files, not the in-memory volume, and none of them speak numpy —
     // so a .npz/.npy image is exported once to a temporary NIfTI carrying the
-    // orientation and spacing it was imported with. Other formats pass through.
+    // orientation and spacing it was imported with. So is an image of any
+    // format with a threshold applied; an unedited file passes through.
     std::string nativeImagePath();
     // convenience wrapper to load a mask and update views (used by segmentation runner)
     bool applyMaskFromPath(const std::string &path);
@@ -151,7 +157,8 @@ private slots:
     void setMaskMode(int mode);
     void setSeedMode(int mode);
     void cleanMask();
-    bool saveMaskToFile(const std::string &path);
+    // `compressionLevel` is zlib's, for .nii.gz; see saveCompressionLevel().
+    bool saveMaskToFile(const std::string &path, int compressionLevel);
     bool loadMaskFromFile(const std::string &path);
     void paintAxialMask(int x, int y);
     void paintSagittalMask(int x, int y);
@@ -159,6 +166,10 @@ private slots:
     void applyBrushToMask(const std::array<int, 3> &center, const std::pair<int, int> &axes, int radius, int labelValue, bool erase = false);
     void resetWindowToFullRange();
     void applyWindowFromValues(float low, float high, bool fromSlider);
+    // Threshold the image over the chosen region, and step back through the
+    // applied thresholds (NiftiImage::undo()).
+    void applyImageThreshold();
+    void undoImageThreshold();
 
 private:
     enum class SlicePlane
@@ -188,6 +199,20 @@ private:
             return true;
         }
     }
+    // Fit the threshold controls to a newly loaded image, leaving it unchanged.
+    void configureThresholdControls();
+    // The region the threshold controls select; false when it needs a mask
+    // and the active mask is missing or not the image's size.
+    bool thresholdRegion(ThresholdRegion &region) const;
+    // Paint the replacement value over the pixels of one full-resolution
+    // slice that the threshold would change, when the preview is on.
+    void previewThreshold(QImage &slice, SlicePlane plane, int sliceIndex, float lo, float hi) const;
+    // A preview limited to the mask needs its voxels, so a mask that is only
+    // selected so far is read when such a preview is turned on or re-aimed,
+    // rather than the preview staying blank.
+    void loadThresholdPreviewMask();
+    // After an edit of m_image: drop what still shows the old voxels.
+    void noteImageEdited();
     // Build a seed-type filter dropdown wired to the shared filter and registered for sync.
     QComboBox *makeSeedTypeFilterCombo();
     // Set the active seed-type filter, sync every dropdown, and refresh all views.
@@ -291,9 +316,12 @@ private:
     MaskLayer m_unsavedMaskStyle;
 
     // One mask resolved for drawing: where its voxels are and how they colour.
+    // Exactly one of `data` (the edited buffer, or a layer kept dense) and
+    // `runs` (a drawn layer, run-length encoded) is set.
     struct MaskRenderItem
     {
-        const std::vector<int> *data = nullptr;
+        const LabelBuffer *data = nullptr;
+        const LabelRuns *runs = nullptr;
         unsigned int dimX = 0;
         unsigned int dimY = 0;
         unsigned int dimZ = 0;
@@ -302,8 +330,9 @@ private:
     };
     // Masks to draw, in paint order; the active mask comes last, on top.
     std::vector<MaskRenderItem> visibleMaskRenderItems() const;
-    // Blend those masks onto one slice's RGB buffer.
-    void blendMaskOverlays(std::vector<unsigned char> &rgb, SlicePlane plane, int sliceIndex) const;
+    // Blend those masks onto one slice's RGB888 image. With `step` > 1 the
+    // image is a pyramid level's slice, one pixel per step x step voxels.
+    void blendMaskOverlays(QImage &slice, SlicePlane plane, int sliceIndex, unsigned int step = 1) const;
 
     // The mask chosen in the list whose voxels have not been read. Selecting a
     // mask is free — nothing is drawn by it — so the read waits for the first
@@ -344,7 +373,7 @@ private:
     // Lowest palette slot no drawn mask is using.
     int nextFreeMaskColorSlot() const;
     // Ask before a pin pushes the drawn masks past a sane memory footprint.
-    bool confirmMaskLayerMemory(std::size_t additionalVoxels);
+    bool confirmMaskLayerMemory(std::size_t additionalBytes);
     // Add a label to the active layer's label list as soon as it is painted, so
     // its colour rule (Auto) reacts to the mask becoming multi-label.
     void noteActiveMaskLabel(int label);
@@ -396,18 +425,29 @@ private:
     QLabel *m_labelColorIndicator;
     QLabel *m_statusLabel;
     QPlainTextEdit *m_logConsole = nullptr;
-    // backup copy used to undo destructive edits like threshold
-    NiftiImage m_imageBackup;
-    bool m_hasImageBackup = false;
+    // Image threshold controls. While m_thresholdPreviewCheck is on,
+    // updateViews() shows the threshold on the three visible slices
+    // (previewThreshold()); only Apply changes m_image.
+    QSlider *m_thresholdSlider = nullptr;
+    QDoubleSpinBox *m_thresholdSpin = nullptr;
+    QDoubleSpinBox *m_thresholdValueSpin = nullptr;
+    QComboBox *m_thresholdRegionCombo = nullptr;
+    QCheckBox *m_thresholdPreviewCheck = nullptr;
+    // undoes destructive edits like threshold (NiftiImage::undo())
     QPushButton *m_btnUndoThreshold = nullptr;
+    // Bounding box of the active mask for the "Mask bounding box" region,
+    // found once per preview or apply rather than on every redraw.
+    mutable ThresholdRegion m_thresholdBox;
+    mutable bool m_thresholdBoxValid = false;
     bool m_mouseDown = false;
     int m_dragButton = 0;
     SliceDragState m_axialSliceDrag;
     SliceDragState m_sagittalSliceDrag;
     SliceDragState m_coronalSliceDrag;
     std::vector<std::array<int, 3>> m_colorLUT;
-    // mask buffer: linearized X * Y * Z, 0 means empty, positive integers are label values
-    std::vector<int> m_maskData;
+    // mask buffer: linearized X * Y * Z, 0 means empty, positive integers are label values;
+    // one byte per voxel until a label needs more
+    LabelBuffer m_maskData;
     unsigned int m_maskDimX = 0;
     unsigned int m_maskDimY = 0;
     unsigned int m_maskDimZ = 0;
@@ -526,16 +566,133 @@ private:
         NpzImportOptions npzOptions;
     };
 
-    // Load a list entry, honouring its numpy import options when it has any.
-    // Writes back what an automatic axis order resolved to, so masks opened
-    // afterwards can be read exactly the same way.
-    bool loadImageData(ImageData &data);
+    // Load a list entry into `image`, honouring its numpy import options when
+    // it has any. Writes back what an automatic axis order resolved to, so
+    // masks opened afterwards can be read exactly the same way. Reads from,
+    // and fills, `cache` (which is thread-safe) but touches no other state,
+    // so it can run on the image load worker. Once `keepGoing` returns false
+    // the decoded image is no longer written to `cache`.
+    static bool loadImageData(NiftiImage &image, ImageData &data, VolumeCache &cache,
+                              const std::function<bool()> &keepGoing);
+
+    // Background loading of list entries. startImageLoad() cancels any load
+    // still running and reads entry `row` on m_imageLoadWorker, showing its
+    // progress and the central axial slice as soon as that is decoded; the
+    // image replaces m_image in finishImageLoad(). Each load has a generation
+    // number, and a load whose generation is no longer current is cancelled
+    // and its results are dropped. Without waitForJoin a cancelled worker is
+    // not waited for: it moves to m_retiredImageLoads and stops at its next
+    // progress report, which an ITK or DICOM read may not make for a while.
+    void startImageLoad(int row);
+    void cancelImageLoad(bool waitForJoin);
+    void showImageLoadPreview(unsigned int generation, const QImage &preview);
+    void finishImageLoad(int row, unsigned int generation, std::shared_ptr<NiftiImage> image,
+                         const ImageData &data, bool ok);
+    // Swap a loaded image in for entry `row`: resets masks, seeds and
+    // sliders, and starts the prefetch timer.
+    void applyLoadedImage(int row, const NiftiImage &image, const NpzImportOptions &options);
+    std::thread m_imageLoadWorker;
+    std::shared_ptr<std::atomic<bool>> m_imageLoadFinished; // set by m_imageLoadWorker as it exits
+    std::atomic<unsigned int> m_imageLoadGeneration{0};
+    // Superseded load and prefetch workers, still running or not yet joined.
+    // reapImageLoads() joins those that have finished, or all of them.
+    struct RetiredWorker
+    {
+        std::thread worker;
+        std::shared_ptr<std::atomic<bool>> finished;
+    };
+    void reapImageLoads(bool waitForAll);
+    std::vector<RetiredWorker> m_retiredImageLoads;
+    QProgressBar *m_imageLoadProgressBar = nullptr;
+
+    // Loaded and prefetched images, under the budget set in m_imageCacheSpin.
+    // Once the user has stayed on an image for m_prefetchTimer's interval,
+    // startImagePrefetch() reads the next and previous entries on
+    // m_prefetchWorker. Any selection cancels it, the same way as a load, and
+    // the cancelled worker joins m_retiredImageLoads.
+    void startImagePrefetch();
+    void cancelImagePrefetch(bool waitForJoin);
+    ImageCache m_imageCache;
+    QSpinBox *m_imageCacheSpin = nullptr;
+    // Decoded volumes kept on disk between sessions, so reopening a .nii.gz,
+    // DICOM series or numpy file maps the cached copy instead of decoding.
+    VolumeCache m_volumeCache;
+    QSpinBox *m_diskCacheSpin = nullptr;
+    // Masks read as the argmax of class probabilities keep a voxel whose best
+    // class is below this as background; 0 keeps every voxel's best class.
+    QDoubleSpinBox *m_maskMinProbabilitySpin = nullptr;
+    // zlib level for images and masks the user saves, from m_compressionCombo.
+    // Temporary files handed to external tools are always written fast.
+    int saveCompressionLevel() const;
+    QComboBox *m_compressionCombo = nullptr;
+    QTimer *m_prefetchTimer = nullptr;
+    std::thread m_prefetchWorker;
+    std::shared_ptr<std::atomic<bool>> m_prefetchFinished; // set by m_prefetchWorker as it exits
+    std::atomic<unsigned int> m_prefetchGeneration{0};
+
+    // Header-only scan of list entries, so hundreds of added paths show their
+    // size, spacing and type before any is loaded. queueMetadataScan() hands
+    // entries to m_metadataWorker, which reads each header and those of the
+    // masks named after it (NiftiImage::readMetadata) and posts the result to
+    // applyImageMetadata(): a summary after the entry's name, the details in
+    // its tooltip, and a warning when a mask's geometry differs. The worker
+    // exits when the queue runs dry; the next queue call starts another.
+    struct MetadataResult
+    {
+        bool ok = false;
+        ImageMetadata image;
+        std::string error;
+        std::vector<std::pair<std::string, ImageMetadata>> masks; // mask path, header
+    };
+    // What one run of the worker shares between entries: the list's image
+    // paths, so another image is never taken for a mask, and each directory,
+    // listed the first time an entry in it is scanned.
+    struct MetadataScanContext
+    {
+        std::set<QString> imagePaths; // cleaned absolute paths
+        unsigned int imagePathsVersion = 0;
+        std::map<QString, QFileInfoList> listings; // directory -> readable files
+    };
+    void queueMetadataScan(const std::vector<ImageData> &entries);
+    void cancelMetadataScan(bool waitForJoin);
+    static MetadataResult scanImageMetadata(const ImageData &data, MetadataScanContext &context);
+    void applyImageMetadata(const QString &path, const MetadataResult &result);
+    std::thread m_metadataWorker;
+    std::mutex m_metadataMutex;
+    std::deque<ImageData> m_metadataQueue;
+    bool m_metadataScanning = false;
+    // Every list entry's path as of the last queue call; guarded by
+    // m_metadataMutex, and the worker copies it when the version moves.
+    std::set<QString> m_metadataImagePaths;
+    unsigned int m_metadataImagePathsVersion = 0;
+    std::map<QString, QString> m_metadataSummaries; // absolute path -> "512×512×120 int16"
+
+    // Reduced copies of m_image for scrolling large volumes. When an image
+    // with a plane of kPyramidMinPlaneVoxels or more is shown,
+    // startPyramidBuild() makes 2x and 4x downsampled levels on
+    // m_pyramidWorker. While a slice slider is dragged, updateViews() draws
+    // from a level (see viewSource()), and m_sharpenTimer redraws at full
+    // resolution once the slider is released or held still. The same worker
+    // then builds the image's sagittal layout (NiftiImage::buildSagittalLayout)
+    // for volumes wide enough to need it and small enough to afford it.
+    // cancelPyramidBuild() stops the worker and drops the levels.
+    void startPyramidBuild();
+    void cancelPyramidBuild();
+    void noteSliceScroll(const QSlider *slider);
+    // The image to draw this frame and its downsampling factor (1: m_image).
+    const NiftiImage &viewSource(unsigned int &factor) const;
+    std::vector<std::shared_ptr<const NiftiImage>> m_pyramid; // 2x, then 4x
+    std::thread m_pyramidWorker;
+    std::atomic<unsigned int> m_pyramidGeneration{0};
+    QTimer *m_sharpenTimer = nullptr;
+    bool m_coarseViews = false;
 
     // Numpy import options for a mask of the current image: the image's own
     // axis order and mirroring, so both land on the same voxel grid.
     NpzImportOptions numpyOptionsForMask() const;
 
-    // Cached NIfTI export of a numpy image, and the image it was made from.
+    // Cached NIfTI export of a numpy or edited image, and the image it was
+    // made from (cleared by an edit).
     std::string m_nativeImagePath;
     std::string m_nativeImageSource;
 
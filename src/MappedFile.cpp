@@ -0,0 +1,115 @@
+#include "MappedFile.h"
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+
+void setError(std::string *error, const std::string &message)
+{
+    if (error)
+        *error = message;
+}
+
+} // namespace
+
+#if defined(_WIN32)
+
+std::shared_ptr<MappedFile> MappedFile::open(const std::string &path, std::string *error)
+{
+    // Shared for deletion so that a save can rename the file while it is
+    // mapped (nifti::writeVolume replacing the volume's own source).
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        setError(error, "could not open '" + path + "'");
+        return nullptr;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart <= 0)
+    {
+        CloseHandle(file);
+        setError(error, "'" + path + "' is empty or its size is unknown");
+        return nullptr;
+    }
+    // PAGE_WRITECOPY + FILE_MAP_COPY is the Windows spelling of MAP_PRIVATE.
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+    CloseHandle(file); // the mapping keeps the file open
+    if (!mapping)
+    {
+        setError(error, "could not map '" + path + "'");
+        return nullptr;
+    }
+    void *view = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+    if (!view)
+    {
+        CloseHandle(mapping);
+        setError(error, "could not map a view of '" + path + "'");
+        return nullptr;
+    }
+
+    std::shared_ptr<MappedFile> mapped(new MappedFile());
+    mapped->m_data = static_cast<unsigned char *>(view);
+    mapped->m_size = static_cast<size_t>(size.QuadPart);
+    mapped->m_mapping = mapping;
+    return mapped;
+}
+
+MappedFile::~MappedFile()
+{
+    if (m_data)
+        UnmapViewOfFile(m_data);
+    if (m_mapping)
+        CloseHandle(m_mapping);
+}
+
+#else
+
+std::shared_ptr<MappedFile> MappedFile::open(const std::string &path, std::string *error)
+{
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        setError(error, "could not open '" + path + "'");
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0)
+    {
+        ::close(fd);
+        setError(error, "'" + path + "' is empty or its size is unknown");
+        return nullptr;
+    }
+    const size_t size = static_cast<size_t>(st.st_size);
+    void *view = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    ::close(fd); // the mapping keeps its own reference
+    if (view == MAP_FAILED)
+    {
+        setError(error, "could not map '" + path + "'");
+        return nullptr;
+    }
+
+    std::shared_ptr<MappedFile> mapped(new MappedFile());
+    mapped->m_data = static_cast<unsigned char *>(view);
+    mapped->m_size = size;
+    return mapped;
+}
+
+MappedFile::~MappedFile()
+{
+    if (m_data)
+        munmap(m_data, m_size);
+}
+
+#endif
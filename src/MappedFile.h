@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+// A whole file mapped into memory, private to this process. Pages are read from
+// disk the first time they are touched, and writes go to copy-on-write pages,
+// never back to the file, so a volume mapped from disk can be edited in place
+// (thresholding, undo restores) without changing what is stored.
+class MappedFile
+{
+public:
+    // Null (with `error` set) when the file cannot be opened or mapped.
+    static std::shared_ptr<MappedFile> open(const std::string &path, std::string *error);
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    unsigned char *data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+private:
+    MappedFile() = default;
+
+    unsigned char *m_data = nullptr;
+    size_t m_size = 0;
+#if defined(_WIN32)
+    void *m_mapping = nullptr;
+#endif
+};
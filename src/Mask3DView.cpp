@@ -37,7 +37,6 @@
 #include <vtkWindowedSincPolyDataFilter.h>
 #include <vtkSmartPointer.h>
 
-#include <set>
 #include <algorithm>
 #include <cmath>
 
@@ -185,7 +184,7 @@ void Mask3DView::buildPipeline()
     m_surfacePicker->AddPickList(m_actor);
 }
 
-void Mask3DView::setMaskData(const std::vector<int> &mask,
+void Mask3DView::setMaskData(const LabelBuffer &mask,
                              unsigned int sizeX,
                              unsigned int sizeY,
                              unsigned int sizeZ,
@@ -238,23 +237,22 @@ void Mask3DView::setMaskData(const std::vector<int> &mask,
 
     int *dst = static_cast<int *>(image->GetScalarPointer());
     std::fill(dst, dst + size_t(padX) * size_t(padY) * size_t(padZ), 0);
-    for (unsigned int z = 0; z < sizeZ; ++z)
-        for (unsigned int y = 0; y < sizeY; ++y)
-        {
-            const size_t srcRow = (size_t(z) * sizeY + y) * sizeX;
-            const size_t dstRow =
-                size_t(padX) * (size_t(padY) * size_t(z + 1) + size_t(y + 1)) + 1;
-            for (unsigned int x = 0; x < sizeX; ++x)
-                dst[dstRow + x] = mask[srcRow + x];
-        }
-
-    std::set<int> labels;
-    for (int value : mask)
-    {
-        if (value > 0)
-            labels.insert(value);
-    }
-    m_activeLabels.assign(labels.begin(), labels.end());
+    mask.visit([&](const auto *src)
+               {
+                   for (unsigned int z = 0; z < sizeZ; ++z)
+                       for (unsigned int y = 0; y < sizeY; ++y)
+                       {
+                           const size_t srcRow = (size_t(z) * sizeY + y) * sizeX;
+                           const size_t dstRow =
+                               size_t(padX) * (size_t(padY) * size_t(z + 1) + size_t(y + 1)) + 1;
+                           std::copy(src + srcRow, src + srcRow + sizeX, dst + dstRow);
+                       }
+               });
+
+    m_activeLabels = mask.distinctLabels();
+    m_activeLabels.erase(std::remove_if(m_activeLabels.begin(), m_activeLabels.end(),
+                                        [](int label) { return label < 0; }),
+                         m_activeLabels.end());
 
     if (m_activeLabels.empty())
     {
@@ -8,6 +8,8 @@
 #include <map>
 #include <vtkSmartPointer.h>
 
+#include "LabelBuffer.h"
+
 QT_FORWARD_DECLARE_CLASS(QCheckBox)
 QT_FORWARD_DECLARE_CLASS(QComboBox)
 QT_FORWARD_DECLARE_CLASS(QLabel)
@@ -57,7 +59,7 @@ public:
     /// them into one volume of unique ids, and then the label values no longer
     /// carry their own colours or names — pass @p labelColors and @p labelNames
     /// so the surface and the label picker still say which mask each id is.
-    void setMaskData(const std::vector<int> &mask,
+    void setMaskData(const LabelBuffer &mask,
                      unsigned int sizeX,
                      unsigned int sizeY,
                      unsigned int sizeZ,
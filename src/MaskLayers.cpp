@@ -7,11 +7,9 @@
 #include <algorithm>
 #include <cmath>
 #include <exception>
-#include <set>
 
 #include <itkImage.h>
 #include <itkImageFileReader.h>
-#include <itkImageRegionConstIterator.h>
 
 namespace
 {
@@ -42,23 +40,43 @@ std::size_t MaskVolume::voxelCount() const
 
 bool MaskVolume::isValid() const
 {
-    return dimX > 0 && dimY > 0 && dimZ > 0 && !data.empty() && data.size() == voxelCount();
+    if (dimX == 0 || dimY == 0 || dimZ == 0)
+        return false;
+    if (!runs.empty())
+        return runs.dimX() == dimX && runs.dimY() == dimY && runs.dimZ() == dimZ;
+    return !data.empty() && data.size() == voxelCount();
 }
 
 std::vector<int> MaskVolume::distinctLabels() const
 {
-    return distinctMaskLabels(data);
+    return runs.empty() ? distinctMaskLabels(data) : runs.distinctLabels();
 }
 
-std::vector<int> distinctMaskLabels(const std::vector<int> &data)
+std::size_t MaskVolume::bytes() const
 {
-    std::set<int> present;
-    for (int value : data)
-    {
-        if (value != 0)
-            present.insert(value);
-    }
-    return std::vector<int>(present.begin(), present.end());
+    return data.bytes() + runs.bytes();
+}
+
+void MaskVolume::compress()
+{
+    if (!runs.empty() || data.size() != voxelCount())
+        return;
+    // Under the dense size or not at all: a noisy mask stays as it is.
+    if (runs.encode(data, dimX, dimY, dimZ, data.bytes()))
+        data.clear();
+}
+
+void MaskVolume::expand()
+{
+    if (runs.empty())
+        return;
+    runs.decode(data);
+    runs.clear();
+}
+
+std::vector<int> distinctMaskLabels(const LabelBuffer &data)
+{
+    return data.distinctLabels();
 }
 
 bool readMaskVolume(const std::string &path,
@@ -74,26 +92,28 @@ bool readMaskVolume(const std::string &path,
     {
         if (NiftiImage::isNumpyPath(path))
         {
-            NiftiImage volume;
+            // Labels are converted straight into the buffer. A network's
+            // per-class output (several channels, none picked) reads as each
+            // voxel's most likely class, without ever holding the
+            // probabilities.
+            NpzImportReport numpyReport;
             std::string importError;
-            if (!volume.loadNumpy(path, numpyOptions, nullptr, &importError))
+            const bool argmax = numpyOptions.channel < 0 &&
+                                NiftiImage::previewNumpy(path, numpyOptions, numpyReport, &importError) &&
+                                numpyReport.channelCount > 1;
+            if (argmax ? !NiftiImage::readNumpyArgmax(path, numpyOptions, out.data, &numpyReport, &importError)
+                       : !NiftiImage::readNumpyLabels(path, numpyOptions, out.data, &numpyReport, &importError))
             {
                 if (error)
                     *error = QString::fromStdString(importError);
                 return false;
             }
-            out.dimX = volume.getSizeX();
-            out.dimY = volume.getSizeY();
-            out.dimZ = volume.getSizeZ();
-            out.spacingX = volume.getSpacingX();
-            out.spacingY = volume.getSpacingY();
-            out.spacingZ = volume.getSpacingZ();
-            out.data.resize(out.voxelCount());
-            std::size_t writeIdx = 0;
-            for (unsigned int z = 0; z < out.dimZ; ++z)
-                for (unsigned int y = 0; y < out.dimY; ++y)
-                    for (unsigned int x = 0; x < out.dimX; ++x)
-                        out.data[writeIdx++] = static_cast<int>(std::lround(volume.getVoxelValue(x, y, z)));
+            out.dimX = numpyReport.size[0];
+            out.dimY = numpyReport.size[1];
+            out.dimZ = numpyReport.size[2];
+            out.spacingX = std::abs(numpyReport.spacing[0]);
+            out.spacingY = std::abs(numpyReport.spacing[1]);
+            out.spacingZ = std::abs(numpyReport.spacing[2]);
         }
         else
         {
@@ -112,11 +132,8 @@ bool readMaskVolume(const std::string &path,
             out.spacingX = std::abs(static_cast<double>(spacing[0]));
             out.spacingY = std::abs(static_cast<double>(spacing[1]));
             out.spacingZ = std::abs(static_cast<double>(spacing[2]));
-            out.data.resize(out.voxelCount());
-            itk::ImageRegionConstIterator<MaskImageType> it(img, region);
-            std::size_t writeIdx = 0;
-            for (it.GoToBegin(); !it.IsAtEnd(); ++it, ++writeIdx)
-                out.data[writeIdx] = static_cast<int>(it.Get());
+            // The largest possible region is the whole buffer, X fastest.
+            out.data.assign(img->GetBufferPointer(), out.voxelCount());
         }
     }
     catch (const std::exception &e)
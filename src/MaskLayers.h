@@ -16,12 +16,17 @@
 #include <string>
 #include <vector>
 
+#include "LabelBuffer.h"
+#include "LabelRuns.h"
 #include "NiftiImage.h" // NpzImportOptions
 
-/// A label volume on its own grid: C-order, X fastest, 0 = background.
+/// A label volume on its own grid: C-order, X fastest, 0 = background. The
+/// labels take one byte per voxel unless one of them needs more. A drawn layer
+/// holds them as runs instead (compress()); `data` is then empty.
 struct MaskVolume
 {
-    std::vector<int> data;
+    LabelBuffer data;
+    LabelRuns runs;
     unsigned int dimX = 0;
     unsigned int dimY = 0;
     unsigned int dimZ = 0;
@@ -30,18 +35,26 @@ struct MaskVolume
     double spacingZ = 1.0;
 
     std::size_t voxelCount() const;
-    /// True when the dimensions are non-zero and the buffer matches them.
+    /// True when the dimensions are non-zero and the buffer (or the runs) matches them.
     bool isValid() const;
     /// Distinct non-zero labels, ascending.
     std::vector<int> distinctLabels() const;
+    /// Memory held by the voxels, in whichever form.
+    std::size_t bytes() const;
+    /// Re-encode `data` as runs when they are smaller, releasing it.
+    void compress();
+    /// Decode the runs back into `data`.
+    void expand();
 };
 
 /// Distinct non-zero labels in a label buffer, ascending.
-std::vector<int> distinctMaskLabels(const std::vector<int> &data);
+std::vector<int> distinctMaskLabels(const LabelBuffer &data);
 
 /// Read a mask file into @p out: NIfTI and the other ITK formats through ITK,
 /// .npy/.npz through the numpy importer — which has no header to read the
 /// layout from, so it takes the current image's convention in @p numpyOptions.
+/// A multi-channel array (class probabilities) reads as its per-voxel argmax
+/// unless @p numpyOptions picks a channel; see NiftiImage::readNumpyArgmax().
 /// Returns false and fills @p error on failure.
 bool readMaskVolume(const std::string &path,
                     const NpzImportOptions &numpyOptions,
@@ -0,0 +1,418 @@
+#include "NiftiHeader.h"
+
+#include "GzipWriter.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <zlib.h>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#endif
+
+namespace nifti
+{
+
+namespace
+{
+
+void setError(std::string *error, const std::string &message)
+{
+    if (error)
+        *error = message;
+}
+
+// Move the finished `part` over `target`. POSIX renames over a mapped file
+// and the mapping keeps the old inode. Windows will not delete a file that
+// has a mapped view, but MappedFile shares it for deletion, which allows
+// renaming it: a mapped target is moved aside first, and the files moved
+// aside are removed once nothing maps them (now, or by a later save).
+bool replaceFile(const std::string &part, const std::string &target, std::string *error)
+{
+#if defined(_WIN32)
+    const std::wstring from = std::filesystem::path(part).wstring();
+    const std::wstring to = std::filesystem::path(target).wstring();
+    constexpr int kAsideNames = 8;
+    auto aside = [&to](int i) { return to + L".replaced" + (i ? L"." + std::to_wstring(i) : L""); };
+    for (int i = 0; i < kAsideNames; ++i)
+        DeleteFileW(aside(i).c_str());
+    if (MoveFileExW(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+        return true;
+    for (int i = 0; i < kAsideNames; ++i)
+    {
+        if (!MoveFileExW(to.c_str(), aside(i).c_str(), 0))
+            continue;
+        if (MoveFileExW(from.c_str(), to.c_str(), MOVEFILE_WRITE_THROUGH))
+        {
+            DeleteFileW(aside(i).c_str());
+            return true;
+        }
+        MoveFileExW(aside(i).c_str(), to.c_str(), 0);
+        break;
+    }
+    setError(error, "could not replace '" + target + "' (error " + std::to_string(GetLastError()) + ")");
+    return false;
+#else
+    std::error_code ec;
+    std::filesystem::rename(part, target, ec);
+    if (ec)
+    {
+        setError(error, "could not replace '" + target + "': " + ec.message());
+        return false;
+    }
+    return true;
+#endif
+}
+
+// Fixed-width reads in either byte order. The header says which one through
+// sizeof_hdr, so every field goes through these.
+template <typename T>
+T readField(const unsigned char *p, bool swapped)
+{
+    unsigned char tmp[sizeof(T)];
+    if (swapped)
+    {
+        for (size_t b = 0; b < sizeof(T); ++b)
+            tmp[b] = p[sizeof(T) - 1 - b];
+    }
+    else
+    {
+        std::memcpy(tmp, p, sizeof(T));
+    }
+    T value;
+    std::memcpy(&value, tmp, sizeof(T));
+    return value;
+}
+
+int32_t byteSwapped32(int32_t v)
+{
+    const uint32_t u = static_cast<uint32_t>(v);
+    return static_cast<int32_t>((u >> 24) | ((u >> 8) & 0xFF00u) | ((u << 8) & 0xFF0000u) | (u << 24));
+}
+
+template <typename T>
+void writeField(std::vector<unsigned char> &bytes, size_t offset, T value)
+{
+    std::memcpy(bytes.data() + offset, &value, sizeof(T));
+}
+
+// Quaternion of a rotation (columns of unit length), after
+// nifti_mat44_to_quatern: b, c, d and the qfac of pixdim[0] for a left-handed
+// frame, whose third column is flipped first.
+void rotationToQuaternion(double r[3][3], float quatern[3], float &qfac)
+{
+    const double det = r[0][0] * (r[1][1] * r[2][2] - r[1][2] * r[2][1]) -
+                       r[0][1] * (r[1][0] * r[2][2] - r[1][2] * r[2][0]) +
+                       r[0][2] * (r[1][0] * r[2][1] - r[1][1] * r[2][0]);
+    qfac = det < 0.0 ? -1.0f : 1.0f;
+    if (det < 0.0)
+        for (int row = 0; row < 3; ++row)
+            r[row][2] = -r[row][2];
+
+    double a = r[0][0] + r[1][1] + r[2][2] + 1.0;
+    double b, c, d;
+    if (a > 0.5)
+    {
+        a = 0.5 * std::sqrt(a);
+        b = 0.25 * (r[2][1] - r[1][2]) / a;
+        c = 0.25 * (r[0][2] - r[2][0]) / a;
+        d = 0.25 * (r[1][0] - r[0][1]) / a;
+    }
+    else
+    {
+        const double xd = 1.0 + r[0][0] - (r[1][1] + r[2][2]);
+        const double yd = 1.0 + r[1][1] - (r[0][0] + r[2][2]);
+        const double zd = 1.0 + r[2][2] - (r[0][0] + r[1][1]);
+        if (xd > 1.0)
+        {
+            b = 0.5 * std::sqrt(xd);
+            c = 0.25 * (r[0][1] + r[1][0]) / b;
+            d = 0.25 * (r[0][2] + r[2][0]) / b;
+            a = 0.25 * (r[2][1] - r[1][2]) / b;
+        }
+        else if (yd > 1.0)
+        {
+            c = 0.5 * std::sqrt(yd);
+            b = 0.25 * (r[0][1] + r[1][0]) / c;
+            d = 0.25 * (r[1][2] + r[2][1]) / c;
+            a = 0.25 * (r[0][2] - r[2][0]) / c;
+        }
+        else
+        {
+            d = 0.5 * std::sqrt(zd);
+            b = 0.25 * (r[0][2] + r[2][0]) / d;
+            c = 0.25 * (r[1][2] + r[2][1]) / d;
+            a = 0.25 * (r[1][0] - r[0][1]) / d;
+        }
+        if (a < 0.0)
+        {
+            b = -b;
+            c = -c;
+            d = -d;
+        }
+    }
+    quatern[0] = static_cast<float>(b);
+    quatern[1] = static_cast<float>(c);
+    quatern[2] = static_cast<float>(d);
+}
+
+bool endsWith(const std::string &text, const std::string &suffix)
+{
+    return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+} // namespace
+
+size_t Header::extent(int axis) const
+{
+    if (axis < 0 || axis > 2 || axis + 1 > dim[0])
+        return 1;
+    return dim[axis + 1] > 0 ? static_cast<size_t>(dim[axis + 1]) : 0;
+}
+
+size_t Header::voxelCount() const
+{
+    return extent(0) * extent(1) * extent(2);
+}
+
+size_t Header::bytesPerVoxel() const
+{
+    switch (datatype)
+    {
+    case kUInt8:
+    case kInt8: return 1;
+    case kInt16:
+    case kUInt16: return 2;
+    case kInt32:
+    case kUInt32:
+    case kFloat32: return 4;
+    case kFloat64:
+    case kInt64:
+    case kUInt64: return 8;
+    default: return 0;
+    }
+}
+
+bool Header::isScaled() const
+{
+    // scl_slope == 0 means "no scaling" by the standard.
+    return std::isfinite(sclSlope) && sclSlope != 0.0 && (sclSlope != 1.0 || sclInter != 0.0);
+}
+
+bool Header::hasExtraDimensions() const
+{
+    for (int axis = 4; axis <= 7 && axis <= dim[0]; ++axis)
+        if (dim[axis] > 1)
+            return true;
+    return false;
+}
+
+bool parseHeader(const unsigned char *bytes, size_t size, Header &out, std::string *error)
+{
+    out = Header();
+    if (size < 348)
+    {
+        setError(error, "file is too short to hold a NIfTI header");
+        return false;
+    }
+
+    int32_t sizeofHdr = 0;
+    std::memcpy(&sizeofHdr, bytes, sizeof(sizeofHdr));
+    if (sizeofHdr != 348 && sizeofHdr != 540)
+    {
+        sizeofHdr = byteSwapped32(sizeofHdr);
+        out.swapped = true;
+    }
+
+    const bool swapped = out.swapped;
+    if (sizeofHdr == 348)
+    {
+        out.version = 1;
+        for (int i = 0; i < 8; ++i)
+            out.dim[i] = readField<int16_t>(bytes + 40 + 2 * i, swapped);
+        out.datatype = readField<int16_t>(bytes + 70, swapped);
+        out.bitpix = readField<int16_t>(bytes + 72, swapped);
+        for (int i = 0; i < 8; ++i)
+            out.pixdim[i] = readField<float>(bytes + 76 + 4 * i, swapped);
+        out.voxOffset = static_cast<int64_t>(readField<float>(bytes + 108, swapped));
+        out.sclSlope = readField<float>(bytes + 112, swapped);
+        out.sclInter = readField<float>(bytes + 116, swapped);
+        out.singleFile = std::memcmp(bytes + 344, "n+1", 3) == 0;
+        if (!out.singleFile && std::memcmp(bytes + 344, "ni1", 3) != 0)
+        {
+            setError(error, "not a NIfTI-1 header (bad magic)");
+            return false;
+        }
+    }
+    else if (sizeofHdr == 540)
+    {
+        if (size < 540)
+        {
+            setError(error, "file is too short to hold a NIfTI-2 header");
+            return false;
+        }
+        out.version = 2;
+        out.singleFile = std::memcmp(bytes + 4, "n+2", 3) == 0;
+        if (!out.singleFile && std::memcmp(bytes + 4, "ni2", 3) != 0)
+        {
+            setError(error, "not a NIfTI-2 header (bad magic)");
+            return false;
+        }
+        out.datatype = readField<int16_t>(bytes + 12, swapped);
+        out.bitpix = readField<int16_t>(bytes + 14, swapped);
+        for (int i = 0; i < 8; ++i)
+            out.dim[i] = readField<int64_t>(bytes + 16 + 8 * i, swapped);
+        for (int i = 0; i < 8; ++i)
+            out.pixdim[i] = readField<double>(bytes + 104 + 8 * i, swapped);
+        out.voxOffset = readField<int64_t>(bytes + 168, swapped);
+        out.sclSlope = readField<double>(bytes + 176, swapped);
+        out.sclInter = readField<double>(bytes + 184, swapped);
+    }
+    else
+    {
+        setError(error, "not a NIfTI file (sizeof_hdr is neither 348 nor 540)");
+        return false;
+    }
+
+    if (out.dim[0] < 1 || out.dim[0] > 7)
+    {
+        setError(error, "NIfTI header has an invalid dim[0]");
+        return false;
+    }
+    // A single-file header is followed by at least the 4-byte extension flag.
+    if (out.singleFile && out.voxOffset < sizeofHdr)
+        out.voxOffset = (out.version == 1) ? 352 : 544;
+    return true;
+}
+
+bool readHeader(const std::string &path, Header &out, std::string *error)
+{
+    // gzread passes plain files through unchanged, so one path covers both.
+    gzFile in = gzopen(path.c_str(), "rb");
+    if (!in)
+    {
+        setError(error, "could not open '" + path + "'");
+        return false;
+    }
+    unsigned char bytes[540];
+    const int got = gzread(in, bytes, sizeof(bytes));
+    gzclose(in);
+    if (got <= 0)
+    {
+        setError(error, "could not read the header of '" + path + "'");
+        return false;
+    }
+    return parseHeader(bytes, static_cast<size_t>(got), out, error);
+}
+
+bool makeHeader(const size_t size[3], int datatype, const double spacing[3], const double origin[3],
+                const double direction[3][3], std::vector<unsigned char> &out)
+{
+    Header probe;
+    probe.datatype = datatype;
+    if (probe.bytesPerVoxel() == 0)
+        return false;
+    for (int axis = 0; axis < 3; ++axis)
+        if (size[axis] == 0 || size[axis] > 32767)
+            return false;
+
+    out.assign(352, 0);
+    writeField<int32_t>(out, 0, 348);
+    out[38] = 'r'; // "regular", as ITK and nibabel leave it
+    const int16_t dims[8] = {3, static_cast<int16_t>(size[0]), static_cast<int16_t>(size[1]),
+                             static_cast<int16_t>(size[2]), 1, 1, 1, 1};
+    for (int i = 0; i < 8; ++i)
+        writeField<int16_t>(out, 40 + 2 * i, dims[i]);
+    writeField<int16_t>(out, 70, static_cast<int16_t>(datatype));
+    writeField<int16_t>(out, 72, static_cast<int16_t>(8 * probe.bytesPerVoxel()));
+    writeField<float>(out, 108, 352.0f); // vox_offset
+    writeField<float>(out, 112, 1.0f);   // scl_slope
+    out[123] = 2 | 8;                    // xyzt_units: mm and s
+
+    // LPS to RAS flips the first two world axes.
+    const double flip[3] = {-1.0, -1.0, 1.0};
+    double rotation[3][3];
+    for (int row = 0; row < 3; ++row)
+    {
+        float srow[4];
+        for (int col = 0; col < 3; ++col)
+        {
+            rotation[row][col] = flip[row] * direction[row][col];
+            srow[col] = static_cast<float>(rotation[row][col] * spacing[col]);
+        }
+        srow[3] = static_cast<float>(flip[row] * origin[row]);
+        for (int i = 0; i < 4; ++i)
+            writeField<float>(out, 280 + 16 * row + 4 * i, srow[i]);
+        writeField<float>(out, 268 + 4 * row, srow[3]); // qoffset
+    }
+    // Columns of unit length, in case the direction carries rounding.
+    for (int col = 0; col < 3; ++col)
+    {
+        const double norm = std::sqrt(rotation[0][col] * rotation[0][col] + rotation[1][col] * rotation[1][col] +
+                                      rotation[2][col] * rotation[2][col]);
+        if (norm > 0.0)
+            for (int row = 0; row < 3; ++row)
+                rotation[row][col] /= norm;
+    }
+    float quatern[3];
+    float qfac = 1.0f;
+    rotationToQuaternion(rotation, quatern, qfac);
+    for (int i = 0; i < 3; ++i)
+        writeField<float>(out, 256 + 4 * i, quatern[i]);
+
+    const float pixdim[8] = {qfac, static_cast<float>(spacing[0]), static_cast<float>(spacing[1]),
+                             static_cast<float>(spacing[2]), 1.0f, 1.0f, 1.0f, 1.0f};
+    for (int i = 0; i < 8; ++i)
+        writeField<float>(out, 76 + 4 * i, pixdim[i]);
+    writeField<int16_t>(out, 252, 1); // qform_code: scanner
+    writeField<int16_t>(out, 254, 1); // sform_code: scanner
+    std::memcpy(out.data() + 344, "n+1", 4);
+    return true;
+}
+
+bool writeVolume(const std::string &path, const std::vector<unsigned char> &header, const void *voxels,
+                 size_t bytes, int level, std::string *error)
+{
+    // `voxels` may be pages of a file mapped from `path` itself (an unedited
+    // .nii saved over its source). Truncating that file would pull them from
+    // under the writer, so the volume goes to a file beside it first and is
+    // renamed over the target only once it is complete.
+    const std::string part = path + ".part";
+    if (endsWith(path, ".gz"))
+    {
+        if (!gzip::writeFile(part, {{header.data(), header.size()}, {voxels, bytes}}, level, error))
+            return false;
+    }
+    else
+    {
+        std::ofstream out(part, std::ios::binary | std::ios::trunc);
+        if (!out)
+        {
+            setError(error, "could not open '" + part + "' for writing");
+            return false;
+        }
+        out.write(reinterpret_cast<const char *>(header.data()), static_cast<std::streamsize>(header.size()));
+        out.write(static_cast<const char *>(voxels), static_cast<std::streamsize>(bytes));
+        out.close();
+        if (out.fail())
+        {
+            setError(error, "could not write '" + path + "'");
+            std::remove(part.c_str());
+            return false;
+        }
+    }
+    if (!replaceFile(part, path, error))
+    {
+        std::remove(part.c_str());
+        return false;
+    }
+    return true;
+}
+
+} // namespace nifti
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Raw NIfTI-1 / NIfTI-2 header fields. ITK reports geometry but hides where the
+// voxels start and how they are stored, which is exactly what a loader that
+// decodes the data itself needs. Writes single-file NIfTI-1 volumes too. Uses
+// only zlib.
+namespace nifti
+{
+
+// NIFTI_TYPE_* codes for the scalar types a volume can hold.
+enum DataType : int
+{
+    kUInt8 = 2,
+    kInt16 = 4,
+    kInt32 = 8,
+    kFloat32 = 16,
+    kFloat64 = 64,
+    kInt8 = 256,
+    kUInt16 = 512,
+    kUInt32 = 768,
+    kInt64 = 1024,
+    kUInt64 = 1280
+};
+
+struct Header
+{
+    int version = 0;      // 1 or 2
+    bool swapped = false; // stored with the other byte order than this machine's
+    int64_t dim[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    int datatype = 0;
+    int bitpix = 0;
+    double pixdim[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    int64_t voxOffset = 0;
+    double sclSlope = 0.0;
+    double sclInter = 0.0;
+    bool singleFile = true; // "n+1"/"n+2"; false for a .hdr/.img pair
+
+    /// Extent of image axis 0..2; axes past dim[0] count as 1.
+    size_t extent(int axis) const;
+    size_t voxelCount() const; // first 3D volume only
+    /// Bytes per voxel for the scalar types in DataType, 0 for anything else.
+    size_t bytesPerVoxel() const;
+    /// True when scl_slope/scl_inter change the stored values.
+    bool isScaled() const;
+    /// True when dims 4..7 hold more than one volume.
+    bool hasExtraDimensions() const;
+};
+
+/// Parse a header from its first bytes (348 for NIfTI-1, 540 for NIfTI-2).
+bool parseHeader(const unsigned char *bytes, size_t size, Header &out, std::string *error);
+
+/// Read and parse the header of a .nii or .nii.gz file without touching voxels.
+bool readHeader(const std::string &path, Header &out, std::string *error);
+
+/// A single-file NIfTI-1 header for a 3D volume, followed by the empty
+/// extension flag so the voxels start at byte 352. Geometry is ITK's (LPS,
+/// direction[row][column]) and is stored the way ITK's writer stores it: the
+/// same RAS transform as qform and sform, in mm. False when an axis does not
+/// fit NIfTI-1's 16-bit dimensions.
+bool makeHeader(const size_t size[3], int datatype, const double spacing[3], const double origin[3],
+                const double direction[3][3], std::vector<unsigned char> &out);
+
+/// Write `header` and then `bytes` of voxels to `path`, deflated over all cores
+/// at zlib `level` when the path ends in ".gz" and as they are otherwise. The
+/// file is written as `path` + ".part" and renamed over `path` when complete,
+/// so `voxels` may be mapped from the file being replaced. On Windows a
+/// mapped `path` (see MappedFile) is first renamed to `path` + ".replaced",
+/// which is deleted once nothing maps it.
+bool writeVolume(const std::string &path, const std::vector<unsigned char> &header, const void *voxels,
+                 size_t bytes, int level, std::string *error);
+
+} // namespace nifti
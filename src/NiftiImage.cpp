@@ -1,27 +1,221 @@
 #include "NiftiImage.h"
+#include "MappedFile.h"
+#include "NiftiHeader.h"
 #include <itkImageFileReader.h>
 #include <itkImageSeriesReader.h>
-#include <itkMinimumMaximumImageCalculator.h>
 #include <itkImageFileWriter.h>
 #include <itkNiftiImageIO.h>
 #include <itkGDCMImageIO.h>
 #include <itkGDCMSeriesFileNames.h>
 #include <itkImageRegionIterator.h>
 #include <itkImageDuplicator.h>
+#include <itkEventObject.h>
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <deque>
 #include <filesystem>
-#include <unordered_set>
+#include <iterator>
+#include <limits>
+#include <mutex>
+#include <thread>
 #include <cmath>
 #include <zlib.h>
-#include <cstdio>
+#include <cstring>
 #include <fstream>
 #include <sstream>
+#include <stdexcept>
 #include <itkImageIOFactory.h>
 #include <itkImageIOBase.h>
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define NIFTI_HAVE_AVX2_KERNELS 1
+#else
+#define NIFTI_HAVE_AVX2_KERNELS 0
+#endif
+
+namespace
+{
+
+#if NIFTI_HAVE_AVX2_KERNELS
+bool cpuHasAvx2()
+{
+    // __builtin_cpu_supports also checks that the OS saves the AVX state.
+    static const bool has = __builtin_cpu_supports("avx2");
+    return has;
+}
+#endif
+
+template <typename T>
+using Volume = itk::Image<T, 3>;
+
+// Call f with a value of the C++ type that holds `storage`.
+template <typename F>
+void forStorage(NiftiImage::StorageType storage, F &&f)
+{
+    switch (storage)
+    {
+    case NiftiImage::StorageType::UInt8: f(uint8_t()); break;
+    case NiftiImage::StorageType::Int8: f(int8_t()); break;
+    case NiftiImage::StorageType::UInt16: f(uint16_t()); break;
+    case NiftiImage::StorageType::Int16: f(int16_t()); break;
+    default: f(PixelType()); break;
+    }
+}
+
+// The types worth keeping as they are stored. 32-bit integers would save
+// nothing over float, and 64-bit ones do not fit it exactly anyway.
+NiftiImage::StorageType storageForComponent(itk::ImageIOBase::IOComponentType component)
+{
+    switch (component)
+    {
+    case itk::ImageIOBase::UCHAR: return NiftiImage::StorageType::UInt8;
+    case itk::ImageIOBase::CHAR: return NiftiImage::StorageType::Int8;
+    case itk::ImageIOBase::USHORT: return NiftiImage::StorageType::UInt16;
+    case itk::ImageIOBase::SHORT: return NiftiImage::StorageType::Int16;
+    default: return NiftiImage::StorageType::Float32;
+    }
+}
+
+const char *storageName(NiftiImage::StorageType storage)
+{
+    switch (storage)
+    {
+    case NiftiImage::StorageType::UInt8: return "uint8";
+    case NiftiImage::StorageType::Int8: return "int8";
+    case NiftiImage::StorageType::UInt16: return "uint16";
+    case NiftiImage::StorageType::Int16: return "int16";
+    default: return "float32";
+    }
+}
+
+// numpy's name for an ITK component type, as readMetadata() reports it.
+const char *componentName(itk::ImageIOBase::IOComponentType component)
+{
+    switch (component)
+    {
+    case itk::ImageIOBase::UCHAR: return "uint8";
+    case itk::ImageIOBase::CHAR: return "int8";
+    case itk::ImageIOBase::USHORT: return "uint16";
+    case itk::ImageIOBase::SHORT: return "int16";
+    case itk::ImageIOBase::UINT: return "uint32";
+    case itk::ImageIOBase::INT: return "int32";
+    case itk::ImageIOBase::ULONG: return sizeof(unsigned long) == 8 ? "uint64" : "uint32";
+    case itk::ImageIOBase::LONG: return sizeof(long) == 8 ? "int64" : "int32";
+    case itk::ImageIOBase::ULONGLONG: return "uint64";
+    case itk::ImageIOBase::LONGLONG: return "int64";
+    case itk::ImageIOBase::FLOAT: return "float32";
+    case itk::ImageIOBase::DOUBLE: return "float64";
+    default: return "unknown";
+    }
+}
+
+nifti::DataType niftiDatatype(NiftiImage::StorageType storage)
+{
+    switch (storage)
+    {
+    case NiftiImage::StorageType::UInt8: return nifti::kUInt8;
+    case NiftiImage::StorageType::Int8: return nifti::kInt8;
+    case NiftiImage::StorageType::UInt16: return nifti::kUInt16;
+    case NiftiImage::StorageType::Int16: return nifti::kInt16;
+    default: return nifti::kFloat32;
+    }
+}
+
+// VolumeCache files are only read on the machine that wrote them, so fields
+// are in its byte order; kCacheByteOrder tells a foreign file apart. Slabs of
+// about kCacheSlabBytes are deflated (or not) independently, and the first one
+// starts on a page boundary so a file without deflated slabs maps in place.
+constexpr char kCacheMagic[4] = {'R', 'V', 'C', '1'};
+constexpr uint32_t kCacheByteOrder = 0x01020304u;
+constexpr size_t kCacheSlabBytes = size_t(4) << 20;
+constexpr size_t kCachePageBytes = 4096;
+
+void putCacheBytes(std::vector<unsigned char> &out, const void *data, size_t size)
+{
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    out.insert(out.end(), bytes, bytes + size);
+}
+
+template <typename T>
+void putCacheField(std::vector<unsigned char> &out, T value)
+{
+    putCacheBytes(out, &value, sizeof(T));
+}
+
+// Bounds-checked reads of a cache file; `ok` drops at the first short read.
+struct CacheReader
+{
+    const unsigned char *data = nullptr;
+    size_t size = 0;
+    size_t pos = 0;
+    bool ok = true;
+
+    const unsigned char *take(size_t n)
+    {
+        if (!ok || n > size - pos)
+        {
+            ok = false;
+            return nullptr;
+        }
+        pos += n;
+        return data + pos - n;
+    }
+    template <typename T>
+    T get()
+    {
+        T value = T();
+        if (const unsigned char *p = take(sizeof(T)))
+            std::memcpy(&value, p, sizeof(T));
+        return value;
+    }
+};
+
+struct CacheSlab
+{
+    uint64_t offset = 0;
+    uint64_t stored = 0; // equal to raw when the slab is not deflated
+    uint64_t raw = 0;
+};
+
+itk::ImageBase<3>::Pointer newVolume(NiftiImage::StorageType storage)
+{
+    itk::ImageBase<3>::Pointer image;
+    forStorage(storage, [&](auto tag) { image = Volume<decltype(tag)>::New().GetPointer(); });
+    return image;
+}
+
+// Forward an ITK reader's progress to a load monitor, aborting the read when
+// the monitor cancels it; Update() then throws ProcessAborted.
+template <typename Reader>
+void watchReader(Reader *reader, const NiftiImage::LoadMonitor &monitor)
+{
+    if (!monitor.progress)
+        return;
+    reader->AddObserver(itk::ProgressEvent(), [reader, &monitor](const itk::EventObject &)
+                        {
+                            if (!monitor.progress(reader->GetProgress()))
+                                reader->AbortGenerateDataOn();
+                        });
+}
+
+} // namespace
+
+template <typename F>
+void NiftiImage::visitVolume(F &&f) const
+{
+    forStorage(m_storage, [&](auto tag)
+               { f(static_cast<Volume<decltype(tag)> *>(m_image.GetPointer())); });
+}
 
 NiftiImage::NiftiImage() {}
 NiftiImage::~NiftiImage() {}
 
+bool NiftiImage::continueLoad(float fraction) const
+{
+    return !m_monitor.progress || m_monitor.progress(fraction);
+}
+
 bool NiftiImage::load(const std::string &path)
 {
     m_spacingX = 1.0;
@@ -32,7 +226,7 @@ bool NiftiImage::load(const std::string &path)
     {
         if (p.size() < suf.size())
             return false;
-        return std::equal(suf.rbegin(), suf.rend(), p.rbegin(), p.rend(), [](char a, char b)
+        return std::equal(suf.rbegin(), suf.rend(), p.rbegin(), [](char a, char b)
                           { return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b)); });
     };
 
@@ -64,79 +258,29 @@ bool NiftiImage::load(const std::string &path)
         }
     }
 
-    // If .nii.gz, decompress to a temporary .nii to avoid any plugin quirks.
-    std::string actualPath = path;
-    std::string tempPath;
-
-    auto cleanupTemp = [&]() {
-        if (!tempPath.empty())
-        {
-            std::error_code ec;
-            std::filesystem::remove(tempPath, ec);
-        }
-    };
-
-    auto decompressGzip = [&](const std::string &src, const std::string &dst) -> bool
+    // A .nii is mapped and a .nii.gz inflated straight into the image buffer.
+    // Anything those paths do not handle (odd datatypes, 4D, .hdr/.img pairs)
+    // goes to ITK below, which reads either kind of file itself.
+    if (has_suffix_ci(path, ".nii") && loadNiftiMapped(path))
     {
-        gzFile in = gzopen(src.c_str(), "rb");
-        if (!in)
-        {
-            std::cerr << "NiftiImage::load: failed to open gzip source: " << src << "\n";
-            return false;
-        }
-        FILE *out = std::fopen(dst.c_str(), "wb");
-        if (!out)
-        {
-            std::cerr << "NiftiImage::load: failed to open temp output: " << dst << "\n";
-            gzclose(in);
-            return false;
-        }
-        constexpr size_t CHUNK = 1 << 15;
-        std::vector<unsigned char> buf(CHUNK);
-        int readBytes = 0;
-        while ((readBytes = gzread(in, buf.data(), static_cast<unsigned int>(buf.size()))) > 0)
-        {
-            if (std::fwrite(buf.data(), 1, static_cast<size_t>(readBytes), out) != static_cast<size_t>(readBytes))
-            {
-                std::cerr << "NiftiImage::load: write error while decompressing " << src << "\n";
-                gzclose(in);
-                std::fclose(out);
-                return false;
-            }
-        }
-        gzclose(in);
-        std::fclose(out);
+        finalizeLoad(path);
         return true;
-    };
-
-    if (has_suffix_ci(path, ".nii.gz"))
+    }
+    if (has_suffix_ci(path, ".nii.gz") && loadNiftiStreaming(path))
     {
-        try
-        {
-            auto tmpdir = std::filesystem::temp_directory_path();
-            auto stem = std::filesystem::path(path).stem().string(); // stem of .nii.gz -> .nii
-            tempPath = (tmpdir / (stem + "_decompressed.nii")).string();
-            if (!decompressGzip(path, tempPath))
-            {
-                cleanupTemp();
-                return false;
-            }
-            actualPath = tempPath;
-        }
-        catch (const std::exception &e)
-        {
-            std::cerr << "NiftiImage::load: failed to create temp for gzip: " << e.what() << "\n";
-            cleanupTemp();
-            return false;
-        }
+        finalizeLoad(path);
+        return true;
     }
+    // A cancelled load stays cancelled rather than starting over in ITK.
+    if (!continueLoad(0.0f))
+        return false;
 
     // Defensive diagnostics: ensure the file exists before trying to read
     try
     {
-        if (!std::filesystem::exists(actualPath))
+        if (!std::filesystem::exists(path))
         {
-            std::cerr << "NiftiImage::load: file does not exist: " << actualPath << std::endl;
+            std::cerr << "NiftiImage::load: file does not exist: " << path << std::endl;
             return false;
         }
     }
@@ -145,21 +289,32 @@ bool NiftiImage::load(const std::string &path)
         std::cerr << "NiftiImage::load: filesystem check error: " << e.what() << "\n";
     }
 
-    // Read directly into float using NIfTI IO (ITK handles conversion from
-    // integer types, preserving signedness and scl_slope/scl_inter).
+    // Read through NIfTI IO into the storage type for the file's component
+    // type. ITK handles the conversion, preserving signedness, and reports
+    // data with scl_slope/scl_inter as float, so that stays float here too.
     try
     {
         itk::NiftiImageIO::Pointer nio = itk::NiftiImageIO::New();
-        nio->SetFileName(actualPath);
+        nio->SetFileName(path);
         nio->ReadImageInformation();
         m_component = nio->GetComponentType();
 
-        using ReaderType = itk::ImageFileReader<ImageType>;
-        ReaderType::Pointer reader = ReaderType::New();
-        reader->SetImageIO(nio);
-        reader->SetFileName(actualPath);
-        reader->Update();
-        m_image = reader->GetOutput();
+        const StorageType storage = storageForComponent(m_component);
+        itk::ImageBase<3>::Pointer image;
+        forStorage(storage, [&](auto tag)
+                   {
+                       using ReaderType = itk::ImageFileReader<Volume<decltype(tag)>>;
+                       typename ReaderType::Pointer reader = ReaderType::New();
+                       reader->SetImageIO(nio);
+                       reader->SetFileName(path);
+                       watchReader(reader.GetPointer(), m_monitor);
+                       reader->Update();
+                       image = reader->GetOutput().GetPointer();
+                   });
+        m_image = image;
+        m_storage = storage;
+        m_mapping.reset();
+        m_lazy.reset();
         if (!m_image)
         {
             std::cerr << "NiftiImage::load: reader produced null output for '" << path << "'" << std::endl;
@@ -205,86 +360,345 @@ bool NiftiImage::load(const std::string &path)
     }
 
     finalizeLoad(path);
-    cleanupTemp();
     return true;
 }
 
-// Load a DICOM volume from either a directory of slices or a single DICOM file.
-// When given a single file, the whole series it belongs to is reconstructed.
-bool NiftiImage::loadDicomSeries(const std::string &path)
+namespace
 {
-    try
+
+// Widen `count` samples of an ITK component type to float; false for types a
+// DICOM slice does not come in.
+bool componentsToFloat(const unsigned char *src, itk::ImageIOBase::IOComponentType component, size_t count,
+                       float *dst)
+{
+    auto widen = [&](auto tag)
     {
-        std::error_code ec;
-        const bool isDir = std::filesystem::is_directory(path, ec);
-        std::string dir = isDir ? path : std::filesystem::path(path).parent_path().string();
-        if (dir.empty())
-            dir = ".";
+        using S = decltype(tag);
+        for (size_t i = 0; i < count; ++i)
+        {
+            S value;
+            std::memcpy(&value, src + i * sizeof(S), sizeof(S));
+            dst[i] = static_cast<float>(value);
+        }
+    };
+    switch (component)
+    {
+    case itk::ImageIOBase::UCHAR: widen(uint8_t()); return true;
+    case itk::ImageIOBase::CHAR: widen(int8_t()); return true;
+    case itk::ImageIOBase::USHORT: widen(uint16_t()); return true;
+    case itk::ImageIOBase::SHORT: widen(int16_t()); return true;
+    case itk::ImageIOBase::UINT: widen(uint32_t()); return true;
+    case itk::ImageIOBase::INT: widen(int32_t()); return true;
+    case itk::ImageIOBase::FLOAT: widen(float()); return true;
+    case itk::ImageIOBase::DOUBLE: widen(double()); return true;
+    default: return false;
+    }
+}
 
-        itk::GDCMSeriesFileNames::Pointer names = itk::GDCMSeriesFileNames::New();
-        names->SetUseSeriesDetails(true);
-        names->SetDirectory(dir);
+// Decode a series that GDCMSeriesFileNames has already sorted by slice
+// position. Slices are shared out across the cores, and each is read by its
+// own GDCMImageIO straight into its Z plane (through a small buffer when it
+// has to be widened to float). Rescale Slope/Intercept are applied per slice
+// by GDCM, as in ITK's series reader. Null when the series is not uniform
+// (slice size or pixel type differ) or a slice cannot be read, so the caller
+// can fall back to that reader; `cancelled` is set when the monitor stopped it.
+itk::ImageBase<3>::Pointer readDicomSeriesParallel(const std::vector<std::string> &fileNames,
+                                                   itk::GDCMImageIO *first, NiftiImage::StorageType storage,
+                                                   const NiftiImage::LoadMonitor &monitor, bool &cancelled,
+                                                   unsigned int &threadsUsed)
+{
+    const itk::ImageIOBase::IOComponentType component = first->GetComponentType();
+    const size_t sx = first->GetDimensions(0);
+    const size_t sy = first->GetDimensions(1);
+    const size_t count = fileNames.size();
+    const bool multiFrame = first->GetNumberOfDimensions() > 2 && first->GetDimensions(2) > 1;
+    if (count < 2 || multiFrame || first->GetNumberOfComponents() != 1 || sx == 0 || sy == 0)
+        return nullptr;
+    // Read straight into the plane when GDCM already produces the storage type.
+    const bool direct = storage != NiftiImage::StorageType::Float32 || component == itk::ImageIOBase::FLOAT;
+    if (!direct)
+    {
+        float probe = 0.0f;
+        const unsigned char zero[8] = {};
+        if (!componentsToFloat(zero, component, 1, &probe))
+            return nullptr;
+    }
 
-        const std::vector<std::string> &seriesUIDs = names->GetSeriesUIDs();
-        if (seriesUIDs.empty())
+    itk::ImageBase<3>::Pointer image = newVolume(storage);
+    itk::Size<3> size;
+    size[0] = sx;
+    size[1] = sy;
+    size[2] = count;
+    itk::Index<3> start;
+    start.Fill(0);
+    image->SetRegions(itk::ImageRegion<3>(start, size));
+    unsigned char *base = nullptr;
+    size_t voxelBytes = 0;
+    forStorage(storage, [&](auto tag)
+               {
+                   auto *volume = static_cast<Volume<decltype(tag)> *>(image.GetPointer());
+                   volume->Allocate();
+                   base = reinterpret_cast<unsigned char *>(volume->GetBufferPointer());
+                   voxelBytes = sizeof(tag);
+               });
+    const size_t sliceVoxels = sx * sy;
+
+    std::vector<std::array<double, 3>> positions(count);
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> done{0};
+    std::atomic<bool> stop{false};
+    std::atomic<bool> failed{false};
+    const size_t centralZ = count / 2;
+    std::atomic<bool> centralDecoded{false};
+    std::mutex errorMutex;
+    std::string error;
+
+    auto decode = [&](size_t z)
+    {
+        itk::GDCMImageIO::Pointer io = itk::GDCMImageIO::New();
+        io->SetFileName(fileNames[z]);
+        io->ReadImageInformation();
+        if (io->GetDimensions(0) != sx || io->GetDimensions(1) != sy || io->GetComponentType() != component ||
+            io->GetNumberOfComponents() != 1)
+            throw std::runtime_error("'" + fileNames[z] + "' differs in size or pixel type from the first slice");
+        for (unsigned int axis = 0; axis < 3; ++axis)
+            positions[z][axis] = io->GetOrigin(axis);
+        unsigned char *plane = base + z * sliceVoxels * voxelBytes;
+        if (direct)
         {
-            std::cerr << "NiftiImage::loadDicomSeries: no DICOM series found in '" << dir << "'\n";
-            return false;
+            io->Read(plane);
+            return;
+        }
+        std::vector<unsigned char> raw(sliceVoxels * io->GetComponentSize());
+        io->Read(raw.data());
+        componentsToFloat(raw.data(), component, sliceVoxels, reinterpret_cast<float *>(plane));
+    };
+
+    // The calling thread decodes too, and is the only one that talks to the
+    // monitor, so its callbacks never run concurrently.
+    auto work = [&](bool reporter)
+    {
+        bool centralSent = !monitor.centralSlice;
+        while (!stop.load())
+        {
+            const size_t z = next++;
+            if (z >= count)
+                break;
+            try
+            {
+                decode(z);
+            }
+            catch (const std::exception &e)
+            {
+                std::lock_guard<std::mutex> lock(errorMutex);
+                if (error.empty())
+                    error = e.what();
+                failed = true;
+                stop = true;
+                break;
+            }
+            if (z == centralZ)
+                centralDecoded = true;
+            ++done;
+            if (!reporter)
+                continue;
+            if (!centralSent && centralDecoded.load())
+            {
+                std::vector<float> slice(sliceVoxels);
+                forStorage(storage, [&](auto tag)
+                           {
+                               const auto *src = reinterpret_cast<const decltype(tag) *>(base) + centralZ * sliceVoxels;
+                               std::copy(src, src + sliceVoxels, slice.begin());
+                           });
+                monitor.centralSlice(slice, static_cast<unsigned int>(sx), static_cast<unsigned int>(sy));
+                centralSent = true;
+            }
+            if (monitor.progress && !monitor.progress(static_cast<float>(done.load()) / static_cast<float>(count)))
+            {
+                cancelled = true;
+                stop = true;
+            }
         }
+    };
 
-        // If a single file was selected, prefer the series that contains it;
-        // otherwise fall back to the series with the most slices.
-        std::string targetFile;
-        if (!isDir)
-            targetFile = std::filesystem::absolute(path, ec).string();
+    const unsigned int hardware = std::max(1u, std::thread::hardware_concurrency());
+    threadsUsed = static_cast<unsigned int>(std::min<size_t>(hardware, count));
+    std::vector<std::thread> helpers;
+    for (unsigned int t = 1; t < threadsUsed; ++t)
+        helpers.emplace_back(work, false);
+    work(true);
+    for (std::thread &helper : helpers)
+        helper.join();
 
-        std::string chosenUID;
-        std::vector<std::string> fileNames;
-        size_t bestCount = 0;
-        for (const std::string &uid : seriesUIDs)
+    if (cancelled)
+        return nullptr;
+    if (failed)
+    {
+        std::cerr << "NiftiImage::loadDicomSeries: parallel decode failed (" << error
+                  << "); using the series reader\n";
+        return nullptr;
+    }
+
+    // Geometry as ITK's series reader derives it: in-plane spacing and
+    // orientation from the first slice, the slice spacing from the distance
+    // between the first and last slice positions along the slice normal.
+    itk::ImageBase<3>::DirectionType direction;
+    for (unsigned int axis = 0; axis < 3; ++axis)
+    {
+        const std::vector<double> column = first->GetDirection(axis);
+        for (unsigned int row = 0; row < 3; ++row)
+            direction[row][axis] = row < column.size() ? column[row] : (row == axis ? 1.0 : 0.0);
+    }
+    double along = 0.0;
+    for (unsigned int row = 0; row < 3; ++row)
+        along += (positions[count - 1][row] - positions[0][row]) * direction[row][2];
+    double sliceSpacing = along / static_cast<double>(count - 1);
+    if (sliceSpacing < 0.0)
+    {
+        for (unsigned int row = 0; row < 3; ++row)
+            direction[row][2] = -direction[row][2];
+        sliceSpacing = -sliceSpacing;
+    }
+    if (!std::isfinite(sliceSpacing) || sliceSpacing <= 0.0)
+        sliceSpacing = first->GetSpacing(2);
+
+    itk::ImageBase<3>::SpacingType spacing;
+    spacing[0] = first->GetSpacing(0);
+    spacing[1] = first->GetSpacing(1);
+    spacing[2] = sliceSpacing;
+    itk::ImageBase<3>::PointType origin;
+    for (unsigned int axis = 0; axis < 3; ++axis)
+        origin[axis] = positions[0][axis];
+    image->SetSpacing(spacing);
+    image->SetOrigin(origin);
+    image->SetDirection(direction);
+    return image;
+}
+
+// The slices of the series `path` stands for: for a directory, its largest
+// series; for a single file, the series that contains it. `seriesCount` is
+// how many series the directory holds. Throws what GDCM throws.
+bool chooseDicomSeries(const std::string &path, const char *caller, std::string &dir, std::string &chosenUID,
+                       std::vector<std::string> &fileNames, size_t &seriesCount)
+{
+    std::error_code ec;
+    const bool isDir = std::filesystem::is_directory(path, ec);
+    dir = isDir ? path : std::filesystem::path(path).parent_path().string();
+    if (dir.empty())
+        dir = ".";
+
+    itk::GDCMSeriesFileNames::Pointer names = itk::GDCMSeriesFileNames::New();
+    names->SetUseSeriesDetails(true);
+    names->SetDirectory(dir);
+
+    const std::vector<std::string> &seriesUIDs = names->GetSeriesUIDs();
+    seriesCount = seriesUIDs.size();
+    if (seriesUIDs.empty())
+    {
+        std::cerr << "NiftiImage::" << caller << ": no DICOM series found in '" << dir << "'\n";
+        return false;
+    }
+
+    // If a single file was selected, prefer the series that contains it;
+    // otherwise fall back to the series with the most slices.
+    std::string targetFile;
+    if (!isDir)
+        targetFile = std::filesystem::absolute(path, ec).string();
+
+    chosenUID.clear();
+    fileNames.clear();
+    size_t bestCount = 0;
+    for (const std::string &uid : seriesUIDs)
+    {
+        const std::vector<std::string> f = names->GetFileNames(uid);
+        if (!targetFile.empty())
         {
-            const std::vector<std::string> f = names->GetFileNames(uid);
-            if (!targetFile.empty())
+            bool match = false;
+            for (const std::string &fn : f)
             {
-                bool match = false;
-                for (const std::string &fn : f)
-                {
-                    std::error_code ec2;
-                    if (std::filesystem::equivalent(fn, targetFile, ec2))
-                    {
-                        match = true;
-                        break;
-                    }
-                }
-                if (match)
+                std::error_code ec2;
+                if (std::filesystem::equivalent(fn, targetFile, ec2))
                 {
-                    chosenUID = uid;
-                    fileNames = f;
+                    match = true;
                     break;
                 }
             }
-            if (f.size() > bestCount)
+            if (match)
             {
-                bestCount = f.size();
                 chosenUID = uid;
                 fileNames = f;
+                break;
             }
         }
-
-        if (fileNames.empty())
+        if (f.size() > bestCount)
         {
-            std::cerr << "NiftiImage::loadDicomSeries: empty file list for series in '" << dir << "'\n";
-            return false;
+            bestCount = f.size();
+            chosenUID = uid;
+            fileNames = f;
         }
+    }
+
+    if (fileNames.empty())
+    {
+        std::cerr << "NiftiImage::" << caller << ": empty file list for series in '" << dir << "'\n";
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+// Load a DICOM volume from either a directory of slices or a single DICOM file.
+// When given a single file, the whole series it belongs to is reconstructed.
+bool NiftiImage::loadDicomSeries(const std::string &path)
+{
+    try
+    {
+        std::string dir;
+        std::string chosenUID;
+        std::vector<std::string> fileNames;
+        size_t seriesCount = 0;
+        if (!chooseDicomSeries(path, "loadDicomSeries", dir, chosenUID, fileNames, seriesCount))
+            return false;
 
+        // The first slice decides the storage type. GDCM reports the type
+        // after Rescale Slope/Intercept, so a CT with slope 1 stays int16;
+        // any other slope can produce fractions and is read as float.
         itk::GDCMImageIO::Pointer dicomIO = itk::GDCMImageIO::New();
-        using SeriesReaderType = itk::ImageSeriesReader<ImageType>;
-        SeriesReaderType::Pointer reader = SeriesReaderType::New();
-        reader->SetImageIO(dicomIO);
-        reader->SetFileNames(fileNames);
-        reader->Update();
+        dicomIO->SetFileName(fileNames.front());
+        dicomIO->ReadImageInformation();
+        const StorageType storage = (dicomIO->GetRescaleSlope() == 1.0)
+                                        ? storageForComponent(dicomIO->GetComponentType())
+                                        : StorageType::Float32;
+
+        bool cancelled = false;
+        unsigned int threadsUsed = 1;
+        itk::ImageBase<3>::Pointer image =
+            readDicomSeriesParallel(fileNames, dicomIO, storage, m_monitor, cancelled, threadsUsed);
+        if (cancelled)
+        {
+            std::cerr << "NiftiImage::loadDicomSeries: cancelled '" << path << "'\n";
+            return false;
+        }
+        if (!image)
+        {
+            threadsUsed = 1;
+            forStorage(storage, [&](auto tag)
+                       {
+                           using SeriesReaderType = itk::ImageSeriesReader<Volume<decltype(tag)>>;
+                           typename SeriesReaderType::Pointer reader = SeriesReaderType::New();
+                           reader->SetImageIO(dicomIO);
+                           reader->SetFileNames(fileNames);
+                           watchReader(reader.GetPointer(), m_monitor);
+                           reader->Update();
+                           image = reader->GetOutput().GetPointer();
+                       });
+        }
 
-        m_image = reader->GetOutput();
+        m_image = image;
+        m_storage = storage;
+        m_mapping.reset();
+        m_lazy.reset();
         if (!m_image)
         {
             std::cerr << "NiftiImage::loadDicomSeries: reader produced null output for '" << path << "'\n";
@@ -306,7 +720,8 @@ bool NiftiImage::loadDicomSeries(const std::string &path)
             m_spacingZ = 1.0;
 
         std::cerr << "NiftiImage::loadDicomSeries: loaded series '" << chosenUID << "' from '" << dir
-                  << "' (" << fileNames.size() << " file(s), " << seriesUIDs.size() << " series in directory)\n";
+                  << "' (" << fileNames.size() << " file(s), " << seriesCount << " series in directory, "
+                  << threadsUsed << " decode thread(s))\n";
         return true;
     }
     catch (itk::ExceptionObject &e)
@@ -326,83 +741,812 @@ bool NiftiImage::loadDicomSeries(const std::string &path)
     }
 }
 
-// ============================================================================
-// NUMPY (.npz / .npy) IMPORT
-//
-// A numpy container stores samples and nothing else: no spacing, no origin, no
-// orientation, and no agreed axis convention. Everything below exists to pin
-// those down before the array is treated as a medical volume, because guessing
-// wrong silently mirrors axes or reports distances and volumes in the wrong
-// units — errors that look like plausible anatomy on screen.
-// ============================================================================
+namespace
+{
 
-const char *npzAxisOrderName(NpzImportOptions::AxisOrder order)
+itk::ImageIOBase::IOComponentType componentForNiftiType(int datatype)
 {
-    switch (order)
+    switch (datatype)
     {
-    case NpzImportOptions::AxisOrder::XYZ: return "XYZ";
-    case NpzImportOptions::AxisOrder::XZY: return "XZY";
-    case NpzImportOptions::AxisOrder::YXZ: return "YXZ";
-    case NpzImportOptions::AxisOrder::YZX: return "YZX";
-    case NpzImportOptions::AxisOrder::ZXY: return "ZXY";
-    case NpzImportOptions::AxisOrder::ZYX: return "ZYX";
-    default: return "auto";
+    case nifti::kUInt8: return itk::ImageIOBase::UCHAR;
+    case nifti::kInt8: return itk::ImageIOBase::CHAR;
+    case nifti::kUInt16: return itk::ImageIOBase::USHORT;
+    case nifti::kInt16: return itk::ImageIOBase::SHORT;
+    case nifti::kUInt32: return itk::ImageIOBase::UINT;
+    case nifti::kInt32: return itk::ImageIOBase::INT;
+    case nifti::kUInt64: return itk::ImageIOBase::ULONGLONG;
+    case nifti::kInt64: return itk::ImageIOBase::LONGLONG;
+    case nifti::kFloat64: return itk::ImageIOBase::DOUBLE;
+    case nifti::kFloat32: return itk::ImageIOBase::FLOAT;
+    default: return itk::ImageIOBase::UNKNOWNCOMPONENTTYPE;
     }
 }
 
-namespace
-{
-
-// Geometry borrowed from a real medical volume sitting next to the array.
-struct ReferenceGeometry
+// The component type a NIfTI header loads as: ITK reports rescaled data as
+// float, and this file does the same so storage and mask detection agree.
+itk::ImageIOBase::IOComponentType loadedNiftiComponent(const nifti::Header &hdr)
 {
-    bool valid = false;
-    size_t size[3] = {0, 0, 0};
-    ImageType::SpacingType spacing;
-    ImageType::PointType origin;
-    ImageType::DirectionType direction;
-    std::string source;
-};
+    return hdr.isScaled() ? itk::ImageIOBase::FLOAT : componentForNiftiType(hdr.datatype);
+}
 
-// Read a volume's header only; the pixels are never needed here.
-bool readReferenceGeometry(const std::string &path, ReferenceGeometry &geom)
+// Stored samples to the storage type in one pass: byte order and
+// scl_slope/scl_inter are applied on the way, so the bytes are touched once.
+template <typename S, typename D>
+void convertNiftiSamples(const unsigned char *src, size_t count, const nifti::Header &hdr, D *dst)
 {
-    std::error_code ec;
-    if (!std::filesystem::exists(path, ec))
-        return false;
-    try
+    constexpr size_t N = sizeof(S);
+    const bool scaled = hdr.isScaled();
+    const double slope = hdr.sclSlope;
+    const double inter = hdr.sclInter;
+    for (size_t i = 0; i < count; ++i)
     {
-        itk::ImageIOBase::Pointer io =
-            itk::ImageIOFactory::CreateImageIO(path.c_str(), itk::ImageIOFactory::ReadMode);
-        if (io.IsNull())
-            return false;
-        io->SetFileName(path);
-        io->ReadImageInformation();
-        if (io->GetNumberOfDimensions() < 3)
-            return false;
-
-        geom.direction.SetIdentity();
-        for (unsigned int i = 0; i < 3; ++i)
+        S value;
+        if (hdr.swapped)
         {
-            geom.size[i] = io->GetDimensions(i);
-            const double s = io->GetSpacing(i);
-            geom.spacing[i] = (std::isfinite(s) && s > 0.0) ? s : 1.0;
-            geom.origin[i] = io->GetOrigin(i);
-            const std::vector<double> column = io->GetDirection(i);
-            for (unsigned int j = 0; j < 3 && j < column.size(); ++j)
-                geom.direction[j][i] = column[j];
+            unsigned char tmp[N];
+            for (size_t b = 0; b < N; ++b)
+                tmp[b] = src[i * N + (N - 1 - b)];
+            std::memcpy(&value, tmp, N);
         }
-        geom.valid = true;
-        geom.source = path;
-        return true;
+        else
+        {
+            std::memcpy(&value, src + i * N, N);
+        }
+        dst[i] = scaled ? static_cast<D>(static_cast<double>(value) * slope + inter) : static_cast<D>(value);
     }
-    catch (...)
+}
+
+template <typename D>
+void convertNiftiChunk(const unsigned char *src, size_t count, const nifti::Header &hdr, D *dst)
+{
+    switch (hdr.datatype)
     {
-        return false;
+    case nifti::kUInt8: convertNiftiSamples<uint8_t>(src, count, hdr, dst); break;
+    case nifti::kInt8: convertNiftiSamples<int8_t>(src, count, hdr, dst); break;
+    case nifti::kUInt16: convertNiftiSamples<uint16_t>(src, count, hdr, dst); break;
+    case nifti::kInt16: convertNiftiSamples<int16_t>(src, count, hdr, dst); break;
+    case nifti::kUInt32: convertNiftiSamples<uint32_t>(src, count, hdr, dst); break;
+    case nifti::kInt32: convertNiftiSamples<int32_t>(src, count, hdr, dst); break;
+    case nifti::kUInt64: convertNiftiSamples<uint64_t>(src, count, hdr, dst); break;
+    case nifti::kInt64: convertNiftiSamples<int64_t>(src, count, hdr, dst); break;
+    case nifti::kFloat32: convertNiftiSamples<float>(src, count, hdr, dst); break;
+    case nifti::kFloat64: convertNiftiSamples<double>(src, count, hdr, dst); break;
+    default: break;
     }
 }
 
-std::string stripNumpySuffix(const std::string &path)
+// RAII for the gzip handle, for the same reason as npz's FileHandle.
+struct GzHandle
+{
+    gzFile f = nullptr;
+    ~GzHandle()
+    {
+        if (f)
+            gzclose(f);
+    }
+};
+
+// Headers the decoders in this file handle themselves: one 3D volume of a
+// plain scalar type in a single file. Everything else is left to ITK.
+bool decodableNiftiHeader(const std::string &path, const char *caller, nifti::Header &hdr)
+{
+    std::string error;
+    if (!nifti::readHeader(path, hdr, &error))
+    {
+        std::cerr << "NiftiImage::" << caller << ": " << error << " ('" << path << "')\n";
+        return false;
+    }
+    if (!hdr.singleFile || hdr.bytesPerVoxel() == 0 || hdr.hasExtraDimensions() || hdr.voxelCount() == 0)
+    {
+        std::cerr << "NiftiImage::" << caller << ": datatype " << hdr.datatype << " / dim[0]=" << hdr.dim[0]
+                  << " is left to ITK ('" << path << "')\n";
+        return false;
+    }
+    return true;
+}
+
+// An unallocated volume of the storage type, with the size from `hdr` and the
+// geometry ITK derives from qform/sform, since turning those into an LPS
+// direction matrix is ITK's job and must match every other read path. Null
+// when the two disagree.
+itk::ImageBase<3>::Pointer imageForNiftiHeader(const std::string &path, const char *caller,
+                                               const nifti::Header &hdr, NiftiImage::StorageType storage)
+{
+    itk::NiftiImageIO::Pointer nio = itk::NiftiImageIO::New();
+    nio->SetFileName(path);
+    nio->ReadImageInformation();
+
+    ImageType::SizeType size;
+    ImageType::SpacingType spacing;
+    ImageType::PointType origin;
+    ImageType::DirectionType direction;
+    direction.SetIdentity();
+    const unsigned int ioDims = nio->GetNumberOfDimensions();
+    for (unsigned int i = 0; i < 3; ++i)
+    {
+        size[i] = hdr.extent(static_cast<int>(i));
+        if (i >= ioDims)
+        {
+            spacing[i] = 1.0;
+            origin[i] = 0.0;
+            continue;
+        }
+        if (nio->GetDimensions(i) != size[i])
+        {
+            std::cerr << "NiftiImage::" << caller << ": header and ITK disagree on the size of axis " << i
+                      << "; leaving '" << path << "' to ITK\n";
+            return nullptr;
+        }
+        spacing[i] = nio->GetSpacing(i);
+        origin[i] = nio->GetOrigin(i);
+        const std::vector<double> column = nio->GetDirection(i);
+        for (unsigned int j = 0; j < 3 && j < column.size(); ++j)
+            direction[j][i] = column[j];
+    }
+
+    ImageType::IndexType start;
+    start.Fill(0);
+    itk::ImageBase<3>::Pointer image = newVolume(storage);
+    image->SetRegions(ImageType::RegionType(start, size));
+    image->SetSpacing(spacing);
+    image->SetOrigin(origin);
+    image->SetDirection(direction);
+    return image;
+}
+
+// Histogram bins: one per value for 8- and 16-bit samples, offset so the bin
+// order is the value order. Floats use the top 16 bits of an order-preserving
+// key, i.e. one bin per bfloat16 value (8 significant bits).
+template <typename T>
+constexpr size_t kHistogramBins = sizeof(T) == 1 ? 256 : 65536;
+
+inline uint32_t histogramBin(uint8_t v) { return v; }
+inline uint32_t histogramBin(int8_t v) { return static_cast<uint8_t>(v) ^ 0x80u; }
+inline uint32_t histogramBin(uint16_t v) { return v; }
+inline uint32_t histogramBin(int16_t v) { return static_cast<uint16_t>(v) ^ 0x8000u; }
+inline uint32_t histogramBin(float v)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &v, sizeof(bits));
+    return ((bits & 0x80000000u) ? ~bits : bits | 0x80000000u) >> 16;
+}
+
+// The value a bin stands for: exact for integers, the bin centre for floats.
+float histogramBinValue(NiftiImage::StorageType storage, uint32_t bin)
+{
+    switch (storage)
+    {
+    case NiftiImage::StorageType::UInt8:
+    case NiftiImage::StorageType::UInt16: return static_cast<float>(bin);
+    case NiftiImage::StorageType::Int8: return static_cast<float>(static_cast<int>(bin) - 0x80);
+    case NiftiImage::StorageType::Int16: return static_cast<float>(static_cast<int>(bin) - 0x8000);
+    default: break;
+    }
+    const uint32_t key = (bin << 16) | 0x8000u;
+    const uint32_t bits = (key & 0x80000000u) ? (key & 0x7FFFFFFFu) : ~key;
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Running min/max of `count` floats, and whether any is fractional or NaN
+// (NaN is left out of the range). The scalar loop is for other CPUs: the
+// compiler will not vectorize the float min/max and trunc reduction itself.
+void floatSpanStatsScalar(const float *values, size_t count, float &lo, float &hi, bool &fractional)
+{
+    float spanLo = lo, spanHi = hi;
+    bool spanFractional = fractional;
+    for (size_t i = 0; i < count; ++i)
+    {
+        const float v = values[i];
+        spanLo = v < spanLo ? v : spanLo;
+        spanHi = v > spanHi ? v : spanHi;
+        spanFractional = spanFractional || v != std::trunc(v);
+    }
+    lo = spanLo;
+    hi = spanHi;
+    fractional = spanFractional;
+}
+
+#if NIFTI_HAVE_AVX2_KERNELS
+// Eight lanes at a time. _mm256_min_ps(v, lo) keeps lo when v is NaN, as the
+// scalar compare does; the integrality test is skipped once a fraction is seen.
+__attribute__((target("avx2"))) void floatSpanStatsAvx2(const float *values, size_t count, float &lo, float &hi,
+                                                       bool &fractional)
+{
+    __m256 vLo = _mm256_set1_ps(lo);
+    __m256 vHi = _mm256_set1_ps(hi);
+    __m256 vFractional = _mm256_setzero_ps();
+    size_t i = 0;
+    if (fractional)
+    {
+        for (; i + 8 <= count; i += 8)
+        {
+            const __m256 v = _mm256_loadu_ps(values + i);
+            vLo = _mm256_min_ps(v, vLo);
+            vHi = _mm256_max_ps(v, vHi);
+        }
+    }
+    else
+    {
+        for (; i + 8 <= count; i += 8)
+        {
+            const __m256 v = _mm256_loadu_ps(values + i);
+            vLo = _mm256_min_ps(v, vLo);
+            vHi = _mm256_max_ps(v, vHi);
+            const __m256 whole = _mm256_round_ps(v, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+            vFractional = _mm256_or_ps(vFractional, _mm256_cmp_ps(v, whole, _CMP_NEQ_UQ));
+        }
+    }
+    alignas(32) float lanes[8];
+    _mm256_store_ps(lanes, vLo);
+    for (const float v : lanes)
+        lo = v < lo ? v : lo;
+    _mm256_store_ps(lanes, vHi);
+    for (const float v : lanes)
+        hi = v > hi ? v : hi;
+    fractional = fractional || _mm256_movemask_ps(vFractional) != 0;
+    floatSpanStatsScalar(values + i, count - i, lo, hi, fractional);
+}
+#endif
+
+void floatSpanStats(const float *values, size_t count, float &lo, float &hi, bool &fractional)
+{
+#if NIFTI_HAVE_AVX2_KERNELS
+    if (cpuHasAvx2())
+    {
+        floatSpanStatsAvx2(values, count, lo, hi, fractional);
+        return;
+    }
+#endif
+    floatSpanStatsScalar(values, count, lo, hi, fractional);
+}
+
+struct VolumeStats
+{
+    float min = 0.0f;
+    float max = 0.0f;
+    bool integral = true;           // every value is a whole number
+    std::vector<uint64_t> histogram; // kHistogramBins<T> counts
+    size_t voxels = 0;
+};
+
+// Range, integrality and histogram of `sliceCount` Z slices in one read of
+// each, spread over the cores. `sliceAt(z, scratch)` returns slice z, either
+// in place or filled into `scratch` (a per-thread buffer). For floats the range
+// and integrality come from floatSpanStats() per row, ahead of the histogram
+// while the row is in L1; for 8/16-bit data the range comes from the histogram
+// and that pass is skipped.
+template <typename T, typename SliceAt>
+VolumeStats gatherVolumeStats(size_t sliceVoxels, unsigned int sliceCount, SliceAt sliceAt)
+{
+    constexpr bool isFloat = std::is_floating_point<T>::value;
+    constexpr size_t bins = kHistogramBins<T>;
+    VolumeStats stats;
+    stats.histogram.assign(bins, 0);
+    stats.voxels = sliceVoxels * sliceCount;
+    float lo = std::numeric_limits<float>::max();
+    float hi = std::numeric_limits<float>::lowest();
+    std::mutex mutex;
+    std::atomic<size_t> next{0};
+
+    auto work = [&]()
+    {
+        std::vector<uint64_t> counts(bins, 0);
+        float localLo = std::numeric_limits<float>::max();
+        float localHi = std::numeric_limits<float>::lowest();
+        bool localFractional = false;
+        std::vector<T> scratch;
+        constexpr size_t kRow = 1024;
+        for (size_t z = next++; z < sliceCount; z = next++)
+        {
+            const T *slice = sliceAt(static_cast<unsigned int>(z), scratch);
+            for (size_t start = 0; start < sliceVoxels; start += kRow)
+            {
+                const size_t end = std::min(sliceVoxels, start + kRow);
+                if constexpr (isFloat)
+                    floatSpanStats(slice + start, end - start, localLo, localHi, localFractional);
+                for (size_t i = start; i < end; ++i)
+                {
+                    if (isFloat && slice[i] != slice[i])
+                        continue; // NaN
+                    ++counts[histogramBin(slice[i])];
+                }
+            }
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t b = 0; b < bins; ++b)
+            stats.histogram[b] += counts[b];
+        lo = std::min(lo, localLo);
+        hi = std::max(hi, localHi);
+        stats.integral = stats.integral && !localFractional;
+    };
+
+    // A worker per core, but not for volumes too small to be worth a thread.
+    const size_t hardware = std::max(1u, std::thread::hardware_concurrency());
+    const size_t threads = std::max<size_t>(1, std::min(hardware, std::min<size_t>(sliceCount, stats.voxels >> 20)));
+    std::vector<std::thread> helpers;
+    for (size_t t = 1; t < threads; ++t)
+        helpers.emplace_back(work);
+    work();
+    for (std::thread &helper : helpers)
+        helper.join();
+
+    if (isFloat)
+    {
+        stats.min = lo <= hi ? lo : 0.0f;
+        stats.max = lo <= hi ? hi : 0.0f;
+        return stats;
+    }
+    const auto first = std::find_if(stats.histogram.begin(), stats.histogram.end(), [](uint64_t c) { return c != 0; });
+    if (first == stats.histogram.end())
+        return stats;
+    const auto last = std::find_if(stats.histogram.rbegin(), stats.histogram.rend(), [](uint64_t c) { return c != 0; });
+    const NiftiImage::StorageType storage = sizeof(T) == 1
+                                                ? (std::is_signed<T>::value ? NiftiImage::StorageType::Int8
+                                                                            : NiftiImage::StorageType::UInt8)
+                                                : (std::is_signed<T>::value ? NiftiImage::StorageType::Int16
+                                                                            : NiftiImage::StorageType::UInt16);
+    stats.min = histogramBinValue(storage, static_cast<uint32_t>(first - stats.histogram.begin()));
+    stats.max = histogramBinValue(storage, static_cast<uint32_t>(bins - 1 - (last - stats.histogram.rbegin())));
+    return stats;
+}
+
+} // namespace
+
+// Converts a mapped volume into m_image one Z slice at a time, the first time
+// the slice is read. Until then single voxels are converted from the mapping,
+// so a sagittal or coronal view does not force every slice in.
+struct LazySlabConverter
+{
+    std::function<void(const unsigned char *, size_t, void *)> convert;
+    const unsigned char *source = nullptr; // first stored sample
+    size_t sampleBytes = 0;
+    size_t sliceVoxels = 0;
+    unsigned char *target = nullptr; // first voxel of the image buffer
+    size_t targetBytes = 0;          // bytes per voxel of the storage type
+    std::unique_ptr<std::atomic<bool>[]> ready;
+    std::mutex mutex;
+
+    bool isReady(size_t z) const { return ready[z].load(std::memory_order_acquire); }
+
+    void materialize(size_t z)
+    {
+        if (isReady(z))
+            return;
+        std::lock_guard<std::mutex> lock(mutex);
+        if (isReady(z))
+            return;
+        convert(source + z * sliceVoxels * sampleBytes, sliceVoxels, target + z * sliceVoxels * targetBytes);
+        ready[z].store(true, std::memory_order_release);
+    }
+
+    // Voxel `index` into `dst`, which holds one storage-type value.
+    void convertOne(size_t index, void *dst) const { convert(source + index * sampleBytes, 1, dst); }
+};
+
+// The voxels again with X outermost, then Z, then Y: axes (Y, Z, X). A sagittal
+// slice is then one contiguous block rather than a voxel per row stride.
+// Shared by every shallow copy of the image, so a copy held by a worker can
+// build it. An in-place edit discards it; `version` lets a build that raced
+// with the edit notice and drop its result.
+struct SagittalLayout
+{
+    std::mutex mutex;
+    std::atomic<bool> ready{false};
+    unsigned int version = 0;
+    itk::ImageBase<3>::Pointer copy;
+
+    void discard()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++version;
+        ready.store(false, std::memory_order_release);
+        copy = nullptr;
+    }
+};
+
+// The voxels as they were before one in-place edit: the axial slices (slabs)
+// it changed, or the whole former volume when it changed the storage type.
+// Promoting allocates a new buffer, so the old one is kept rather than copied.
+struct UndoLevel
+{
+    NiftiImage::StorageType storage = NiftiImage::StorageType::Float32;
+    itk::ImageBase<3>::Pointer image; // set when the edit changed the storage type
+    std::shared_ptr<MappedFile> mapping;
+    std::shared_ptr<LazySlabConverter> lazy;
+    std::vector<std::pair<unsigned int, std::vector<unsigned char>>> slabs; // slice index, former bytes
+    size_t bytes = 0;
+};
+
+// Undo levels, oldest first.
+struct EditHistory
+{
+    std::deque<UndoLevel> levels;
+    size_t bytes = 0;
+    size_t edits = 0; // recorded and not undone, trimmed levels included
+
+    // Drop the oldest levels until the rest fit `budget`.
+    void trim(size_t budget)
+    {
+        while (!levels.empty() && bytes > budget)
+        {
+            bytes -= levels.front().bytes;
+            levels.pop_front();
+        }
+    }
+};
+
+// Decode a .nii.gz without a temporary file: the header is parsed from the
+// gzip stream and the voxels are inflated chunk by chunk straight into the
+// image buffer.
+bool NiftiImage::loadNiftiStreaming(const std::string &path)
+{
+    nifti::Header hdr;
+    if (!decodableNiftiHeader(path, "loadNiftiStreaming", hdr))
+        return false;
+    const size_t elemSize = hdr.bytesPerVoxel();
+    const StorageType storage = storageForComponent(loadedNiftiComponent(hdr));
+
+    try
+    {
+        itk::ImageBase<3>::Pointer image = imageForNiftiHeader(path, "loadNiftiStreaming", hdr, storage);
+        if (!image)
+            return false;
+
+        GzHandle in;
+        in.f = gzopen(path.c_str(), "rb");
+        if (!in.f)
+        {
+            std::cerr << "NiftiImage::loadNiftiStreaming: could not open '" << path << "'\n";
+            return false;
+        }
+        gzbuffer(in.f, 1u << 17);
+        if (gzseek(in.f, static_cast<z_off_t>(hdr.voxOffset), SEEK_SET) != static_cast<z_off_t>(hdr.voxOffset))
+        {
+            std::cerr << "NiftiImage::loadNiftiStreaming: voxel data offset is past the end of '" << path << "'\n";
+            return false;
+        }
+
+        // Whole samples per chunk, so a sample never straddles two reads.
+        const size_t chunkElems = (size_t(4) << 20) / elemSize;
+        std::vector<unsigned char> chunk(chunkElems * elemSize);
+        const size_t total = hdr.voxelCount();
+        // The middle axial slice is handed to the monitor once it is complete.
+        const size_t sliceVoxels = hdr.extent(0) * hdr.extent(1);
+        const size_t centralEnd = (hdr.extent(2) / 2 + 1) * sliceVoxels;
+        bool centralSent = !m_monitor.centralSlice;
+        bool complete = true;
+        forStorage(storage, [&](auto tag)
+                   {
+                       using T = decltype(tag);
+                       auto *volume = static_cast<Volume<T> *>(image.GetPointer());
+                       volume->Allocate();
+                       T *dst = volume->GetBufferPointer();
+                       size_t done = 0;
+                       while (done < total)
+                       {
+                           const size_t want = std::min(chunkElems, total - done);
+                           const int got = gzread(in.f, chunk.data(), static_cast<unsigned int>(want * elemSize));
+                           if (got != static_cast<int>(want * elemSize))
+                           {
+                               std::cerr << "NiftiImage::loadNiftiStreaming: '" << path << "' ended after " << done
+                                         << " of " << total << " voxels\n";
+                               complete = false;
+                               return;
+                           }
+                           convertNiftiChunk(chunk.data(), want, hdr, dst + done);
+                           done += want;
+                           if (!centralSent && done >= centralEnd)
+                           {
+                               const T *slice = dst + centralEnd - sliceVoxels;
+                               m_monitor.centralSlice(std::vector<float>(slice, slice + sliceVoxels),
+                                                      static_cast<unsigned int>(hdr.extent(0)),
+                                                      static_cast<unsigned int>(hdr.extent(1)));
+                               centralSent = true;
+                           }
+                           if (!continueLoad(static_cast<float>(done) / static_cast<float>(total)))
+                           {
+                               std::cerr << "NiftiImage::loadNiftiStreaming: cancelled '" << path << "'\n";
+                               complete = false;
+                               return;
+                           }
+                       }
+                   });
+        if (!complete)
+            return false;
+
+        m_image = image;
+        m_storage = storage;
+        m_mapping.reset();
+        m_lazy.reset();
+    }
+    catch (itk::ExceptionObject &e)
+    {
+        std::cerr << "NiftiImage::loadNiftiStreaming: ITK exception while reading '" << path << "': " << e << std::endl;
+        return false;
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "NiftiImage::loadNiftiStreaming: std::exception while reading '" << path << "': " << e.what() << std::endl;
+        return false;
+    }
+
+    m_region = m_image->GetLargestPossibleRegion();
+    m_component = loadedNiftiComponent(hdr);
+    const auto spacing = m_image->GetSpacing();
+    m_spacingX = std::abs(static_cast<double>(spacing[0]));
+    m_spacingY = std::abs(static_cast<double>(spacing[1]));
+    m_spacingZ = std::abs(static_cast<double>(spacing[2]));
+    if (!std::isfinite(m_spacingX) || m_spacingX <= 0.0)
+        m_spacingX = 1.0;
+    if (!std::isfinite(m_spacingY) || m_spacingY <= 0.0)
+        m_spacingY = 1.0;
+    if (!std::isfinite(m_spacingZ) || m_spacingZ <= 0.0)
+        m_spacingZ = 1.0;
+    return true;
+}
+
+// Map an uncompressed .nii. Samples already in the storage type and byte
+// order (float32, or an unscaled 8/16-bit integer) are used in place; anything
+// else is converted slice by slice as the slices are first read, so opening
+// costs the header and one read of the file for the statistics, but no copy.
+bool NiftiImage::loadNiftiMapped(const std::string &path)
+{
+    nifti::Header hdr;
+    if (!decodableNiftiHeader(path, "loadNiftiMapped", hdr))
+        return false;
+    const size_t elemSize = hdr.bytesPerVoxel();
+    const StorageType storage = storageForComponent(loadedNiftiComponent(hdr));
+
+    std::string error;
+    std::shared_ptr<MappedFile> file = MappedFile::open(path, &error);
+    if (!file)
+    {
+        std::cerr << "NiftiImage::loadNiftiMapped: " << error << "\n";
+        return false;
+    }
+    if (hdr.voxOffset < 0 ||
+        static_cast<uint64_t>(hdr.voxOffset) + static_cast<uint64_t>(hdr.voxelCount()) * elemSize > file->size())
+    {
+        std::cerr << "NiftiImage::loadNiftiMapped: '" << path << "' is shorter than its header says\n";
+        return false;
+    }
+
+    try
+    {
+        itk::ImageBase<3>::Pointer image = imageForNiftiHeader(path, "loadNiftiMapped", hdr, storage);
+        if (!image)
+            return false;
+        // Unscaled, native byte order, and either float32 or kept as stored.
+        const bool inPlace = !hdr.swapped && !hdr.isScaled() &&
+                             (hdr.datatype == nifti::kFloat32 || storage != StorageType::Float32);
+        SampleConverter convert;
+        if (!inPlace)
+        {
+            forStorage(storage, [&](auto tag)
+                       {
+                           using T = decltype(tag);
+                           convert = [hdr](const unsigned char *src, size_t count, void *dst)
+                           { convertNiftiChunk(src, count, hdr, static_cast<T *>(dst)); };
+                       });
+        }
+        if (!attachMapping(image, storage, file, static_cast<size_t>(hdr.voxOffset), elemSize, convert))
+            return false;
+    }
+    catch (itk::ExceptionObject &e)
+    {
+        std::cerr << "NiftiImage::loadNiftiMapped: ITK exception while reading '" << path << "': " << e << std::endl;
+        return false;
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "NiftiImage::loadNiftiMapped: std::exception while reading '" << path << "': " << e.what() << std::endl;
+        return false;
+    }
+
+    m_component = loadedNiftiComponent(hdr);
+    const auto spacing = m_image->GetSpacing();
+    m_spacingX = std::abs(static_cast<double>(spacing[0]));
+    m_spacingY = std::abs(static_cast<double>(spacing[1]));
+    m_spacingZ = std::abs(static_cast<double>(spacing[2]));
+    if (!std::isfinite(m_spacingX) || m_spacingX <= 0.0)
+        m_spacingX = 1.0;
+    if (!std::isfinite(m_spacingY) || m_spacingY <= 0.0)
+        m_spacingY = 1.0;
+    if (!std::isfinite(m_spacingZ) || m_spacingZ <= 0.0)
+        m_spacingZ = 1.0;
+    std::cerr << "NiftiImage::loadNiftiMapped: '" << path << "' mapped "
+              << (m_lazy ? "with per-slice conversion" : "in place") << "\n";
+    return true;
+}
+
+bool NiftiImage::attachMapping(itk::ImageBase<3>::Pointer image, StorageType storage,
+                               const std::shared_ptr<MappedFile> &file, size_t dataOffset, size_t sampleBytes,
+                               SampleConverter convert)
+{
+    const ImageType::SizeType size = image->GetLargestPossibleRegion().GetSize();
+    const size_t sliceVoxels = static_cast<size_t>(size[0]) * size[1];
+    const size_t count = sliceVoxels * size[2];
+    unsigned char *source = file->data() + dataOffset;
+
+    std::shared_ptr<LazySlabConverter> lazy;
+    forStorage(storage, [&](auto tag)
+               {
+                   using T = decltype(tag);
+                   auto *volume = static_cast<Volume<T> *>(image.GetPointer());
+                   // Samples at an odd offset cannot be used as T in place;
+                   // copying them out slice by slice is the next best thing.
+                   if (!convert && reinterpret_cast<uintptr_t>(source) % alignof(T) != 0)
+                       convert = [](const unsigned char *src, size_t n, void *dst)
+                       { std::memcpy(dst, src, n * sizeof(T)); };
+
+                   if (!convert)
+                   {
+                       // The container does not own the pages; m_mapping keeps them alive.
+                       volume->GetPixelContainer()->SetImportPointer(reinterpret_cast<T *>(source), count, false);
+                       return;
+                   }
+                   // Not initialised: untouched slices stay unbacked until converted.
+                   volume->Allocate(false);
+                   lazy = std::make_shared<LazySlabConverter>();
+                   lazy->convert = std::move(convert);
+                   lazy->source = source;
+                   lazy->sampleBytes = sampleBytes;
+                   lazy->sliceVoxels = sliceVoxels;
+                   lazy->target = reinterpret_cast<unsigned char *>(volume->GetBufferPointer());
+                   lazy->targetBytes = sizeof(T);
+                   lazy->ready.reset(new std::atomic<bool>[size[2]]);
+                   for (size_t z = 0; z < size[2]; ++z)
+                       lazy->ready[z].store(false, std::memory_order_relaxed);
+               });
+
+    m_image = image;
+    m_storage = storage;
+    m_region = m_image->GetLargestPossibleRegion();
+    m_mapping = file;
+    m_lazy = lazy;
+    return true;
+}
+
+void NiftiImage::materializeSlices(unsigned int z0, unsigned int z1) const
+{
+    if (!m_lazy)
+        return;
+    z1 = std::min(z1, getSizeZ());
+    for (unsigned int z = z0; z < z1; ++z)
+        m_lazy->materialize(z);
+}
+
+float NiftiImage::voxelAt(const itk::Index<3> &idx) const
+{
+    float value = 0.0f;
+    visitVolume([&](auto *volume)
+                {
+                    using T = typename std::remove_pointer_t<decltype(volume)>::PixelType;
+                    if (m_lazy && !m_lazy->isReady(static_cast<size_t>(idx[2])))
+                    {
+                        const size_t sx = m_region.GetSize()[0];
+                        const size_t sy = m_region.GetSize()[1];
+                        T stored = T();
+                        m_lazy->convertOne((static_cast<size_t>(idx[2]) * sy + static_cast<size_t>(idx[1])) * sx +
+                                               static_cast<size_t>(idx[0]),
+                                           &stored);
+                        value = static_cast<float>(stored);
+                    }
+                    else
+                    {
+                        value = static_cast<float>(volume->GetPixel(idx));
+                    }
+                });
+    return value;
+}
+
+void NiftiImage::promoteToFloat()
+{
+    if (!m_image || m_storage == StorageType::Float32)
+        return;
+    materializeSlices(0, getSizeZ());
+    ImageType::Pointer promoted = ImageType::New();
+    promoted->SetRegions(m_region);
+    promoted->SetSpacing(m_image->GetSpacing());
+    promoted->SetOrigin(m_image->GetOrigin());
+    promoted->SetDirection(m_image->GetDirection());
+    promoted->Allocate();
+    PixelType *dst = promoted->GetBufferPointer();
+    visitVolume([&](auto *volume)
+                {
+                    const auto *src = volume->GetBufferPointer();
+                    const size_t count = m_region.GetNumberOfPixels();
+                    for (size_t i = 0; i < count; ++i)
+                        dst[i] = static_cast<PixelType>(src[i]);
+                });
+    std::cerr << "NiftiImage::promoteToFloat: " << storageName(m_storage) << " volume now held as float32\n";
+    m_image = promoted.GetPointer();
+    m_storage = StorageType::Float32;
+    m_mapping.reset();
+    m_lazy.reset();
+    // Other shallow copies still hold the old buffer, and the layout with it.
+    m_sagittal = std::make_shared<SagittalLayout>();
+}
+
+// ============================================================================
+// NUMPY (.npz / .npy) IMPORT
+//
+// A numpy container stores samples and nothing else: no spacing, no origin, no
+// orientation, and no agreed axis convention. Everything below exists to pin
+// those down before the array is treated as a medical volume, because guessing
+// wrong silently mirrors axes or reports distances and volumes in the wrong
+// units — errors that look like plausible anatomy on screen.
+// ============================================================================
+
+const char *npzAxisOrderName(NpzImportOptions::AxisOrder order)
+{
+    switch (order)
+    {
+    case NpzImportOptions::AxisOrder::XYZ: return "XYZ";
+    case NpzImportOptions::AxisOrder::XZY: return "XZY";
+    case NpzImportOptions::AxisOrder::YXZ: return "YXZ";
+    case NpzImportOptions::AxisOrder::YZX: return "YZX";
+    case NpzImportOptions::AxisOrder::ZXY: return "ZXY";
+    case NpzImportOptions::AxisOrder::ZYX: return "ZYX";
+    default: return "auto";
+    }
+}
+
+namespace
+{
+
+// Geometry borrowed from a real medical volume sitting next to the array.
+struct ReferenceGeometry
+{
+    bool valid = false;
+    size_t size[3] = {0, 0, 0};
+    ImageType::SpacingType spacing;
+    ImageType::PointType origin;
+    ImageType::DirectionType direction;
+    std::string source;
+};
+
+// Read a volume's header only; the pixels are never needed here.
+bool readReferenceGeometry(const std::string &path, ReferenceGeometry &geom)
+{
+    std::error_code ec;
+    if (!std::filesystem::exists(path, ec))
+        return false;
+    try
+    {
+        itk::ImageIOBase::Pointer io =
+            itk::ImageIOFactory::CreateImageIO(path.c_str(), itk::ImageIOFactory::ReadMode);
+        if (io.IsNull())
+            return false;
+        io->SetFileName(path);
+        io->ReadImageInformation();
+        if (io->GetNumberOfDimensions() < 3)
+            return false;
+
+        geom.direction.SetIdentity();
+        for (unsigned int i = 0; i < 3; ++i)
+        {
+            geom.size[i] = io->GetDimensions(i);
+            const double s = io->GetSpacing(i);
+            geom.spacing[i] = (std::isfinite(s) && s > 0.0) ? s : 1.0;
+            geom.origin[i] = io->GetOrigin(i);
+            const std::vector<double> column = io->GetDirection(i);
+            for (unsigned int j = 0; j < 3 && j < column.size(); ++j)
+                geom.direction[j][i] = column[j];
+        }
+        geom.valid = true;
+        geom.source = path;
+        return true;
+    }
+    catch (...)
+    {
+        return false;
+    }
+}
+
+std::string stripNumpySuffix(const std::string &path)
 {
     if (path.size() > 4)
     {
@@ -621,6 +1765,19 @@ itk::ImageIOBase::IOComponentType componentForDType(npz::DType t)
     }
 }
 
+// The element type npz::gather() writes for a volume stored as `storage`.
+npz::DType dtypeForStorage(NiftiImage::StorageType storage)
+{
+    switch (storage)
+    {
+    case NiftiImage::StorageType::UInt8: return npz::DType::UInt8;
+    case NiftiImage::StorageType::Int8: return npz::DType::Int8;
+    case NiftiImage::StorageType::UInt16: return npz::DType::UInt16;
+    case NiftiImage::StorageType::Int16: return npz::DType::Int16;
+    default: return npz::DType::Float32;
+    }
+}
+
 } // namespace
 
 bool NiftiImage::isNumpyPath(const std::string &path)
@@ -746,7 +1903,8 @@ bool resolveImport(const std::string &path, const NpzImportOptions &options,
         ref.valid = false;
     }
 
-    // Strides of the numpy array, which readAsFloat/readAllAsFloat give in C order.
+    // C-order strides of the numpy array; loadNumpy walks a Fortran-ordered one
+    // with its own.
     const size_t nd = info.shape.size();
     std::vector<size_t> stride(nd, 1);
     for (size_t a = nd - 1; a-- > 0;)
@@ -831,16 +1989,255 @@ void fillReport(const ResolvedImport &resolved, NpzImportReport &report)
     report.geometryResolved = resolved.geometryResolved;
 }
 
+// Element strides of the array as it is stored: the C-order ones, or
+// Fortran order's, first axis fastest.
+std::vector<size_t> storedStrides(const ResolvedImport &resolved)
+{
+    std::vector<size_t> stride = resolved.stride;
+    if (resolved.info.fortranOrder)
+    {
+        size_t s = 1;
+        for (size_t axis = 0; axis < stride.size(); ++axis)
+        {
+            stride[axis] = s;
+            s *= resolved.info.shape[axis];
+        }
+    }
+    return stride;
+}
+
+// How one channel of the stored array lands on the image grid, X fastest. A
+// flipped image axis walks its source axis backwards from the far end.
+npz::Gather3D imageWalk(const ResolvedImport &resolved, const std::vector<size_t> &sourceStride, size_t channel)
+{
+    const NpzAxisMapping &layout = resolved.layout;
+    npz::Gather3D walk;
+    const size_t axisFor[3] = {layout.axisForX, layout.axisForY, layout.axisForZ};
+    const size_t extent[3] = {layout.sizeX, layout.sizeY, layout.sizeZ};
+    walk.first = layout.hasChannel ? static_cast<ptrdiff_t>(channel * sourceStride[layout.channelAxis]) : 0;
+    for (int d = 0; d < 3; ++d)
+    {
+        const ptrdiff_t step = static_cast<ptrdiff_t>(sourceStride[axisFor[d]]);
+        walk.size[d] = extent[d];
+        walk.step[d] = resolved.flip[d] ? -step : step;
+        if (resolved.flip[d])
+            walk.first += static_cast<ptrdiff_t>(extent[d] - 1) * step;
+    }
+    walk.dstStride[0] = layout.sizeX;
+    walk.dstStride[1] = layout.sizeX * layout.sizeY;
+    return walk;
+}
+
+// Convert the selected channel onto the image grid in `buffer`, X fastest,
+// as `dstType`. Samples are gathered as they are stored, Fortran order
+// included: from `file` when the array is mapped (at `dataOffset`, in the
+// byte order `bigEndian` says), otherwise inflated a slab of the slowest
+// stored image axis at a time, each gathered (across cores) into the part of
+// the volume it covers before the next is inflated, so one slab of stored
+// bytes is held, never the array. `progress` gets the fraction done after
+// each slab and returns false to cancel.
+bool gatherChannel(const std::string &path, const ResolvedImport &resolved, const MappedFile *file,
+                   uint64_t dataOffset, bool bigEndian, npz::DType dstType, void *buffer,
+                   const std::function<bool(float)> &progress, std::string *error)
+{
+    const npz::ArrayInfo &info = resolved.info;
+    const NpzAxisMapping &layout = resolved.layout;
+    const std::vector<size_t> sourceStride = storedStrides(resolved);
+    const size_t sourceBase =
+        layout.hasChannel ? static_cast<size_t>(resolved.channel) * sourceStride[layout.channelAxis] : 0;
+    // When the selected channel is one contiguous block (channel-first in C
+    // order, channel-last in Fortran order) only that block is read.
+    const bool channelBlock =
+        !layout.hasChannel ||
+        (info.fortranOrder ? layout.channelAxis == info.shape.size() - 1 : layout.channelAxis == 0);
+    const size_t rawBase = file || !channelBlock ? 0 : sourceBase;
+    npz::Gather3D walk = imageWalk(resolved, sourceStride, static_cast<size_t>(resolved.channel));
+    walk.first -= static_cast<ptrdiff_t>(rawBase);
+
+    if (file)
+    {
+        npz::gather(file->data() + dataOffset, info.dtype, bigEndian, walk, dstType, buffer);
+        return true;
+    }
+
+    constexpr size_t kSlabBytes = size_t(32) << 20;
+    const size_t axisFor[3] = {layout.axisForX, layout.axisForY, layout.axisForZ};
+    size_t slow = info.fortranOrder ? info.shape.size() - 1 : 0;
+    if (layout.hasChannel && slow == layout.channelAxis)
+        slow = info.fortranOrder ? slow - 1 : slow + 1;
+    int d = 0;
+    while (axisFor[d] != slow)
+        ++d;
+    const size_t planeElements = sourceStride[slow];
+    const size_t planes = walk.size[d];
+    const size_t planesPerSlab = std::max<size_t>(1, kSlabBytes / (planeElements * npz::dtypeSize(info.dtype)));
+    const size_t dstStride[3] = {1, walk.dstStride[0], walk.dstStride[1]};
+    const size_t voxelBytes = npz::dtypeSize(dstType);
+    bool streamBigEndian = false;
+    auto gatherSlab = [&](const uint8_t *data, size_t first, size_t count)
+    {
+        const size_t p0 = (first - rawBase) / planeElements;
+        const size_t p1 = p0 + count / planeElements;
+        const size_t o0 = resolved.flip[d] ? planes - p1 : p0;
+        npz::Gather3D slab = walk;
+        slab.size[d] = p1 - p0;
+        slab.first += static_cast<ptrdiff_t>(o0) * walk.step[d] - static_cast<ptrdiff_t>(first - rawBase);
+        npz::gather(data, info.dtype, streamBigEndian, slab, dstType,
+                    static_cast<unsigned char *>(buffer) + o0 * dstStride[d] * voxelBytes);
+        return !progress || progress(static_cast<float>(p1) / static_cast<float>(planes));
+    };
+    return npz::streamRawElements(path, info.name, rawBase, planes * planeElements, planesPerSlab * planeElements,
+                                  gatherSlab, streamBigEndian, error);
+}
+
 } // namespace
 
-bool NiftiImage::previewNumpy(const std::string &path, const NpzImportOptions &options,
-                              NpzImportReport &report, std::string *error)
-{
-    ResolvedImport resolved;
-    if (!resolveImport(path, options, resolved, error))
-        return false;
-    fillReport(resolved, report);
-    return true;
+bool NiftiImage::previewNumpy(const std::string &path, const NpzImportOptions &options,
+                              NpzImportReport &report, std::string *error)
+{
+    ResolvedImport resolved;
+    if (!resolveImport(path, options, resolved, error))
+        return false;
+    fillReport(resolved, report);
+    return true;
+}
+
+bool NiftiImage::readMetadata(const std::string &path, const NpzImportOptions &options, ImageMetadata &out,
+                              std::string *error)
+{
+    auto fail = [&](const std::string &message) -> bool
+    {
+        if (error)
+            *error = message;
+        return false;
+    };
+    auto hasSuffix = [](const std::string &p, const std::string &suffix)
+    {
+        if (p.size() < suffix.size())
+            return false;
+        return std::equal(suffix.rbegin(), suffix.rend(), p.rbegin(), [](char a, char b)
+                          { return std::tolower(static_cast<unsigned char>(a)) == b; });
+    };
+
+    out = ImageMetadata();
+    std::error_code ec;
+    const bool isDir = std::filesystem::is_directory(path, ec);
+    if (!isDir)
+    {
+        out.bytesOnDisk = std::filesystem::file_size(path, ec);
+        if (ec)
+            return fail("cannot read '" + path + "': " + ec.message());
+    }
+
+    if (isNumpyPath(path))
+    {
+        ResolvedImport resolved;
+        if (!resolveImport(path, options, resolved, error))
+            return false;
+        out.format = "numpy";
+        out.size[0] = static_cast<unsigned int>(resolved.layout.sizeX);
+        out.size[1] = static_cast<unsigned int>(resolved.layout.sizeY);
+        out.size[2] = static_cast<unsigned int>(resolved.layout.sizeZ);
+        for (unsigned int i = 0; i < 3; ++i)
+            out.spacing[i] = resolved.spacing[i];
+        out.dtype = npz::dtypeName(resolved.info.dtype);
+        return true;
+    }
+
+    if (hasSuffix(path, ".nii") || hasSuffix(path, ".nii.gz"))
+    {
+        nifti::Header hdr;
+        std::string headerError;
+        if (!nifti::readHeader(path, hdr, &headerError))
+            return fail(headerError);
+        out.format = hdr.version == 2 ? "NIfTI-2" : "NIfTI-1";
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            out.size[axis] = static_cast<unsigned int>(hdr.extent(axis));
+            const double spacing = std::abs(hdr.pixdim[axis + 1]);
+            out.spacing[axis] = (std::isfinite(spacing) && spacing > 0.0) ? spacing : 1.0;
+        }
+        out.dtype = componentName(componentForNiftiType(hdr.datatype));
+        return true;
+    }
+
+    try
+    {
+        std::string ext = std::filesystem::path(path).extension().string();
+        std::transform(ext.begin(), ext.end(), ext.begin(),
+                       [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        if (isDir || ext == ".dcm" || ext == ".dicom" || ext == ".ima")
+        {
+            std::string dir;
+            std::string chosenUID;
+            std::vector<std::string> fileNames;
+            size_t seriesCount = 0;
+            if (!chooseDicomSeries(path, "readMetadata", dir, chosenUID, fileNames, seriesCount))
+                return fail("no DICOM series in '" + path + "'");
+
+            // In-plane geometry from the first slice, the slice spacing from
+            // the first and last positions, as loadDicomSeries() derives it.
+            itk::GDCMImageIO::Pointer first = itk::GDCMImageIO::New();
+            first->SetFileName(fileNames.front());
+            first->ReadImageInformation();
+            out.format = "DICOM";
+            out.files = static_cast<unsigned int>(fileNames.size());
+            out.size[0] = static_cast<unsigned int>(first->GetDimensions(0));
+            out.size[1] = static_cast<unsigned int>(first->GetDimensions(1));
+            out.size[2] = out.files;
+            out.spacing[0] = std::abs(first->GetSpacing(0));
+            out.spacing[1] = std::abs(first->GetSpacing(1));
+            out.spacing[2] = std::abs(first->GetSpacing(2));
+            out.dtype = first->GetRescaleSlope() == 1.0 ? componentName(first->GetComponentType()) : "float32";
+            if (fileNames.size() > 1)
+            {
+                itk::GDCMImageIO::Pointer last = itk::GDCMImageIO::New();
+                last->SetFileName(fileNames.back());
+                last->ReadImageInformation();
+                const std::vector<double> normal = first->GetDirection(2);
+                double along = 0.0;
+                for (unsigned int row = 0; row < 3 && row < normal.size(); ++row)
+                    along += (last->GetOrigin(row) - first->GetOrigin(row)) * normal[row];
+                const double sliceSpacing = std::abs(along) / static_cast<double>(fileNames.size() - 1);
+                if (std::isfinite(sliceSpacing) && sliceSpacing > 0.0)
+                    out.spacing[2] = sliceSpacing;
+            }
+            out.bytesOnDisk = 0;
+            for (const std::string &file : fileNames)
+            {
+                std::error_code sizeError;
+                const uintmax_t bytes = std::filesystem::file_size(file, sizeError);
+                if (!sizeError)
+                    out.bytesOnDisk += bytes;
+            }
+            return true;
+        }
+
+        // Anything else ITK reads (.nrrd, .mha, .hdr/.img pairs): its header only.
+        itk::ImageIOBase::Pointer io =
+            itk::ImageIOFactory::CreateImageIO(path.c_str(), itk::ImageIOFactory::ReadMode);
+        if (io.IsNull())
+            return fail("no reader for '" + path + "'");
+        io->SetFileName(path);
+        io->ReadImageInformation();
+        out.format = io->GetNameOfClass();
+        for (unsigned int axis = 0; axis < 3; ++axis)
+        {
+            out.size[axis] = axis < io->GetNumberOfDimensions() ? static_cast<unsigned int>(io->GetDimensions(axis)) : 1u;
+            const double spacing = axis < io->GetNumberOfDimensions() ? std::abs(io->GetSpacing(axis)) : 1.0;
+            out.spacing[axis] = (std::isfinite(spacing) && spacing > 0.0) ? spacing : 1.0;
+        }
+        out.dtype = componentName(io->GetComponentType());
+        return true;
+    }
+    catch (itk::ExceptionObject &e)
+    {
+        return fail(e.GetDescription());
+    }
+    catch (const std::exception &e)
+    {
+        return fail(e.what());
+    }
 }
 
 bool NiftiImage::loadNumpy(const std::string &path, const NpzImportOptions &options,
@@ -863,27 +2260,8 @@ bool NiftiImage::loadNumpy(const std::string &path, const NpzImportOptions &opti
     const NpzAxisMapping &layout = resolved.layout;
     const std::vector<size_t> &stride = resolved.stride;
     const size_t channelBase = resolved.channelBase;
-    const size_t voxelCount = layout.sizeX * layout.sizeY * layout.sizeZ;
     std::string npzError;
 
-    // A channel-first array keeps each channel contiguous, so only the selected
-    // one is read. Anything else has to be materialised whole and gathered.
-    const bool contiguousChannel = !info.fortranOrder && (!layout.hasChannel || layout.channelAxis == 0);
-    std::vector<float> values;
-    size_t bufferBase = 0;
-    if (contiguousChannel)
-    {
-        if (!npz::readAsFloat(path, info.name, channelBase, voxelCount, values, &npzError))
-            return fail(npzError);
-        bufferBase = channelBase;
-    }
-    else
-    {
-        npz::ArrayInfo readInfo;
-        if (!npz::readAllAsFloat(path, info.name, &readInfo, values, &npzError))
-            return fail(npzError);
-    }
-
     ImageType::SizeType size;
     size[0] = layout.sizeX;
     size[1] = layout.sizeY;
@@ -892,46 +2270,97 @@ bool NiftiImage::loadNumpy(const std::string &path, const NpzImportOptions &opti
     start.Fill(0);
     ImageType::RegionType region(start, size);
 
-    ImageType::Pointer image = ImageType::New();
+    const StorageType storage = storageForComponent(componentForDType(info.dtype));
+    itk::ImageBase<3>::Pointer image = newVolume(storage);
     image->SetRegions(region);
-    try
-    {
-        image->Allocate();
-    }
-    catch (const std::exception &e)
-    {
-        return fail(std::string("could not allocate the volume: ") + e.what());
-    }
-
     image->SetSpacing(resolved.spacing);
     image->SetOrigin(resolved.origin);
     image->SetDirection(resolved.direction);
 
-    // Scatter the numpy samples into the ITK buffer, which runs X fastest.
-    // A flipped image axis simply walks its source axis backwards.
-    float *buffer = image->GetBufferPointer();
-    const size_t strideX = stride[layout.axisForX];
-    const size_t strideY = stride[layout.axisForY];
-    const size_t strideZ = stride[layout.axisForZ];
-    auto sourceIndex = [](size_t i, size_t extent, bool flipped)
-    { return flipped ? (extent - 1 - i) : i; };
-
-    for (size_t z = 0; z < layout.sizeZ; ++z)
+    // Stored samples (a .npy, or a .npz member written by np.savez) are mapped.
+    // In image order (C order, ZYX, nothing flipped) the volume uses the
+    // mapping itself: it is usable at once and only the slices that are
+    // viewed are ever paged in. Otherwise they are gathered from the mapping
+    // straight into the volume.
+    const bool imageOrder = !info.fortranOrder && stride[layout.axisForX] == 1 &&
+                            stride[layout.axisForY] == layout.sizeX &&
+                            stride[layout.axisForZ] == layout.sizeX * layout.sizeY && !resolved.flip[0] &&
+                            !resolved.flip[1] && !resolved.flip[2];
+    bool mapped = false;
+    npz::ArrayInfo rawInfo;
+    bool bigEndian = false;
+    uint64_t dataOffset = 0;
+    std::string mapError;
+    std::shared_ptr<MappedFile> file;
+    if (npz::locateArrayData(path, info.name, rawInfo, bigEndian, dataOffset, &mapError))
+        file = MappedFile::open(path, &mapError);
+    const size_t sampleBytes = npz::dtypeSize(info.dtype);
+    if (file && imageOrder)
     {
-        const size_t sourceZ = channelBase + sourceIndex(z, layout.sizeZ, resolved.flip[2]) * strideZ;
-        const size_t targetZ = z * layout.sizeY * layout.sizeX;
-        for (size_t y = 0; y < layout.sizeY; ++y)
+        const bool swapped = bigEndian && sampleBytes > 1;
+        SampleConverter convert;
+        if (swapped || (storage == StorageType::Float32 && rawInfo.dtype != npz::DType::Float32))
         {
-            const size_t sourceY = sourceZ + sourceIndex(y, layout.sizeY, resolved.flip[1]) * strideY;
-            const size_t targetY = targetZ + y * layout.sizeX;
-            for (size_t x = 0; x < layout.sizeX; ++x)
-                buffer[targetY + x] =
-                    values[sourceY + sourceIndex(x, layout.sizeX, resolved.flip[0]) * strideX - bufferBase];
+            const npz::DType dtype = rawInfo.dtype;
+            forStorage(storage, [&](auto tag)
+                       {
+                           using T = decltype(tag);
+                           convert = [dtype, bigEndian](const unsigned char *src, size_t count, void *dst)
+                           {
+                               if (std::is_same<T, float>::value)
+                               {
+                                   npz::convertToFloat(src, count, dtype, bigEndian, static_cast<float *>(dst));
+                                   return;
+                               }
+                               std::vector<float> values(count);
+                               npz::convertToFloat(src, count, dtype, bigEndian, values.data());
+                               std::copy(values.begin(), values.end(), static_cast<T *>(dst));
+                           };
+                       });
         }
+        mapped = attachMapping(image, storage, file,
+                               static_cast<size_t>(dataOffset) + channelBase * sampleBytes, sampleBytes, convert);
+        if (!mapped)
+            std::cerr << "NiftiImage::loadNumpy: not mapped; reading instead\n";
+    }
+
+    if (!mapped)
+    {
+        std::string allocError;
+        void *buffer = nullptr;
+        forStorage(storage, [&](auto tag)
+                   {
+                       using T = decltype(tag);
+                       auto *volume = static_cast<Volume<T> *>(image.GetPointer());
+                       try
+                       {
+                           volume->Allocate();
+                       }
+                       catch (const std::exception &e)
+                       {
+                           allocError = e.what();
+                           return;
+                       }
+                       buffer = volume->GetBufferPointer();
+                   });
+        if (!allocError.empty())
+            return fail("could not allocate the volume: " + allocError);
+
+        // The values are exact in the storage type: it is only narrower than
+        // float for 8/16-bit integer arrays.
+        if (!gatherChannel(path, resolved, file.get(), dataOffset, bigEndian, dtypeForStorage(storage), buffer,
+                           [this](float done) { return continueLoad(0.9f * done); }, &npzError))
+            return fail(npzError);
+        if (!continueLoad(0.9f))
+            return fail("cancelled");
+
+        m_image = image;
+        m_storage = storage;
+        m_region = m_image->GetLargestPossibleRegion();
+        m_mapping.reset();
+        m_lazy.reset();
     }
 
-    m_image = image;
-    m_region = m_image->GetLargestPossibleRegion();
     m_component = componentForDType(info.dtype);
     m_spacingX = std::abs(static_cast<double>(resolved.spacing[0]));
     m_spacingY = std::abs(static_cast<double>(resolved.spacing[1]));
@@ -946,7 +2375,7 @@ bool NiftiImage::loadNumpy(const std::string &path, const NpzImportOptions &opti
               << (resolved.flip[2] ? "Z" : "-")
               << " channel=" << resolved.channel << "/" << layout.channelCount
               << " geometry=" << resolved.geometrySource
-              << (resolved.geometryResolved ? "" : " (UNVERIFIED)") << "\n";
+              << (resolved.geometryResolved ? "" : " (UNVERIFIED)") << (mapped ? " mapped" : "") << "\n";
     if (!resolved.geometryResolved)
         std::cerr << "NiftiImage::loadNumpy: WARNING no spacing found for '" << path
                   << "'; using 1 mm isotropic. Distances, volumes and 3D proportions will be wrong "
@@ -956,101 +2385,830 @@ bool NiftiImage::loadNumpy(const std::string &path, const NpzImportOptions &opti
     return true;
 }
 
-// Shared post-read processing: compute global min/max, classify mask vs. image,
-// and log the result. Used by both the NIfTI and DICOM loading paths.
-void NiftiImage::finalizeLoad(const std::string &path)
+bool NiftiImage::readNumpyLabels(const std::string &path, const NpzImportOptions &options,
+                                 LabelBuffer &labels, NpzImportReport *report, std::string *error)
+{
+    auto fail = [&](const std::string &message) -> bool
+    {
+        if (error)
+            *error = message;
+        std::cerr << "NiftiImage::readNumpyLabels: " << message << " ('" << path << "')\n";
+        return false;
+    };
+
+    ResolvedImport resolved;
+    std::string resolveError;
+    if (!resolveImport(path, options, resolved, &resolveError))
+        return fail(resolveError);
+    const NpzAxisMapping &layout = resolved.layout;
+    // Bytes and uint16 samples are gathered at their own width; anything
+    // else as int32, narrowed once the labels are known.
+    const npz::DType stored = resolved.info.dtype;
+    const bool narrow = stored == npz::DType::Bool || stored == npz::DType::UInt8;
+    const LabelBuffer::Width width = narrow                           ? LabelBuffer::Width::Bits8
+                                     : stored == npz::DType::UInt16 ? LabelBuffer::Width::Bits16
+                                                                      : LabelBuffer::Width::Bits32;
+    try
+    {
+        labels.assign(layout.sizeX * layout.sizeY * layout.sizeZ, 0, width);
+    }
+    catch (const std::exception &e)
+    {
+        return fail(std::string("could not allocate the labels: ") + e.what());
+    }
+
+    npz::ArrayInfo rawInfo;
+    bool bigEndian = false;
+    uint64_t dataOffset = 0;
+    std::string npzError;
+    std::shared_ptr<MappedFile> file;
+    if (npz::locateArrayData(path, resolved.info.name, rawInfo, bigEndian, dataOffset, &npzError))
+        file = MappedFile::open(path, &npzError);
+    const npz::DType target = width == LabelBuffer::Width::Bits8    ? npz::DType::UInt8
+                              : width == LabelBuffer::Width::Bits16 ? npz::DType::UInt16
+                                                                    : npz::DType::Int32;
+    if (!labels.visit([&](auto *data) { return gatherChannel(path, resolved, file.get(), dataOffset, bigEndian, target,
+                                                            data, nullptr, &npzError); }))
+        return fail(npzError);
+    labels.shrinkToFit();
+
+    if (report)
+        fillReport(resolved, *report);
+    return true;
+}
+
+bool NiftiImage::readNumpyArgmax(const std::string &path, const NpzImportOptions &options,
+                                 LabelBuffer &labels, NpzImportReport *report, std::string *error)
+{
+    auto fail = [&](const std::string &message) -> bool
+    {
+        if (error)
+            *error = message;
+        std::cerr << "NiftiImage::readNumpyArgmax: " << message << " ('" << path << "')\n";
+        return false;
+    };
+
+    ResolvedImport resolved;
+    std::string resolveError;
+    if (!resolveImport(path, options, resolved, &resolveError))
+        return fail(resolveError);
+    const npz::ArrayInfo &info = resolved.info;
+    const NpzAxisMapping &layout = resolved.layout;
+    if (!layout.hasChannel)
+        return fail("array '" + info.name + "' has shape " + info.shapeString() + "; it has no channel axis");
+
+    const std::vector<size_t> sourceStride = storedStrides(resolved);
+    const npz::Gather3D walk = imageWalk(resolved, sourceStride, 0);
+    const size_t channels = layout.channelCount;
+    const size_t channelStride = sourceStride[layout.channelAxis];
+    const size_t sliceVoxels = layout.sizeX * layout.sizeY;
+    const size_t voxels = sliceVoxels * layout.sizeZ;
+
+    // The array is read in planes of its slowest stored spatial axis, which
+    // image axis d shows. The channel axis is either slower still (each plane
+    // holds one channel) or the fastest (each plane holds all of them).
+    const size_t slowest = info.fortranOrder ? info.shape.size() - 1 : 0;
+    const bool channelSlowest = slowest == layout.channelAxis;
+    size_t slow = slowest;
+    if (channelSlowest)
+        slow = info.fortranOrder ? slow - 1 : slow + 1;
+    const size_t axisFor[3] = {layout.axisForX, layout.axisForY, layout.axisForZ};
+    int d = 0;
+    while (axisFor[d] != slow)
+        ++d;
+    const size_t planes = walk.size[d];
+    const size_t planeElements = sourceStride[slow];
+    const size_t planeVoxels = voxels / planes;
+
+    npz::ArrayInfo rawInfo;
+    bool bigEndian = false;
+    uint64_t dataOffset = 0;
+    std::string mapError;
+    std::shared_ptr<MappedFile> file;
+    if (npz::locateArrayData(path, info.name, rawInfo, bigEndian, dataOffset, &mapError))
+        file = MappedFile::open(path, &mapError);
+
+    // The running maximum only spans the block of planes being folded: every
+    // channel of a block is folded before the next block starts.
+    constexpr size_t kBlockVoxels = size_t(4) << 20;
+    const size_t planesPerBlock = std::max<size_t>(1, kBlockVoxels / planeVoxels);
+    const size_t blockVoxels = std::min(planes, planesPerBlock) * planeVoxels;
+    std::vector<float> values, best;
+    try
+    {
+        labels.assign(voxels, 0, LabelBuffer::widthFor(static_cast<int>(channels) - 1));
+        values.resize(blockVoxels);
+        best.assign(blockVoxels, -std::numeric_limits<float>::infinity());
+    }
+    catch (const std::exception &e)
+    {
+        return fail(std::string("could not allocate the labels: ") + e.what());
+    }
+    const float minProbability = options.minProbability;
+    float *bestData = best.data();
+
+    // Fold channels [c0, c1) of stored planes [p0, p1) into the labels, a
+    // block of planes at a time; `data` holds element `base` of the array.
+    // The maximum starts over with channel 0 and is compared with the minimum
+    // probability after the last channel, so a block may be folded over
+    // several calls, one channel each, as long as [p0, p1) is one block.
+    auto fold = [&](const uint8_t *data, size_t base, size_t c0, size_t c1, size_t p0, size_t p1)
+    {
+        for (size_t q0 = p0; q0 < p1; q0 += planesPerBlock)
+        {
+            const size_t q1 = std::min(p1, q0 + planesPerBlock);
+            const size_t o0 = resolved.flip[d] ? planes - q1 : q0;
+            npz::Gather3D block = walk;
+            block.size[d] = q1 - q0;
+            block.first += static_cast<ptrdiff_t>(o0) * walk.step[d] - static_cast<ptrdiff_t>(base);
+            block.dstStride[0] = block.size[0];
+            block.dstStride[1] = block.size[0] * block.size[1];
+            size_t origin[3] = {0, 0, 0};
+            origin[d] = o0;
+            if (c0 == 0)
+                std::fill(best.begin(), best.begin() + (q1 - q0) * planeVoxels,
+                          -std::numeric_limits<float>::infinity());
+            for (size_t c = c0; c < c1; ++c)
+            {
+                npz::Gather3D channel = block;
+                channel.first += static_cast<ptrdiff_t>(c * channelStride);
+                npz::gather(data, info.dtype, bigEndian, channel, npz::DType::Float32, values.data());
+                labels.visit(
+                    [&](auto *labelData)
+                    {
+                        using Label = std::remove_pointer_t<decltype(labelData)>;
+                        for (size_t z = 0; z < block.size[2]; ++z)
+                            for (size_t y = 0; y < block.size[1]; ++y)
+                            {
+                                const size_t in = (z * block.size[1] + y) * block.size[0];
+                                const size_t out =
+                                    (origin[2] + z) * sliceVoxels + (origin[1] + y) * layout.sizeX + origin[0];
+                                const float *row = values.data() + in;
+                                float *bestRow = bestData + in;
+                                Label *labelRow = labelData + out;
+                                for (size_t x = 0; x < block.size[0]; ++x)
+                                {
+                                    if (row[x] > bestRow[x])
+                                    {
+                                        bestRow[x] = row[x];
+                                        labelRow[x] = static_cast<Label>(c);
+                                    }
+                                }
+                            }
+                    });
+            }
+            if (c1 != channels || minProbability <= 0.0f)
+                continue;
+            labels.visit(
+                [&](auto *labelData)
+                {
+                    for (size_t z = 0; z < block.size[2]; ++z)
+                        for (size_t y = 0; y < block.size[1]; ++y)
+                        {
+                            const size_t in = (z * block.size[1] + y) * block.size[0];
+                            const size_t out =
+                                (origin[2] + z) * sliceVoxels + (origin[1] + y) * layout.sizeX + origin[0];
+                            for (size_t x = 0; x < block.size[0]; ++x)
+                                if (bestData[in + x] < minProbability)
+                                    labelData[out + x] = 0;
+                        }
+                });
+        }
+    };
+
+    if (file)
+    {
+        fold(file->data() + dataOffset, 0, 0, channels, 0, planes);
+    }
+    else if (channelSlowest)
+    {
+        // Stored channel by channel, so a voxel's channels are far apart in
+        // the deflated stream. Each block is read once per channel; the
+        // member's checkpoint index (npz::checkpointCount()) lets every read
+        // after the first pass start near its block instead of at the front.
+        std::vector<uint8_t> raw;
+        std::string npzError;
+        for (size_t p0 = 0; p0 < planes; p0 += planesPerBlock)
+        {
+            const size_t p1 = std::min(planes, p0 + planesPerBlock);
+            for (size_t c = 0; c < channels; ++c)
+            {
+                const size_t first = c * channelStride + p0 * planeElements;
+                if (!npz::readRawElements(path, info.name, first, (p1 - p0) * planeElements, raw, bigEndian,
+                                          &npzError))
+                    return fail(npzError);
+                fold(raw.data(), first, c, c + 1, p0, p1);
+            }
+        }
+    }
+    else
+    {
+        // Inflated a slab of planes at a time, like loadNumpy(); each plane
+        // holds every channel of its voxels.
+        constexpr size_t kSlabBytes = size_t(32) << 20;
+        const size_t sampleBytes = npz::dtypeSize(info.dtype);
+        const size_t planesPerSlab = std::max<size_t>(1, kSlabBytes / (planeElements * sampleBytes));
+        auto foldSlab = [&](const uint8_t *data, size_t first, size_t count)
+        {
+            fold(data, first, 0, channels, first / planeElements, (first + count) / planeElements);
+            return true;
+        };
+        std::string npzError;
+        if (!npz::streamRawElements(path, info.name, 0, planes * planeElements, planesPerSlab * planeElements,
+                                    foldSlab, bigEndian, &npzError))
+            return fail(npzError);
+    }
+
+    if (report)
+        fillReport(resolved, *report);
+    std::cerr << "NiftiImage::readNumpyArgmax: array='" << info.name << "' shape=" << info.shapeString()
+              << " dtype=" << npz::dtypeName(info.dtype) << " order=" << npzAxisOrderName(resolved.order)
+              << " channels=" << channels << " minProbability=" << minProbability << (file ? " mapped" : "")
+              << "\n";
+    return true;
+}
+
+// Shared post-read processing: one pass for the global min/max, integrality
+// and intensity histogram, mask classification, and logging. Used by both the
+// NIfTI and DICOM loading paths.
+void NiftiImage::finalizeLoad(const std::string &path, bool gatherStats)
 {
-    using MinMaxCalculatorType = itk::MinimumMaximumImageCalculator<ImageType>;
-    MinMaxCalculatorType::Pointer calc = MinMaxCalculatorType::New();
-    calc->SetImage(m_image);
-    calc->Compute();
-    m_min = static_cast<float>(calc->GetMinimum());
-    m_max = static_cast<float>(calc->GetMaximum());
+    m_sagittal = std::make_shared<SagittalLayout>();
+    m_history.reset();
+    const unsigned int sz = getSizeZ();
+    const size_t sliceVoxels = static_cast<size_t>(getSizeX()) * getSizeY();
+
+    VolumeStats stats;
+    if (!gatherStats)
+    {
+        stats.min = m_min;
+        stats.max = m_max;
+        stats.integral = m_integral;
+        stats.histogram = std::move(m_histogram);
+        stats.voxels = sliceVoxels * sz;
+    }
+    else
+    {
+        // Every slice is read, mapped or not: a value missed here would skew the
+        // window and could make a multi-label volume pass for a binary mask. A
+        // slice still waiting for lazy conversion is converted into a scratch
+        // buffer rather than into the image, so it is only paged in when viewed.
+        visitVolume(
+            [&](auto *volume)
+            {
+                using T = typename std::remove_pointer_t<decltype(volume)>::PixelType;
+                const T *base = volume->GetBufferPointer();
+                const LazySlabConverter *lazy = m_lazy.get();
+                stats = gatherVolumeStats<T>(sliceVoxels, sz,
+                                             [&](unsigned int z, std::vector<T> &scratch) -> const T *
+                                             {
+                                                 if (!lazy || lazy->isReady(z))
+                                                     return base + static_cast<size_t>(z) * sliceVoxels;
+                                                 scratch.resize(sliceVoxels);
+                                                 lazy->convert(lazy->source + z * sliceVoxels * lazy->sampleBytes,
+                                                               sliceVoxels, scratch.data());
+                                                 return scratch.data();
+                                             });
+            });
+    }
+    m_min = stats.min;
+    m_max = stats.max;
+    m_histogram = std::move(stats.histogram);
+    m_integral = stats.integral;
     if (m_max == m_min)
         m_max = m_min + 1.0f;
 
+    // Distinct values, exact for 8/16-bit storage where each bin is one value.
+    const size_t occupiedBins = static_cast<size_t>(
+        std::count_if(m_histogram.begin(), m_histogram.end(), [](uint64_t c) { return c != 0; }));
+
     const bool isInteger = (m_component == itk::ImageIOBase::UCHAR || m_component == itk::ImageIOBase::CHAR ||
                             m_component == itk::ImageIOBase::USHORT || m_component == itk::ImageIOBase::SHORT ||
                             m_component == itk::ImageIOBase::UINT || m_component == itk::ImageIOBase::INT ||
-                            m_component == itk::ImageIOBase::ULONG || m_component == itk::ImageIOBase::LONG);
+                            m_component == itk::ImageIOBase::ULONG || m_component == itk::ImageIOBase::LONG ||
+                            m_component == itk::ImageIOBase::ULONGLONG ||
+                            m_component == itk::ImageIOBase::LONGLONG);
 
-    // Sample voxels to decide if this is a mask: small integer range or few unique values.
-    size_t uniqueLimit = 16;
-    std::unordered_set<int> uniques;
-    size_t sampleLimit = 200000; // enough to classify without costing too much
-    size_t sampled = 0;
+    // Only treat genuinely binary-ish volumes (e.g. {0,1}) as display masks.
+    // Multi-label volumes opened as the primary image (e.g. {0,1,2,3}) must stay
+    // windowable: classifying them as masks would collapse the window range to
+    // [0,1] and force binary rendering, breaking the Window/Level controls.
+    m_isMask = false;
     if (isInteger)
     {
-        itk::ImageRegionConstIterator<ImageType> it(m_image, m_region);
-        for (it.GoToBegin(); !it.IsAtEnd() && sampled < sampleLimit; ++it, ++sampled)
+        const bool binaryRange = (m_max - m_min) <= 1.5f;
+        if (binaryRange)
+            m_isMask = true;
+    }
+
+    // For masks, normalize min/max to [0,1] to avoid windowing artifacts.
+    if (m_isMask)
+    {
+        m_min = 0.0f;
+        m_max = 1.0f;
+    }
+
+    // Log loaded image properties for debugging
+    std::cerr << "NiftiImage::finalizeLoad: '" << path << "' size=(" << m_region.GetSize()[0] << "," << m_region.GetSize()[1] << "," << m_region.GetSize()[2] << ") spacing=(" << m_spacingX << "," << m_spacingY << "," << m_spacingZ << ") min=" << m_min << " max=" << m_max << " comp=" << m_component << " storage=" << storageName(m_storage) << " isMask=" << (m_isMask ? "yes" : "no") << " integral=" << (m_integral ? "yes" : "no") << " bins=" << occupiedBins << " voxels=" << stats.voxels << (m_mapping ? " mapped" : "") << "\n";
+}
+
+unsigned int NiftiImage::getSizeX() const { return m_region.GetSize()[0]; }
+unsigned int NiftiImage::getSizeY() const { return m_region.GetSize()[1]; }
+unsigned int NiftiImage::getSizeZ() const { return m_region.GetSize()[2]; }
+double NiftiImage::getSpacingX() const { return m_spacingX; }
+double NiftiImage::getSpacingY() const { return m_spacingY; }
+double NiftiImage::getSpacingZ() const { return m_spacingZ; }
+
+size_t NiftiImage::memoryBytes() const
+{
+    if (!m_image)
+        return 0;
+    size_t bytesPerVoxel = 0;
+    forStorage(m_storage, [&](auto tag) { bytesPerVoxel = sizeof(tag); });
+    const size_t copies = hasSagittalLayout() ? 2 : 1;
+    return static_cast<size_t>(m_region.GetNumberOfPixels()) * bytesPerVoxel * copies;
+}
+
+bool NiftiImage::hasSagittalLayout() const
+{
+    return m_sagittal && m_sagittal->ready.load(std::memory_order_acquire);
+}
+
+bool NiftiImage::buildSagittalLayout(const std::function<bool()> &keepGoing) const
+{
+    if (!m_image || !m_sagittal)
+        return false;
+    if (hasSagittalLayout())
+        return true;
+    unsigned int version = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_sagittal->mutex);
+        version = m_sagittal->version;
+    }
+
+    const unsigned int sx = getSizeX(), sy = getSizeY(), sz = getSizeZ();
+    ImageType::SizeType size;
+    size[0] = sy;
+    size[1] = sz;
+    size[2] = sx;
+    ImageType::IndexType start;
+    start.Fill(0);
+    itk::ImageBase<3>::Pointer copy = newVolume(m_storage);
+    copy->SetRegions(ImageType::RegionType(start, size));
+    bool complete = true;
+    visitVolume([&](auto *volume)
+                {
+                    using T = typename std::remove_pointer_t<decltype(volume)>::PixelType;
+                    auto *target = static_cast<Volume<T> *>(copy.GetPointer());
+                    target->Allocate();
+                    const T *src = volume->GetBufferPointer();
+                    T *dst = target->GetBufferPointer();
+                    const size_t plane = static_cast<size_t>(sx) * sy;
+                    const size_t sagittalPlane = static_cast<size_t>(sy) * sz;
+                    // 64x64 tiles of each axial slice: the reads walk X rows,
+                    // the writes walk Y runs of the sagittal slices.
+                    constexpr unsigned int kTile = 64;
+                    for (unsigned int z = 0; z < sz; ++z)
+                    {
+                        if (keepGoing && !keepGoing())
+                        {
+                            complete = false;
+                            return;
+                        }
+                        materializeSlices(z, z + 1);
+                        const T *slice = src + z * plane;
+                        for (unsigned int y0 = 0; y0 < sy; y0 += kTile)
+                        {
+                            const unsigned int y1 = std::min(sy, y0 + kTile);
+                            for (unsigned int x0 = 0; x0 < sx; x0 += kTile)
+                            {
+                                const unsigned int x1 = std::min(sx, x0 + kTile);
+                                for (unsigned int x = x0; x < x1; ++x)
+                                {
+                                    T *out = dst + x * sagittalPlane + static_cast<size_t>(z) * sy;
+                                    for (unsigned int y = y0; y < y1; ++y)
+                                        out[y] = slice[static_cast<size_t>(y) * sx + x];
+                                }
+                            }
+                        }
+                    }
+                });
+    if (!complete)
+        return false;
+
+    std::lock_guard<std::mutex> lock(m_sagittal->mutex);
+    if (m_sagittal->version != version)
+        return false; // edited meanwhile; this copy is stale
+    m_sagittal->copy = copy;
+    m_sagittal->ready.store(true, std::memory_order_release);
+    return true;
+}
+
+float NiftiImage::getGlobalMin() const { return m_min; }
+float NiftiImage::getGlobalMax() const { return m_max; }
+
+float NiftiImage::intensityPercentile(double fraction) const
+{
+    uint64_t total = 0;
+    for (uint64_t count : m_histogram)
+        total += count;
+    if (total == 0)
+        return m_min;
+    const double target = std::clamp(fraction, 0.0, 1.0) * static_cast<double>(total);
+    uint64_t seen = 0;
+    uint32_t bin = 0;
+    for (; bin + 1 < m_histogram.size(); ++bin)
+    {
+        seen += m_histogram[bin];
+        if (m_histogram[bin] != 0 && static_cast<double>(seen) >= target)
+            break;
+    }
+    while (bin > 0 && m_histogram[bin] == 0)
+        --bin;
+    const float value = histogramBinValue(m_storage, bin);
+    // A float bin centre can fall just outside the exact range.
+    return m_storage == StorageType::Float32 && !m_isMask ? std::clamp(value, m_min, m_max) : value;
+}
+
+std::vector<uint64_t> NiftiImage::intensityHistogram(unsigned int bins) const
+{
+    std::vector<uint64_t> out(bins, 0);
+    if (bins == 0 || m_histogram.empty())
+        return out;
+    const double scale = static_cast<double>(bins) / static_cast<double>(m_max - m_min);
+    for (uint32_t bin = 0; bin < m_histogram.size(); ++bin)
+    {
+        if (m_histogram[bin] == 0)
+            continue;
+        const double offset = (histogramBinValue(m_storage, bin) - m_min) * scale;
+        const unsigned int target = offset <= 0.0 ? 0u : static_cast<unsigned int>(std::min<double>(offset, bins - 1));
+        out[target] += m_histogram[bin];
+    }
+    return out;
+}
+
+bool NiftiImage::save(const std::string &path, int compressionLevel) const
+{
+    if (!m_image)
+        return false;
+    try
+    {
+        std::string outpath = path;
+        auto has_suffix = [](const std::string &p, const std::string &suf)
+        {
+            if (p.size() < suf.size())
+                return false;
+            return p.compare(p.size() - suf.size(), suf.size(), suf) == 0;
+        };
+        if (!has_suffix(outpath, ".nii") && !has_suffix(outpath, ".nii.gz"))
+            outpath += ".nii.gz";
+        materializeSlices(0, getSizeZ());
+
+        // Written in the storage type, so an int16 CT stays int16 on disk.
+        const size_t size[3] = {getSizeX(), getSizeY(), getSizeZ()};
+        const auto &itkSpacing = m_image->GetSpacing();
+        const auto &itkOrigin = m_image->GetOrigin();
+        const auto &itkDirection = m_image->GetDirection();
+        double spacing[3], origin[3], direction[3][3];
+        for (int row = 0; row < 3; ++row)
+        {
+            spacing[row] = itkSpacing[row];
+            origin[row] = itkOrigin[row];
+            for (int col = 0; col < 3; ++col)
+                direction[row][col] = itkDirection[row][col];
+        }
+        std::vector<unsigned char> header;
+        if (!nifti::makeHeader(size, niftiDatatype(m_storage), spacing, origin, direction, header))
+        {
+            // Too large for NIfTI-1's 16-bit dimensions; ITK picks the format.
+            visitVolume([&](auto *volume)
+                        {
+                            using WriterType = itk::ImageFileWriter<std::remove_pointer_t<decltype(volume)>>;
+                            typename WriterType::Pointer writer = WriterType::New();
+                            writer->SetImageIO(itk::NiftiImageIO::New());
+                            writer->SetFileName(outpath);
+                            writer->SetInput(volume);
+                            writer->Update();
+                        });
+            return true;
+        }
+
+        const void *voxels = nullptr;
+        size_t bytes = 0;
+        visitVolume([&](auto *volume)
+                    {
+                        voxels = volume->GetBufferPointer();
+                        bytes = size[0] * size[1] * size[2] * sizeof(*volume->GetBufferPointer());
+                    });
+        std::string error;
+        if (!nifti::writeVolume(outpath, header, voxels, bytes, compressionLevel, &error))
+        {
+            std::cerr << "NiftiImage::save: " << error << std::endl;
+            return false;
+        }
+        return true;
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "NiftiImage::save: exception: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+bool NiftiImage::saveCached(const std::string &path, bool compress, const std::string &tag,
+                            const std::function<bool()> &keepGoing) const
+{
+    if (!m_image)
+        return false;
+    materializeSlices(0, getSizeZ());
+
+    const unsigned char *voxels = nullptr;
+    size_t sampleBytes = 0;
+    visitVolume([&](auto *volume)
+                {
+                    voxels = reinterpret_cast<const unsigned char *>(volume->GetBufferPointer());
+                    sampleBytes = sizeof(*volume->GetBufferPointer());
+                });
+    const size_t sz = getSizeZ();
+    const size_t sliceBytes = static_cast<size_t>(getSizeX()) * getSizeY() * sampleBytes;
+    const size_t slabSlices = std::max<size_t>(1, kCacheSlabBytes / std::max<size_t>(1, sliceBytes));
+    const size_t slabCount = (sz + slabSlices - 1) / slabSlices;
+    auto slabRaw = [&](size_t i) { return (std::min(sz, (i + 1) * slabSlices) - i * slabSlices) * sliceBytes; };
+
+    // Deflated copies, empty where a slab is stored as it is. Level 1: the
+    // cache is about reading back fast, and most of the gain is in the zeros.
+    std::vector<std::vector<unsigned char>> packed(slabCount);
+    std::atomic<bool> stopped{false};
+    if (compress)
+    {
+        std::atomic<size_t> next{0};
+        auto work = [&]()
+        {
+            for (size_t i = next++; i < slabCount && !stopped; i = next++)
+            {
+                if (keepGoing && !keepGoing())
+                {
+                    stopped = true;
+                    return;
+                }
+                const size_t raw = slabRaw(i);
+                uLongf size = compressBound(static_cast<uLong>(raw));
+                std::vector<unsigned char> out(size);
+                if (compress2(out.data(), &size, voxels + i * slabSlices * sliceBytes, static_cast<uLong>(raw), 1) ==
+                        Z_OK &&
+                    size < raw - raw / 8)
+                {
+                    out.resize(size);
+                    packed[i] = std::move(out);
+                }
+            }
+        };
+        const size_t threads = std::max<size_t>(
+            1, std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), slabCount));
+        std::vector<std::thread> helpers;
+        for (size_t t = 1; t < threads; ++t)
+            helpers.emplace_back(work);
+        work();
+        for (std::thread &helper : helpers)
+            helper.join();
+        if (stopped)
+            return false;
+    }
+
+    std::vector<unsigned char> header;
+    putCacheBytes(header, kCacheMagic, sizeof(kCacheMagic));
+    putCacheField<uint32_t>(header, kCacheByteOrder);
+    putCacheField<int32_t>(header, static_cast<int32_t>(m_storage));
+    putCacheField<int32_t>(header, static_cast<int32_t>(m_component));
+    for (int axis = 0; axis < 3; ++axis)
+        putCacheField<uint64_t>(header, m_region.GetSize()[axis]);
+    const auto spacing = m_image->GetSpacing();
+    const auto origin = m_image->GetOrigin();
+    const auto direction = m_image->GetDirection();
+    for (int axis = 0; axis < 3; ++axis)
+        putCacheField<double>(header, spacing[axis]);
+    for (int axis = 0; axis < 3; ++axis)
+        putCacheField<double>(header, origin[axis]);
+    for (int row = 0; row < 3; ++row)
+        for (int col = 0; col < 3; ++col)
+            putCacheField<double>(header, direction[row][col]);
+    putCacheField<float>(header, m_min);
+    putCacheField<float>(header, m_max);
+    putCacheField<uint8_t>(header, m_isMask ? 1 : 0);
+    putCacheField<uint8_t>(header, m_integral ? 1 : 0);
+    putCacheField<uint64_t>(header, m_histogram.size());
+    putCacheBytes(header, m_histogram.data(), m_histogram.size() * sizeof(uint64_t));
+    putCacheField<uint64_t>(header, tag.size());
+    putCacheBytes(header, tag.data(), tag.size());
+    putCacheField<uint64_t>(header, slabSlices);
+    putCacheField<uint64_t>(header, slabCount);
+
+    const size_t tableBytes = slabCount * sizeof(CacheSlab);
+    uint64_t offset = (header.size() + tableBytes + kCachePageBytes - 1) / kCachePageBytes * kCachePageBytes;
+    for (size_t i = 0; i < slabCount; ++i)
+    {
+        CacheSlab slab;
+        slab.offset = offset;
+        slab.raw = slabRaw(i);
+        slab.stored = packed[i].empty() ? slab.raw : packed[i].size();
+        putCacheField(header, slab);
+        offset += slab.stored;
+    }
+    header.resize((header.size() + kCachePageBytes - 1) / kCachePageBytes * kCachePageBytes, 0);
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char *>(header.data()), static_cast<std::streamsize>(header.size()));
+    for (size_t i = 0; i < slabCount && out; ++i)
+    {
+        if (keepGoing && !keepGoing())
         {
-            int v = static_cast<int>(std::lrint(it.Value()));
-            uniques.insert(v);
-            if (uniques.size() > uniqueLimit)
-                break;
+            stopped = true;
+            break;
         }
+        if (packed[i].empty())
+            out.write(reinterpret_cast<const char *>(voxels + i * slabSlices * sliceBytes),
+                      static_cast<std::streamsize>(slabRaw(i)));
+        else
+            out.write(reinterpret_cast<const char *>(packed[i].data()),
+                      static_cast<std::streamsize>(packed[i].size()));
     }
-
-    // Only treat genuinely binary-ish volumes (e.g. {0,1}) as display masks.
-    // Multi-label volumes opened as the primary image (e.g. {0,1,2,3}) must stay
-    // windowable: classifying them as masks would collapse the window range to
-    // [0,1] and force binary rendering, breaking the Window/Level controls.
-    m_isMask = false;
-    if (isInteger)
+    out.close();
+    if (stopped || out.fail())
     {
-        const bool binaryRange = (m_max - m_min) <= 1.5f;
-        if (binaryRange)
-            m_isMask = true;
+        if (!stopped)
+            std::cerr << "NiftiImage::saveCached: could not write '" << path << "'\n";
+        std::error_code ec;
+        std::filesystem::remove(path, ec);
+        return false;
     }
+    return true;
+}
 
-    // For masks, normalize min/max to [0,1] to avoid windowing artifacts.
-    if (m_isMask)
+NiftiImage::CacheLoad NiftiImage::loadCached(const std::string &path, const std::string &tagPrefix, std::string *tag)
+{
+    std::string error;
+    std::shared_ptr<MappedFile> file = MappedFile::open(path, &error);
+    if (!file)
     {
-        m_min = 0.0f;
-        m_max = 1.0f;
+        std::cerr << "NiftiImage::loadCached: " << error << "\n";
+        return CacheLoad::Stale;
     }
 
-    // Log loaded image properties for debugging
-    std::cerr << "NiftiImage::finalizeLoad: '" << path << "' size=(" << m_region.GetSize()[0] << "," << m_region.GetSize()[1] << "," << m_region.GetSize()[2] << ") spacing=(" << m_spacingX << "," << m_spacingY << "," << m_spacingZ << ") min=" << m_min << " max=" << m_max << " comp=" << m_component << " isMask=" << (m_isMask ? "yes" : "no") << " uniq=" << uniques.size() << " sampled=" << sampled << "\n";
-}
-
-unsigned int NiftiImage::getSizeX() const { return m_region.GetSize()[0]; }
-unsigned int NiftiImage::getSizeY() const { return m_region.GetSize()[1]; }
-unsigned int NiftiImage::getSizeZ() const { return m_region.GetSize()[2]; }
-double NiftiImage::getSpacingX() const { return m_spacingX; }
-double NiftiImage::getSpacingY() const { return m_spacingY; }
-double NiftiImage::getSpacingZ() const { return m_spacingZ; }
-
-float NiftiImage::getGlobalMin() const { return m_min; }
-float NiftiImage::getGlobalMax() const { return m_max; }
+    CacheReader in{file->data(), file->size()};
+    const unsigned char *magic = in.take(sizeof(kCacheMagic));
+    if (!magic || std::memcmp(magic, kCacheMagic, sizeof(kCacheMagic)) != 0 ||
+        in.get<uint32_t>() != kCacheByteOrder)
+    {
+        std::cerr << "NiftiImage::loadCached: '" << path << "' is not a cache file of this machine\n";
+        return CacheLoad::Stale;
+    }
+    const int32_t storageCode = in.get<int32_t>();
+    const auto component = static_cast<itk::ImageIOBase::IOComponentType>(in.get<int32_t>());
+    ImageType::SizeType size;
+    ImageType::SpacingType spacing;
+    ImageType::PointType origin;
+    ImageType::DirectionType direction;
+    for (int axis = 0; axis < 3; ++axis)
+        size[axis] = static_cast<size_t>(in.get<uint64_t>());
+    for (int axis = 0; axis < 3; ++axis)
+        spacing[axis] = in.get<double>();
+    for (int axis = 0; axis < 3; ++axis)
+        origin[axis] = in.get<double>();
+    for (int row = 0; row < 3; ++row)
+        for (int col = 0; col < 3; ++col)
+            direction[row][col] = in.get<double>();
+    const float minValue = in.get<float>();
+    const float maxValue = in.get<float>();
+    const bool isMask = in.get<uint8_t>() != 0;
+    const bool integral = in.get<uint8_t>() != 0;
+    const uint64_t bins = in.get<uint64_t>();
+    const unsigned char *histogram = bins <= (size_t(1) << 20) ? in.take(bins * sizeof(uint64_t)) : nullptr;
+    const uint64_t tagBytes = in.get<uint64_t>();
+    const unsigned char *tagData = in.take(tagBytes);
+    const uint64_t slabSlices = in.get<uint64_t>();
+    const uint64_t slabCount = in.get<uint64_t>();
+
+    const StorageType storage = static_cast<StorageType>(storageCode);
+    size_t sampleBytes = 0;
+    if (storageCode >= static_cast<int32_t>(StorageType::Float32) &&
+        storageCode <= static_cast<int32_t>(StorageType::Int16))
+        forStorage(storage, [&](auto tag) { sampleBytes = sizeof(tag); });
+    const size_t sliceBytes = static_cast<size_t>(size[0]) * size[1] * sampleBytes;
+    bool valid = in.ok && histogram && tagData && sampleBytes > 0 && size[0] > 0 && size[1] > 0 && size[2] > 0 &&
+                 slabSlices > 0 && slabCount == (size[2] + slabSlices - 1) / slabSlices;
+    std::vector<CacheSlab> slabs(valid ? slabCount : 0);
+    bool inPlace = valid;
+    for (size_t i = 0; valid && i < slabs.size(); ++i)
+    {
+        slabs[i] = in.get<CacheSlab>();
+        const size_t slices = std::min<size_t>(size[2], (i + 1) * slabSlices) - i * slabSlices;
+        valid = in.ok && slabs[i].raw == slices * sliceBytes && slabs[i].offset <= file->size() &&
+                slabs[i].stored <= file->size() - slabs[i].offset;
+        inPlace = inPlace && slabs[i].stored == slabs[i].raw &&
+                  (i == 0 || slabs[i].offset == slabs[i - 1].offset + slabs[i - 1].raw);
+    }
+    if (!valid)
+    {
+        std::cerr << "NiftiImage::loadCached: '" << path << "' is damaged\n";
+        return CacheLoad::Stale;
+    }
+    if (tagBytes < tagPrefix.size() || std::memcmp(tagData, tagPrefix.data(), tagPrefix.size()) != 0)
+        return CacheLoad::Stale;
 
-bool NiftiImage::save(const std::string &path) const
-{
     try
     {
-        using WriterType = itk::ImageFileWriter<ImageType>;
-        WriterType::Pointer writer = WriterType::New();
-        std::string outpath = path;
-        auto has_suffix = [](const std::string &p, const std::string &suf)
+        ImageType::IndexType start;
+        start.Fill(0);
+        itk::ImageBase<3>::Pointer image = newVolume(storage);
+        image->SetRegions(ImageType::RegionType(start, size));
+        image->SetSpacing(spacing);
+        image->SetOrigin(origin);
+        image->SetDirection(direction);
+
+        if (inPlace)
         {
-            if (p.size() < suf.size())
-                return false;
-            return p.compare(p.size() - suf.size(), suf.size(), suf) == 0;
-        };
-        if (!has_suffix(outpath, ".nii") && !has_suffix(outpath, ".nii.gz"))
-            outpath += ".nii.gz";
-        itk::NiftiImageIO::Pointer nio = itk::NiftiImageIO::New();
-        writer->SetImageIO(nio);
-        writer->SetFileName(outpath);
-        writer->SetInput(m_image);
-        writer->Update();
-        return true;
+            if (!attachMapping(image, storage, file, static_cast<size_t>(slabs[0].offset), sampleBytes, {}))
+                return CacheLoad::Stale;
+        }
+        else
+        {
+            // Inflate the slabs over all cores straight into the buffer.
+            unsigned char *buffer = nullptr;
+            forStorage(storage, [&](auto tag)
+                       {
+                           auto *volume = static_cast<Volume<decltype(tag)> *>(image.GetPointer());
+                           volume->Allocate(false);
+                           buffer = reinterpret_cast<unsigned char *>(volume->GetBufferPointer());
+                       });
+            std::atomic<size_t> next{0};
+            std::atomic<size_t> done{0};
+            std::atomic<bool> stop{false};
+            std::atomic<bool> failed{false};
+            auto work = [&](bool reporter)
+            {
+                for (size_t i = next++; i < slabs.size() && !stop; i = next++)
+                {
+                    const CacheSlab &slab = slabs[i];
+                    unsigned char *dst = buffer + i * slabSlices * sliceBytes;
+                    const unsigned char *src = file->data() + slab.offset;
+                    uLongf got = static_cast<uLongf>(slab.raw);
+                    if (slab.stored == slab.raw)
+                        std::memcpy(dst, src, slab.raw);
+                    else if (uncompress(dst, &got, src, static_cast<uLong>(slab.stored)) != Z_OK || got != slab.raw)
+                    {
+                        failed = true;
+                        stop = true;
+                    }
+                    ++done;
+                    if (reporter && !continueLoad(static_cast<float>(done.load()) / static_cast<float>(slabs.size())))
+                        stop = true;
+                }
+            };
+            const size_t threads = std::max<size_t>(
+                1, std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), slabs.size()));
+            std::vector<std::thread> helpers;
+            for (size_t t = 1; t < threads; ++t)
+                helpers.emplace_back(work, false);
+            work(true);
+            for (std::thread &helper : helpers)
+                helper.join();
+            if (failed)
+            {
+                std::cerr << "NiftiImage::loadCached: '" << path << "' holds a damaged slab\n";
+                return CacheLoad::Stale;
+            }
+            if (stop)
+                return CacheLoad::Cancelled;
+            m_image = image;
+            m_storage = storage;
+            m_region = m_image->GetLargestPossibleRegion();
+            m_mapping.reset();
+            m_lazy.reset();
+        }
     }
     catch (const std::exception &e)
     {
-        std::cerr << "NiftiImage::save: exception: " << e.what() << std::endl;
-        return false;
+        std::cerr << "NiftiImage::loadCached: exception while reading '" << path << "': " << e.what() << std::endl;
+        return CacheLoad::Stale;
     }
+
+    std::cerr << "NiftiImage::loadCached: '" << path << "' " << (m_mapping ? "mapped in place" : "inflated") << "\n";
+    m_component = component;
+    m_spacingX = std::abs(static_cast<double>(spacing[0]));
+    m_spacingY = std::abs(static_cast<double>(spacing[1]));
+    m_spacingZ = std::abs(static_cast<double>(spacing[2]));
+    // The statistics were stored with the entry, so the voxels are not read
+    // again for them.
+    m_min = minValue;
+    m_max = maxValue;
+    m_integral = integral;
+    m_histogram.resize(bins);
+    std::memcpy(m_histogram.data(), histogram, bins * sizeof(uint64_t));
+    finalizeLoad(path, false);
+    m_isMask = isMask;
+    if (tag)
+        tag->assign(reinterpret_cast<const char *>(tagData), tagBytes);
+    return CacheLoad::Hit;
 }
 
 float NiftiImage::getVoxelValue(unsigned int x, unsigned int y, unsigned int z) const
@@ -1063,27 +3221,334 @@ float NiftiImage::getVoxelValue(unsigned int x, unsigned int y, unsigned int z)
     idx[0] = x;
     idx[1] = y;
     idx[2] = z;
-    ImageType::RegionType region = m_image->GetLargestPossibleRegion();
-    if (!region.IsInside(idx))
+    if (!m_region.IsInside(idx))
     {
         return 0.0f;
     }
-    return static_cast<float>(m_image->GetPixel(idx));
+    // Callers walk whole volumes through here, so convert the slice once
+    // rather than one voxel per call.
+    materializeSlices(z, z + 1);
+    float value = 0.0f;
+    visitVolume([&](auto *volume) { value = static_cast<float>(volume->GetPixel(idx)); });
+    return value;
+}
+
+namespace
+{
+
+// The box of `region` clamped to `size`; false when nothing is left of it.
+bool clampRegion(const ThresholdRegion &region, const unsigned int size[3], unsigned int begin[3], unsigned int end[3])
+{
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        end[axis] = std::min(region.end[axis], size[axis]);
+        begin[axis] = std::min(region.begin[axis], end[axis]);
+        if (begin[axis] == end[axis])
+            return false;
+    }
+    return true;
+}
+
+// The threshold as a bound in the sample type, so rows are compared at their
+// own width: a float voxel is hit above the bound, an integer one at or above
+// it (float(v) > t is v >= floor(t) + 1 for whole v). False when no voxel of
+// the type can be hit.
+template <typename T>
+bool thresholdBound(float threshold, T &bound)
+{
+    if (std::is_floating_point<T>::value)
+    {
+        bound = static_cast<T>(threshold);
+        return threshold == threshold;
+    }
+    const float first = std::floor(threshold) + 1.0f;
+    if (!(first <= static_cast<float>(std::numeric_limits<T>::max())))
+        return false; // NaN too
+    bound = first <= static_cast<float>(std::numeric_limits<T>::lowest()) ? std::numeric_limits<T>::lowest()
+                                                                         : static_cast<T>(first);
+    return true;
+}
+
+template <typename T>
+inline bool aboveBound(T v, T bound)
+{
+    return std::is_floating_point<T>::value ? v > bound : v >= bound;
+}
+
+// Rows are walked in blocks of a fixed length so the compiler vectorizes the
+// block bodies even at -O2, whose cost model gives up on loops that need a
+// remainder loop. The rest of each row runs the same body as a scalar loop.
+constexpr unsigned int kThresholdBlock = 16;
+
+// Whether thresholding `count` voxels changes any, as an integer OR so the
+// reduction vectorizes; the masked form reads the mask alongside.
+template <bool Masked, typename T, typename M>
+inline unsigned int spanChanges(const T *__restrict row, const M *__restrict mask, unsigned int count, T bound,
+                                T value)
+{
+    unsigned int any = 0;
+    for (unsigned int x = 0; x < count; ++x)
+        any |= (!Masked || mask[x] != 0) & aboveBound(row[x], bound) & (row[x] != value);
+    return any;
+}
+
+template <bool Masked, typename T, typename M>
+inline void thresholdSpan(T *__restrict row, const M *__restrict mask, unsigned int count, T bound, T value)
+{
+    for (unsigned int x = 0; x < count; ++x)
+    {
+        const bool hit = (!Masked || mask[x] != 0) & aboveBound(row[x], bound);
+        row[x] = hit ? value : row[x];
+    }
+}
+
+template <bool Masked, typename T, typename M>
+bool rowChanges(const T *row, const M *mask, unsigned int x0, unsigned int x1, T bound, T value)
+{
+    unsigned int any = 0;
+    unsigned int x = x0;
+    for (; x + kThresholdBlock <= x1; x += kThresholdBlock)
+        any |= spanChanges<Masked>(row + x, Masked ? mask + x : mask, kThresholdBlock, bound, value);
+    any |= spanChanges<Masked>(row + x, Masked ? mask + x : mask, x1 - x, bound, value);
+    return any != 0;
+}
+
+template <bool Masked, typename T, typename M>
+void thresholdRow(T *row, const M *mask, unsigned int x0, unsigned int x1, T bound, T value)
+{
+    unsigned int x = x0;
+    for (; x + kThresholdBlock <= x1; x += kThresholdBlock)
+        thresholdSpan<Masked>(row + x, Masked ? mask + x : mask, kThresholdBlock, bound, value);
+    thresholdSpan<Masked>(row + x, Masked ? mask + x : mask, x1 - x, bound, value);
+}
+
+using SavedSlices = std::vector<std::pair<unsigned int, std::vector<unsigned char>>>;
+
+// Threshold the box [begin, end) of a volume, slices spread over the cores.
+// Only rows that change are written, and each slice is copied into `saved`
+// (unless null) before its first change. The mask is read as stored.
+template <typename T, typename M>
+void thresholdVolume(T *base, unsigned int sx, unsigned int sy, const unsigned int begin[3], const unsigned int end[3],
+                     const M *mask, float threshold, T value, SavedSlices *saved)
+{
+    T bound;
+    if (!thresholdBound(threshold, bound))
+        return;
+    const size_t plane = static_cast<size_t>(sx) * sy;
+    std::mutex mutex;
+    std::atomic<unsigned int> next{begin[2]};
+    auto work = [&]()
+    {
+        SavedSlices local;
+        for (unsigned int z = next++; z < end[2]; z = next++)
+        {
+            T *slice = base + z * plane;
+            bool kept = false;
+            for (unsigned int y = begin[1]; y < end[1]; ++y)
+            {
+                T *row = slice + static_cast<size_t>(y) * sx;
+                const M *maskRow = mask ? mask + z * plane + static_cast<size_t>(y) * sx : nullptr;
+                const bool changes = maskRow ? rowChanges<true>(row, maskRow, begin[0], end[0], bound, value)
+                                             : rowChanges<false>(row, maskRow, begin[0], end[0], bound, value);
+                if (!changes)
+                    continue;
+                if (saved && !kept)
+                {
+                    const unsigned char *bytes = reinterpret_cast<const unsigned char *>(slice);
+                    local.emplace_back(z, std::vector<unsigned char>(bytes, bytes + plane * sizeof(T)));
+                    kept = true;
+                }
+                if (maskRow)
+                    thresholdRow<true>(row, maskRow, begin[0], end[0], bound, value);
+                else
+                    thresholdRow<false>(row, maskRow, begin[0], end[0], bound, value);
+            }
+        }
+        if (saved)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::move(local.begin(), local.end(), std::back_inserter(*saved));
+        }
+    };
+
+    // A worker per core, but not for boxes too small to be worth a thread.
+    const size_t slices = end[2] - begin[2];
+    const size_t voxels = slices * (end[1] - begin[1]) * (end[0] - begin[0]);
+    const size_t hardware = std::max(1u, std::thread::hardware_concurrency());
+    const size_t threads = std::max<size_t>(1, std::min(hardware, std::min(slices, voxels >> 20)));
+    std::vector<std::thread> helpers;
+    for (size_t t = 1; t < threads; ++t)
+        helpers.emplace_back(work);
+    work();
+    for (std::thread &helper : helpers)
+        helper.join();
 }
 
-void NiftiImage::applyThreshold(float threshold, float newValue)
+} // namespace
+
+void NiftiImage::applyThreshold(float threshold, float newValue, const ThresholdRegion &region)
 {
     if (!m_image)
         return;
-    using IteratorType = itk::ImageRegionIterator<ImageType>;
-    ImageType::RegionType region = m_image->GetLargestPossibleRegion();
-    IteratorType it(m_image, region);
-    for (it.GoToBegin(); !it.IsAtEnd(); ++it)
+    const unsigned int size[3] = {getSizeX(), getSizeY(), getSizeZ()};
+    unsigned int begin[3], end[3];
+    if (!clampRegion(region, size, begin, end))
+        return;
+    UndoLevel level;
+    level.storage = m_storage;
+    // An integer volume keeps its type unless newValue does not fit it.
+    bool representable = true;
+    visitVolume([&](auto *volume)
+                {
+                    using T = typename std::remove_pointer_t<decltype(volume)>::PixelType;
+                    if (!std::is_floating_point<T>::value)
+                        representable = newValue >= static_cast<float>(std::numeric_limits<T>::lowest()) &&
+                                        newValue <= static_cast<float>(std::numeric_limits<T>::max()) &&
+                                        std::nearbyint(newValue) == newValue;
+                });
+    if (!representable)
+    {
+        // Every voxel changes type, so the level keeps the whole old buffer.
+        materializeSlices(0, getSizeZ());
+        level.image = m_image;
+        level.mapping = m_mapping;
+        level.lazy = m_lazy;
+        forStorage(m_storage, [&](auto tag) { level.bytes = m_region.GetNumberOfPixels() * sizeof(tag); });
+        promoteToFloat();
+    }
+    if (m_sagittal)
+        m_sagittal->discard();
+    materializeSlices(begin[2], end[2]);
+    visitVolume([&](auto *volume)
+                {
+                    using T = typename std::remove_pointer_t<decltype(volume)>::PixelType;
+                    auto threshold3D = [&](const auto *mask)
+                    {
+                        thresholdVolume(volume->GetBufferPointer(), size[0], size[1], begin, end, mask, threshold,
+                                        static_cast<T>(newValue), level.image ? nullptr : &level.slabs);
+                    };
+                    if (region.mask)
+                        region.mask->visit(threshold3D);
+                    else
+                        threshold3D(static_cast<const uint8_t *>(nullptr));
+                });
+    std::sort(level.slabs.begin(), level.slabs.end(),
+              [](const auto &a, const auto &b) { return a.first < b.first; });
+    for (const auto &slab : level.slabs)
+        level.bytes += slab.second.size();
+    recordEdit(std::move(level), "applyThreshold");
+}
+
+// Per voxel rather than per row: it covers one slice, and keeps the planes,
+// the box and the lazily converted slices in one loop.
+bool NiftiImage::thresholdPreview(int plane, unsigned int index, float threshold, const ThresholdRegion &region,
+                                  std::vector<unsigned char> &changed) const
+{
+    const unsigned int size[3] = {getSizeX(), getSizeY(), getSizeZ()};
+    const int fixedAxis = plane == 0 ? 2 : plane == 1 ? 0 : 1;
+    if (!m_image || plane < 0 || plane > 2 || index >= size[fixedAxis])
+        return false;
+    const unsigned int width = plane == 1 ? size[1] : size[0];
+    const unsigned int height = plane == 0 ? size[1] : size[2];
+    changed.assign(static_cast<size_t>(width) * height, 0);
+    unsigned int begin[3], end[3];
+    if (!clampRegion(region, size, begin, end) || index < begin[fixedAxis] || index >= end[fixedAxis])
+        return true;
+    if (plane == 0)
+        materializeSlices(index, index + 1);
+    const size_t planeVoxels = static_cast<size_t>(size[0]) * size[1];
+    visitVolume([&](auto *volume)
+                {
+                    const auto *base = volume->GetBufferPointer();
+                    for (unsigned int v = 0; v < height; ++v)
+                        for (unsigned int u = 0; u < width; ++u)
+                        {
+                            itk::Index<3> idx;
+                            idx[0] = plane == 1 ? index : u;
+                            idx[1] = plane == 0 ? v : plane == 1 ? u : index;
+                            idx[2] = plane == 0 ? index : v;
+                            bool inside = true;
+                            for (int axis = 0; axis < 3; ++axis)
+                                inside = inside && static_cast<unsigned int>(idx[axis]) >= begin[axis] &&
+                                         static_cast<unsigned int>(idx[axis]) < end[axis];
+                            const size_t at = idx[2] * planeVoxels + idx[1] * size[0] + idx[0];
+                            if (!inside || (region.mask && (*region.mask)[at] == 0))
+                                continue;
+                            const float value = m_lazy && !m_lazy->isReady(static_cast<unsigned int>(idx[2]))
+                                                    ? voxelAt(idx)
+                                                    : static_cast<float>(base[at]);
+                            changed[static_cast<size_t>(v) * width + u] = value > threshold ? 1 : 0;
+                        }
+                });
+    return true;
+}
+
+void NiftiImage::recordEdit(UndoLevel &&level, const char *edit)
+{
+    if (!level.image && level.slabs.empty())
+        return;
+    if (!m_history)
+        m_history = std::make_shared<EditHistory>();
+    const size_t slabs = level.slabs.size();
+    const size_t bytes = level.bytes;
+    m_history->bytes += level.bytes;
+    ++m_history->edits;
+    m_history->levels.push_back(std::move(level));
+    m_history->trim(m_undoBudget);
+    std::cerr << "NiftiImage::" << edit << ": undo level of "
+              << (slabs ? std::to_string(slabs) + " slices" : std::string("the whole volume")) << " ("
+              << bytes / (1024 * 1024) << " MiB), " << m_history->levels.size() << " level(s) held\n";
+}
+
+bool NiftiImage::undo()
+{
+    if (!m_history || m_history->levels.empty())
+        return false;
+    UndoLevel level = std::move(m_history->levels.back());
+    m_history->levels.pop_back();
+    m_history->bytes -= level.bytes;
+    --m_history->edits;
+    if (level.image)
     {
-        auto v = it.Get();
-        if (v > threshold)
-            it.Set(static_cast<PixelType>(newValue));
+        m_image = level.image;
+        m_storage = level.storage;
+        m_mapping = level.mapping;
+        m_lazy = level.lazy;
+        // Shallow copies made since the edit still use the promoted buffer's layout.
+        m_sagittal = std::make_shared<SagittalLayout>();
+        return true;
     }
+    if (m_sagittal)
+        m_sagittal->discard();
+    visitVolume([&](auto *volume)
+                {
+                    unsigned char *buffer = reinterpret_cast<unsigned char *>(volume->GetBufferPointer());
+                    for (const auto &slab : level.slabs)
+                        std::memcpy(buffer + slab.first * slab.second.size(), slab.second.data(), slab.second.size());
+                });
+    return true;
+}
+
+void NiftiImage::setUndoBudget(size_t bytes)
+{
+    m_undoBudget = bytes;
+    if (m_history)
+        m_history->trim(m_undoBudget);
+}
+
+size_t NiftiImage::undoLevels() const
+{
+    return m_history ? m_history->levels.size() : 0;
+}
+
+bool NiftiImage::isEdited() const
+{
+    return m_history && m_history->edits > 0;
+}
+
+size_t NiftiImage::undoBytes() const
+{
+    return m_history ? m_history->bytes : 0;
 }
 
 NiftiImage NiftiImage::deepCopy() const
@@ -1091,133 +3556,391 @@ NiftiImage NiftiImage::deepCopy() const
     NiftiImage out;
     if (!m_image)
         return out;
-    using DuplicatorType = itk::ImageDuplicator<ImageType>;
-    DuplicatorType::Pointer dup = DuplicatorType::New();
-    dup->SetInputImage(m_image);
-    dup->Update();
-    out.m_image = dup->GetOutput();
+    materializeSlices(0, getSizeZ());
+    visitVolume([&](auto *volume)
+                {
+                    using DuplicatorType = itk::ImageDuplicator<std::remove_pointer_t<decltype(volume)>>;
+                    typename DuplicatorType::Pointer dup = DuplicatorType::New();
+                    dup->SetInputImage(volume);
+                    dup->Update();
+                    out.m_image = dup->GetOutput().GetPointer();
+                });
+    out.m_storage = m_storage;
     out.m_region = out.m_image->GetLargestPossibleRegion();
     out.m_min = m_min;
     out.m_max = m_max;
+    out.m_histogram = m_histogram;
+    out.m_integral = m_integral;
     out.m_spacingX = m_spacingX;
     out.m_spacingY = m_spacingY;
     out.m_spacingZ = m_spacingZ;
     return out;
 }
 
-static void fillRGBFromSlice(const std::vector<PixelType> &slice, std::vector<unsigned char> &out, float lo, float hi, unsigned int w, unsigned int h, bool isMask)
+NiftiImage NiftiImage::downsampled(unsigned int factor, const std::function<bool()> &keepGoing) const
 {
-    out.resize(w * h * 3);
-    if (isMask)
-    {
-        for (unsigned int i = 0; i < w * h; ++i)
-        {
-            float v = slice[i];
-            unsigned char c = (std::abs(v) > 0.5f) ? 255u : 0u; // any non-zero -> 255
-            out[i * 3 + 0] = c;
-            out[i * 3 + 1] = c;
-            out[i * 3 + 2] = c;
-        }
-    }
-    else
+    NiftiImage out;
+    if (!m_image || factor < 2)
+        return out;
+    const unsigned int sx = getSizeX(), sy = getSizeY(), sz = getSizeZ();
+    ImageType::SizeType size;
+    size[0] = (sx + factor - 1) / factor;
+    size[1] = (sy + factor - 1) / factor;
+    size[2] = (sz + factor - 1) / factor;
+    ImageType::IndexType start;
+    start.Fill(0);
+
+    // Each output voxel covers a factor^3 block, so its centre moves by half
+    // a block less one input voxel from the input's first voxel centre.
+    const auto inputSpacing = m_image->GetSpacing();
+    const auto direction = m_image->GetDirection();
+    itk::ImageBase<3>::SpacingType spacing;
+    itk::ImageBase<3>::PointType origin = m_image->GetOrigin();
+    for (unsigned int axis = 0; axis < 3; ++axis)
     {
-        const float denom = (hi - lo != 0.0f) ? (hi - lo) : 1.0f;
-        for (unsigned int i = 0; i < w * h; ++i)
-        {
-            float v = slice[i];
-            if (v < lo)
-                v = lo;
-            if (v > hi)
-                v = hi;
-            unsigned char c = static_cast<unsigned char>(255.0f * (v - lo) / denom);
-            out[i * 3 + 0] = c;
-            out[i * 3 + 1] = c;
-            out[i * 3 + 2] = c;
-        }
+        spacing[axis] = inputSpacing[axis] * factor;
+        for (unsigned int row = 0; row < 3; ++row)
+            origin[row] += direction[row][axis] * inputSpacing[axis] * (factor - 1) / 2.0;
     }
+
+    itk::ImageBase<3>::Pointer image = newVolume(m_storage);
+    image->SetRegions(ImageType::RegionType(start, size));
+    image->SetSpacing(spacing);
+    image->SetOrigin(origin);
+    image->SetDirection(direction);
+    bool complete = true;
+    visitVolume([&](auto *volume)
+                {
+                    using T = typename std::remove_pointer_t<decltype(volume)>::PixelType;
+                    auto *target = static_cast<Volume<T> *>(image.GetPointer());
+                    target->Allocate();
+                    const T *src = volume->GetBufferPointer();
+                    T *dst = target->GetBufferPointer();
+                    const size_t plane = static_cast<size_t>(sx) * sy;
+                    for (unsigned int oz = 0; oz < size[2]; ++oz)
+                    {
+                        if (keepGoing && !keepGoing())
+                        {
+                            complete = false;
+                            return;
+                        }
+                        const unsigned int z0 = oz * factor, z1 = std::min(sz, z0 + factor);
+                        materializeSlices(z0, z1);
+                        for (unsigned int oy = 0; oy < size[1]; ++oy)
+                        {
+                            const unsigned int y0 = oy * factor, y1 = std::min(sy, y0 + factor);
+                            for (unsigned int ox = 0; ox < size[0]; ++ox, ++dst)
+                            {
+                                const unsigned int x0 = ox * factor, x1 = std::min(sx, x0 + factor);
+                                // Labels must stay labels: take one voxel instead of a mean.
+                                if (m_isMask)
+                                {
+                                    *dst = src[z0 * plane + static_cast<size_t>(y0) * sx + x0];
+                                    continue;
+                                }
+                                double sum = 0.0;
+                                for (unsigned int z = z0; z < z1; ++z)
+                                    for (unsigned int y = y0; y < y1; ++y)
+                                    {
+                                        const T *row = src + z * plane + static_cast<size_t>(y) * sx;
+                                        for (unsigned int x = x0; x < x1; ++x)
+                                            sum += static_cast<double>(row[x]);
+                                    }
+                                const double mean = sum / static_cast<double>((z1 - z0) * (y1 - y0) * (x1 - x0));
+                                *dst = std::is_integral<T>::value ? static_cast<T>(std::lround(mean)) : static_cast<T>(mean);
+                            }
+                        }
+                    }
+                });
+    if (!complete)
+        return out;
+
+    out.m_image = image;
+    out.m_storage = m_storage;
+    out.m_region = image->GetLargestPossibleRegion();
+    out.m_min = m_min;
+    out.m_max = m_max;
+    out.m_isMask = m_isMask;
+    out.m_integral = m_integral;
+    out.m_component = m_component;
+    out.m_spacingX = m_spacingX * factor;
+    out.m_spacingY = m_spacingY * factor;
+    out.m_spacingZ = m_spacingZ * factor;
+    return out;
 }
 
-std::vector<unsigned char> NiftiImage::getAxialSliceAsRGB(unsigned int z, float lo, float hi) const
+// The display window of one slice render: grey = (v - lo) * 255 / (hi - lo),
+// clamped, or black/white for masks.
+struct SliceWindow
 {
-    unsigned int w = getSizeX();
-    unsigned int h = getSizeY();
-    std::vector<PixelType> slice(w * h);
-    ImageType::IndexType idx;
-    if (!m_image)
+    float lo = 0.0f;
+    float hi = 1.0f;
+    float scale = 255.0f;
+    bool binary = false;
+};
+
+namespace
+{
+
+// Window `count` samples `step` apart into grey RGB888. The step is a template
+// argument so the contiguous case needs no multiply per sample; contiguous
+// float rows go through the AVX2 kernel below when the CPU has it.
+template <bool Binary>
+inline unsigned char windowGrey(float v, float lo, float hi, float scale)
+{
+    if (Binary)
+        return std::abs(v) > 0.5f ? 255u : 0u; // any non-zero -> 255
+    return static_cast<unsigned char>((std::min(std::max(v, lo), hi) - lo) * scale);
+}
+
+template <size_t Step, bool Binary, typename T>
+void windowRowScalar(const T *src, size_t step, unsigned int count, const SliceWindow &window, unsigned char *out)
+{
+    if (Step != 0)
+        step = Step;
+    const float lo = window.lo, hi = window.hi, scale = window.scale;
+    for (unsigned int i = 0; i < count; ++i, out += 3)
     {
-        // Defensive: if image pointer is null, return a black image buffer
-        std::fill(slice.begin(), slice.end(), PixelType(0));
+        const unsigned char grey = windowGrey<Binary>(static_cast<float>(src[i * step]), lo, hi, scale);
+        out[0] = grey;
+        out[1] = grey;
+        out[2] = grey;
     }
-    else
+}
+
+#if NIFTI_HAVE_AVX2_KERNELS
+// Eight greys as 32-bit lanes. _mm256_max_ps(v, lo) yields lo for NaN, which
+// is black, as the scalar conversion gives.
+template <bool Binary>
+__attribute__((target("avx2"))) inline __m256i windowGreyAvx2(__m256 v, __m256 lo, __m256 hi, __m256 scale)
+{
+    if (Binary)
     {
-        for (unsigned int y = 0; y < h; ++y)
-        {
-            for (unsigned int x = 0; x < w; ++x)
-            {
-                idx[0] = x;
-                idx[1] = y;
-                idx[2] = z;
-                slice[y * w + x] = m_image->GetPixel(idx);
-            }
-        }
+        const __m256 magnitude = _mm256_and_ps(v, _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF)));
+        const __m256 set = _mm256_cmp_ps(magnitude, _mm256_set1_ps(0.5f), _CMP_GT_OQ);
+        return _mm256_and_si256(_mm256_castps_si256(set), _mm256_set1_epi32(255));
     }
-    std::vector<unsigned char> out;
-    fillRGBFromSlice(slice, out, lo, hi, w, h, m_isMask);
-    return out;
+    const __m256 clamped = _mm256_min_ps(_mm256_max_ps(v, lo), hi);
+    return _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_sub_ps(clamped, lo), scale));
 }
 
-std::vector<unsigned char> NiftiImage::getSagittalSliceAsRGB(unsigned int x, float lo, float hi) const
+// Sixteen floats to 48 bytes at a time: window in two registers, pack to
+// bytes, and spread each byte over R, G and B with three byte shuffles.
+// Returns how many samples it wrote; the caller finishes the row.
+template <bool Binary>
+__attribute__((target("avx2"))) unsigned int windowRowAvx2(const float *src, unsigned int count,
+                                                          const SliceWindow &window, unsigned char *out)
 {
-    unsigned int w = getSizeY();
-    unsigned int h = getSizeZ();
-    std::vector<PixelType> slice(w * h);
-    ImageType::IndexType idx;
-    if (!m_image)
+    const __m256 lo = _mm256_set1_ps(window.lo);
+    const __m256 hi = _mm256_set1_ps(window.hi);
+    const __m256 scale = _mm256_set1_ps(window.scale);
+    const __m128i spread0 = _mm_setr_epi8(0, 0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4, 4, 5);
+    const __m128i spread1 = _mm_setr_epi8(5, 5, 6, 6, 6, 7, 7, 7, 8, 8, 8, 9, 9, 9, 10, 10);
+    const __m128i spread2 = _mm_setr_epi8(10, 11, 11, 11, 12, 12, 12, 13, 13, 13, 14, 14, 14, 15, 15, 15);
+    unsigned int i = 0;
+    for (; i + 16 <= count; i += 16, out += 48)
     {
-        std::fill(slice.begin(), slice.end(), PixelType(0));
+        const __m256i a = windowGreyAvx2<Binary>(_mm256_loadu_ps(src + i), lo, hi, scale);
+        const __m256i b = windowGreyAvx2<Binary>(_mm256_loadu_ps(src + i + 8), lo, hi, scale);
+        const __m128i wordsA = _mm_packus_epi32(_mm256_castsi256_si128(a), _mm256_extracti128_si256(a, 1));
+        const __m128i wordsB = _mm_packus_epi32(_mm256_castsi256_si128(b), _mm256_extracti128_si256(b, 1));
+        const __m128i bytes = _mm_packus_epi16(wordsA, wordsB);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm_shuffle_epi8(bytes, spread0));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 16), _mm_shuffle_epi8(bytes, spread1));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 32), _mm_shuffle_epi8(bytes, spread2));
     }
-    else
+    return i;
+}
+#endif
+
+template <size_t Step, bool Binary, typename T>
+void windowRow(const T *src, size_t step, unsigned int count, const SliceWindow &window, unsigned char *out)
+{
+#if NIFTI_HAVE_AVX2_KERNELS
+    if constexpr (Step == 1 && std::is_same<T, float>::value)
     {
-        for (unsigned int z = 0; z < h; ++z)
+        if (cpuHasAvx2())
         {
-            for (unsigned int y = 0; y < w; ++y)
-            {
-                idx[0] = x;
-                idx[1] = y;
-                idx[2] = z;
-                slice[z * w + y] = m_image->GetPixel(idx);
-            }
+            const unsigned int done = windowRowAvx2<Binary>(src, count, window, out);
+            src += done;
+            count -= done;
+            out += 3 * static_cast<size_t>(done);
         }
     }
-    std::vector<unsigned char> out;
-    fillRGBFromSlice(slice, out, lo, hi, w, h, m_isMask);
-    return out;
+#endif
+    windowRowScalar<Step, Binary>(src, step, count, window, out);
 }
 
-std::vector<unsigned char> NiftiImage::getCoronalSliceAsRGB(unsigned int yidx, float lo, float hi) const
+template <typename T>
+void windowRow(const T *src, size_t step, unsigned int count, const SliceWindow &window, unsigned char *out)
 {
-    unsigned int w = getSizeX();
-    unsigned int h = getSizeZ();
-    std::vector<PixelType> slice(w * h);
-    ImageType::IndexType idx;
-    if (!m_image)
+    if (window.binary)
+        step == 1 ? windowRow<1, true>(src, 1, count, window, out) : windowRow<0, true>(src, step, count, window, out);
+    else
+        step == 1 ? windowRow<1, false>(src, 1, count, window, out) : windowRow<0, false>(src, step, count, window, out);
+}
+
+// The same for 8/16-bit samples through a table holding the grey level of
+// every value (indexed like the histogram), so a pixel costs one load.
+template <size_t Step, typename T>
+void windowRowLut(const T *src, size_t step, unsigned int count, const unsigned char *lut, unsigned char *out)
+{
+    if (Step != 0)
+        step = Step;
+    for (unsigned int i = 0; i < count; ++i, out += 3)
     {
-        std::fill(slice.begin(), slice.end(), PixelType(0));
+        const unsigned char grey = lut[histogramBin(src[i * step])];
+        out[0] = grey;
+        out[1] = grey;
+        out[2] = grey;
     }
-    else
+}
+
+template <typename T>
+void windowRowLut(const T *src, size_t step, unsigned int count, const unsigned char *lut, unsigned char *out)
+{
+    step == 1 ? windowRowLut<1>(src, 1, count, lut, out) : windowRowLut<0>(src, step, count, lut, out);
+}
+
+} // namespace
+
+// Plane 0, 1, 2: axial (X by Y), sagittal (Y by Z), coronal (X by Z). Every
+// output row is a run of samples at a fixed step in some buffer, so the row
+// pointer and step are all that differ between planes. Rows of a lazily
+// converted slice that has not been converted yet are read voxel by voxel
+// from the mapping rather than forcing the whole volume in.
+template <int Plane>
+bool NiftiImage::renderSlice(unsigned int index, float lo, float hi, unsigned char *dst, size_t bytesPerLine) const
+{
+    const unsigned int sx = getSizeX(), sy = getSizeY(), sz = getSizeZ();
+    const unsigned int limit = Plane == 0 ? sz : Plane == 1 ? sx : sy;
+    if (!m_image || index >= limit)
+        return false;
+    const unsigned int width = Plane == 1 ? sy : sx;
+    const unsigned int height = Plane == 0 ? sy : sz;
+
+    SliceWindow window;
+    window.lo = lo;
+    window.hi = hi;
+    window.scale = 255.0f / ((hi - lo != 0.0f) ? (hi - lo) : 1.0f);
+    window.binary = m_isMask;
+
+    if (Plane == 0)
+        materializeSlices(index, index + 1);
+    const bool sagittalLayout = Plane == 1 && hasSagittalLayout();
+    const size_t plane = static_cast<size_t>(sx) * sy;
+    std::vector<float> fallback;
+    visitVolume([&](auto *volume)
+                {
+                    using T = typename std::remove_pointer_t<decltype(volume)>::PixelType;
+                    const unsigned char *lut = std::is_floating_point<T>::value ? nullptr : windowLut(window);
+                    const T *base = volume->GetBufferPointer();
+                    if (sagittalLayout)
+                        base = static_cast<const Volume<T> *>(m_sagittal->copy.GetPointer())->GetBufferPointer();
+                    for (unsigned int row = 0; row < height; ++row)
+                    {
+                        unsigned char *out = dst + row * bytesPerLine;
+                        // Z of the samples in this row: the slice for axial, the row otherwise.
+                        const unsigned int z = Plane == 0 ? index : row;
+                        if (Plane != 0 && !sagittalLayout && m_lazy && !m_lazy->isReady(z))
+                        {
+                            fallback.resize(width);
+                            itk::Index<3> idx;
+                            idx[2] = z;
+                            for (unsigned int u = 0; u < width; ++u)
+                            {
+                                idx[0] = Plane == 1 ? index : u;
+                                idx[1] = Plane == 1 ? u : index;
+                                fallback[u] = voxelAt(idx);
+                            }
+                            windowRow(fallback.data(), 1, width, window, out);
+                            continue;
+                        }
+                        const T *src = nullptr;
+                        size_t step = 1;
+                        if (Plane == 0)
+                            src = base + index * plane + static_cast<size_t>(row) * sx;
+                        else if (Plane == 2)
+                            src = base + z * plane + static_cast<size_t>(index) * sx;
+                        else if (sagittalLayout)
+                            src = base + static_cast<size_t>(index) * sy * sz + static_cast<size_t>(z) * sy;
+                        else
+                        {
+                            src = base + z * plane + index;
+                            step = sx;
+                        }
+                        if (lut)
+                            windowRowLut(src, step, width, lut, out);
+                        else
+                            windowRow(src, step, width, window, out);
+                    }
+                });
+    return true;
+}
+
+// Rebuilt only when the window, the mask flag or the storage type changed
+// since the last render, so a window drag costs one table per new window.
+const unsigned char *NiftiImage::windowLut(const SliceWindow &window) const
+{
+    size_t bins = 0;
+    forStorage(m_storage, [&](auto tag)
+               {
+                   using T = decltype(tag);
+                   bins = std::is_floating_point<T>::value ? 0 : kHistogramBins<T>;
+               });
+    if (bins == 0)
+        return nullptr;
+    if (m_windowLut.size() != bins || m_windowLutStorage != m_storage || m_windowLutLo != window.lo ||
+        m_windowLutHi != window.hi || m_windowLutBinary != window.binary)
     {
-        for (unsigned int z = 0; z < h; ++z)
+        m_windowLut.resize(bins);
+        for (uint32_t bin = 0; bin < bins; ++bin)
         {
-            for (unsigned int x = 0; x < w; ++x)
-            {
-                idx[0] = x;
-                idx[1] = yidx;
-                idx[2] = z;
-                slice[z * w + x] = m_image->GetPixel(idx);
-            }
+            const float value = histogramBinValue(m_storage, bin);
+            m_windowLut[bin] = window.binary ? windowGrey<true>(value, window.lo, window.hi, window.scale)
+                                             : windowGrey<false>(value, window.lo, window.hi, window.scale);
         }
+        m_windowLutStorage = m_storage;
+        m_windowLutLo = window.lo;
+        m_windowLutHi = window.hi;
+        m_windowLutBinary = window.binary;
     }
-    std::vector<unsigned char> out;
-    fillRGBFromSlice(slice, out, lo, hi, w, h, m_isMask);
+    return m_windowLut.data();
+}
+
+bool NiftiImage::renderAxialSlice(unsigned int z, float lo, float hi, unsigned char *dst, size_t bytesPerLine) const
+{
+    return renderSlice<0>(z, lo, hi, dst, bytesPerLine);
+}
+
+bool NiftiImage::renderSagittalSlice(unsigned int x, float lo, float hi, unsigned char *dst, size_t bytesPerLine) const
+{
+    return renderSlice<1>(x, lo, hi, dst, bytesPerLine);
+}
+
+bool NiftiImage::renderCoronalSlice(unsigned int y, float lo, float hi, unsigned char *dst, size_t bytesPerLine) const
+{
+    return renderSlice<2>(y, lo, hi, dst, bytesPerLine);
+}
+
+// The vector versions stay black where the render functions refuse.
+std::vector<unsigned char> NiftiImage::getAxialSliceAsRGB(unsigned int z, float lo, float hi) const
+{
+    std::vector<unsigned char> out(static_cast<size_t>(getSizeX()) * getSizeY() * 3, 0);
+    renderAxialSlice(z, lo, hi, out.data(), static_cast<size_t>(getSizeX()) * 3);
+    return out;
+}
+
+std::vector<unsigned char> NiftiImage::getSagittalSliceAsRGB(unsigned int x, float lo, float hi) const
+{
+    std::vector<unsigned char> out(static_cast<size_t>(getSizeY()) * getSizeZ() * 3, 0);
+    renderSagittalSlice(x, lo, hi, out.data(), static_cast<size_t>(getSizeY()) * 3);
+    return out;
+}
+
+std::vector<unsigned char> NiftiImage::getCoronalSliceAsRGB(unsigned int y, float lo, float hi) const
+{
+    std::vector<unsigned char> out(static_cast<size_t>(getSizeX()) * getSizeZ() * 3, 0);
+    renderCoronalSlice(y, lo, hi, out.data(), static_cast<size_t>(getSizeX()) * 3);
     return out;
 }
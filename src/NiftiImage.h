@@ -1,15 +1,29 @@
 #pragma once
 
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
 #include <string>
 #include <vector>
 #include <itkImage.h>
 #include <itkImageFileReader.h>
 
+#include "LabelBuffer.h"
 #include "NpzVolume.h"
 
+// Volumes that are not kept in their on-disk type (see NiftiImage::StorageType)
+// are held as float.
 using PixelType = float;
 using ImageType = itk::Image<PixelType, 3>;
 
+class MappedFile;
+struct LazySlabConverter;
+struct SagittalLayout;
+struct SliceWindow;
+struct UndoLevel;
+struct EditHistory;
+
 // How to turn a numpy array into a 3D medical volume. A .npz/.npy stores raw
 // samples only: no spacing, no origin, no orientation and no axis convention,
 // so all of that has to be supplied or recovered before the volume is usable.
@@ -37,6 +51,7 @@ struct NpzImportOptions
     bool flip[3] = {false, false, false}; // mirror the image X / Y / Z axis after mapping
     double spacing[3] = {0.0, 0.0, 0.0}; // all > 0 overrides the resolved spacing
     std::string referencePath;           // volume to copy geometry from; empty: look for a sibling
+    float minProbability = 0.0f;         // readNumpyArgmax(): a best channel below this is background (0)
 };
 
 // What the importer did, or would do. Filled by both previewNumpy() and
@@ -73,6 +88,29 @@ struct NpzAxisMapping
 bool npzBuildAxisMapping(const std::vector<size_t> &shape, NpzImportOptions::AxisOrder order,
                          NpzAxisMapping &mapping);
 
+// What a volume's header says, for listing it before it is loaded. Filled by
+// NiftiImage::readMetadata() without reading any voxel.
+struct ImageMetadata
+{
+    std::string format;                  // "NIfTI-1", "DICOM", "numpy", or ITK's reader
+    unsigned int size[3] = {0, 0, 0};
+    double spacing[3] = {1.0, 1.0, 1.0};
+    std::string dtype;                   // stored sample type, numpy's name ("int16", ...)
+    uint64_t bytesOnDisk = 0;            // of every slice, for a DICOM series
+    unsigned int files = 1;
+};
+
+// Where NiftiImage::applyThreshold() may change voxels: the box [begin, end)
+// in voxel indices, clamped to the image, and within it only the voxels where
+// `mask` is non-zero when it is set. The mask has the image's size, X fastest.
+struct ThresholdRegion
+{
+    unsigned int begin[3] = {0, 0, 0};
+    unsigned int end[3] = {std::numeric_limits<unsigned int>::max(), std::numeric_limits<unsigned int>::max(),
+                           std::numeric_limits<unsigned int>::max()};
+    const LabelBuffer *mask = nullptr;
+};
+
 class NiftiImage
 {
 public:
@@ -80,7 +118,31 @@ public:
     ~NiftiImage();
 
     bool load(const std::string &path);
-    bool save(const std::string &path) const;
+    // NIfTI-1 in the storage type; ".nii.gz" (also added when the path has no
+    // NIfTI suffix) is deflated on every core at zlib `compressionLevel`
+    // (1 fastest .. 9 smallest, -1 zlib's default).
+    bool save(const std::string &path, int compressionLevel = -1) const;
+    // The decoded volume in VolumeCache's file format: geometry, the load-time
+    // statistics and `tag` (kept verbatim for the caller), then slabs of whole
+    // slices, each deflated when `compress` is set and that makes it smaller.
+    // `keepGoing` is polled once per slab; when it returns false nothing is
+    // left at `path` and false is returned.
+    bool saveCached(const std::string &path, bool compress, const std::string &tag,
+                    const std::function<bool()> &keepGoing = {}) const;
+    // How loadCached() ended: Stale when the file is damaged or its tag does
+    // not start with the expected prefix (nothing in it is worth keeping),
+    // Cancelled when the load monitor stopped it midway (the file is fine).
+    enum class CacheLoad
+    {
+        Hit,
+        Stale,
+        Cancelled
+    };
+    // Read back what saveCached() wrote; Stale, before any voxel is read,
+    // when the tag does not start with `tagPrefix`. When no slab is deflated
+    // the voxels are mapped rather than read, like an uncompressed .nii.
+    CacheLoad loadCached(const std::string &path, const std::string &tagPrefix = std::string(),
+                         std::string *tag = nullptr);
 
     // True for paths this class routes through the numpy importer.
     static bool isNumpyPath(const std::string &path);
@@ -89,18 +151,87 @@ public:
     // What loadNumpy() would produce for these options, without reading voxels.
     static bool previewNumpy(const std::string &path, const NpzImportOptions &options,
                              NpzImportReport &report, std::string *error = nullptr);
+    // Size, spacing and sample type of whatever load() would read from `path`
+    // (numpy files resolved with `options`), from the headers alone: a NIfTI
+    // header, the .npy headers, or the first and last slice of a DICOM series.
+    // Safe to call from any thread.
+    static bool readMetadata(const std::string &path, const NpzImportOptions &options, ImageMetadata &out,
+                             std::string *error = nullptr);
     // Import one numpy array as a volume. Called by load() with default options.
     bool loadNumpy(const std::string &path, const NpzImportOptions &options,
                    NpzImportReport *report = nullptr, std::string *error = nullptr);
+    // One channel of a label array, on the grid loadNumpy() would give it, X
+    // fastest: whole-number samples as they are, others rounded. Converted
+    // straight into `labels` from the mapping, or a slab at a time as a
+    // deflated member is inflated, with no float volume in between. Bytes
+    // and uint16 samples keep their width; wider ones are narrowed after.
+    static bool readNumpyLabels(const std::string &path, const NpzImportOptions &options, LabelBuffer &labels,
+                                NpzImportReport *report = nullptr, std::string *error = nullptr);
+    // The label of a multi-channel (probability) array: per voxel, the index
+    // of its largest channel, on the grid loadNumpy() would give one channel,
+    // X fastest. Ties go to the lower channel and NaN never wins. With
+    // options.minProbability > 0 a voxel whose largest value is below it is 0.
+    // The array is read a block at a time (stored samples are mapped), so
+    // only the labels are held at full size; a deflated array stored channel
+    // by channel is read per block and channel, from its checkpoints. Labels
+    // take one byte per voxel up to 256 channels.
+    static bool readNumpyArgmax(const std::string &path, const NpzImportOptions &options, LabelBuffer &labels,
+                                NpzImportReport *report = nullptr, std::string *error = nullptr);
     // return voxel value at x,y,z (no bounds checking)
     float getVoxelValue(unsigned int x, unsigned int y, unsigned int z) const;
-    // apply threshold: for all voxels with value > threshold, set to newValue
-    void applyThreshold(float threshold, float newValue);
-    // deep copy the image (returns an independent NiftiImage)
+    // apply threshold: for all voxels in `region` with value > threshold, set
+    // to newValue. The slices are spread over the cores.
+    void applyThreshold(float threshold, float newValue, const ThresholdRegion &region = ThresholdRegion());
+    // The pixels of one slice (plane 0/1/2: axial/sagittal/coronal) that
+    // applyThreshold() with these arguments would change, as 0/1 bytes laid
+    // out like the render*Slice rows, tightly packed. Reads only that slice,
+    // so it can follow a threshold slider while it is dragged. False when
+    // there is no image or the index is out of range.
+    bool thresholdPreview(int plane, unsigned int index, float threshold, const ThresholdRegion &region,
+                          std::vector<unsigned char> &changed) const;
+    // Edits (applyThreshold()) can be undone, most recent first. An undo level
+    // keeps only the axial slices its edit changed, so a threshold touching 5%
+    // of them costs 5% of the volume; one that widens the storage type keeps
+    // the former buffer instead of copying it. Levels beyond the budget are
+    // dropped oldest first, including a new one that alone exceeds it, and a
+    // load drops them all. Shallow copies share the levels, so undo through
+    // the copy that made the edit.
+    bool undo(); // false when there is nothing to undo
+    void setUndoBudget(size_t bytes);
+    size_t undoBudget() const { return m_undoBudget; }
+    size_t undoLevels() const;
+    size_t undoBytes() const;
+    // True while an edit since the load has not been undone, even when its
+    // level was dropped for the budget: the voxels then differ from the file.
+    bool isEdited() const;
+    // deep copy the image (returns an independent NiftiImage, without undo levels)
     NiftiImage deepCopy() const;
+    // A copy reduced by `factor` along each axis (block means; one voxel per
+    // block for masks, so labels survive), for drawing while scrolling.
+    // `keepGoing` is polled once per output slice; when it returns false the
+    // copy is abandoned and an empty image is returned.
+    NiftiImage downsampled(unsigned int factor, const std::function<bool()> &keepGoing = {}) const;
+    // Sagittal slices cut across every row of the volume, one voxel per row
+    // stride. buildSagittalLayout() makes a second copy of the voxels with X
+    // outermost so each sagittal slice is contiguous, and the sagittal
+    // accessor uses it once it is there. It costs as much memory as the
+    // volume, so it is opt-in. The copy is shared with shallow copies of this
+    // image (it can be built on one held by a worker thread) and discarded by
+    // edits. `keepGoing` as in downsampled(); false when not built.
+    bool buildSagittalLayout(const std::function<bool()> &keepGoing = {}) const;
+    bool hasSagittalLayout() const;
     std::vector<unsigned char> getAxialSliceAsRGB(unsigned int z, float lo, float hi) const;
     std::vector<unsigned char> getSagittalSliceAsRGB(unsigned int x, float lo, float hi) const;
     std::vector<unsigned char> getCoronalSliceAsRGB(unsigned int y, float lo, float hi) const;
+    // The same slices windowed straight into `dst`: RGB888 rows `bytesPerLine`
+    // apart, such as a QImage's bits(), with no intermediate float copy. The
+    // sizes are those of the matching vector versions. False, with `dst`
+    // untouched, when there is no image or the index is out of range. 8/16-bit
+    // volumes go through a per-window lookup table cached on the image, so
+    // render one image from one thread at a time.
+    bool renderAxialSlice(unsigned int z, float lo, float hi, unsigned char *dst, size_t bytesPerLine) const;
+    bool renderSagittalSlice(unsigned int x, float lo, float hi, unsigned char *dst, size_t bytesPerLine) const;
+    bool renderCoronalSlice(unsigned int y, float lo, float hi, unsigned char *dst, size_t bytesPerLine) const;
 
     unsigned int getSizeX() const;
     unsigned int getSizeY() const;
@@ -112,21 +243,136 @@ public:
     float getGlobalMin() const;
     float getGlobalMax() const;
 
+    // Intensity statistics gathered at load time, in the same pass over every
+    // voxel as the range, mapped volumes included. They describe the
+    // volume as loaded; edits do not update them.
+    // The value below which `fraction` (0..1) of the voxels lie, e.g. 0.01 and
+    // 0.99 for an automatic window. Exact for 8/16-bit volumes, within 0.4%
+    // of the value for float ones.
+    float intensityPercentile(double fraction) const;
+    // Voxel counts in `bins` equal-width bins over [getGlobalMin(), getGlobalMax()].
+    std::vector<uint64_t> intensityHistogram(unsigned int bins) const;
+    // True when every voxel holds a whole number, whatever the storage type.
+    bool hasIntegralValues() const { return m_integral; }
+
     bool isMask() const { return m_isMask; }
+    // True when the voxels are read from a mapped file (an uncompressed .nii,
+    // a stored numpy array or cache entry) rather than held in memory.
+    bool isMapped() const { return m_mapping != nullptr; }
+
+    // Watches the next loads from the thread running them. `progress` gets the
+    // fraction of the voxel data read so far and cancels the load by returning
+    // false (the load then fails). `centralSlice` gets the middle axial slice,
+    // X fastest, as soon as it has been decoded, so a viewer can show it while
+    // the rest is still being read. Either may be empty; not every path can
+    // report both.
+    struct LoadMonitor
+    {
+        std::function<bool(float fraction)> progress;
+        std::function<void(const std::vector<float> &slice, unsigned int width, unsigned int height)> centralSlice;
+    };
+    void setLoadMonitor(LoadMonitor monitor) { m_monitor = std::move(monitor); }
+
+    // How the voxels are held in memory. 8- and 16-bit integer volumes keep
+    // their on-disk type; everything else, and anything rescaled on load
+    // (scl_slope, DICOM rescale), is float. getVoxelValue() and the slice
+    // accessors convert to float on the way out.
+    enum class StorageType
+    {
+        Float32,
+        UInt8,
+        Int8,
+        UInt16,
+        Int16
+    };
+    StorageType storageType() const { return m_storage; }
+    // Bytes the voxel buffer takes once every slice has been read, plus the
+    // sagittal layout when built. Pages of a mapped file count too: they stay
+    // resident while the volume is viewed.
+    size_t memoryBytes() const;
+    // Axial slice z in storage order (X fastest), or null when T is not the
+    // storage type. Valid until the image is reloaded or edited into float.
+    template <typename T>
+    const T *axialSliceData(unsigned int z) const;
 
 private:
     // Loads a DICOM volume from a directory of slices or a single DICOM file.
     bool loadDicomSeries(const std::string &path);
-    // Shared post-read processing (min/max, mask classification, logging).
-    void finalizeLoad(const std::string &path);
+    // Inflates a .nii.gz straight into the image buffer. False (with nothing
+    // changed) for files it leaves to ITK, such as 4D or RGB volumes.
+    bool loadNiftiStreaming(const std::string &path);
+    // Maps an uncompressed .nii instead of reading it. False (with nothing
+    // changed) for files it leaves to ITK, as loadNiftiStreaming().
+    bool loadNiftiMapped(const std::string &path);
+    // Converts `count` stored samples into the storage type at `dst`.
+    using SampleConverter = std::function<void(const unsigned char *, size_t, void *)>;
+    // Back `image` (an unallocated volume of the storage type, regions and
+    // geometry set) with the samples at `dataOffset` in `file`. An empty
+    // `convert` means they already are in the storage type and are used in
+    // place; otherwise each Z slice is converted the first time it is read.
+    bool attachMapping(itk::ImageBase<3>::Pointer image, StorageType storage,
+                       const std::shared_ptr<MappedFile> &file, size_t dataOffset, size_t sampleBytes,
+                       SampleConverter convert);
+    // Make Z slices [z0, z1) of a lazily converted volume valid in m_image.
+    void materializeSlices(unsigned int z0, unsigned int z1) const;
+    // One voxel, read from the mapping when its slice is not converted yet.
+    float voxelAt(const itk::Index<3> &idx) const;
+    // Replace integer storage by float, for edits the storage type cannot hold.
+    void promoteToFloat();
+    // The render*Slice functions; Plane 0/1/2 is axial/sagittal/coronal.
+    template <int Plane>
+    bool renderSlice(unsigned int index, float lo, float hi, unsigned char *dst, size_t bytesPerLine) const;
+    // Grey level per value of 8/16-bit storage under `window` (m_windowLut,
+    // rebuilt on change); null for float storage.
+    const unsigned char *windowLut(const SliceWindow &window) const;
+    // Call f with m_image cast to its concrete itk::Image<T, 3> *.
+    template <typename F>
+    void visitVolume(F &&f) const;
+    // Push the undo level of an edit that just finished (nothing when it
+    // changed no voxel) and trim the history to the budget.
+    void recordEdit(UndoLevel &&level, const char *edit);
+    // Report progress to the load monitor; false when the load was cancelled.
+    bool continueLoad(float fraction) const;
+    // Shared post-read processing (statistics, mask classification, logging).
+    // Without `gatherStats` the range, integrality and histogram already set
+    // are kept (a cache entry stores them) and no voxel is read.
+    void finalizeLoad(const std::string &path, bool gatherStats = true);
 
-    ImageType::Pointer m_image;
-    ImageType::RegionType m_region;
+    itk::ImageBase<3>::Pointer m_image; // an itk::Image<T, 3> for m_storage's T
+    StorageType m_storage = StorageType::Float32;
+    itk::ImageRegion<3> m_region;
     float m_min = 0.0f;
     float m_max = 1.0f;
     double m_spacingX = 1.0;
     double m_spacingY = 1.0;
     double m_spacingZ = 1.0;
     bool m_isMask = false;
+    bool m_integral = false;
+    // Load-time intensity histogram: one bin per value for 8/16-bit storage,
+    // per bfloat16 value for float (see intensityPercentile()).
+    std::vector<uint64_t> m_histogram;
     itk::ImageIOBase::IOComponentType m_component = itk::ImageIOBase::UNKNOWNCOMPONENTTYPE;
+    // Set when m_image lives in (or is converted from) a mapped file.
+    std::shared_ptr<MappedFile> m_mapping;
+    std::shared_ptr<LazySlabConverter> m_lazy;
+    std::shared_ptr<SagittalLayout> m_sagittal; // created by finalizeLoad()
+    std::shared_ptr<EditHistory> m_history;     // created by the first edit
+    size_t m_undoBudget = size_t(1) << 30;
+    LoadMonitor m_monitor;
+    // Cache behind windowLut(): the table and the window it was built for.
+    mutable std::vector<unsigned char> m_windowLut;
+    mutable StorageType m_windowLutStorage = StorageType::Float32;
+    mutable float m_windowLutLo = 0.0f;
+    mutable float m_windowLutHi = 0.0f;
+    mutable bool m_windowLutBinary = false;
 };
+
+template <typename T>
+const T *NiftiImage::axialSliceData(unsigned int z) const
+{
+    auto *image = dynamic_cast<itk::Image<T, 3> *>(m_image.GetPointer());
+    if (!image || z >= getSizeZ())
+        return nullptr;
+    materializeSlices(z, z + 1);
+    return image->GetBufferPointer() + static_cast<size_t>(z) * getSizeX() * getSizeY();
+}
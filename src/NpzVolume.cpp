@@ -1,12 +1,26 @@
 #include "NpzVolume.h"
+#include "MappedFile.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cctype>
+#include <cmath>
 #include <cstdio>
 #include <cstring>
+#include <filesystem>
+#include <functional>
+#include <limits>
+#include <map>
+#include <mutex>
 #include <sstream>
+#include <thread>
 #include <zlib.h>
 
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
 #if defined(_MSC_VER)
 #define NPZ_FSEEK _fseeki64
 #else
@@ -172,25 +186,170 @@ struct Payload
     uint64_t compSize = 0;
     uint64_t uncompSize = 0;
     bool deflated = false;
+    std::string source; // path of the file, naming the member's checkpoint index
+};
+
+// Deflated members are indexed the way zlib's examples/zran.c does it: while a
+// member is inflated, the state at a block boundary is kept every
+// kCheckpointSpan bytes of output (where the block starts in both streams,
+// and the 32 KiB window before it). A later read starts at the last such
+// checkpoint before its offset instead of at the start of the member, so
+// reading channel 4 of a channel-first softmax inflates channel 4, not 0-3
+// first. Indexes live for the process and are dropped when the file changes.
+constexpr uint64_t kCheckpointSpan = uint64_t(4) << 20;
+constexpr size_t kWindowSize = size_t(1) << MAX_WBITS;
+// Windows held over all members; about 1% of the output indexed.
+constexpr size_t kIndexBudget = size_t(64) << 20;
+
+struct Checkpoint
+{
+    uint64_t in = 0;  // compressed bytes before the block, from the payload base
+    int bits = 0;     // bits of the byte before `in` that belong to the block
+    uint64_t out = 0; // uncompressed position of the block
+    std::vector<uint8_t> window;
 };
 
-// Inflate from the start of the member, discarding output until `offset`.
-// Zip members hold a raw deflate stream, hence the negative window bits.
-bool readDeflated(const Payload &p, uint64_t offset, uint64_t count, uint8_t *dst, std::string *error)
+struct MemberIndex
+{
+    std::string stamp; // size and modification time of the file when indexed
+    std::vector<Checkpoint> points;
+};
+
+std::mutex &indexMutex()
+{
+    static std::mutex mutex;
+    return mutex;
+}
+
+std::map<std::string, MemberIndex> &memberIndexes()
+{
+    static std::map<std::string, MemberIndex> indexes;
+    return indexes;
+}
+
+std::string indexKey(const Payload &p)
+{
+    return p.source + '\n' + std::to_string(p.base);
+}
+
+std::string fileStamp(const std::string &path)
+{
+    std::error_code ec;
+    const uintmax_t size = std::filesystem::file_size(path, ec);
+    if (ec)
+        return std::string();
+    const auto modified = std::filesystem::last_write_time(path, ec);
+    if (ec)
+        return std::string();
+    return std::to_string(size) + ' ' + std::to_string(modified.time_since_epoch().count());
+}
+
+// The last checkpoint at or before `offset`, if any, and where the index ends.
+void findCheckpoint(const std::string &key, const std::string &stamp, uint64_t offset, Checkpoint &start,
+                    uint64_t &indexedTo)
+{
+    std::lock_guard<std::mutex> lock(indexMutex());
+    indexedTo = 0;
+    auto it = memberIndexes().find(key);
+    if (it == memberIndexes().end())
+        return;
+    if (it->second.stamp != stamp)
+    {
+        memberIndexes().erase(it);
+        return;
+    }
+    const std::vector<Checkpoint> &points = it->second.points;
+    if (points.empty())
+        return;
+    indexedTo = points.back().out;
+    auto after = std::upper_bound(points.begin(), points.end(), offset,
+                                  [](uint64_t value, const Checkpoint &point) { return value < point.out; });
+    if (after != points.begin())
+        start = *(after - 1);
+}
+
+// Append checkpoints found past the end of the index, within the budget.
+void addCheckpoints(const std::string &key, const std::string &stamp, std::vector<Checkpoint> &found)
+{
+    std::lock_guard<std::mutex> lock(indexMutex());
+    std::map<std::string, MemberIndex> &indexes = memberIndexes();
+    MemberIndex &index = indexes[key];
+    if (index.stamp != stamp)
+    {
+        index.stamp = stamp;
+        index.points.clear();
+    }
+    for (Checkpoint &point : found)
+    {
+        if (index.points.empty() || point.out > index.points.back().out)
+            index.points.push_back(std::move(point));
+    }
+
+    size_t held = 0;
+    for (const auto &entry : indexes)
+        held += entry.second.points.size() * kWindowSize;
+    for (auto it = indexes.begin(); it != indexes.end() && held > kIndexBudget;)
+    {
+        if (it->first == key)
+        {
+            ++it;
+            continue;
+        }
+        held -= it->second.points.size() * kWindowSize;
+        it = indexes.erase(it);
+    }
+    while (held > kIndexBudget && !index.points.empty())
+    {
+        index.points.pop_back();
+        held -= kWindowSize;
+    }
+}
+
+// Inflate the member from the nearest checkpoint, discarding output until
+// `offset`, and index it further on the way. The requested bytes go to `emit`
+// in order, straight from the inflate window; it returns false to stop. Zip
+// members hold a raw deflate stream, hence the negative window bits.
+bool readDeflated(const Payload &p, uint64_t offset, uint64_t count,
+                  const std::function<bool(const uint8_t *, size_t)> &emit, std::string *error)
 {
+    const std::string key = p.source.empty() ? std::string() : indexKey(p);
+    const std::string stamp = key.empty() ? std::string() : fileStamp(p.source);
+    Checkpoint start;
+    uint64_t indexedTo = 0;
+    if (!stamp.empty())
+        findCheckpoint(key, stamp, offset, start, indexedTo);
+
     z_stream zs{};
     if (inflateInit2(&zs, -MAX_WBITS) != Z_OK)
     {
         setError(error, "zlib: inflateInit2 failed");
         return false;
     }
+    if (start.bits > 0)
+    {
+        uint8_t partial = 0;
+        if (!readAt(p.f, p.base + start.in - 1, &partial, 1))
+        {
+            inflateEnd(&zs);
+            setError(error, "failed to read compressed data");
+            return false;
+        }
+        inflatePrime(&zs, start.bits, partial >> (8 - start.bits));
+    }
+    if (!start.window.empty())
+        inflateSetDictionary(&zs, start.window.data(), static_cast<uInt>(start.window.size()));
 
+    // Output goes round `window`, so its last 32 KiB are at hand for a checkpoint.
     std::vector<uint8_t> inBuf(1 << 16);
-    std::vector<uint8_t> outBuf(1 << 16);
-    uint64_t consumedIn = 0;
-    uint64_t produced = 0;
+    std::vector<uint8_t> window(kWindowSize);
+    uint64_t consumedIn = start.in;
+    uint64_t produced = start.out;
     uint64_t written = 0;
+    uint64_t nextCheckpoint = indexedTo + kCheckpointSpan;
+    std::vector<Checkpoint> found;
     int status = Z_OK;
+    zs.next_out = window.data();
+    zs.avail_out = static_cast<uInt>(window.size());
 
     while (written < count)
     {
@@ -210,10 +369,14 @@ bool readDeflated(const Payload &p, uint64_t offset, uint64_t count, uint8_t *ds
             zs.next_in = inBuf.data();
             zs.avail_in = static_cast<uInt>(want);
         }
+        if (zs.avail_out == 0)
+        {
+            zs.next_out = window.data();
+            zs.avail_out = static_cast<uInt>(window.size());
+        }
 
-        zs.next_out = outBuf.data();
-        zs.avail_out = static_cast<uInt>(outBuf.size());
-        status = inflate(&zs, Z_NO_FLUSH);
+        uint8_t *const chunk = zs.next_out;
+        status = inflate(&zs, Z_BLOCK);
         if (status != Z_OK && status != Z_STREAM_END && status != Z_BUF_ERROR)
         {
             inflateEnd(&zs);
@@ -221,7 +384,7 @@ bool readDeflated(const Payload &p, uint64_t offset, uint64_t count, uint8_t *ds
             return false;
         }
 
-        const size_t got = outBuf.size() - zs.avail_out;
+        const size_t got = static_cast<size_t>(zs.next_out - chunk);
         if (got > 0)
         {
             const uint64_t chunkEnd = produced + got;
@@ -231,8 +394,14 @@ bool readDeflated(const Payload &p, uint64_t offset, uint64_t count, uint8_t *ds
                 const uint64_t to = std::min<uint64_t>(offset + count, chunkEnd);
                 if (to > from)
                 {
-                    std::memcpy(dst + (from - offset), outBuf.data() + (from - produced),
-                                static_cast<size_t>(to - from));
+                    if (!emit(chunk + (from - produced), static_cast<size_t>(to - from)))
+                    {
+                        inflateEnd(&zs);
+                        if (!found.empty())
+                            addCheckpoints(key, stamp, found);
+                        setError(error, "cancelled");
+                        return false;
+                    }
                     written += to - from;
                 }
             }
@@ -241,11 +410,28 @@ bool readDeflated(const Payload &p, uint64_t offset, uint64_t count, uint8_t *ds
 
         if (status == Z_STREAM_END)
             break;
+        // Stopped between two blocks, and not before the last one: inflate
+        // can restart here given the window and the unused bits.
+        if (!stamp.empty() && (zs.data_type & 128) && !(zs.data_type & 64) && produced >= nextCheckpoint)
+        {
+            Checkpoint point;
+            point.in = consumedIn - zs.avail_in;
+            point.bits = zs.data_type & 7;
+            point.out = produced;
+            point.window.resize(kWindowSize);
+            const size_t tail = zs.avail_out;
+            std::memcpy(point.window.data(), window.data() + kWindowSize - tail, tail);
+            std::memcpy(point.window.data() + tail, window.data(), kWindowSize - tail);
+            found.push_back(std::move(point));
+            nextCheckpoint = produced + kCheckpointSpan;
+        }
         if (got == 0 && zs.avail_in == 0 && consumedIn >= p.compSize)
             break;
     }
 
     inflateEnd(&zs);
+    if (!found.empty())
+        addCheckpoints(key, stamp, found);
     if (written < count)
     {
         setError(error, "compressed entry ended before the requested range");
@@ -272,7 +458,76 @@ bool readPayload(const Payload &p, uint64_t offset, uint64_t count, uint8_t *dst
         }
         return true;
     }
-    return readDeflated(p, offset, count, dst, error);
+    return readDeflated(p, offset, count,
+                        [&dst](const uint8_t *bytes, size_t size)
+                        {
+                            std::memcpy(dst, bytes, size);
+                            dst += size;
+                            return true;
+                        },
+                        error);
+}
+
+// Bytes [offset, offset + count) of the payload, handed to `consume` in pieces
+// of `pieceBytes` (the last may be shorter) with the position of each within
+// the range. Only one piece is held; a deflated payload is inflated once.
+bool streamPayload(const Payload &p, uint64_t offset, uint64_t count, size_t pieceBytes,
+                   const std::function<bool(const uint8_t *, uint64_t, size_t)> &consume, std::string *error)
+{
+    if (offset + count > p.uncompSize)
+    {
+        setError(error, "read past the end of the array data");
+        return false;
+    }
+    std::vector<uint8_t> piece(static_cast<size_t>(std::min<uint64_t>(pieceBytes, count)));
+    if (!p.deflated)
+    {
+        for (uint64_t at = 0; at < count; at += piece.size())
+        {
+            const size_t size = static_cast<size_t>(std::min<uint64_t>(piece.size(), count - at));
+            if (!readAt(p.f, p.base + offset + at, piece.data(), size))
+            {
+                setError(error, "failed to read array data");
+                return false;
+            }
+            if (!consume(piece.data(), at, size))
+            {
+                setError(error, "cancelled");
+                return false;
+            }
+        }
+        return true;
+    }
+
+    uint64_t pieceStart = 0;
+    size_t filled = 0;
+    auto fill = [&](const uint8_t *bytes, size_t size)
+    {
+        while (size > 0)
+        {
+            const size_t take = std::min(size, piece.size() - filled);
+            std::memcpy(piece.data() + filled, bytes, take);
+            filled += take;
+            bytes += take;
+            size -= take;
+            if (filled == piece.size())
+            {
+                if (!consume(piece.data(), pieceStart, filled))
+                    return false;
+                pieceStart += filled;
+                filled = 0;
+            }
+        }
+        return true;
+    };
+    if (!readDeflated(p, offset, count, fill, error))
+        return false;
+    if (filled > 0 && !consume(piece.data(), pieceStart, filled))
+    {
+        setError(error, "cancelled");
+        return false;
+    }
+    return true;
 }
 
 struct ZipEntry
@@ -567,99 +822,277 @@ bool parseNpyHeader(const Payload &p, ArrayInfo &info, bool &bigEndian, uint64_t
     return parseHeaderDict(header, info, bigEndian, error);
 }
 
+// Exact for every half, subnormals, infinities and NaN included, without a
+// loop or a table: the exponent is rebased with one add, and a subnormal is
+// renormalised by letting the FPU subtract the implicit bit.
 float halfToFloat(uint16_t h)
 {
-    const uint32_t sign = static_cast<uint32_t>(h & 0x8000u) << 16;
-    const uint32_t exponent = (h >> 10) & 0x1Fu;
-    uint32_t mantissa = h & 0x3FFu;
-    uint32_t bits = 0;
-    if (exponent == 0)
+    constexpr uint32_t kExponent = 0x7C00u << 13;
+    uint32_t bits = static_cast<uint32_t>(h & 0x7FFFu) << 13;
+    const uint32_t exponent = bits & kExponent;
+    bits += (127 - 15) << 23;
+    float value = 0.0f;
+    if (exponent == kExponent)
     {
-        if (mantissa != 0)
-        {
-            // Subnormal half: renormalise into a float32 exponent.
-            int shift = 0;
-            while ((mantissa & 0x400u) == 0)
-            {
-                mantissa <<= 1;
-                ++shift;
-            }
-            mantissa &= 0x3FFu;
-            bits = sign | (static_cast<uint32_t>(127 - 15 - shift) << 23) | (mantissa << 13);
-        }
-        else
-        {
-            bits = sign;
-        }
+        bits += (128 - 16) << 23; // Inf / NaN
+        std::memcpy(&value, &bits, sizeof(value));
     }
-    else if (exponent == 0x1Fu)
+    else if (exponent == 0)
     {
-        bits = sign | 0x7F800000u | (mantissa << 13);
+        bits += 1u << 23;
+        std::memcpy(&value, &bits, sizeof(value));
+        value -= 6.103515625e-05f; // 2^-14, the implicit bit added above
     }
     else
     {
-        bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+        std::memcpy(&value, &bits, sizeof(value));
     }
-    float value = 0.0f;
-    std::memcpy(&value, &bits, sizeof(value));
+    return (h & 0x8000u) ? -value : value;
+}
+
+inline uint16_t byteSwap(uint16_t v) { return static_cast<uint16_t>((v >> 8) | (v << 8)); }
+
+inline uint32_t byteSwap(uint32_t v)
+{
+    return (v >> 24) | ((v >> 8) & 0xFF00u) | ((v << 8) & 0xFF0000u) | (v << 24);
+}
+
+inline uint64_t byteSwap(uint64_t v)
+{
+    return (static_cast<uint64_t>(byteSwap(static_cast<uint32_t>(v))) << 32) |
+           byteSwap(static_cast<uint32_t>(v >> 32));
+}
+
+template <size_t Size>
+struct Bits;
+template <>
+struct Bits<2>
+{
+    using type = uint16_t;
+};
+template <>
+struct Bits<4>
+{
+    using type = uint32_t;
+};
+template <>
+struct Bits<8>
+{
+    using type = uint64_t;
+};
+
+// One element of a byte-swapped (big-endian) array.
+template <typename T>
+inline T loadSwapped(const uint8_t *p)
+{
+    typename Bits<sizeof(T)>::type bits;
+    std::memcpy(&bits, p, sizeof(T));
+    bits = byteSwap(bits);
+    T value;
+    std::memcpy(&value, &bits, sizeof(T));
     return value;
 }
 
+template <>
+inline int8_t loadSwapped<int8_t>(const uint8_t *p) { return static_cast<int8_t>(*p); }
+template <>
+inline uint8_t loadSwapped<uint8_t>(const uint8_t *p) { return *p; }
+
+// The kernels for contiguous elements are plain loops the compiler
+// vectorises; the swap is hoisted out so both loops stay branch-free. They
+// are forced inline so the AVX2 entry point below gets its own wide copy.
+#if defined(__GNUC__) || defined(__clang__)
+#define NPZ_KERNEL inline __attribute__((always_inline))
+#else
+#define NPZ_KERNEL inline
+#endif
+
 template <typename T>
-void convertTyped(const uint8_t *src, size_t count, bool swap, float *dst)
+NPZ_KERNEL void convertSpan(const uint8_t *src, size_t count, bool swap, float *dst)
 {
-    constexpr size_t S = sizeof(T);
+    if (swap)
+    {
+        for (size_t i = 0; i < count; ++i)
+            dst[i] = static_cast<float>(loadSwapped<T>(src + i * sizeof(T)));
+        return;
+    }
     for (size_t i = 0; i < count; ++i)
     {
         T value;
+        std::memcpy(&value, src + i * sizeof(T), sizeof(T));
+        dst[i] = static_cast<float>(value);
+    }
+}
+
+NPZ_KERNEL void convertHalfSpan(const uint8_t *src, size_t count, bool swap, float *dst)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        uint16_t raw;
+        std::memcpy(&raw, src + 2 * i, 2);
+        dst[i] = halfToFloat(swap ? byteSwap(raw) : raw);
+    }
+}
+
+NPZ_KERNEL void convertSpanAny(const uint8_t *src, size_t count, DType dtype, bool swap, float *dst)
+{
+    switch (dtype)
+    {
+    case DType::Bool:
+        for (size_t i = 0; i < count; ++i)
+            dst[i] = src[i] != 0 ? 1.0f : 0.0f;
+        break;
+    case DType::Int8: convertSpan<int8_t>(src, count, false, dst); break;
+    case DType::UInt8: convertSpan<uint8_t>(src, count, false, dst); break;
+    case DType::Int16: convertSpan<int16_t>(src, count, swap, dst); break;
+    case DType::UInt16: convertSpan<uint16_t>(src, count, swap, dst); break;
+    case DType::Int32: convertSpan<int32_t>(src, count, swap, dst); break;
+    case DType::UInt32: convertSpan<uint32_t>(src, count, swap, dst); break;
+    case DType::Int64: convertSpan<int64_t>(src, count, swap, dst); break;
+    case DType::UInt64: convertSpan<uint64_t>(src, count, swap, dst); break;
+    case DType::Float32:
+        if (swap)
+            convertSpan<float>(src, count, true, dst);
+        else
+            std::memcpy(dst, src, count * sizeof(float));
+        break;
+    case DType::Float64: convertSpan<double>(src, count, swap, dst); break;
+    case DType::Float16: convertHalfSpan(src, count, swap, dst); break;
+    default: break;
+    }
+}
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define NPZ_HAVE_AVX2_KERNELS 1
+
+// The same kernels built for AVX2, with float16 going through the F16C
+// instruction that converts eight halves at once. Used when the CPU has both.
+__attribute__((target("avx2,f16c"))) void convertSpanAvx2(const uint8_t *src, size_t count, DType dtype, bool swap,
+                                                         float *dst)
+{
+    if (dtype != DType::Float16)
+    {
+        convertSpanAny(src, count, dtype, swap, dst);
+        return;
+    }
+    const __m128i swapBytes = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i halves = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 2 * i));
+        if (swap)
+            halves = _mm_shuffle_epi8(halves, swapBytes);
+        _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(halves));
+    }
+    convertHalfSpan(src + 2 * i, count - i, swap, dst + i);
+}
+
+bool cpuHasAvx2()
+{
+    static const bool has = []
+    {
+        unsigned eax = 0, ebx = 0, ecx = 0, edx = 0;
+        // __builtin_cpu_supports also checks that the OS saves the AVX state.
+        return __builtin_cpu_supports("avx2") && __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_F16C) != 0;
+    }();
+    return has;
+}
+#else
+#define NPZ_HAVE_AVX2_KERNELS 0
+#endif
+
+void convertSpanBest(const uint8_t *src, size_t count, DType dtype, bool swap, float *dst)
+{
+#if NPZ_HAVE_AVX2_KERNELS
+    if (cpuHasAvx2())
+    {
+        convertSpanAvx2(src, count, dtype, swap, dst);
+        return;
+    }
+#endif
+    convertSpanAny(src, count, dtype, swap, dst);
+}
+
+// Contiguous conversions this long are split across cores; a few GB of
+// float16 otherwise takes seconds on one.
+constexpr size_t kConvertChunk = size_t(1) << 20;
+
+// `stride` is in elements and may be negative: a gather walks an axis of the
+// stored array, forwards or mirrored.
+template <typename T>
+void convertTyped(const uint8_t *src, size_t count, ptrdiff_t stride, bool swap, float *dst)
+{
+    constexpr ptrdiff_t S = sizeof(T);
+    for (size_t i = 0; i < count; ++i)
+    {
+        const uint8_t *p = src + static_cast<ptrdiff_t>(i) * stride * S;
         if (swap)
         {
-            uint8_t tmp[S];
-            for (size_t b = 0; b < S; ++b)
-                tmp[b] = src[i * S + (S - 1 - b)];
-            std::memcpy(&value, tmp, S);
+            dst[i] = static_cast<float>(loadSwapped<T>(p));
         }
         else
         {
-            std::memcpy(&value, src + i * S, S);
+            T value;
+            std::memcpy(&value, p, S);
+            dst[i] = static_cast<float>(value);
         }
-        dst[i] = static_cast<float>(value);
     }
 }
 
-void convertRaw(const uint8_t *src, size_t count, DType dtype, bool bigEndian, float *dst)
+void convertRaw(const uint8_t *src, size_t count, DType dtype, bool bigEndian, float *dst, ptrdiff_t stride = 1)
 {
     const bool swap = bigEndian && dtypeSize(dtype) > 1;
+    if (stride == 1)
+    {
+        const size_t chunks = (count + kConvertChunk - 1) / kConvertChunk;
+        if (chunks <= 1)
+        {
+            convertSpanBest(src, count, dtype, swap, dst);
+            return;
+        }
+        const size_t threads = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), chunks);
+        const size_t elemSize = dtypeSize(dtype);
+        std::atomic<size_t> next{0};
+        auto work = [&]()
+        {
+            for (size_t c = next++; c < chunks; c = next++)
+            {
+                const size_t first = c * kConvertChunk;
+                convertSpanBest(src + first * elemSize, std::min(kConvertChunk, count - first), dtype, swap,
+                                dst + first);
+            }
+        };
+        std::vector<std::thread> helpers;
+        for (size_t t = 1; t < threads; ++t)
+            helpers.emplace_back(work);
+        work();
+        for (std::thread &helper : helpers)
+            helper.join();
+        return;
+    }
+
     switch (dtype)
     {
     case DType::Bool:
         for (size_t i = 0; i < count; ++i)
-            dst[i] = src[i] != 0 ? 1.0f : 0.0f;
+            dst[i] = src[static_cast<ptrdiff_t>(i) * stride] != 0 ? 1.0f : 0.0f;
         break;
-    case DType::Int8: convertTyped<int8_t>(src, count, false, dst); break;
-    case DType::UInt8: convertTyped<uint8_t>(src, count, false, dst); break;
-    case DType::Int16: convertTyped<int16_t>(src, count, swap, dst); break;
-    case DType::UInt16: convertTyped<uint16_t>(src, count, swap, dst); break;
-    case DType::Int32: convertTyped<int32_t>(src, count, swap, dst); break;
-    case DType::UInt32: convertTyped<uint32_t>(src, count, swap, dst); break;
-    case DType::Int64: convertTyped<int64_t>(src, count, swap, dst); break;
-    case DType::UInt64: convertTyped<uint64_t>(src, count, swap, dst); break;
-    case DType::Float32: convertTyped<float>(src, count, swap, dst); break;
-    case DType::Float64: convertTyped<double>(src, count, swap, dst); break;
+    case DType::Int8: convertTyped<int8_t>(src, count, stride, false, dst); break;
+    case DType::UInt8: convertTyped<uint8_t>(src, count, stride, false, dst); break;
+    case DType::Int16: convertTyped<int16_t>(src, count, stride, swap, dst); break;
+    case DType::UInt16: convertTyped<uint16_t>(src, count, stride, swap, dst); break;
+    case DType::Int32: convertTyped<int32_t>(src, count, stride, swap, dst); break;
+    case DType::UInt32: convertTyped<uint32_t>(src, count, stride, swap, dst); break;
+    case DType::Int64: convertTyped<int64_t>(src, count, stride, swap, dst); break;
+    case DType::UInt64: convertTyped<uint64_t>(src, count, stride, swap, dst); break;
+    case DType::Float32: convertTyped<float>(src, count, stride, swap, dst); break;
+    case DType::Float64: convertTyped<double>(src, count, stride, swap, dst); break;
     case DType::Float16:
         for (size_t i = 0; i < count; ++i)
         {
             uint16_t raw;
-            if (swap)
-            {
-                const uint8_t tmp[2] = {src[i * 2 + 1], src[i * 2]};
-                std::memcpy(&raw, tmp, 2);
-            }
-            else
-            {
-                std::memcpy(&raw, src + i * 2, 2);
-            }
-            dst[i] = halfToFloat(raw);
+            std::memcpy(&raw, src + static_cast<ptrdiff_t>(i) * stride * 2, 2);
+            dst[i] = halfToFloat(swap ? byteSwap(raw) : raw);
         }
         break;
     default:
@@ -667,6 +1100,156 @@ void convertRaw(const uint8_t *src, size_t count, DType dtype, bool bigEndian, f
     }
 }
 
+// Tiles of kTile x kTile output elements: 16 KiB of float, which stays in L1
+// beside the source and destination lines being walked.
+constexpr size_t kTile = 64;
+
+template <typename T>
+void storeRow(const float *values, size_t count, ptrdiff_t step, T *dst)
+{
+    for (size_t i = 0; i < count; ++i)
+        dst[i] = static_cast<T>(values[static_cast<ptrdiff_t>(i) * step]);
+}
+
+// Labels: rounded to the nearest whole number as std::lround does, clamped to
+// the range, and 0 for NaN.
+void storeRow(const float *values, size_t count, ptrdiff_t step, int32_t *dst)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        const float value = values[static_cast<ptrdiff_t>(i) * step];
+        if (!(value == value))
+            dst[i] = 0;
+        else if (value >= 2147483520.0f)
+            dst[i] = std::numeric_limits<int32_t>::max();
+        else if (value <= -2147483648.0f)
+            dst[i] = std::numeric_limits<int32_t>::min();
+        else
+            dst[i] = static_cast<int32_t>(std::lround(value));
+    }
+}
+
+// `count` values, `step` apart, to dst[at...] of type `dstType`.
+void storeRow(const float *values, size_t count, ptrdiff_t step, DType dstType, void *dst, size_t at)
+{
+    switch (dstType)
+    {
+    case DType::Int32: storeRow(values, count, step, static_cast<int32_t *>(dst) + at); break;
+    case DType::UInt8: storeRow(values, count, step, static_cast<uint8_t *>(dst) + at); break;
+    case DType::Int8: storeRow(values, count, step, static_cast<int8_t *>(dst) + at); break;
+    case DType::UInt16: storeRow(values, count, step, static_cast<uint16_t *>(dst) + at); break;
+    case DType::Int16: storeRow(values, count, step, static_cast<int16_t *>(dst) + at); break;
+    default: storeRow(values, count, step, static_cast<float *>(dst) + at); break;
+    }
+}
+
+// The whole array, as stored at `src`, converted into C order. A Fortran-ordered
+// array is transposed by gather(): its last axis runs along X, the one before
+// along Y and the first, which is stored contiguously, along Z. Axes in between
+// are walked one such block at a time.
+void convertArray(const uint8_t *src, const ArrayInfo &info, bool bigEndian, float *dst)
+{
+    const size_t total = info.elementCount();
+    const size_t nd = info.shape.size();
+    if (!info.fortranOrder || nd < 2 || total == 0)
+    {
+        convertRaw(src, total, info.dtype, bigEndian, dst);
+        return;
+    }
+    std::vector<size_t> fortranStride(nd), cStride(nd);
+    size_t s = 1;
+    for (size_t a = 0; a < nd; ++a)
+    {
+        fortranStride[a] = s;
+        s *= info.shape[a];
+    }
+    s = 1;
+    for (size_t a = nd; a-- > 0;)
+    {
+        cStride[a] = s;
+        s *= info.shape[a];
+    }
+
+    Gather3D walk;
+    walk.size[0] = info.shape[nd - 1];
+    walk.step[0] = static_cast<ptrdiff_t>(fortranStride[nd - 1]);
+    walk.dstStride[0] = cStride[nd - 2];
+    if (nd == 2)
+    {
+        walk.size[1] = info.shape[0];
+        walk.step[1] = 1;
+        walk.size[2] = 1;
+        walk.dstStride[1] = total;
+    }
+    else
+    {
+        walk.size[1] = info.shape[nd - 2];
+        walk.step[1] = static_cast<ptrdiff_t>(fortranStride[nd - 2]);
+        walk.size[2] = info.shape[0];
+        walk.step[2] = 1;
+        walk.dstStride[1] = cStride[0];
+    }
+
+    std::vector<size_t> idx(nd, 0);
+    const size_t blocks = nd > 3 ? total / (info.shape[0] * info.shape[nd - 2] * info.shape[nd - 1]) : 1;
+    for (size_t b = 0; b < blocks; ++b)
+    {
+        size_t from = 0, to = 0;
+        for (size_t a = 1; a + 2 < nd; ++a)
+        {
+            from += idx[a] * fortranStride[a];
+            to += idx[a] * cStride[a];
+        }
+        walk.first = static_cast<ptrdiff_t>(from);
+        gather(src, info.dtype, bigEndian, walk, DType::Float32, dst + to);
+        for (size_t a = nd - 2; a-- > 1;)
+        {
+            if (++idx[a] < info.shape[a])
+                break;
+            idx[a] = 0;
+        }
+    }
+}
+
+bool checkRange(size_t total, size_t offset, size_t &count, std::string *error)
+{
+    if (offset > total)
+    {
+        setError(error, "requested range starts past the end of the array");
+        return false;
+    }
+    if (count == 0)
+        count = total - offset;
+    if (offset + count > total)
+    {
+        setError(error, "requested range extends past the end of the array");
+        return false;
+    }
+    return true;
+}
+
+// A stored (not deflated) payload, mapped: its bytes [offset, offset + count)
+// start at file->data() + p.base + offset.
+bool mapPayload(const std::string &path, const Payload &p, uint64_t offset, uint64_t count,
+                std::shared_ptr<MappedFile> &file, std::string *error)
+{
+    if (offset + count > p.uncompSize)
+    {
+        setError(error, "read past the end of the array data");
+        return false;
+    }
+    file = MappedFile::open(path, error);
+    if (!file)
+        return false;
+    if (p.base + offset + count > file->size())
+    {
+        setError(error, "'" + path + "' is shorter than its header says");
+        file.reset();
+        return false;
+    }
+    return true;
+}
+
 std::string entryArrayName(const std::string &zipName)
 {
     return hasSuffixCi(zipName, ".npy") ? zipName.substr(0, zipName.size() - 4) : zipName;
@@ -722,6 +1305,7 @@ bool openArray(const std::string &path, const std::string &arrayName, FileHandle
     }
     if (!resolvePayload(handle.f, *chosen, payload, error))
         return false;
+    payload.source = path;
     info.name = entryArrayName(chosen->name);
     return parseNpyHeader(payload, info, bigEndian, dataOffset, error);
 }
@@ -773,6 +1357,7 @@ bool inspect(const std::string &path, std::vector<ArrayInfo> &out, std::string *
         Payload payload;
         if (!resolvePayload(handle.f, entry, payload, nullptr))
             continue; // skip members we cannot decode instead of failing the whole archive
+        payload.source = path;
         ArrayInfo info;
         bool bigEndian = false;
         uint64_t dataOffset = 0;
@@ -806,24 +1391,25 @@ bool readAsFloat(const std::string &path, const std::string &arrayName,
         return false;
     }
 
-    const size_t total = info.elementCount();
-    if (offset > total)
-    {
-        setError(error, "requested range starts past the end of the array");
+    if (!checkRange(info.elementCount(), offset, count, error))
         return false;
-    }
-    if (count == 0)
-        count = total - offset;
-    if (offset + count > total)
+
+    const size_t elemSize = dtypeSize(info.dtype);
+    const uint64_t start = dataOffset + static_cast<uint64_t>(offset) * elemSize;
+    const uint64_t bytes = static_cast<uint64_t>(count) * elemSize;
+    if (!payload.deflated)
     {
-        setError(error, "requested range extends past the end of the array");
-        return false;
+        // Converted straight from the mapped pages: no staging copy.
+        std::shared_ptr<MappedFile> file;
+        if (!mapPayload(path, payload, start, bytes, file, error))
+            return false;
+        out.resize(count);
+        convertRaw(file->data() + payload.base + start, count, info.dtype, bigEndian, out.data());
+        return true;
     }
 
-    const size_t elemSize = dtypeSize(info.dtype);
-    std::vector<uint8_t> raw(count * elemSize);
-    if (!readPayload(payload, dataOffset + static_cast<uint64_t>(offset) * elemSize,
-                     static_cast<uint64_t>(count) * elemSize, raw.data(), error))
+    std::vector<uint8_t> raw(static_cast<size_t>(bytes));
+    if (!readPayload(payload, start, bytes, raw.data(), error))
         return false;
 
     out.resize(count);
@@ -843,51 +1429,210 @@ bool readAllAsFloat(const std::string &path, const std::string &arrayName,
         return false;
 
     const size_t total = local.elementCount();
-    const size_t elemSize = dtypeSize(local.dtype);
-    std::vector<uint8_t> raw(total * elemSize);
-    if (!readPayload(payload, dataOffset, static_cast<uint64_t>(total) * elemSize, raw.data(), error))
+    const uint64_t bytes = static_cast<uint64_t>(total) * dtypeSize(local.dtype);
+    if (!payload.deflated)
+    {
+        std::shared_ptr<MappedFile> file;
+        if (!mapPayload(path, payload, dataOffset, bytes, file, error))
+            return false;
+        out.resize(total);
+        convertArray(file->data() + payload.base + dataOffset, local, bigEndian, out.data());
+    }
+    else
+    {
+        std::vector<uint8_t> raw(static_cast<size_t>(bytes));
+        if (!readPayload(payload, dataOffset, bytes, raw.data(), error))
+            return false;
+        out.resize(total);
+        convertArray(raw.data(), local, bigEndian, out.data());
+    }
+
+    if (info)
+        *info = local;
+    return true;
+}
+
+bool locateArrayData(const std::string &path, const std::string &arrayName, ArrayInfo &info, bool &bigEndian,
+                     uint64_t &dataOffset, std::string *error)
+{
+    FileHandle handle;
+    Payload payload;
+    if (!openArray(path, arrayName, handle, payload, info, bigEndian, dataOffset, error))
+        return false;
+    if (payload.deflated)
+    {
+        setError(error, "array '" + info.name + "' is compressed");
+        return false;
+    }
+    const uint64_t dataBytes = static_cast<uint64_t>(info.elementCount()) * dtypeSize(info.dtype);
+    if (dataOffset + dataBytes > payload.uncompSize)
+    {
+        setError(error, "'" + path + "' is shorter than its header says");
+        return false;
+    }
+    dataOffset += payload.base;
+    return true;
+}
+
+void convertToFloat(const uint8_t *src, size_t count, DType dtype, bool bigEndian, float *dst, ptrdiff_t stride)
+{
+    convertRaw(src, count, dtype, bigEndian, dst, stride);
+}
+
+bool readRawElements(const std::string &path, const std::string &arrayName, size_t offset, size_t count,
+                     std::vector<uint8_t> &out, bool &bigEndian, std::string *error)
+{
+    FileHandle handle;
+    Payload payload;
+    ArrayInfo info;
+    uint64_t dataOffset = 0;
+    if (!openArray(path, arrayName, handle, payload, info, bigEndian, dataOffset, error))
         return false;
+    if (!checkRange(info.elementCount(), offset, count, error))
+        return false;
+    const size_t elemSize = dtypeSize(info.dtype);
+    out.resize(count * elemSize);
+    return readPayload(payload, dataOffset + static_cast<uint64_t>(offset) * elemSize, out.size(), out.data(), error);
+}
 
-    std::vector<float> values(total);
-    convertRaw(raw.data(), total, local.dtype, bigEndian, values.data());
-    raw.clear();
-    raw.shrink_to_fit();
+bool streamRawElements(const std::string &path, const std::string &arrayName, size_t offset, size_t count,
+                       size_t chunkElements,
+                       const std::function<bool(const uint8_t *data, size_t first, size_t count)> &consume,
+                       bool &bigEndian, std::string *error)
+{
+    FileHandle handle;
+    Payload payload;
+    ArrayInfo info;
+    uint64_t dataOffset = 0;
+    if (!openArray(path, arrayName, handle, payload, info, bigEndian, dataOffset, error))
+        return false;
+    if (!checkRange(info.elementCount(), offset, count, error))
+        return false;
+    const size_t elemSize = dtypeSize(info.dtype);
+    return streamPayload(payload, dataOffset + static_cast<uint64_t>(offset) * elemSize,
+                         static_cast<uint64_t>(count) * elemSize, std::max<size_t>(1, chunkElements) * elemSize,
+                         [&](const uint8_t *data, uint64_t at, size_t bytes)
+                         { return consume(data, offset + static_cast<size_t>(at / elemSize), bytes / elemSize); },
+                         error);
+}
 
-    if (local.fortranOrder && local.shape.size() > 1)
+void gather(const uint8_t *src, DType dtype, bool bigEndian, const Gather3D &walk, DType dstType, void *dst)
+{
+    const size_t *size = walk.size;
+    if (size[0] == 0 || size[1] == 0 || size[2] == 0)
+        return;
+    const size_t elemSize = dtypeSize(dtype);
+    const size_t dstStride[3] = {1, walk.dstStride[0], walk.dstStride[1]};
+    const bool direct = dstType == DType::Float32;
+
+    // The output axis the stored elements run along, when it is not X: that
+    // axis and X are then walked in tiles, converting runs of the source into
+    // the tile's columns and writing its rows out.
+    int inner = -1;
+    if (walk.step[0] != 1 && walk.step[0] != -1)
     {
-        // Walk C-order positions and gather from the column-major buffer.
-        const size_t nd = local.shape.size();
-        std::vector<size_t> stride(nd);
-        size_t s = 1;
-        for (size_t a = 0; a < nd; ++a)
+        for (int axis = 1; axis < 3 && inner < 0; ++axis)
         {
-            stride[a] = s;
-            s *= local.shape[a];
+            if ((walk.step[axis] == 1 || walk.step[axis] == -1) && size[axis] > 1)
+                inner = axis;
         }
-        out.assign(total, 0.0f);
-        std::vector<size_t> idx(nd, 0);
-        for (size_t c = 0; c < total; ++c)
+    }
+    const int outer = 3 - inner;
+    const size_t blocks = inner < 0 ? (size[1] + kTile - 1) / kTile : (size[inner] + kTile - 1) / kTile;
+    const size_t items = (inner < 0 ? size[2] : size[outer]) * blocks;
+
+    // A run of `count` elements starting at `index`, `step` apart, converted
+    // forwards into `values`; a run stored backwards is converted from its
+    // far end, so it still takes the contiguous kernels.
+    auto convertRun = [&](ptrdiff_t index, size_t count, ptrdiff_t step, float *values)
+    {
+        if (step == -1)
+            index -= static_cast<ptrdiff_t>(count) - 1;
+        convertRaw(src + index * static_cast<ptrdiff_t>(elemSize), count, dtype, bigEndian, values,
+                   step == -1 ? 1 : step);
+    };
+
+    auto rows = [&](size_t item, std::vector<float> &scratch)
+    {
+        const size_t z = item / blocks;
+        const size_t yEnd = std::min(size[1], (item % blocks + 1) * kTile);
+        for (size_t y = (item % blocks) * kTile; y < yEnd; ++y)
         {
-            size_t f = 0;
-            for (size_t a = 0; a < nd; ++a)
-                f += idx[a] * stride[a];
-            out[c] = values[f];
-            for (size_t a = nd; a-- > 0;)
+            const ptrdiff_t index = walk.first + static_cast<ptrdiff_t>(y) * walk.step[1] +
+                                    static_cast<ptrdiff_t>(z) * walk.step[2];
+            const size_t at = y * dstStride[1] + z * dstStride[2];
+            if (direct && walk.step[0] != -1)
             {
-                if (++idx[a] < local.shape[a])
-                    break;
-                idx[a] = 0;
+                convertRaw(src + index * static_cast<ptrdiff_t>(elemSize), size[0], dtype, bigEndian,
+                           static_cast<float *>(dst) + at, walk.step[0]);
+                continue;
             }
+            convertRun(index, size[0], walk.step[0], scratch.data());
+            if (walk.step[0] == -1)
+                storeRow(scratch.data() + size[0] - 1, size[0], -1, dstType, dst, at);
+            else
+                storeRow(scratch.data(), size[0], 1, dstType, dst, at);
         }
-    }
-    else
+    };
+
+    auto tiles = [&](size_t item, std::vector<float> &tile)
     {
-        out = std::move(values);
-    }
+        const size_t o = item / blocks;
+        const size_t i0 = (item % blocks) * kTile;
+        const size_t ni = std::min(kTile, size[inner] - i0);
+        const ptrdiff_t innerStep = walk.step[inner];
+        const ptrdiff_t base = walk.first + static_cast<ptrdiff_t>(o) * walk.step[outer] +
+                               static_cast<ptrdiff_t>(i0) * innerStep;
+        for (size_t x0 = 0; x0 < size[0]; x0 += kTile)
+        {
+            const size_t nx = std::min(kTile, size[0] - x0);
+            for (size_t x = 0; x < nx; ++x)
+                convertRun(base + static_cast<ptrdiff_t>(x0 + x) * walk.step[0], ni, innerStep,
+                           tile.data() + x * kTile);
+            for (size_t i = 0; i < ni; ++i)
+            {
+                const size_t column = innerStep == 1 ? i : ni - 1 - i;
+                storeRow(tile.data() + column, nx, static_cast<ptrdiff_t>(kTile), dstType, dst,
+                         x0 + (i0 + i) * dstStride[inner] + o * dstStride[outer]);
+            }
+        }
+    };
 
-    if (info)
-        *info = local;
-    return true;
+    std::atomic<size_t> next{0};
+    auto work = [&]()
+    {
+        std::vector<float> scratch(inner < 0 ? size[0] : kTile * kTile);
+        for (size_t item = next++; item < items; item = next++)
+        {
+            if (inner < 0)
+                rows(item, scratch);
+            else
+                tiles(item, scratch);
+        }
+    };
+    // Small volumes are not worth a thread.
+    const size_t threads = size[0] * size[1] * size[2] < kConvertChunk
+                               ? 1
+                               : std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), items);
+    std::vector<std::thread> helpers;
+    for (size_t t = 1; t < threads; ++t)
+        helpers.emplace_back(work);
+    work();
+    for (std::thread &helper : helpers)
+        helper.join();
+}
+
+size_t checkpointCount(const std::string &path)
+{
+    std::lock_guard<std::mutex> lock(indexMutex());
+    const std::string prefix = path + '\n';
+    size_t count = 0;
+    for (const auto &entry : memberIndexes())
+    {
+        if (entry.first.compare(0, prefix.size(), prefix) == 0)
+            count += entry.second.points.size();
+    }
+    return count;
 }
 
 } // namespace npz
@@ -2,6 +2,7 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <functional>
 #include <string>
 #include <vector>
 
@@ -50,13 +51,72 @@ bool inspect(const std::string &path, std::vector<ArrayInfo> &out, std::string *
 
 // Read `count` elements starting at C-order element `offset`, converted to float.
 // `count == 0` reads to the end. Rejects Fortran-ordered arrays: their element
-// order differs from the C-order indexing this range assumes.
+// order differs from the C-order indexing this range assumes. Stored data is
+// converted straight from the mapped file; a deflated .npz member is inflated
+// from the nearest checkpoint an earlier read of it left (see
+// checkpointCount()), so a later channel does not cost inflating every
+// channel before it.
 bool readAsFloat(const std::string &path, const std::string &arrayName,
                  size_t offset, size_t count,
                  std::vector<float> &out, std::string *error);
 
-// Read the whole array as float, transposing Fortran-ordered data into C order.
+// Read the whole array as float, transposing Fortran-ordered data into C order
+// in tiles (see gather()). Stored data (a .npy, or a .npz member written by
+// np.savez) is converted straight from the mapped file.
 bool readAllAsFloat(const std::string &path, const std::string &arrayName,
                     ArrayInfo *info, std::vector<float> &out, std::string *error);
 
+// Where the elements of an array start in its file, for callers that map the
+// file instead of reading it: a .npy, or a .npz member stored without
+// compression (np.savez). Elements are stored as-is from `dataOffset` on.
+// Fails for deflated members.
+bool locateArrayData(const std::string &path, const std::string &arrayName, ArrayInfo &info, bool &bigEndian,
+                     uint64_t &dataOffset, std::string *error);
+
+// Convert `count` raw elements to float, exactly as the readers above do.
+// `stride` (in elements, negative to walk backwards) gathers along an axis.
+void convertToFloat(const uint8_t *src, size_t count, DType dtype, bool bigEndian, float *dst,
+                    ptrdiff_t stride = 1);
+
+// The stored bytes of elements [offset, offset + count) in storage order
+// (C or Fortran, as the array says), inflated if need be but not converted.
+// `count == 0` reads to the end.
+bool readRawElements(const std::string &path, const std::string &arrayName, size_t offset, size_t count,
+                     std::vector<uint8_t> &out, bool &bigEndian, std::string *error);
+
+// The same elements, handed to `consume` a chunk of `chunkElements` at a time
+// (the last may be shorter) with the index of the first; it returns false to
+// stop, which fails the read as "cancelled". A deflated member is inflated once,
+// front to back, and only one chunk is held.
+bool streamRawElements(const std::string &path, const std::string &arrayName, size_t offset, size_t count,
+                       size_t chunkElements,
+                       const std::function<bool(const uint8_t *data, size_t first, size_t count)> &consume,
+                       bool &bigEndian, std::string *error);
+
+// A 3D walk through stored elements: output (x, y, z) is element
+// first + x * step[0] + y * step[1] + z * step[2], in elements (negative to
+// walk an axis backwards), and lands at x + y * dstStride[0] + z * dstStride[1].
+struct Gather3D
+{
+    ptrdiff_t first = 0;
+    ptrdiff_t step[3] = {1, 0, 0};
+    size_t size[3] = {0, 0, 0};
+    size_t dstStride[2] = {0, 0};
+};
+
+// Convert the elements `walk` picks from `src` into `dst`, whose type is
+// `dstType`: Float32, an 8/16-bit integer type holding the values exactly, or
+// Int32 for labels, rounded like std::lround (exact up to 2^24, as the values
+// pass through float).
+// When the stored rows do not run along X (a Fortran-ordered array, or
+// another axis order) output and input are both visited in tiles that fit
+// the cache, so the transpose happens once, during conversion. Split across
+// threads.
+void gather(const uint8_t *src, DType dtype, bool bigEndian, const Gather3D &walk, DType dstType, void *dst);
+
+// Restart points held in memory for the deflated members of `path`: one
+// every few MB of output that reads have inflated so far. Forgotten when the
+// file's size or modification time changes.
+size_t checkpointCount(const std::string &path);
+
 } // namespace npz
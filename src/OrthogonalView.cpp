@@ -46,7 +46,12 @@ OrthogonalView::OrthogonalView(QWidget *parent): QWidget(parent) {
 }
 
 void OrthogonalView::setImage(const QImage &img) {
+    setImage(img, img.size());
+}
+
+void OrthogonalView::setImage(const QImage &img, const QSize &logicalSize) {
     m_image = img;
+    m_logicalSize = img.isNull() ? QSize() : logicalSize;
     update();
 }
 
@@ -59,13 +64,13 @@ void OrthogonalView::paintEvent(QPaintEvent *event) {
     p.fillRect(rect(), Qt::black);
     if (!m_image.isNull()) {
         // Fit while keeping the physical aspect ratio, then apply user zoom.
-        const DisplayRect r = computeDisplayRect(m_image.width(), m_image.height(),
+        const DisplayRect r = computeDisplayRect(m_logicalSize.width(), m_logicalSize.height(),
                                                  m_pixelAspect, size(), m_userZoom, m_pan);
         const int w = std::max(1, static_cast<int>(std::lround(r.dispW)));
         const int h = std::max(1, static_cast<int>(std::lround(r.dispH)));
         QImage scaled = m_image.scaled(w, h, Qt::IgnoreAspectRatio, Qt::FastTransformation);
-        const float scaleX = float(scaled.width()) / float(m_image.width());
-        const float scaleY = float(scaled.height()) / float(m_image.height());
+        const float scaleX = float(scaled.width()) / float(m_logicalSize.width());
+        const float scaleY = float(scaled.height()) / float(m_logicalSize.height());
         const int x = r.xoff;
         const int y = r.yoff;
         p.drawImage(QRect(x, y, scaled.width(), scaled.height()), scaled);
@@ -76,8 +81,8 @@ void OrthogonalView::paintEvent(QPaintEvent *event) {
 }
 
 // helper: map widget coords to image coords, returns false if outside image
-static bool widgetToImage(const QImage &img, const QPoint &widgetPos, const QSize &widgetSize, float userZoom, const QPoint &pan, double pixelAspect, int &outX, int &outY) {
-    if (img.isNull()) return false;
+static bool widgetToImage(const QSize &img, const QPoint &widgetPos, const QSize &widgetSize, float userZoom, const QPoint &pan, double pixelAspect, int &outX, int &outY) {
+    if (img.isEmpty()) return false;
     const DisplayRect r = computeDisplayRect(img.width(), img.height(), pixelAspect, widgetSize, userZoom, pan);
     if (r.dispW <= 0.0 || r.dispH <= 0.0) return false;
     const double scaleX = r.dispW / static_cast<double>(img.width());
@@ -97,7 +102,7 @@ void OrthogonalView::mousePressEvent(QMouseEvent *event) {
         return;
     }
     int xi, yi;
-    if (widgetToImage(m_image, event->pos(), size(), m_userZoom, m_pan, m_pixelAspect, xi, yi)) {
+    if (widgetToImage(m_logicalSize, event->pos(), size(), m_userZoom, m_pan, m_pixelAspect, xi, yi)) {
 #if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
         const QPoint globalPos = event->globalPosition().toPoint();
 #else
@@ -120,7 +125,7 @@ void OrthogonalView::mouseReleaseEvent(QMouseEvent *event) {
         return;
     }
     int xi, yi;
-    if (widgetToImage(m_image, event->pos(), size(), m_userZoom, m_pan, m_pixelAspect, xi, yi)) {
+    if (widgetToImage(m_logicalSize, event->pos(), size(), m_userZoom, m_pan, m_pixelAspect, xi, yi)) {
         emit mouseReleased(xi, yi, event->button());
     }
 }
@@ -145,7 +150,7 @@ void OrthogonalView::mouseMoveEvent(QMouseEvent *event) {
         return;
     }
     int xi, yi;
-    if (widgetToImage(m_image, event->pos(), size(), m_userZoom, m_pan, m_pixelAspect, xi, yi)) {
+    if (widgetToImage(m_logicalSize, event->pos(), size(), m_userZoom, m_pan, m_pixelAspect, xi, yi)) {
         if (getenv("MANUAL_SEED_DEBUG")) std::cerr << "mouseMove mapped: widget("<<event->x()<<","<<event->y()<<") -> img("<<xi<<","<<yi<<")\n";
         emit mouseMoved(xi, yi, event->buttons());
     } else {
@@ -12,6 +12,10 @@ public:
     explicit OrthogonalView(QWidget *parent = nullptr);
 
     void setImage(const QImage &img);
+    // A reduced rendering of a slice whose full size is `logicalSize`, as drawn
+    // while scrolling large volumes. It is stretched over the full-size display
+    // rect; mouse coordinates and overlay scales stay in full-size pixels.
+    void setImage(const QImage &img, const QSize &logicalSize);
     /// The slice as last composed, mask overlay included.
     const QImage &image() const { return m_image; }
     void setOverlayDraw(std::function<void(QPainter &p, float scaleX, float scaleY)> func);
@@ -40,6 +44,7 @@ protected:
 
 private:
     QImage m_image;
+    QSize m_logicalSize; // slice size in image pixels; m_image may be smaller
     std::function<void(QPainter &p, float scaleX, float scaleY)> m_overlay;
     double m_pixelAspect = 1.0;
     float m_userZoom = 1.0f;
@@ -0,0 +1,318 @@
+#include "VolumeCache.h"
+
+#include "NiftiImage.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+
+constexpr const char *kEntrySuffix = ".rvc";
+constexpr const char *kPartSuffix = ".part";
+// A part file this old belongs to a store that was killed or crashed; a live
+// one is rewritten slab by slab and renamed long before.
+constexpr auto kStalePartAge = std::chrono::hours(1);
+
+// FNV-1a; the name only has to spread entries, the tag inside each one says
+// exactly which source it holds.
+uint64_t hashText(const std::string &text)
+{
+    uint64_t hash = 1469598103934665603ull;
+    for (unsigned char c : text)
+    {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+std::string absolutePath(const std::string &source)
+{
+    std::error_code ec;
+    const fs::path path = fs::absolute(source, ec);
+    return (ec ? fs::path(source) : path).lexically_normal().string();
+}
+
+// Size and modification time of the source; for a DICOM directory, those of
+// every file in it. Empty when the source cannot be read.
+std::string fingerprint(const std::string &source)
+{
+    std::error_code ec;
+    std::ostringstream out;
+    if (fs::is_directory(source, ec))
+    {
+        uint64_t files = 0;
+        uint64_t bytes = 0;
+        int64_t newest = 0;
+        for (const fs::directory_entry &entry : fs::directory_iterator(source, ec))
+        {
+            std::error_code entryError;
+            if (!entry.is_regular_file(entryError))
+                continue;
+            ++files;
+            bytes += entry.file_size(entryError);
+            newest = std::max<int64_t>(newest, entry.last_write_time(entryError).time_since_epoch().count());
+        }
+        if (ec)
+            return std::string();
+        out << "dir " << files << ' ' << bytes << ' ' << newest;
+        return out.str();
+    }
+    const uintmax_t bytes = fs::file_size(source, ec);
+    if (ec)
+        return std::string();
+    const auto modified = fs::last_write_time(source, ec);
+    if (ec)
+        return std::string();
+    out << "file " << bytes << ' ' << modified.time_since_epoch().count();
+    return out.str();
+}
+
+// What an entry's tag starts with; the caller's note follows it.
+std::string entryTag(const std::string &source, const std::string &variant, const std::string &print)
+{
+    return source + '\n' + variant + '\n' + print + '\n';
+}
+
+fs::path entryPath(const std::string &directory, const std::string &source, const std::string &variant)
+{
+    std::ostringstream name;
+    name << std::hex << hashText(source + '\n' + variant) << kEntrySuffix;
+    return fs::path(directory) / name.str();
+}
+
+bool isEntry(const fs::directory_entry &entry)
+{
+    std::error_code ec;
+    return entry.is_regular_file(ec) && entry.path().extension() == kEntrySuffix;
+}
+
+// An entry being written by store(): "<entry>.rvc.<thread>.part".
+bool isPart(const fs::directory_entry &entry)
+{
+    std::error_code ec;
+    return entry.is_regular_file(ec) && entry.path().extension() == kPartSuffix &&
+           entry.path().filename().string().find(std::string(kEntrySuffix) + '.') != std::string::npos;
+}
+
+// Remove the part files last written before `before`.
+void removeParts(const std::string &directory, fs::file_time_type before)
+{
+    std::error_code ec;
+    std::vector<fs::path> stale;
+    for (const fs::directory_entry &entry : fs::directory_iterator(directory, ec))
+    {
+        std::error_code entryError;
+        if (isPart(entry) && entry.last_write_time(entryError) < before && !entryError)
+            stale.push_back(entry.path());
+    }
+    for (const fs::path &path : stale)
+        fs::remove(path, ec);
+}
+
+} // namespace
+
+void VolumeCache::setDirectory(const std::string &directory)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_settings.directory = directory;
+}
+
+std::string VolumeCache::directory() const
+{
+    return settings().directory;
+}
+
+void VolumeCache::setBudget(std::size_t budgetBytes)
+{
+    Settings current;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_settings.budget = budgetBytes;
+        current = m_settings;
+    }
+    if (!current.directory.empty())
+        evictToFit(current.directory, current.budget, std::string());
+}
+
+std::size_t VolumeCache::budget() const
+{
+    return settings().budget;
+}
+
+void VolumeCache::setCompression(bool compress)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_settings.compress = compress;
+}
+
+bool VolumeCache::compression() const
+{
+    return settings().compress;
+}
+
+VolumeCache::Settings VolumeCache::settings() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_settings;
+}
+
+bool VolumeCache::worthCaching(const std::string &source)
+{
+    std::string lower = source;
+    std::transform(lower.begin(), lower.end(), lower.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return lower.size() < 4 || lower.compare(lower.size() - 4, 4, ".nii") != 0;
+}
+
+bool VolumeCache::load(const std::string &source, const std::string &variant, NiftiImage &image,
+                       std::string *note) const
+{
+    const Settings current = settings();
+    if (current.budget == 0 || current.directory.empty())
+        return false;
+    const std::string path = absolutePath(source);
+    const fs::path entry = entryPath(current.directory, path, variant);
+    std::error_code ec;
+    if (!fs::exists(entry, ec))
+        return false;
+
+    const std::string expected = entryTag(path, variant, fingerprint(path));
+    std::string tag;
+    const NiftiImage::CacheLoad result = image.loadCached(entry.string(), expected, &tag);
+    if (result == NiftiImage::CacheLoad::Cancelled)
+        return false; // the entry is fine; the next load of this source hits it
+    if (result == NiftiImage::CacheLoad::Stale)
+    {
+        // Out of date (the source changed since) or unreadable; either way
+        // the next load stores it afresh.
+        std::cerr << "VolumeCache::load: dropping '" << entry.string() << "' for '" << path << "'\n";
+        fs::remove(entry, ec);
+        return false;
+    }
+    if (note)
+        *note = tag.substr(expected.size());
+    // Reading counts as use: eviction goes by modification time.
+    fs::last_write_time(entry, fs::file_time_type::clock::now(), ec);
+    return true;
+}
+
+bool VolumeCache::store(const std::string &source, const std::string &variant, const NiftiImage &image,
+                        const std::string &note, const std::function<bool()> &keepGoing)
+{
+    const Settings current = settings();
+    if (current.budget == 0 || current.directory.empty() || image.isMapped())
+        return false;
+    const std::string path = absolutePath(source);
+    const std::string print = fingerprint(path);
+    if (print.empty())
+        return false;
+    if (image.memoryBytes() > current.budget)
+        return false;
+
+    std::error_code ec;
+    fs::create_directories(current.directory, ec);
+    const fs::path entry = entryPath(current.directory, path, variant);
+    // Written aside and renamed, so a reader never sees half an entry. The
+    // part name is per thread: a load and a prefetch may store the same one.
+    std::ostringstream partName;
+    partName << entry.filename().string() << '.' << std::hash<std::thread::id>()(std::this_thread::get_id())
+             << ".part";
+    const fs::path part = entry.parent_path() / partName.str();
+    if (!image.saveCached(part.string(), current.compress, entryTag(path, variant, print) + note, keepGoing))
+        return false;
+    fs::rename(part, entry, ec);
+    if (ec)
+    {
+        std::cerr << "VolumeCache::store: could not place '" << entry.string() << "': " << ec.message() << "\n";
+        fs::remove(part, ec);
+        return false;
+    }
+    evictToFit(current.directory, current.budget, entry.string());
+    return true;
+}
+
+std::size_t VolumeCache::usedBytes() const
+{
+    const std::string directory = settings().directory;
+    std::size_t used = 0;
+    std::error_code ec;
+    if (directory.empty())
+        return 0;
+    for (const fs::directory_entry &entry : fs::directory_iterator(directory, ec))
+    {
+        std::error_code entryError;
+        if (isEntry(entry) || isPart(entry))
+            used += static_cast<std::size_t>(entry.file_size(entryError));
+    }
+    return used;
+}
+
+void VolumeCache::clear()
+{
+    const std::string directory = settings().directory;
+    if (directory.empty())
+        return;
+    removeParts(directory, fs::file_time_type::max());
+    evictToFit(directory, 0, std::string());
+}
+
+void VolumeCache::evictToFit(const std::string &directory, std::size_t budget, const std::string &keep)
+{
+    if (directory.empty())
+        return;
+    struct Candidate
+    {
+        fs::path path;
+        std::size_t bytes = 0;
+        fs::file_time_type used;
+    };
+    // Parts left by a store that never finished are garbage; those of stores
+    // still running count against the budget but cannot be evicted.
+    removeParts(directory, fs::file_time_type::clock::now() - kStalePartAge);
+    std::vector<Candidate> entries;
+    std::size_t total = 0;
+    std::error_code ec;
+    for (const fs::directory_entry &entry : fs::directory_iterator(directory, ec))
+    {
+        std::error_code entryError;
+        if (isPart(entry))
+            total += static_cast<std::size_t>(entry.file_size(entryError));
+        if (!isEntry(entry))
+            continue;
+        Candidate candidate;
+        candidate.path = entry.path();
+        candidate.bytes = static_cast<std::size_t>(entry.file_size(entryError));
+        candidate.used = entry.last_write_time(entryError);
+        total += candidate.bytes;
+        entries.push_back(std::move(candidate));
+    }
+    if (total <= budget)
+        return;
+
+    std::sort(entries.begin(), entries.end(),
+              [](const Candidate &a, const Candidate &b) { return a.used < b.used; });
+    for (const Candidate &candidate : entries)
+    {
+        if (total <= budget)
+            break;
+        if (candidate.path.string() == keep)
+            continue;
+        // Fails on Windows while the entry is mapped by an open image; it
+        // goes on a later pass.
+        std::error_code removeError;
+        if (fs::remove(candidate.path, removeError))
+            total -= candidate.bytes;
+    }
+}
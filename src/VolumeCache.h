@@ -0,0 +1,76 @@
+#pragma once
+
+/**
+ * VolumeCache.h — decoded volumes kept on disk between sessions.
+ *
+ * Opening a .nii.gz, a DICOM series or a .npz decodes the whole volume every
+ * time. The cache stores the decoded result (NiftiImage::saveCached) under a
+ * name derived from the source path and how it was read, and checks the
+ * source's size and modification time before handing it back, so a changed
+ * file is decoded again. Entries not deflated are mapped on reopening, which
+ * costs about as much as reading the raw bytes. The directory is kept under
+ * a byte budget by removing the least recently used entries.
+ *
+ * Loads and stores may run on worker threads; the settings are guarded.
+ */
+
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <string>
+
+class NiftiImage;
+
+class VolumeCache
+{
+public:
+    VolumeCache() = default;
+
+    /// Where entries live; created on the first store. Entries already in
+    /// the previous directory stay there.
+    void setDirectory(const std::string &directory);
+    std::string directory() const;
+    /// 0 disables the cache. Shrinking evicts down to the new budget.
+    void setBudget(std::size_t budgetBytes);
+    std::size_t budget() const;
+    /// Deflate the slabs of new entries (smaller, but read rather than mapped).
+    void setCompression(bool compress);
+    bool compression() const;
+
+    /// Sources whose decode the cache can save; an uncompressed .nii is
+    /// already mapped in place, so caching it would only copy it.
+    static bool worthCaching(const std::string &source);
+
+    /// Load `source`, read with `variant` (e.g. the numpy import options),
+    /// into `image`. `note` receives what store() was given. False when there
+    /// is no entry, when it is out of date or unreadable (it is removed), and
+    /// when the image's load monitor cancels the read (it is kept).
+    bool load(const std::string &source, const std::string &variant, NiftiImage &image,
+              std::string *note = nullptr) const;
+    /// Keep `image`, decoded from `source`, then evict down to the budget.
+    /// An image mapped from its source (an image-ordered .npy or a stored
+    /// .npz member) is not kept, for the same reason as worthCaching().
+    /// `keepGoing` is polled once per slab written; when it returns false the
+    /// entry is abandoned.
+    bool store(const std::string &source, const std::string &variant, const NiftiImage &image,
+               const std::string &note = std::string(), const std::function<bool()> &keepGoing = {});
+    /// Bytes the entries in the directory take, those still being written
+    /// (or left behind by a store that never finished) included. Eviction
+    /// removes such leftovers once they are an hour old.
+    std::size_t usedBytes() const;
+    /// Remove every entry and every leftover of an unfinished store.
+    void clear();
+
+private:
+    struct Settings
+    {
+        std::string directory;
+        std::size_t budget = 0;
+        bool compress = false;
+    };
+    Settings settings() const;
+    static void evictToFit(const std::string &directory, std::size_t budget, const std::string &keep);
+
+    mutable std::mutex m_mutex;
+    Settings m_settings;
+};
@@ -0,0 +1,129 @@
+// Checks the image cache's budget accounting and least-recently-used eviction,
+// including an entry recounted after its shared sagittal layout is built.
+//
+// The volumes are small uncompressed NIfTI files written here, so each cache
+// entry has a known size (voxels x 4 bytes of float32).
+#include "ImageCache.h"
+#include "NiftiImage.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+int failures = 0;
+
+void check(bool condition, const char *what)
+{
+    std::printf("%-58s %s\n", what, condition ? "ok" : "FAIL");
+    if (!condition)
+        ++failures;
+}
+
+// Little-endian float32 NIfTI-1 of dimX x dimY x dimZ, filled with a ramp.
+bool writeNifti(const std::string &path, int16_t dimX, int16_t dimY, int16_t dimZ)
+{
+    std::vector<unsigned char> bytes(352, 0);
+    auto put = [&bytes](size_t offset, const void *value, size_t size)
+    { std::memcpy(bytes.data() + offset, value, size); };
+    const int32_t headerSize = 348;
+    put(0, &headerSize, 4);
+    const int16_t dims[8] = {3, dimX, dimY, dimZ, 1, 1, 1, 1};
+    put(40, dims, sizeof(dims));
+    const int16_t datatype = 16;
+    const int16_t bitpix = 32;
+    put(70, &datatype, 2);
+    put(72, &bitpix, 2);
+    const float pixdim[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+    put(76, pixdim, sizeof(pixdim));
+    const float voxOffset = 352.0f;
+    put(108, &voxOffset, 4);
+    std::memcpy(bytes.data() + 344, "n+1\0", 4);
+    for (int i = 0; i < dimX * dimY * dimZ; ++i)
+    {
+        const float value = static_cast<float>(i);
+        const size_t offset = bytes.size();
+        bytes.resize(offset + 4);
+        put(offset, &value, 4);
+    }
+    std::ofstream out(path, std::ios::binary);
+    out.write(reinterpret_cast<const char *>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+    return static_cast<bool>(out);
+}
+
+std::shared_ptr<NiftiImage> loadImage(const std::string &path)
+{
+    auto image = std::make_shared<NiftiImage>();
+    return image->load(path) ? image : nullptr;
+}
+
+} // namespace
+
+int main()
+{
+    const std::filesystem::path dir = std::filesystem::temp_directory_path() / "roift_image_cache_test";
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+
+    const std::string a = (dir / "a.nii").string();
+    const std::string b = (dir / "b.nii").string();
+    const std::string c = (dir / "c.nii").string();
+    check(writeNifti(a, 8, 8, 4) && writeNifti(b, 8, 8, 4) && writeNifti(c, 8, 8, 4), "fixture: three 8x8x4 volumes");
+    const size_t volumeBytes = 8 * 8 * 4 * sizeof(float);
+
+    std::shared_ptr<NiftiImage> imageA = loadImage(a);
+    std::shared_ptr<NiftiImage> imageB = loadImage(b);
+    std::shared_ptr<NiftiImage> imageC = loadImage(c);
+    check(imageA && imageB && imageC, "fixture: volumes load");
+    if (!imageA || !imageB || !imageC)
+        return 1;
+    check(imageA->memoryBytes() == volumeBytes, "memoryBytes: voxels times sample size");
+
+    {
+        ImageCache cache;
+        check(!cache.insert(a, imageA, NpzImportOptions{}) && cache.size() == 0, "zero budget: nothing cached");
+    }
+
+    ImageCache cache(2 * volumeBytes);
+    check(cache.insert(a, imageA, NpzImportOptions{}) && cache.insert(b, imageB, NpzImportOptions{}),
+          "two volumes fit a two-volume budget");
+    check(cache.usedBytes() == 2 * volumeBytes, "used bytes add up");
+
+    // Touch a, so b is the least recently used when c arrives.
+    const ImageCache::Entry *hit = cache.find(a);
+    check(hit && hit->image == imageA, "find returns the stored instance");
+    check(cache.insert(c, imageC, NpzImportOptions{}), "third volume inserted");
+    check(cache.contains(a) && !cache.contains(b) && cache.contains(c), "least recently used entry evicted");
+    check(cache.usedBytes() == 2 * volumeBytes, "used bytes stay within the budget");
+
+    check(cache.insert(c, imageC, NpzImportOptions{}) && cache.size() == 2, "reinserting a key replaces it");
+
+    // A sagittal layout built on a shared copy doubles what the entry holds.
+    const NiftiImage shared = *imageA;
+    cache.setBudget(2 * volumeBytes + volumeBytes / 2);
+    check(cache.insert(a, imageA, NpzImportOptions{}) && cache.find(c) && shared.buildSagittalLayout() &&
+              imageA->memoryBytes() == 2 * volumeBytes,
+          "layout on a shallow copy grows the cached image");
+    check(cache.refresh(a) && cache.usedBytes() == 2 * volumeBytes && !cache.contains(c) && cache.contains(a),
+          "refresh recounts the entry and evicts the others");
+    cache.setBudget(volumeBytes + volumeBytes / 2);
+    check(cache.size() == 0 && !cache.refresh(a), "grown entry above the budget is dropped");
+    check(cache.insert(c, imageC, NpzImportOptions{}), "third volume inserted again");
+
+    cache.setBudget(volumeBytes);
+    check(cache.size() == 1 && cache.contains(c), "shrinking the budget evicts oldest first");
+
+    cache.setBudget(volumeBytes / 2);
+    check(cache.size() == 0 && cache.usedBytes() == 0, "budget below one volume empties the cache");
+
+    std::filesystem::remove_all(dir, ec);
+    std::printf("%s\n", failures == 0 ? "ALL OK" : "FAILURES");
+    return failures == 0 ? 0 : 1;
+}
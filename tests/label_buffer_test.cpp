@@ -0,0 +1,79 @@
+// Checks the width-adaptive label buffer: it starts at one byte per voxel,
+// widens in place (to 16 bits, then 32 for large or negative labels) without
+// losing a voxel, narrows back on request, and lists and compares labels the
+// same at every width. Moving one leaves the source empty.
+#include "LabelBuffer.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+int failures = 0;
+
+void check(bool condition, const char *what)
+{
+    std::printf("%-58s %s\n", what, condition ? "ok" : "FAIL");
+    if (!condition)
+        ++failures;
+}
+
+} // namespace
+
+int main()
+{
+    const size_t count = 100000;
+    LabelBuffer labels(count, 0);
+    check(labels.size() == count && labels.width() == LabelBuffer::Width::Bits8 && labels.bytes() == count,
+          "new buffer: one byte per voxel");
+
+    for (size_t i = 0; i < count; i += 7)
+        labels.set(i, static_cast<int>(i % 200) + 1);
+    labels.set(5, 300);
+    bool kept = labels.width() == LabelBuffer::Width::Bits16 && labels[5] == 300;
+    for (size_t i = 0; i < count; i += 7)
+        kept = kept && labels[i] == static_cast<int>(i % 200) + 1;
+    check(kept, "label 300: widened to 16 bits, voxels kept");
+
+    labels.set(6, -4);
+    labels.set(8, 70000);
+    check(labels.width() == LabelBuffer::Width::Bits32 && labels[6] == -4 && labels[8] == 70000 &&
+              labels[5] == 300 && labels[7] == 8,
+          "negative and large labels: widened to 32 bits");
+
+    const std::vector<int> distinct = labels.distinctLabels();
+    check(distinct.size() == 203 && distinct.front() == -4 && distinct.back() == 70000,
+          "distinct labels at 32 bits");
+
+    labels.set(6, 0);
+    labels.set(8, 0);
+    labels.set(5, 0);
+    LabelBuffer wide = labels;
+    labels.shrinkToFit();
+    check(labels.width() == LabelBuffer::Width::Bits8 && labels == wide && labels.distinctLabels().size() == 200,
+          "shrinkToFit: back to one byte, same voxels");
+
+    size_t nonZero = 0;
+    labels.visit(
+        [&](const auto *data)
+        {
+            for (size_t i = 0; i < labels.size(); ++i)
+                nonZero += data[i] != 0 ? 1 : 0;
+        });
+    check(nonZero == (count + 6) / 7, "visit: reads the stored voxels");
+
+    const int32_t values[4] = {0, 12, 65535, 3};
+    LabelBuffer copied;
+    copied.assign(values, 4);
+    check(copied.width() == LabelBuffer::Width::Bits16 && copied[2] == 65535 && copied[1] == 12,
+          "assign from int32: narrowest width that holds them");
+
+    LabelBuffer moved = std::move(labels);
+    check(moved.size() == count && labels.empty() && labels.bytes() == 0, "move: source left empty");
+
+    std::printf("%s\n", failures == 0 ? "ALL OK" : "FAILURES");
+    return failures == 0 ? 0 : 1;
+}
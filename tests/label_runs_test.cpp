@@ -0,0 +1,97 @@
+// Checks the run-length label volume: an organ-like mask (two labelled
+// spheres, one with a label past 255) encodes to a fraction of its dense size
+// and decodes voxel for voxel, whole, by row and by single voxel, at the width
+// it came from. Noise that would not shrink is refused under a byte budget.
+#include "LabelRuns.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+namespace
+{
+
+int failures = 0;
+
+void check(bool condition, const char *what)
+{
+    std::printf("%-58s %s\n", what, condition ? "ok" : "FAIL");
+    if (!condition)
+        ++failures;
+}
+
+constexpr unsigned int kDimX = 160;
+constexpr unsigned int kDimY = 120;
+constexpr unsigned int kDimZ = 90;
+
+int sphereLabel(unsigned int x, unsigned int y, unsigned int z)
+{
+    auto inside = [&](int cx, int cy, int cz, int r)
+    {
+        const int dx = static_cast<int>(x) - cx, dy = static_cast<int>(y) - cy, dz = static_cast<int>(z) - cz;
+        return dx * dx + dy * dy + dz * dz <= r * r;
+    };
+    if (inside(50, 60, 45, 30))
+        return 3;
+    if (inside(115, 60, 40, 25))
+        return 700;
+    return 0;
+}
+
+} // namespace
+
+int main()
+{
+    const size_t voxels = size_t(kDimX) * kDimY * kDimZ;
+    LabelBuffer dense(voxels, 0);
+    size_t i = 0;
+    for (unsigned int z = 0; z < kDimZ; ++z)
+        for (unsigned int y = 0; y < kDimY; ++y)
+            for (unsigned int x = 0; x < kDimX; ++x, ++i)
+                if (const int label = sphereLabel(x, y, z))
+                    dense.set(i, label);
+
+    LabelRuns runs;
+    check(runs.encode(dense, kDimX, kDimY, kDimZ) && runs.dimX() == kDimX && runs.dimZ() == kDimZ,
+          "spheres: encoded");
+    check(runs.bytes() * 10 < dense.bytes(), "spheres: under a tenth of the dense size");
+    const std::vector<int> labels = runs.distinctLabels();
+    check(labels.size() == 2 && labels[0] == 3 && labels[1] == 700, "spheres: distinct labels");
+
+    LabelBuffer decoded;
+    runs.decode(decoded);
+    check(decoded == dense && decoded.width() == LabelBuffer::Width::Bits16, "decode: same voxels, same width");
+
+    size_t rowMismatches = 0, voxelMismatches = 0;
+    std::vector<int> line(kDimX);
+    i = 0;
+    for (unsigned int z = 0; z < kDimZ; ++z)
+        for (unsigned int y = 0; y < kDimY; ++y)
+        {
+            runs.decodeRow(y, z, line.data());
+            for (unsigned int x = 0; x < kDimX; ++x, ++i)
+            {
+                rowMismatches += line[x] == dense[i] ? 0 : 1;
+                voxelMismatches += runs.at(x, y, z) == dense[i] ? 0 : 1;
+            }
+        }
+    check(rowMismatches == 0, "decodeRow: every row");
+    check(voxelMismatches == 0, "at: every voxel");
+
+    // Alternating labels: a run per voxel, far larger than the dense bytes.
+    LabelBuffer noise(voxels, 0);
+    for (size_t v = 0; v < voxels; v += 2)
+        noise.set(v, 1);
+    LabelRuns refused;
+    check(!refused.encode(noise, kDimX, kDimY, kDimZ, noise.bytes()) && refused.empty(),
+          "noise: refused under the dense size");
+    check(!refused.encode(noise, kDimX, kDimY, kDimZ + 1), "wrong size: refused");
+
+    LabelRuns blank;
+    check(blank.encode(LabelBuffer(voxels, 0), kDimX, kDimY, kDimZ) && blank.runCount() == 0 &&
+              blank.at(5, 5, 5) == 0,
+          "empty mask: index only");
+
+    std::printf("%s\n", failures == 0 ? "ALL OK" : "FAILURES");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,505 @@
+// Checks the memory-mapped load paths for uncompressed .nii and .npy files.
+//
+// Unscaled float32 and 8/16-bit integer data are used in place; everything else
+// is converted one slice at a time as slices are read, so the test reads the
+// volume in the orders the viewer does (single voxels, sagittal rows, whole
+// axial slices) and compares every voxel with ITK. It also checks which type
+// each volume is stored as, that a flipped .npy is gathered from its mapping
+// (as a volume and as labels), that editing a mapped volume never writes
+// back to the file, and that it can be saved over that file. The header-only
+// metadata of the same files is checked last.
+#include "NiftiImage.h"
+
+#include <itkImage.h>
+#include <itkImageFileReader.h>
+#include <itkNiftiImageIO.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+int failures = 0;
+
+void check(bool condition, const char *what)
+{
+    std::printf("%-58s %s\n", what, condition ? "ok" : "FAIL");
+    if (!condition)
+        ++failures;
+}
+
+constexpr int kDimX = 13;
+constexpr int kDimY = 9;
+constexpr int kDimZ = 40;
+
+int ramp(int x, int y, int z) { return x + 20 * y + 300 * z; }
+
+template <typename T>
+void put(std::vector<unsigned char> &bytes, size_t offset, T value, bool bigEndian)
+{
+    unsigned char tmp[sizeof(T)];
+    std::memcpy(tmp, &value, sizeof(T));
+    for (size_t b = 0; b < sizeof(T); ++b)
+        bytes[offset + b] = bigEndian ? tmp[sizeof(T) - 1 - b] : tmp[b];
+}
+
+bool writeBytes(const std::string &path, const std::vector<unsigned char> &bytes)
+{
+    std::ofstream out(path, std::ios::binary);
+    out.write(reinterpret_cast<const char *>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+    return static_cast<bool>(out);
+}
+
+// Uncompressed single-file NIfTI-1 holding ramp() as T.
+template <typename T>
+bool writeNifti(const std::string &path, int16_t datatype, bool bigEndian, float slope, float inter)
+{
+    std::vector<unsigned char> bytes(352, 0);
+    put<int32_t>(bytes, 0, 348, bigEndian);
+    const int16_t dims[8] = {3, kDimX, kDimY, kDimZ, 1, 1, 1, 1};
+    for (int i = 0; i < 8; ++i)
+        put<int16_t>(bytes, 40 + 2 * i, dims[i], bigEndian);
+    put<int16_t>(bytes, 70, datatype, bigEndian);
+    put<int16_t>(bytes, 72, static_cast<int16_t>(8 * sizeof(T)), bigEndian);
+    const float pixdim[4] = {1.0f, 0.5f, 0.5f, 1.25f};
+    for (int i = 0; i < 4; ++i)
+        put<float>(bytes, 76 + 4 * i, pixdim[i], bigEndian);
+    put<float>(bytes, 108, 352.0f, bigEndian);
+    put<float>(bytes, 112, slope, bigEndian);
+    put<float>(bytes, 116, inter, bigEndian);
+    std::memcpy(bytes.data() + 344, "n+1\0", 4);
+    for (int z = 0; z < kDimZ; ++z)
+        for (int y = 0; y < kDimY; ++y)
+            for (int x = 0; x < kDimX; ++x)
+            {
+                const size_t offset = bytes.size();
+                bytes.resize(offset + sizeof(T));
+                put<T>(bytes, offset, static_cast<T>(ramp(x, y, z)), bigEndian);
+            }
+    return writeBytes(path, bytes);
+}
+
+// A C-order (Z, Y, X) .npy holding ramp() as T.
+template <typename T>
+bool writeNpy(const std::string &path, const char *descr)
+{
+    std::string header = std::string("{'descr': '") + descr + "', 'fortran_order': False, 'shape': (" +
+                         std::to_string(kDimZ) + ", " + std::to_string(kDimY) + ", " + std::to_string(kDimX) +
+                         "), }";
+    while ((10 + header.size() + 1) % 64 != 0)
+        header += ' ';
+    header += '\n';
+
+    std::vector<unsigned char> bytes = {0x93, 'N', 'U', 'M', 'P', 'Y', 1, 0,
+                                        static_cast<unsigned char>(header.size() & 0xFF),
+                                        static_cast<unsigned char>(header.size() >> 8)};
+    bytes.insert(bytes.end(), header.begin(), header.end());
+    for (int z = 0; z < kDimZ; ++z)
+        for (int y = 0; y < kDimY; ++y)
+            for (int x = 0; x < kDimX; ++x)
+            {
+                const size_t offset = bytes.size();
+                bytes.resize(offset + sizeof(T));
+                put<T>(bytes, offset, static_cast<T>(ramp(x, y, z)), false);
+            }
+    return writeBytes(path, bytes);
+}
+
+// Reads a sagittal slice first so some slices are sampled before they are
+// converted, then an axial one, then every voxel.
+size_t countMismatches(const NiftiImage &image, float slope, float inter)
+{
+    image.getSagittalSliceAsRGB(4, 0.0f, 1.0f);
+    image.getAxialSliceAsRGB(kDimZ / 3, 0.0f, 1.0f);
+    size_t mismatches = 0;
+    for (int z = 0; z < kDimZ; ++z)
+        for (int y = 0; y < kDimY; ++y)
+            for (int x = 0; x < kDimX; ++x)
+            {
+                const float expected = slope * static_cast<float>(ramp(x, y, z)) + inter;
+                if (std::abs(image.getVoxelValue(x, y, z) - expected) > 1e-4f * std::max(1.0f, std::abs(expected)))
+                    ++mismatches;
+            }
+    return mismatches;
+}
+
+void compareWithItk(const std::string &path, const char *what)
+{
+    NiftiImage image;
+    const bool loaded = image.load(path);
+    std::string label = std::string(what) + ": loads";
+    check(loaded, label.c_str());
+    if (!loaded)
+        return;
+
+    using ReferenceType = itk::Image<float, 3>;
+    using ReaderType = itk::ImageFileReader<ReferenceType>;
+    ReaderType::Pointer reader = ReaderType::New();
+    reader->SetImageIO(itk::NiftiImageIO::New());
+    reader->SetFileName(path);
+    try
+    {
+        reader->Update();
+    }
+    catch (const std::exception &e)
+    {
+        std::printf("ITK could not read %s: %s\n", path.c_str(), e.what());
+        ++failures;
+        return;
+    }
+    ReferenceType::Pointer reference = reader->GetOutput();
+
+    const auto spacing = reference->GetSpacing();
+    label = std::string(what) + ": spacing matches ITK";
+    check(std::abs(image.getSpacingX() - std::abs(spacing[0])) < 1e-6 &&
+              std::abs(image.getSpacingY() - std::abs(spacing[1])) < 1e-6 &&
+              std::abs(image.getSpacingZ() - std::abs(spacing[2])) < 1e-6,
+          label.c_str());
+
+    // Sagittal first, so unconverted slices are read through the mapping.
+    image.getSagittalSliceAsRGB(4, 0.0f, 1.0f);
+    size_t mismatches = 0;
+    for (int z = 0; z < kDimZ; ++z)
+        for (int y = 0; y < kDimY; ++y)
+            for (int x = 0; x < kDimX; ++x)
+            {
+                ReferenceType::IndexType idx;
+                idx[0] = x;
+                idx[1] = y;
+                idx[2] = z;
+                const float expected = reference->GetPixel(idx);
+                if (std::abs(image.getVoxelValue(x, y, z) - expected) > 1e-4f * std::max(1.0f, std::abs(expected)))
+                    ++mismatches;
+            }
+    label = std::string(what) + ": voxels match ITK";
+    check(mismatches == 0, label.c_str());
+}
+
+} // namespace
+
+int main()
+{
+    const std::filesystem::path dir = std::filesystem::temp_directory_path() / "roift_nifti_mapped_test";
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+
+    const std::string floatPath = (dir / "float.nii").string();
+    check(writeNifti<float>(floatPath, 16, false, 0.0f, 0.0f), "fixture: float32 .nii");
+    compareWithItk(floatPath, "float32 in place");
+
+    const std::string int16Path = (dir / "int16.nii").string();
+    check(writeNifti<int16_t>(int16Path, 4, false, 0.0f, 0.0f), "fixture: int16 .nii");
+    compareWithItk(int16Path, "int16 in place");
+
+    const std::string scaledPath = (dir / "scaled.nii").string();
+    check(writeNifti<uint16_t>(scaledPath, 512, true, 0.5f, -1024.0f), "fixture: big-endian scaled uint16 .nii");
+    compareWithItk(scaledPath, "scaled uint16 per-slice");
+
+    {
+        NiftiImage int16Image;
+        int16Image.load(int16Path);
+        check(int16Image.storageType() == NiftiImage::StorageType::Int16, "int16 .nii: stored as int16");
+        NiftiImage scaledImage;
+        scaledImage.load(scaledPath);
+        check(scaledImage.storageType() == NiftiImage::StorageType::Float32, "scaled uint16 .nii: stored as float");
+
+        // Every ramp value is distinct, so percentiles are ranks in z, y, x order.
+        check(int16Image.getGlobalMin() == 0.0f && int16Image.getGlobalMax() == ramp(kDimX - 1, kDimY - 1, kDimZ - 1),
+              "int16 stats: range from the histogram");
+        check(int16Image.intensityPercentile(0.0) == 0.0f &&
+                  int16Image.intensityPercentile(0.5) == ramp(kDimX - 1, kDimY - 1, kDimZ / 2 - 1) &&
+                  int16Image.intensityPercentile(1.0) == int16Image.getGlobalMax(),
+              "int16 stats: exact percentiles");
+        const std::vector<uint64_t> histogram = int16Image.intensityHistogram(kDimZ);
+        check(histogram.size() == static_cast<size_t>(kDimZ) &&
+                  std::all_of(histogram.begin(), histogram.end(),
+                              [](uint64_t count) { return count == static_cast<uint64_t>(kDimX) * kDimY; }),
+              "int16 stats: one Z slice per histogram bin");
+        check(int16Image.hasIntegralValues() && !scaledImage.hasIntegralValues(), "stats: integral vs. scaled values");
+        check(scaledImage.getGlobalMin() == -1024.0f &&
+                  scaledImage.getGlobalMax() == 0.5f * ramp(kDimX - 1, kDimY - 1, kDimZ - 1) - 1024.0f,
+              "scaled stats: range of every unconverted slice");
+
+        // Labels in two slices of a deep volume: every slice counts, so this
+        // is neither mistaken for a binary mask nor windowed to [0, 1].
+        std::vector<unsigned char> labels(352, 0);
+        std::ifstream header(int16Path, std::ios::binary);
+        header.read(reinterpret_cast<char *>(labels.data()), 352);
+        const int labelDimZ = 100;
+        put<int16_t>(labels, 46, labelDimZ, false);
+        const size_t sliceVoxels = static_cast<size_t>(kDimX) * kDimY;
+        labels.resize(352 + sizeof(int16_t) * sliceVoxels * labelDimZ, 0);
+        for (size_t i = 0; i < sliceVoxels; ++i)
+        {
+            put<int16_t>(labels, 352 + sizeof(int16_t) * (38 * sliceVoxels + i), 3, false);
+            put<int16_t>(labels, 352 + sizeof(int16_t) * (50 * sliceVoxels + i), 2, false);
+        }
+        const std::string labelPath = (dir / "labels.nii").string();
+        NiftiImage labelImage;
+        check(writeBytes(labelPath, labels) && labelImage.load(labelPath) && !labelImage.isMask() &&
+                  labelImage.getGlobalMax() == 3.0f && labelImage.intensityPercentile(1.0) == 3.0f,
+              "sparse labels: exact range, not a binary mask");
+
+        // 2x2x2 block means, rounded; the odd last column averages what there is.
+        const NiftiImage half = int16Image.downsampled(2);
+        check(half.getSizeX() == (kDimX + 1) / 2 && half.getSizeZ() == kDimZ / 2 &&
+                  half.storageType() == NiftiImage::StorageType::Int16 &&
+                  half.getSpacingZ() == 2 * int16Image.getSpacingZ(),
+              "downsampled: size, storage and spacing");
+        check(half.getVoxelValue(1, 1, 1) == std::lround((ramp(2, 2, 2) + ramp(3, 3, 3)) / 2.0) &&
+                  half.getVoxelValue(kDimX / 2, 0, 0) == (ramp(kDimX - 1, 0, 0) + ramp(kDimX - 1, 1, 1)) / 2,
+              "downsampled: block means");
+        check(int16Image.downsampled(2, [] { return false; }).getSizeX() == 0, "downsampled: cancelled copy is empty");
+
+        const std::vector<unsigned char> sagittal = int16Image.getSagittalSliceAsRGB(5, 0.0f, 12000.0f);
+        check(int16Image.buildSagittalLayout() && int16Image.hasSagittalLayout() &&
+                  int16Image.getSagittalSliceAsRGB(5, 0.0f, 12000.0f) == sagittal,
+              "sagittal layout: same slice from the X-major copy");
+
+        // Padded rows, as in a QImage whose width is not a multiple of four.
+        const size_t bytesPerLine = kDimX * 3 + 5;
+        std::vector<unsigned char> padded(bytesPerLine * kDimZ, 7);
+        const std::vector<unsigned char> coronal = int16Image.getCoronalSliceAsRGB(3, 100.0f, 9000.0f);
+        bool rowsMatch = int16Image.renderCoronalSlice(3, 100.0f, 9000.0f, padded.data(), bytesPerLine);
+        for (int z = 0; z < kDimZ; ++z)
+            rowsMatch = rowsMatch &&
+                        std::equal(coronal.begin() + z * kDimX * 3, coronal.begin() + (z + 1) * kDimX * 3,
+                                   padded.begin() + z * bytesPerLine) &&
+                        padded[z * bytesPerLine + kDimX * 3] == 7;
+        check(rowsMatch && !int16Image.renderCoronalSlice(kDimY, 0.0f, 1.0f, padded.data(), bytesPerLine),
+              "render: rows land at the given stride");
+
+        // Slice 0 is below the threshold below, so the float copy must window
+        // it exactly like the lookup table did; two windows catch a stale table.
+        const std::vector<unsigned char> lutWide = int16Image.getAxialSliceAsRGB(0, 0.0f, 12000.0f);
+        const std::vector<unsigned char> lutNarrow = int16Image.getAxialSliceAsRGB(0, 150.5f, 2300.0f);
+
+        // Only the last two slices hold values above this, so only they are kept.
+        const size_t sliceBytes = kDimX * kDimY * sizeof(int16_t);
+        int16Image.applyThreshold(static_cast<float>(ramp(kDimX - 1, kDimY - 1, kDimZ - 3)), 7.0f);
+        check(int16Image.storageType() == NiftiImage::StorageType::Int16 && int16Image.undoLevels() == 1 &&
+                  int16Image.undoBytes() == 2 * sliceBytes && int16Image.getVoxelValue(0, 0, kDimZ - 1) == 7.0f,
+              "undo: threshold keeps the slices it changed");
+        int16Image.applyThreshold(static_cast<float>(ramp(kDimX - 1, kDimY - 1, kDimZ - 1)), 0.0f);
+        check(int16Image.undoLevels() == 1, "undo: an edit changing nothing adds no level");
+
+        // 0.5 does not fit in int16, so the threshold has to widen the volume.
+        int16Image.applyThreshold(static_cast<float>(ramp(0, 0, 1)), 0.5f);
+        check(int16Image.storageType() == NiftiImage::StorageType::Float32, "int16 threshold: promoted to float");
+        check(!int16Image.hasSagittalLayout(), "sagittal layout: dropped by the edit");
+        check(int16Image.getVoxelValue(1, 1, 1) == 0.5f && int16Image.getVoxelValue(1, 1, 0) == ramp(1, 1, 0),
+              "int16 threshold: values after promotion");
+        check(lutWide != lutNarrow && int16Image.getAxialSliceAsRGB(0, 0.0f, 12000.0f) == lutWide &&
+                  int16Image.getAxialSliceAsRGB(0, 150.5f, 2300.0f) == lutNarrow,
+              "render: lookup table matches the float path");
+
+        check(int16Image.undoLevels() == 2 && int16Image.undo() &&
+                  int16Image.storageType() == NiftiImage::StorageType::Int16 &&
+                  int16Image.getVoxelValue(1, 1, 1) == ramp(1, 1, 1) && int16Image.getVoxelValue(0, 0, kDimZ - 1) == 7.0f,
+              "undo: promoting threshold restores the int16 buffer");
+        check(int16Image.undo() && int16Image.getVoxelValue(0, 0, kDimZ - 1) == ramp(0, 0, kDimZ - 1) &&
+                  int16Image.getVoxelValue(kDimX - 1, kDimY - 1, kDimZ - 1) == ramp(kDimX - 1, kDimY - 1, kDimZ - 1) &&
+                  !int16Image.undo() && int16Image.undoBytes() == 0 && !int16Image.isEdited(),
+              "undo: slices restored, then nothing left");
+        int16Image.applyThreshold(static_cast<float>(ramp(0, 0, kDimZ - 1)), 1.0f);
+        int16Image.applyThreshold(static_cast<float>(ramp(0, 0, kDimZ - 2)), 2.0f);
+        int16Image.setUndoBudget(int16Image.undoBytes() - 1);
+        check(int16Image.undoLevels() == 1 && int16Image.undo() && int16Image.getVoxelValue(1, 0, kDimZ - 1) == 1.0f,
+              "undo: budget drops the oldest level");
+        check(int16Image.undoLevels() == 0 && int16Image.isEdited(), "undo: a dropped level's edit still counts");
+
+        int16Image.setUndoBudget(size_t(1) << 30);
+        ThresholdRegion box;
+        box.begin[0] = 2;
+        box.end[0] = 5;
+        box.begin[2] = kDimZ - 4;
+        box.end[2] = kDimZ - 2;
+        int16Image.applyThreshold(-1.0f, 0.0f, box);
+        check(int16Image.getVoxelValue(2, 8, kDimZ - 4) == 0.0f && int16Image.getVoxelValue(4, 0, kDimZ - 3) == 0.0f &&
+                  int16Image.getVoxelValue(5, 0, kDimZ - 3) == ramp(5, 0, kDimZ - 3) &&
+                  int16Image.getVoxelValue(2, 0, kDimZ - 2) == ramp(2, 0, kDimZ - 2) &&
+                  int16Image.undoBytes() == 2 * sliceBytes,
+              "threshold: limited to the box");
+
+        LabelBuffer mask(kDimX * kDimY * kDimZ, 0);
+        mask.set((5 * kDimY + 4) * kDimX + 3, 1);
+        ThresholdRegion masked;
+        masked.mask = &mask;
+        std::vector<unsigned char> axialPreview, sagittalPreview;
+        check(int16Image.thresholdPreview(0, 5, -1.0f, masked, axialPreview) &&
+                  int16Image.thresholdPreview(1, 3, -1.0f, masked, sagittalPreview) &&
+                  std::count(axialPreview.begin(), axialPreview.end(), 1) == 1 && axialPreview[4 * kDimX + 3] == 1 &&
+                  std::count(sagittalPreview.begin(), sagittalPreview.end(), 1) == 1 &&
+                  sagittalPreview[5 * kDimY + 4] == 1 && int16Image.getVoxelValue(3, 4, 5) == ramp(3, 4, 5),
+              "threshold preview: the masked voxel, nothing applied");
+        int16Image.applyThreshold(-1.0f, 9.0f, masked);
+        check(int16Image.getVoxelValue(3, 4, 5) == 9.0f && int16Image.getVoxelValue(2, 4, 5) == ramp(2, 4, 5) &&
+                  int16Image.undoLevels() == 2,
+              "threshold: limited to the mask");
+        check(int16Image.undo() && int16Image.undo() && int16Image.getVoxelValue(3, 4, 5) == ramp(3, 4, 5) &&
+                  int16Image.getVoxelValue(2, 8, kDimZ - 4) == ramp(2, 8, kDimZ - 4),
+              "threshold: region edits undone");
+
+        // Integer rows are compared at their own width, so a fractional
+        // threshold has to split neighbouring values exactly.
+        ThresholdRegion slab;
+        slab.begin[2] = 5;
+        slab.end[2] = 6;
+        int16Image.applyThreshold(static_cast<float>(ramp(5, 0, 5)) - 0.5f, 3.0f, slab);
+        check(int16Image.storageType() == NiftiImage::StorageType::Int16 && int16Image.getVoxelValue(5, 0, 5) == 3.0f &&
+                  int16Image.getVoxelValue(4, 0, 5) == ramp(4, 0, 5) && int16Image.undo(),
+              "threshold: fractional value on int16 rows");
+    }
+
+    const std::string npyFloatPath = (dir / "float.npy").string();
+    check(writeNpy<float>(npyFloatPath, "<f4"), "fixture: float32 .npy");
+    {
+        NiftiImage image;
+        check(image.load(npyFloatPath), "float32 .npy: loads");
+        check(countMismatches(image, 1.0f, 0.0f) == 0, "float32 .npy: voxels match");
+        const float median = image.intensityPercentile(0.5);
+        const float expected = static_cast<float>(ramp(kDimX - 1, kDimY - 1, kDimZ / 2 - 1));
+        check(std::abs(median - expected) <= 0.004f * expected && image.intensityPercentile(1.0) == image.getGlobalMax(),
+              "float32 .npy: percentiles within a histogram bin");
+    }
+
+    const std::string npyInt16Path = (dir / "int16.npy").string();
+    check(writeNpy<int16_t>(npyInt16Path, "<i2"), "fixture: int16 .npy");
+    {
+        NiftiImage image;
+        check(image.load(npyInt16Path), "int16 .npy: loads");
+        check(countMismatches(image, 1.0f, 0.0f) == 0, "int16 .npy: voxels match");
+        check(image.storageType() == NiftiImage::StorageType::Int16, "int16 .npy: stored as int16");
+    }
+
+    {
+        // Flipped axes are not image order: the samples are gathered from the
+        // mapping row by row, X walked backwards.
+        NpzImportOptions options;
+        options.flip[0] = true;
+        options.flip[2] = true;
+        NiftiImage flippedFloat, flippedInt16;
+        size_t mismatches = 0;
+        const bool loaded =
+            flippedFloat.loadNumpy(npyFloatPath, options) && flippedInt16.loadNumpy(npyInt16Path, options);
+        for (int z = 0; loaded && z < kDimZ; ++z)
+            for (int y = 0; y < kDimY; ++y)
+                for (int x = 0; x < kDimX; ++x)
+                {
+                    const float expected = static_cast<float>(ramp(kDimX - 1 - x, y, kDimZ - 1 - z));
+                    if (flippedFloat.getVoxelValue(x, y, z) != expected ||
+                        flippedInt16.getVoxelValue(x, y, z) != expected)
+                        ++mismatches;
+                }
+        check(loaded && mismatches == 0, "flipped .npy: gathered voxels match");
+
+        // Read as labels: converted straight to integers, mapped and flipped
+        // alike, and stored in 16 bits since the ramp passes 255.
+        LabelBuffer floatLabels, int16Labels;
+        size_t labelMismatches = 0;
+        const bool labelsRead = NiftiImage::readNumpyLabels(npyFloatPath, options, floatLabels) &&
+                                NiftiImage::readNumpyLabels(npyInt16Path, options, int16Labels) &&
+                                floatLabels.size() == static_cast<size_t>(kDimX * kDimY * kDimZ) &&
+                                int16Labels.size() == floatLabels.size() &&
+                                floatLabels.width() == LabelBuffer::Width::Bits16 &&
+                                int16Labels.width() == LabelBuffer::Width::Bits16;
+        size_t at = 0;
+        for (int z = 0; labelsRead && z < kDimZ; ++z)
+            for (int y = 0; y < kDimY; ++y)
+                for (int x = 0; x < kDimX; ++x, ++at)
+                {
+                    const int expected = ramp(kDimX - 1 - x, y, kDimZ - 1 - z);
+                    if (floatLabels[at] != expected || int16Labels[at] != expected)
+                        ++labelMismatches;
+                }
+        check(labelsRead && labelMismatches == 0, "flipped .npy: read as labels");
+    }
+
+    {
+        NiftiImage edited;
+        edited.load(floatPath);
+        edited.applyThreshold(-1.0f, 0.0f);
+        NiftiImage fresh;
+        fresh.load(floatPath);
+        check(edited.getVoxelValue(1, 1, 1) == 0.0f, "mapped float32: threshold edits the image");
+        check(fresh.getVoxelValue(1, 1, 1) == static_cast<float>(ramp(1, 1, 1)),
+              "mapped float32: file on disk unchanged");
+        NiftiImage copy = edited.deepCopy();
+        check(copy.getVoxelValue(2, 2, 2) == 0.0f, "mapped float32: deep copy sees the edit");
+    }
+
+    {
+        // Saved over its own source: the unedited slices are still pages of
+        // that file, so they must survive the write.
+        const std::string overwritePath = (dir / "overwrite.nii").string();
+        std::filesystem::copy_file(floatPath, overwritePath, std::filesystem::copy_options::overwrite_existing, ec);
+        NiftiImage edited;
+        edited.load(overwritePath);
+        const float cut = static_cast<float>(ramp(0, 0, kDimZ / 2));
+        edited.applyThreshold(cut, -1.0f);
+        check(edited.save(overwritePath) && !std::filesystem::exists(overwritePath + ".part"),
+              "mapped float32: saved over its source");
+        NiftiImage reloaded;
+        check(reloaded.load(overwritePath) &&
+                  reloaded.getVoxelValue(3, 2, 1) == static_cast<float>(ramp(3, 2, 1)) &&
+                  reloaded.getVoxelValue(3, 2, kDimZ - 1) == -1.0f &&
+                  reloaded.getVoxelValue(3, 2, kDimZ - 1) == edited.getVoxelValue(3, 2, kDimZ - 1),
+              "mapped float32: reloaded save keeps edited and unedited slices");
+
+        // Unedited and still mapped from that file: saved over it twice, it
+        // keeps reading its own voxels. Windows moves a mapped source aside to
+        // replace it; once nothing maps it, the next save leaves nothing beside
+        // the file.
+        NiftiImage mapped;
+        check(mapped.load(overwritePath) && mapped.isMapped() && mapped.save(overwritePath) &&
+                  mapped.save(overwritePath) && mapped.getVoxelValue(3, 2, 1) == static_cast<float>(ramp(3, 2, 1)),
+              "mapped float32: saved over its own mapping twice");
+        mapped = NiftiImage();
+        edited = NiftiImage();
+        reloaded = NiftiImage();
+        NiftiImage fresh;
+        check(fresh.load(floatPath) && fresh.save(overwritePath) &&
+                  !std::filesystem::exists(overwritePath + ".part") &&
+                  !std::filesystem::exists(overwritePath + ".replaced"),
+              "mapped float32: no file left beside the saved one");
+    }
+
+    {
+        // Headers only: the byte count is the file's, the type the stored one.
+        const NpzImportOptions options;
+        ImageMetadata nifti, scaled, npy, missing;
+        check(NiftiImage::readMetadata(int16Path, options, nifti) && nifti.size[0] == kDimX &&
+                  nifti.size[1] == kDimY && nifti.size[2] == kDimZ && nifti.dtype == "int16" &&
+                  nifti.spacing[0] == 0.5 && nifti.spacing[2] == 1.25 &&
+                  nifti.bytesOnDisk == 352 + sizeof(int16_t) * kDimX * kDimY * kDimZ,
+              "metadata: int16 .nii size, type, spacing and bytes");
+        check(NiftiImage::readMetadata(scaledPath, options, scaled) && scaled.dtype == "uint16" &&
+                  scaled.size[2] == kDimZ,
+              "metadata: big-endian header, stored type");
+        check(NiftiImage::readMetadata(npyInt16Path, options, npy) && npy.format == "numpy" &&
+                  npy.size[0] == kDimX && npy.size[1] == kDimY && npy.size[2] == kDimZ && npy.dtype == "int16",
+              "metadata: .npy header mapped to image axes");
+        const std::string int64Path = (dir / "int64.nii").string();
+        ImageMetadata wide;
+        check(writeNifti<int64_t>(int64Path, 1024, false, 0.0f, 0.0f) &&
+                  NiftiImage::readMetadata(int64Path, options, wide) && wide.dtype == "int64" &&
+                  wide.size[2] == kDimZ,
+              "metadata: int64 .nii named as such");
+        std::string error;
+        check(!NiftiImage::readMetadata((dir / "missing.nii").string(), options, missing, &error) && !error.empty(),
+              "metadata: a missing file fails with a reason");
+    }
+
+    std::filesystem::remove_all(dir, ec);
+    std::printf("%s\n", failures == 0 ? "ALL OK" : "FAILURES");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,274 @@
+// Checks the in-memory .nii.gz decoder against ITK's own reader.
+//
+// NiftiImage inflates compressed NIfTI straight into its buffer and converts
+// the samples on the way, so the byte order, the datatype and scl_slope /
+// scl_inter are all its own business now. The fixtures are written by hand to
+// cover each of those, and every voxel is compared with what ITK reads from the
+// same file. It also checks the progress, preview and cancel hooks of a load,
+// and that what save() writes, through its own header and parallel deflate,
+// reads back the same in both.
+#include "GzipWriter.h"
+#include "NiftiHeader.h"
+#include "NiftiImage.h"
+
+#include <itkImage.h>
+#include <itkImageFileReader.h>
+#include <itkNiftiImageIO.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+namespace
+{
+
+int failures = 0;
+
+void check(bool condition, const char *what)
+{
+    std::printf("%-58s %s\n", what, condition ? "ok" : "FAIL");
+    if (!condition)
+        ++failures;
+}
+
+constexpr int kDimX = 13;
+constexpr int kDimY = 9;
+constexpr int kDimZ = 7;
+
+template <typename T>
+void put(std::vector<unsigned char> &bytes, size_t offset, T value, bool bigEndian)
+{
+    unsigned char tmp[sizeof(T)];
+    std::memcpy(tmp, &value, sizeof(T));
+    for (size_t b = 0; b < sizeof(T); ++b)
+        bytes[offset + b] = bigEndian ? tmp[sizeof(T) - 1 - b] : tmp[b];
+}
+
+// A single-file NIfTI-1 volume whose voxel (x, y, z) stores sampleAt(x, y, z).
+template <typename T, typename SampleAt>
+bool writeNifti(const std::string &path, int16_t datatype, bool bigEndian, float slope, float inter,
+                SampleAt sampleAt)
+{
+    std::vector<unsigned char> bytes(352, 0);
+    put<int32_t>(bytes, 0, 348, bigEndian);
+    const int16_t dims[8] = {3, kDimX, kDimY, kDimZ, 1, 1, 1, 1};
+    for (int i = 0; i < 8; ++i)
+        put<int16_t>(bytes, 40 + 2 * i, dims[i], bigEndian);
+    put<int16_t>(bytes, 70, datatype, bigEndian);
+    put<int16_t>(bytes, 72, static_cast<int16_t>(8 * sizeof(T)), bigEndian);
+    const float pixdim[8] = {1.0f, 0.8f, 0.6f, 2.5f, 1.0f, 1.0f, 1.0f, 1.0f};
+    for (int i = 0; i < 8; ++i)
+        put<float>(bytes, 76 + 4 * i, pixdim[i], bigEndian);
+    put<float>(bytes, 108, 352.0f, bigEndian);
+    put<float>(bytes, 112, slope, bigEndian);
+    put<float>(bytes, 116, inter, bigEndian);
+    put<int16_t>(bytes, 252, 1, bigEndian); // qform_code: scanner
+    put<float>(bytes, 280, 0.0f, bigEndian);
+    std::memcpy(bytes.data() + 344, "n+1\0", 4);
+
+    for (int z = 0; z < kDimZ; ++z)
+        for (int y = 0; y < kDimY; ++y)
+            for (int x = 0; x < kDimX; ++x)
+            {
+                const size_t offset = bytes.size();
+                bytes.resize(offset + sizeof(T));
+                put<T>(bytes, offset, sampleAt(x, y, z), bigEndian);
+            }
+
+    gzFile out = gzopen(path.c_str(), "wb");
+    if (!out)
+        return false;
+    const bool ok = gzwrite(out, bytes.data(), static_cast<unsigned int>(bytes.size())) ==
+                    static_cast<int>(bytes.size());
+    gzclose(out);
+    return ok;
+}
+
+// Every voxel and the spacing of NiftiImage::load() against an ITK read.
+void compareWithItk(const std::string &path, const char *what)
+{
+    NiftiImage image;
+    const bool loaded = image.load(path);
+    std::string label = std::string(what) + ": loads";
+    check(loaded, label.c_str());
+    if (!loaded)
+        return;
+
+    using ReferenceType = itk::Image<float, 3>;
+    using ReaderType = itk::ImageFileReader<ReferenceType>;
+    ReaderType::Pointer reader = ReaderType::New();
+    reader->SetImageIO(itk::NiftiImageIO::New());
+    reader->SetFileName(path);
+    try
+    {
+        reader->Update();
+    }
+    catch (const std::exception &e)
+    {
+        std::printf("ITK could not read %s: %s\n", path.c_str(), e.what());
+        ++failures;
+        return;
+    }
+    ReferenceType::Pointer reference = reader->GetOutput();
+
+    const auto size = reference->GetLargestPossibleRegion().GetSize();
+    label = std::string(what) + ": size matches ITK";
+    check(image.getSizeX() == size[0] && image.getSizeY() == size[1] && image.getSizeZ() == size[2],
+          label.c_str());
+
+    const auto spacing = reference->GetSpacing();
+    label = std::string(what) + ": spacing matches ITK";
+    check(std::abs(image.getSpacingX() - std::abs(spacing[0])) < 1e-6 &&
+              std::abs(image.getSpacingY() - std::abs(spacing[1])) < 1e-6 &&
+              std::abs(image.getSpacingZ() - std::abs(spacing[2])) < 1e-6,
+          label.c_str());
+
+    size_t mismatches = 0;
+    for (int z = 0; z < kDimZ; ++z)
+        for (int y = 0; y < kDimY; ++y)
+            for (int x = 0; x < kDimX; ++x)
+            {
+                ReferenceType::IndexType idx;
+                idx[0] = x;
+                idx[1] = y;
+                idx[2] = z;
+                const float expected = reference->GetPixel(idx);
+                const float got = image.getVoxelValue(x, y, z);
+                if (std::abs(expected - got) > 1e-4f * std::max(1.0f, std::abs(expected)))
+                    ++mismatches;
+            }
+    label = std::string(what) + ": voxels match ITK";
+    check(mismatches == 0, label.c_str());
+}
+
+} // namespace
+
+int main()
+{
+    const std::filesystem::path dir = std::filesystem::temp_directory_path() / "roift_nifti_stream_test";
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+
+    auto ramp = [](int x, int y, int z) { return x + 20 * y + 300 * z; };
+
+    const std::string int16Path = (dir / "int16.nii.gz").string();
+    check(writeNifti<int16_t>(int16Path, 4, false, 0.0f, 0.0f,
+                              [&](int x, int y, int z) { return static_cast<int16_t>(ramp(x, y, z) - 1024); }),
+          "fixture: int16 little-endian");
+    compareWithItk(int16Path, "int16");
+
+    {
+        // The monitor sees the middle slice, then the load runs to the end.
+        NiftiImage monitored;
+        std::vector<float> central;
+        float lastFraction = 0.0f;
+        NiftiImage::LoadMonitor monitor;
+        monitor.progress = [&](float fraction)
+        {
+            lastFraction = fraction;
+            return true;
+        };
+        monitor.centralSlice = [&](const std::vector<float> &slice, unsigned int width, unsigned int height)
+        {
+            if (width == kDimX && height == kDimY)
+                central = slice;
+        };
+        monitored.setLoadMonitor(monitor);
+        check(monitored.load(int16Path) && lastFraction == 1.0f, "monitored load: runs to completion");
+        check(central.size() == size_t(kDimX) * kDimY && central[kDimX + 2] == ramp(2, 1, kDimZ / 2) - 1024,
+              "monitored load: central slice delivered");
+
+        NiftiImage cancelled;
+        monitor.progress = [](float) { return false; };
+        cancelled.setLoadMonitor(monitor);
+        check(!cancelled.load(int16Path) && cancelled.getSizeX() == 0, "monitored load: cancel leaves no image");
+    }
+
+    const std::string scaledPath = (dir / "scaled.nii.gz").string();
+    check(writeNifti<uint16_t>(scaledPath, 512, false, 0.5f, -1024.0f,
+                               [&](int x, int y, int z) { return static_cast<uint16_t>(ramp(x, y, z)); }),
+          "fixture: uint16 with scl_slope/scl_inter");
+    compareWithItk(scaledPath, "scaled uint16");
+    {
+        NiftiImage scaled;
+        scaled.load(scaledPath);
+        check(std::abs(scaled.getVoxelValue(1, 0, 0) - (0.5f * 1.0f - 1024.0f)) < 1e-4f,
+              "scaled uint16: slope and intercept applied");
+    }
+
+    const std::string bigEndianPath = (dir / "big_endian.nii.gz").string();
+    check(writeNifti<float>(bigEndianPath, 16, true, 0.0f, 0.0f,
+                            [&](int x, int y, int z) { return 0.25f * static_cast<float>(ramp(x, y, z)); }),
+          "fixture: float32 big-endian");
+    compareWithItk(bigEndianPath, "big-endian float32");
+
+    const std::string maskPath = (dir / "mask.nii.gz").string();
+    check(writeNifti<uint8_t>(maskPath, 2, false, 0.0f, 0.0f,
+                              [](int x, int, int) { return static_cast<uint8_t>(x > 6 ? 1 : 0); }),
+          "fixture: uint8 binary mask");
+    compareWithItk(maskPath, "uint8 mask");
+    {
+        NiftiImage mask;
+        mask.load(maskPath);
+        check(mask.isMask(), "uint8 mask: still classified as a mask");
+    }
+
+    {
+        NiftiImage source;
+        source.load(int16Path);
+        const char *names[3] = {"saved_fast.nii.gz", "saved_best.nii.gz", "saved.nii"};
+        const int levels[3] = {gzip::kFastLevel, gzip::kBestLevel, gzip::kDefaultLevel};
+        for (int i = 0; i < 3; ++i)
+        {
+            const std::string savedPath = (dir / names[i]).string();
+            std::string label = std::string(names[i]) + ": saved";
+            check(source.save(savedPath, levels[i]), label.c_str());
+            compareWithItk(savedPath, names[i]);
+
+            NiftiImage saved;
+            saved.load(savedPath);
+            size_t mismatches = 0;
+            for (int z = 0; z < kDimZ; ++z)
+                for (int y = 0; y < kDimY; ++y)
+                    for (int x = 0; x < kDimX; ++x)
+                        if (saved.getVoxelValue(x, y, z) != source.getVoxelValue(x, y, z))
+                            ++mismatches;
+            nifti::Header header;
+            label = std::string(names[i]) + ": same voxels, still int16";
+            check(mismatches == 0 && nifti::readHeader(savedPath, header, nullptr) &&
+                      header.datatype == nifti::kInt16 && std::abs(header.pixdim[3] - 2.5) < 1e-6,
+                  label.c_str());
+        }
+    }
+
+    {
+        // Two rounds of blocks on four threads, the input split in two pieces.
+        std::vector<unsigned char> data(size_t(3) << 20);
+        for (size_t i = 0; i < data.size(); ++i)
+            data[i] = static_cast<unsigned char>((i % 251) ^ (i / 7000));
+        const std::string gzPath = (dir / "blocks.gz").string();
+        std::string error;
+        const bool written = gzip::writeFile(
+            gzPath, {{data.data(), 1000}, {data.data() + 1000, data.size() - 1000}}, 6, &error, 4);
+        std::vector<unsigned char> back(data.size() + 1);
+        int got = -1;
+        if (gzFile in = gzopen(gzPath.c_str(), "rb"))
+        {
+            got = gzread(in, back.data(), static_cast<unsigned int>(back.size()));
+            gzclose(in);
+        }
+        check(written && got == static_cast<int>(data.size()) && std::equal(data.begin(), data.end(), back.begin()),
+              "parallel gzip: multi-block stream inflates intact");
+    }
+
+    std::filesystem::remove_all(dir, ec);
+    std::printf("%s\n", failures == 0 ? "ALL OK" : "FAILURES");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,256 @@
+// Checks the argmax import of multi-channel probability arrays: for channels
+// first and last, stored (.npy, mapped) and deflated (.npz, streamed), each
+// with every image axis flipped or not, the labels match a direct argmax of
+// the same values, ties going to the lower channel and NaN never winning. A
+// minimum probability turns unsure voxels into background, the labels take a
+// byte per voxel, and an array with no channel axis is refused.
+//
+// The arrays span two blocks of 4M voxels, so a deflated channel-first array
+// is read a block and a channel at a time, the second block from the middle
+// of each channel.
+#include "NiftiImage.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+namespace
+{
+
+int failures = 0;
+
+void check(bool condition, const char *what)
+{
+    std::printf("%-58s %s\n", what, condition ? "ok" : "FAIL");
+    if (!condition)
+        ++failures;
+}
+
+constexpr size_t kChannels = 3;
+constexpr size_t kDimZ = 80;
+constexpr size_t kDimY = 256;
+constexpr size_t kDimX = 256;
+
+// Eighths, so channels often tie, and now and then NaN.
+float probability(size_t c, size_t z, size_t y, size_t x)
+{
+    uint32_t h = static_cast<uint32_t>(((c * kDimZ + z) * kDimY + y) * kDimX + x) * 2654435761u;
+    h ^= h >> 13;
+    if (h % 61 == 0)
+        return std::numeric_limits<float>::quiet_NaN();
+    return static_cast<float>(h % 8) / 8.0f;
+}
+
+// The argmax as readNumpyArgmax() defines it, at stored position (z, y, x).
+int expectedLabel(size_t z, size_t y, size_t x, float minProbability)
+{
+    float best = -std::numeric_limits<float>::infinity();
+    int label = 0;
+    for (size_t c = 0; c < kChannels; ++c)
+    {
+        const float value = probability(c, z, y, x);
+        if (value > best)
+        {
+            best = value;
+            label = static_cast<int>(c);
+        }
+    }
+    return minProbability > 0.0f && best < minProbability ? 0 : label;
+}
+
+void put16(std::vector<uint8_t> &out, uint16_t value)
+{
+    out.push_back(static_cast<uint8_t>(value));
+    out.push_back(static_cast<uint8_t>(value >> 8));
+}
+
+void put32(std::vector<uint8_t> &out, uint32_t value)
+{
+    put16(out, static_cast<uint16_t>(value));
+    put16(out, static_cast<uint16_t>(value >> 16));
+}
+
+// A little-endian float32 .npy of the given shape, e.g. "(4, 5, 6)".
+std::vector<uint8_t> npyBytes(const std::string &shape, const std::vector<float> &values)
+{
+    std::string header = "{'descr': '<f4', 'fortran_order': False, 'shape': " + shape + ", }";
+    while ((10 + header.size() + 1) % 64 != 0)
+        header += ' ';
+    header += '\n';
+    std::vector<uint8_t> npy = {0x93, 'N', 'U', 'M', 'P', 'Y', 1, 0};
+    put16(npy, static_cast<uint16_t>(header.size()));
+    npy.insert(npy.end(), header.begin(), header.end());
+    const size_t dataStart = npy.size();
+    npy.resize(dataStart + values.size() * sizeof(float));
+    std::memcpy(npy.data() + dataStart, values.data(), values.size() * sizeof(float));
+    return npy;
+}
+
+// The probabilities as (C, Z, Y, X), or (Z, Y, X, C) when not channelFirst.
+std::vector<uint8_t> makeNpy(bool channelFirst)
+{
+    std::vector<float> values(kChannels * kDimZ * kDimY * kDimX);
+    for (size_t c = 0; c < kChannels; ++c)
+        for (size_t z = 0; z < kDimZ; ++z)
+            for (size_t y = 0; y < kDimY; ++y)
+                for (size_t x = 0; x < kDimX; ++x)
+                {
+                    const size_t spatial = (z * kDimY + y) * kDimX + x;
+                    values[channelFirst ? c * kDimZ * kDimY * kDimX + spatial : spatial * kChannels + c] =
+                        probability(c, z, y, x);
+                }
+    const std::string channels = std::to_string(kChannels);
+    const std::string spatial = std::to_string(kDimZ) + ", " + std::to_string(kDimY) + ", " + std::to_string(kDimX);
+    return npyBytes(channelFirst ? "(" + channels + ", " + spatial + ")" : "(" + spatial + ", " + channels + ")",
+                    values);
+}
+
+bool writeFile(const std::string &path, const std::vector<uint8_t> &bytes)
+{
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char *>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+    return static_cast<bool>(out);
+}
+
+// A .npz holding `npy` as one deflated member "probabilities", as
+// np.savez_compressed writes it.
+bool writeNpz(const std::string &path, const std::vector<uint8_t> &npy)
+{
+    z_stream zs{};
+    if (deflateInit2(&zs, 1, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return false;
+    std::vector<uint8_t> packed(deflateBound(&zs, static_cast<uLong>(npy.size())));
+    zs.next_in = const_cast<uint8_t *>(npy.data());
+    zs.avail_in = static_cast<uInt>(npy.size());
+    zs.next_out = packed.data();
+    zs.avail_out = static_cast<uInt>(packed.size());
+    const bool deflated = deflate(&zs, Z_FINISH) == Z_STREAM_END;
+    packed.resize(zs.total_out);
+    deflateEnd(&zs);
+    if (!deflated)
+        return false;
+    const uint32_t crc = static_cast<uint32_t>(crc32(0L, npy.data(), static_cast<uInt>(npy.size())));
+
+    const std::string name = "probabilities.npy";
+    std::vector<uint8_t> zip;
+    put32(zip, 0x04034b50);
+    put16(zip, 20);
+    put16(zip, 0);
+    put16(zip, 8);
+    put32(zip, 0);
+    put32(zip, crc);
+    put32(zip, static_cast<uint32_t>(packed.size()));
+    put32(zip, static_cast<uint32_t>(npy.size()));
+    put16(zip, static_cast<uint16_t>(name.size()));
+    put16(zip, 0);
+    zip.insert(zip.end(), name.begin(), name.end());
+    zip.insert(zip.end(), packed.begin(), packed.end());
+
+    const uint32_t central = static_cast<uint32_t>(zip.size());
+    put32(zip, 0x02014b50);
+    put16(zip, 20);
+    put16(zip, 20);
+    put16(zip, 0);
+    put16(zip, 8);
+    put32(zip, 0);
+    put32(zip, crc);
+    put32(zip, static_cast<uint32_t>(packed.size()));
+    put32(zip, static_cast<uint32_t>(npy.size()));
+    put16(zip, static_cast<uint16_t>(name.size()));
+    put16(zip, 0);
+    put16(zip, 0);
+    put16(zip, 0);
+    put16(zip, 0);
+    put32(zip, 0);
+    put32(zip, 0);
+    zip.insert(zip.end(), name.begin(), name.end());
+    const uint32_t centralSize = static_cast<uint32_t>(zip.size()) - central;
+
+    put32(zip, 0x06054b50);
+    put16(zip, 0);
+    put16(zip, 0);
+    put16(zip, 1);
+    put16(zip, 1);
+    put32(zip, centralSize);
+    put32(zip, central);
+    put16(zip, 0);
+    return writeFile(path, zip);
+}
+
+// Labels of every flip combination compared with the direct argmax; the
+// number of voxels that differ.
+size_t argmaxMismatches(const std::string &path, float minProbability)
+{
+    size_t mismatches = 0;
+    for (int flips = 0; flips < 8; ++flips)
+    {
+        NpzImportOptions options;
+        options.axisOrder = NpzImportOptions::AxisOrder::ZYX;
+        for (int i = 0; i < 3; ++i)
+        {
+            options.flip[i] = (flips >> i) & 1;
+            options.spacing[i] = 1.0;
+        }
+        options.minProbability = minProbability;
+        LabelBuffer labels;
+        NpzImportReport report;
+        if (!NiftiImage::readNumpyArgmax(path, options, labels, &report) ||
+            labels.size() != kDimX * kDimY * kDimZ || labels.width() != LabelBuffer::Width::Bits8 ||
+            report.size[0] != kDimX || report.size[2] != kDimZ)
+            return labels.size() + 1;
+        size_t out = 0;
+        for (size_t z = 0; z < kDimZ; ++z)
+            for (size_t y = 0; y < kDimY; ++y)
+                for (size_t x = 0; x < kDimX; ++x, ++out)
+                {
+                    const size_t sz = options.flip[2] ? kDimZ - 1 - z : z;
+                    const size_t sy = options.flip[1] ? kDimY - 1 - y : y;
+                    const size_t sx = options.flip[0] ? kDimX - 1 - x : x;
+                    mismatches += labels[out] == expectedLabel(sz, sy, sx, minProbability) ? 0 : 1;
+                }
+    }
+    return mismatches;
+}
+
+} // namespace
+
+int main()
+{
+    const std::filesystem::path dir = std::filesystem::temp_directory_path() / "roift_npz_argmax_test";
+    std::error_code ec;
+    std::filesystem::remove_all(dir, ec);
+    std::filesystem::create_directories(dir, ec);
+
+    for (bool channelFirst : {true, false})
+    {
+        const std::string layout = channelFirst ? "channels first" : "channels last";
+        const std::vector<uint8_t> npy = makeNpy(channelFirst);
+        const std::string stored = (dir / (channelFirst ? "first.npy" : "last.npy")).string();
+        const std::string deflated = (dir / (channelFirst ? "first.npz" : "last.npz")).string();
+        check(writeFile(stored, npy) && writeNpz(deflated, npy), ("fixture: " + layout).c_str());
+
+        check(argmaxMismatches(stored, 0.0f) == 0, (layout + ", .npy: labels, every flip").c_str());
+        check(argmaxMismatches(deflated, 0.0f) == 0, (layout + ", .npz: labels, every flip").c_str());
+        check(argmaxMismatches(stored, 0.5f) == 0, (layout + ", .npy: minimum probability").c_str());
+        check(argmaxMismatches(deflated, 0.5f) == 0, (layout + ", .npz: minimum probability").c_str());
+    }
+
+    // One spatial volume: nothing to take the argmax over.
+    const std::string volume = (dir / "volume.npy").string();
+    LabelBuffer labels;
+    std::string error;
+    check(writeFile(volume, npyBytes("(4, 5, 6)", std::vector<float>(120, 0.5f))) &&
+              !NiftiImage::readNumpyArgmax(volume, NpzImportOptions(), labels, nullptr, &error) && !error.empty(),
+          "3D array: refused");
+
+    std::filesystem::remove_all(dir, ec);
+    std::printf("%s\n", failures == 0 ? "ALL OK" : "FAILURES");
+    return failures == 0 ? 0 : 1;
+}
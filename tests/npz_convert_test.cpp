@@ -0,0 +1,178 @@
+// Checks the numpy sample conversion: every float16 bit pattern against a
+// reference computed from its fields, in both byte orders and walked
+// backwards, and every dtype converted in bulk (vector kernels, split across
+// threads) against the same elements converted one at a time. Then the tiled
+// gather, for every assignment of stored axes to output axes, each flipped or
+// not, against a direct walk, and its rounding of labels.
+#include "NpzVolume.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+int failures = 0;
+
+void check(bool condition, const char *what)
+{
+    std::printf("%-58s %s\n", what, condition ? "ok" : "FAIL");
+    if (!condition)
+        ++failures;
+}
+
+float halfReference(uint16_t h)
+{
+    const int exponent = (h >> 10) & 0x1F;
+    const int mantissa = h & 0x3FF;
+    float magnitude = 0.0f;
+    if (exponent == 0x1F)
+        magnitude = mantissa == 0 ? INFINITY : NAN;
+    else if (exponent == 0)
+        magnitude = std::ldexp(static_cast<float>(mantissa), -24);
+    else
+        magnitude = std::ldexp(static_cast<float>(1024 + mantissa), exponent - 25);
+    return (h & 0x8000) ? -magnitude : magnitude;
+}
+
+bool same(float a, float b)
+{
+    if (std::isnan(a) || std::isnan(b))
+        return std::isnan(a) && std::isnan(b);
+    return std::memcmp(&a, &b, sizeof(float)) == 0;
+}
+
+// Deterministic bytes, so every bit of every dtype is exercised.
+std::vector<uint8_t> noise(size_t size)
+{
+    std::vector<uint8_t> bytes(size);
+    uint32_t state = 12345;
+    for (uint8_t &b : bytes)
+    {
+        state = state * 1664525u + 1013904223u;
+        b = static_cast<uint8_t>(state >> 24);
+    }
+    return bytes;
+}
+
+} // namespace
+
+int main()
+{
+    std::vector<uint8_t> little(2 * 65536), big(2 * 65536);
+    for (unsigned h = 0; h < 65536; ++h)
+    {
+        little[2 * h] = big[2 * h + 1] = static_cast<uint8_t>(h);
+        little[2 * h + 1] = big[2 * h] = static_cast<uint8_t>(h >> 8);
+    }
+    std::vector<float> forward(65536), swapped(65536), backward(65536);
+    npz::convertToFloat(little.data(), 65536, npz::DType::Float16, false, forward.data());
+    npz::convertToFloat(big.data(), 65536, npz::DType::Float16, true, swapped.data());
+    npz::convertToFloat(little.data() + 2 * 65535, 65536, npz::DType::Float16, false, backward.data(), -1);
+    size_t halfMismatches = 0, swapMismatches = 0, strideMismatches = 0;
+    for (unsigned h = 0; h < 65536; ++h)
+    {
+        const float expected = halfReference(static_cast<uint16_t>(h));
+        halfMismatches += same(forward[h], expected) ? 0 : 1;
+        swapMismatches += same(swapped[h], expected) ? 0 : 1;
+        strideMismatches += same(backward[65535 - h], expected) ? 0 : 1;
+    }
+    check(halfMismatches == 0, "float16: every half exact (subnormals, inf, nan)");
+    check(swapMismatches == 0, "float16: big-endian");
+    check(strideMismatches == 0, "float16: reversed stride");
+
+    // Longer than a few conversion chunks, and not a multiple of the vector
+    // width, so the threaded split and the kernel tails both run.
+    const size_t count = (size_t(3) << 20) + 13;
+    const std::vector<uint8_t> bytes = noise(count * 8);
+    const npz::DType dtypes[] = {npz::DType::Bool,   npz::DType::Int8,    npz::DType::UInt8,   npz::DType::Int16,
+                                 npz::DType::UInt16, npz::DType::Int32,   npz::DType::UInt32,  npz::DType::Int64,
+                                 npz::DType::UInt64, npz::DType::Float16, npz::DType::Float32, npz::DType::Float64};
+    std::vector<float> bulk(count), single(count);
+    for (bool bigEndian : {false, true})
+    {
+        for (npz::DType dtype : dtypes)
+        {
+            const size_t size = npz::dtypeSize(dtype);
+            npz::convertToFloat(bytes.data(), count, dtype, bigEndian, bulk.data());
+            // A stride on a single element takes the scalar gather path.
+            for (size_t i = 0; i < count; ++i)
+                npz::convertToFloat(bytes.data() + i * size, 1, dtype, bigEndian, &single[i], 2);
+            size_t mismatches = 0;
+            for (size_t i = 0; i < count; ++i)
+                mismatches += same(bulk[i], single[i]) ? 0 : 1;
+            const std::string what = std::string(npz::dtypeName(dtype)) + (bigEndian ? " big-endian" : "") +
+                                     ": bulk matches element-wise";
+            check(mismatches == 0, what.c_str());
+        }
+    }
+
+    // A (70, 90, 130) int16 array, large enough to be split across threads,
+    // with sizes that leave partial tiles.
+    const size_t dims[3] = {70, 90, 130};
+    const size_t stored = dims[0] * dims[1] * dims[2];
+    std::vector<int16_t> samples(stored);
+    for (size_t i = 0; i < stored; ++i)
+        samples[i] = static_cast<int16_t>((i * 7919) % 60001 - 30000);
+    const ptrdiff_t storedStride[3] = {static_cast<ptrdiff_t>(dims[1] * dims[2]), static_cast<ptrdiff_t>(dims[2]), 1};
+    const int orders[6][3] = {{2, 1, 0}, {0, 1, 2}, {1, 2, 0}, {2, 0, 1}, {0, 2, 1}, {1, 0, 2}};
+    size_t gatherMismatches = 0;
+    for (const auto &order : orders)
+    {
+        for (int flips = 0; flips < 8; ++flips)
+        {
+            // Output axis d walks stored axis order[d], backwards when flipped.
+            npz::Gather3D walk;
+            for (int d = 0; d < 3; ++d)
+            {
+                const bool flipped = (flips >> d) & 1;
+                walk.size[d] = dims[order[d]];
+                walk.step[d] = flipped ? -storedStride[order[d]] : storedStride[order[d]];
+                if (flipped)
+                    walk.first += static_cast<ptrdiff_t>(dims[order[d]] - 1) * storedStride[order[d]];
+            }
+            walk.dstStride[0] = walk.size[0];
+            walk.dstStride[1] = walk.size[0] * walk.size[1];
+            std::vector<float> asFloat(stored);
+            std::vector<int16_t> asInt16(stored);
+            std::vector<int32_t> asInt32(stored);
+            const uint8_t *source = reinterpret_cast<const uint8_t *>(samples.data());
+            npz::gather(source, npz::DType::Int16, false, walk, npz::DType::Float32, asFloat.data());
+            npz::gather(source, npz::DType::Int16, false, walk, npz::DType::Int16, asInt16.data());
+            npz::gather(source, npz::DType::Int16, false, walk, npz::DType::Int32, asInt32.data());
+            size_t out = 0;
+            for (size_t z = 0; z < walk.size[2]; ++z)
+                for (size_t y = 0; y < walk.size[1]; ++y)
+                    for (size_t x = 0; x < walk.size[0]; ++x, ++out)
+                    {
+                        const ptrdiff_t index = walk.first + static_cast<ptrdiff_t>(x) * walk.step[0] +
+                                                static_cast<ptrdiff_t>(y) * walk.step[1] +
+                                                static_cast<ptrdiff_t>(z) * walk.step[2];
+                        const int16_t expected = samples[index];
+                        if (asFloat[out] != expected || asInt16[out] != expected || asInt32[out] != expected)
+                            ++gatherMismatches;
+                    }
+        }
+    }
+    check(gatherMismatches == 0, "gather: every axis order and flip, float, int16 and int32");
+
+    // Labels from float samples round like std::lround; NaN is background.
+    const float labelSamples[6] = {2.5f, -2.5f, 0.49f, 7.0f, NAN, 1e12f};
+    int32_t labels[6] = {};
+    npz::Gather3D row;
+    row.size[0] = 6;
+    row.size[1] = row.size[2] = 1;
+    row.dstStride[0] = row.dstStride[1] = 6;
+    npz::gather(reinterpret_cast<const uint8_t *>(labelSamples), npz::DType::Float32, false, row, npz::DType::Int32,
+                labels);
+    check(labels[0] == 3 && labels[1] == -3 && labels[2] == 0 && labels[3] == 7 && labels[4] == 0 &&
+              labels[5] == 2147483647,
+          "gather: int32 labels rounded, NaN as 0, clamped");
+
+    std::printf("%s\n", failures == 0 ? "ALL OK" : "FAILURES");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,230 @@
+// Checks the checkpoint index of deflated .npz members: channels of a
+// channel-first array read in any order match what was written, the index
+// grows as reads go further into the member, a later read starts from it, and
+// rewriting the file drops it. Streaming the member hands it over in order,
+// one chunk at a time, and can be stopped.
+//
+// The archive is written here with zlib (one deflated member, as
+// np.savez_compressed makes it), large enough to hold several checkpoints.
+#include "NpzVolume.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+namespace
+{
+
+int failures = 0;
+
+void check(bool condition, const char *what)
+{
+    std::printf("%-58s %s\n", what, condition ? "ok" : "FAIL");
+    if (!condition)
+        ++failures;
+}
+
+constexpr size_t kChannels = 6;
+constexpr size_t kDimZ = 80;
+constexpr size_t kDimY = 128;
+constexpr size_t kDimX = 128;
+constexpr size_t kChannelSize = kDimZ * kDimY * kDimX;
+
+// Small integers with some noise: compressible, but not to nothing, so the
+// deflate stream has many blocks.
+float sample(size_t i, uint32_t seed)
+{
+    uint32_t h = static_cast<uint32_t>(i) * 2654435761u ^ seed;
+    h ^= h >> 15;
+    return static_cast<float>((i / kDimX) % 97) + static_cast<float>(h % 5);
+}
+
+void put16(std::vector<uint8_t> &out, uint16_t value)
+{
+    out.push_back(static_cast<uint8_t>(value));
+    out.push_back(static_cast<uint8_t>(value >> 8));
+}
+
+void put32(std::vector<uint8_t> &out, uint32_t value)
+{
+    put16(out, static_cast<uint16_t>(value));
+    put16(out, static_cast<uint16_t>(value >> 16));
+}
+
+// A .npz holding one float32 array "probabilities" of shape (C, Z, Y, X).
+bool writeNpz(const std::string &path, uint32_t seed)
+{
+    std::string header = "{'descr': '<f4', 'fortran_order': False, 'shape': (" + std::to_string(kChannels) + ", " +
+                         std::to_string(kDimZ) + ", " + std::to_string(kDimY) + ", " + std::to_string(kDimX) + "), }";
+    while ((10 + header.size() + 1) % 64 != 0)
+        header += ' ';
+    header += '\n';
+    std::vector<uint8_t> npy = {0x93, 'N', 'U', 'M', 'P', 'Y', 1, 0};
+    put16(npy, static_cast<uint16_t>(header.size()));
+    npy.insert(npy.end(), header.begin(), header.end());
+    const size_t dataStart = npy.size();
+    npy.resize(dataStart + kChannels * kChannelSize * sizeof(float));
+    for (size_t i = 0; i < kChannels * kChannelSize; ++i)
+    {
+        const float value = sample(i, seed);
+        std::memcpy(npy.data() + dataStart + i * sizeof(float), &value, sizeof(float));
+    }
+
+    z_stream zs{};
+    if (deflateInit2(&zs, 6, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return false;
+    std::vector<uint8_t> packed(deflateBound(&zs, static_cast<uLong>(npy.size())));
+    zs.next_in = npy.data();
+    zs.avail_in = static_cast<uInt>(npy.size());
+    zs.next_out = packed.data();
+    zs.avail_out = static_cast<uInt>(packed.size());
+    const bool deflated = deflate(&zs, Z_FINISH) == Z_STREAM_END;
+    packed.resize(zs.total_out);
+    deflateEnd(&zs);
+    if (!deflated)
+        return false;
+    const uint32_t crc = static_cast<uint32_t>(crc32(0L, npy.data(), static_cast<uInt>(npy.size())));
+
+    const std::string name = "probabilities.npy";
+    std::vector<uint8_t> zip;
+    put32(zip, 0x04034b50);
+    put16(zip, 20);
+    put16(zip, 0);
+    put16(zip, 8);
+    put32(zip, 0);
+    put32(zip, crc);
+    put32(zip, static_cast<uint32_t>(packed.size()));
+    put32(zip, static_cast<uint32_t>(npy.size()));
+    put16(zip, static_cast<uint16_t>(name.size()));
+    put16(zip, 0);
+    zip.insert(zip.end(), name.begin(), name.end());
+    zip.insert(zip.end(), packed.begin(), packed.end());
+
+    const uint32_t central = static_cast<uint32_t>(zip.size());
+    put32(zip, 0x02014b50);
+    put16(zip, 20);
+    put16(zip, 20);
+    put16(zip, 0);
+    put16(zip, 8);
+    put32(zip, 0);
+    put32(zip, crc);
+    put32(zip, static_cast<uint32_t>(packed.size()));
+    put32(zip, static_cast<uint32_t>(npy.size()));
+    put16(zip, static_cast<uint16_t>(name.size()));
+    put16(zip, 0);
+    put16(zip, 0);
+    put16(zip, 0);
+    put16(zip, 0);
+    put32(zip, 0);
+    put32(zip, 0);
+    zip.insert(zip.end(), name.begin(), name.end());
+    const uint32_t centralSize = static_cast<uint32_t>(zip.size()) - central;
+
+    put32(zip, 0x06054b50);
+    put16(zip, 0);
+    put16(zip, 0);
+    put16(zip, 1);
+    put16(zip, 1);
+    put32(zip, centralSize);
+    put32(zip, central);
+    put16(zip, 0);
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char *>(zip.data()), static_cast<std::streamsize>(zip.size()));
+    return static_cast<bool>(out);
+}
+
+bool channelMatches(const std::string &path, size_t channel, uint32_t seed)
+{
+    std::vector<float> values;
+    std::string error;
+    if (!npz::readAsFloat(path, "probabilities", channel * kChannelSize, kChannelSize, values, &error))
+    {
+        std::printf("read failed: %s\n", error.c_str());
+        return false;
+    }
+    for (size_t i = 0; i < kChannelSize; ++i)
+    {
+        if (values[i] != sample(channel * kChannelSize + i, seed))
+            return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int main()
+{
+    const std::filesystem::path dir = std::filesystem::temp_directory_path() / "roift_npz_index_test";
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    const std::string path = (dir / "softmax.npz").string();
+    check(writeNpz(path, 1), "fixture: deflated 6-channel .npz");
+
+    std::vector<npz::ArrayInfo> arrays;
+    check(npz::inspect(path, arrays, nullptr) && arrays.size() == 1 && arrays[0].shape.size() == 4,
+          "inspect: one 4D array");
+    check(npz::checkpointCount(path) == 0, "no reads past the header: no checkpoints");
+
+    check(channelMatches(path, 0, 1), "channel 0: values");
+    const size_t afterFirst = npz::checkpointCount(path);
+    check(afterFirst > 0, "channel 0: checkpoints recorded");
+    check(channelMatches(path, 4, 1), "channel 4: values");
+    const size_t afterFifth = npz::checkpointCount(path);
+    check(afterFifth > afterFirst, "channel 4: index extended");
+    // Both start from a checkpoint inside the part already indexed.
+    check(channelMatches(path, 2, 1) && channelMatches(path, 1, 1), "channels 2 and 1: values from checkpoints");
+    check(npz::checkpointCount(path) == afterFifth, "earlier channels: index unchanged");
+
+    std::vector<float> straddle;
+    check(npz::readAsFloat(path, "probabilities", 3 * kChannelSize - 5, 10, straddle, nullptr) &&
+              straddle[0] == sample(3 * kChannelSize - 5, 1) && straddle[9] == sample(3 * kChannelSize + 4, 1),
+          "range across a channel boundary");
+
+    // Two channels from the middle, in chunks of 3000 elements (not a
+    // divisor of the range, so the last chunk is short).
+    size_t expectedFirst = 2 * kChannelSize;
+    bool inOrder = true;
+    size_t streamMismatches = 0;
+    bool bigEndian = true;
+    const bool streamed = npz::streamRawElements(
+        path, "probabilities", 2 * kChannelSize, 2 * kChannelSize, 3000,
+        [&](const uint8_t *data, size_t first, size_t count)
+        {
+            inOrder = inOrder && first == expectedFirst && count <= 3000;
+            expectedFirst = first + count;
+            for (size_t i = 0; i < count; ++i)
+            {
+                float value;
+                std::memcpy(&value, data + i * sizeof(float), sizeof(float));
+                streamMismatches += value == sample(first + i, 1) ? 0 : 1;
+            }
+            return true;
+        },
+        bigEndian, nullptr);
+    check(streamed && inOrder && expectedFirst == 4 * kChannelSize && !bigEndian,
+          "stream: chunks in order, covering the range");
+    check(streamMismatches == 0, "stream: values");
+    std::string streamError;
+    size_t chunks = 0;
+    check(!npz::streamRawElements(
+              path, "probabilities", 0, 0, 4096, [&](const uint8_t *, size_t, size_t) { return ++chunks < 3; },
+              bigEndian, &streamError) &&
+              chunks == 3 && streamError == "cancelled",
+          "stream: stopping fails as cancelled");
+
+    // Other values, and a later modification time in case the size matches.
+    check(writeNpz(path, 7), "fixture: rewritten");
+    std::filesystem::last_write_time(path, std::filesystem::last_write_time(path) + std::chrono::seconds(5), ec);
+    check(channelMatches(path, 3, 7), "rewritten file: index dropped, new values");
+
+    std::filesystem::remove_all(dir, ec);
+    std::printf("%s\n", failures == 0 ? "ALL OK" : "FAILURES");
+    return failures == 0 ? 0 : 1;
+}
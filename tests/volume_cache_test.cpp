@@ -0,0 +1,205 @@
+// Checks the on-disk volume cache: a stored volume comes back voxel for voxel
+// (mapped, or inflated when compressed), a changed source or another read
+// variant misses, and the directory is kept under its budget by evicting the
+// least recently used entry. A cancelled read keeps its entry, and part files
+// left by an unfinished store are counted and cleaned up.
+//
+// The sources are small .nii.gz files, written by NiftiImage::save from an
+// uncompressed fixture, since an uncompressed .nii is never worth caching.
+#include "NiftiImage.h"
+#include "VolumeCache.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+int failures = 0;
+
+void check(bool condition, const char *what)
+{
+    std::printf("%-58s %s\n", what, condition ? "ok" : "FAIL");
+    if (!condition)
+        ++failures;
+}
+
+constexpr int kDimX = 16;
+constexpr int kDimY = 12;
+constexpr int kDimZ = 10;
+
+// Little-endian int16 NIfTI-1, mostly zero with a ramp in one corner, so the
+// slabs have something to deflate. `seed` varies the ramp between fixtures.
+bool writeNifti(const std::string &path, int seed)
+{
+    std::vector<unsigned char> bytes(352, 0);
+    auto put = [&bytes](size_t offset, const void *value, size_t size)
+    { std::memcpy(bytes.data() + offset, value, size); };
+    const int32_t headerSize = 348;
+    put(0, &headerSize, 4);
+    const int16_t dims[8] = {3, kDimX, kDimY, kDimZ, 1, 1, 1, 1};
+    put(40, dims, sizeof(dims));
+    const int16_t datatype = 4;
+    const int16_t bitpix = 16;
+    put(70, &datatype, 2);
+    put(72, &bitpix, 2);
+    const float pixdim[4] = {1.0f, 0.75f, 0.75f, 2.0f};
+    put(76, pixdim, sizeof(pixdim));
+    const float voxOffset = 352.0f;
+    put(108, &voxOffset, 4);
+    std::memcpy(bytes.data() + 344, "n+1\0", 4);
+    for (int z = 0; z < kDimZ; ++z)
+        for (int y = 0; y < kDimY; ++y)
+            for (int x = 0; x < kDimX; ++x)
+            {
+                const int16_t value = static_cast<int16_t>(x < 6 && y < 6 ? seed + x + 7 * y + 50 * z : 0);
+                const size_t offset = bytes.size();
+                bytes.resize(offset + 2);
+                put(offset, &value, 2);
+            }
+    std::ofstream out(path, std::ios::binary);
+    out.write(reinterpret_cast<const char *>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+    return static_cast<bool>(out);
+}
+
+// A .nii.gz source made from a fixture.
+bool writeSource(const std::filesystem::path &dir, const std::string &name, int seed)
+{
+    const std::string raw = (dir / (name + ".nii")).string();
+    NiftiImage image;
+    return writeNifti(raw, seed) && image.load(raw) && image.save((dir / (name + ".nii.gz")).string());
+}
+
+bool sameVoxels(const NiftiImage &a, const NiftiImage &b)
+{
+    if (a.getSizeX() != b.getSizeX() || a.getSizeY() != b.getSizeY() || a.getSizeZ() != b.getSizeZ())
+        return false;
+    for (unsigned int z = 0; z < a.getSizeZ(); ++z)
+        for (unsigned int y = 0; y < a.getSizeY(); ++y)
+            for (unsigned int x = 0; x < a.getSizeX(); ++x)
+                if (a.getVoxelValue(x, y, z) != b.getVoxelValue(x, y, z))
+                    return false;
+    return true;
+}
+
+} // namespace
+
+int main()
+{
+    const std::filesystem::path dir = std::filesystem::temp_directory_path() / "roift_volume_cache_test";
+    std::error_code ec;
+    std::filesystem::remove_all(dir, ec);
+    std::filesystem::create_directories(dir, ec);
+    const std::string a = (dir / "a.nii.gz").string();
+    const std::string b = (dir / "b.nii.gz").string();
+    const std::string c = (dir / "c.nii.gz").string();
+    check(writeSource(dir, "a", 1) && writeSource(dir, "b", 2) && writeSource(dir, "c", 3),
+          "fixture: three .nii.gz sources");
+    check(VolumeCache::worthCaching(a) && !VolumeCache::worthCaching((dir / "a.nii").string()),
+          "only decoded sources are worth caching");
+
+    VolumeCache cache;
+    cache.setDirectory((dir / "cache").string());
+    cache.setBudget(size_t(1) << 30);
+
+    NiftiImage sourceA;
+    sourceA.load(a);
+    NiftiImage cached;
+    check(!cache.load(a, "", cached), "empty cache: miss");
+    check(cache.store(a, "", sourceA, "note a"), "store: a");
+
+    std::string note;
+    check(cache.load(a, "", cached, &note) && note == "note a", "hit: a, with its note");
+    check(sameVoxels(sourceA, cached), "hit: same voxels");
+    check(cached.getSpacingX() == sourceA.getSpacingX() && cached.getSpacingZ() == sourceA.getSpacingZ() &&
+              cached.getGlobalMin() == sourceA.getGlobalMin() && cached.getGlobalMax() == sourceA.getGlobalMax() &&
+              cached.storageType() == NiftiImage::StorageType::Int16,
+          "hit: same spacing, range and storage");
+    NiftiImage other;
+    check(!cache.load(a, "npz ZYX", other), "another read variant: miss");
+
+    // Compressed entries are inflated rather than mapped, and smaller.
+    const size_t rawBytes = cache.usedBytes();
+    cache.clear();
+    cache.setCompression(true);
+    check(cache.store(a, "", sourceA) && cache.usedBytes() < rawBytes, "compressed store: smaller entry");
+    NiftiImage inflated;
+    check(cache.load(a, "", inflated) && sameVoxels(sourceA, inflated), "compressed hit: same voxels");
+
+    // A read its caller cancels misses but keeps the entry.
+    NiftiImage cancelled;
+    NiftiImage::LoadMonitor stopAtOnce;
+    stopAtOnce.progress = [](float) { return false; };
+    cancelled.setLoadMonitor(stopAtOnce);
+    const size_t compressedBytes = cache.usedBytes();
+    check(!cache.load(a, "", cancelled) && cache.usedBytes() == compressedBytes, "cancelled hit: entry kept");
+    NiftiImage resumed;
+    check(cache.load(a, "", resumed) && sameVoxels(sourceA, resumed), "cancelled hit: next load hits");
+
+    // A mapped image is not copied into the cache, and a store whose caller
+    // gives up leaves nothing behind.
+    cache.clear();
+    NiftiImage mapped;
+    mapped.load((dir / "a.nii").string());
+    check(mapped.isMapped() && !cache.store(b, "", mapped) && cache.usedBytes() == 0, "mapped image: not stored");
+    check(!cache.store(b, "", sourceA, "", []() { return false; }) && cache.usedBytes() == 0,
+          "abandoned store: no entry");
+    NiftiImage abandoned;
+    check(!cache.load(b, "", abandoned), "abandoned store: miss");
+
+    // What a store killed midway leaves: counted, removed once stale, and
+    // always by clear().
+    const std::filesystem::path leftover = dir / "cache" / "0123abcd.rvc.42.part";
+    {
+        std::ofstream part(leftover, std::ios::binary);
+        part << std::string(1000, 'x');
+    }
+    check(cache.usedBytes() == 1000, "leftover part: counted");
+    cache.setBudget(size_t(1) << 30);
+    check(std::filesystem::exists(leftover), "leftover part: kept while it may be a live store");
+    std::filesystem::last_write_time(leftover, std::filesystem::file_time_type::clock::now() - std::chrono::hours(2),
+                                     ec);
+    cache.setBudget(size_t(1) << 30);
+    check(!std::filesystem::exists(leftover) && cache.usedBytes() == 0, "leftover part: stale one evicted");
+    {
+        std::ofstream part(leftover, std::ios::binary);
+        part << "x";
+    }
+    cache.clear();
+    check(!std::filesystem::exists(leftover), "leftover part: removed by clear");
+    check(cache.store(a, "", sourceA), "compressed store: a again");
+
+    // A newer source invalidates its entry, which is dropped.
+    std::filesystem::last_write_time(a, std::filesystem::last_write_time(a) + std::chrono::seconds(5), ec);
+    NiftiImage stale;
+    check(!cache.load(a, "", stale) && cache.usedBytes() == 0, "changed source: miss, entry dropped");
+
+    // Room for two entries: reading a makes b the least recently used.
+    cache.setCompression(false);
+    cache.clear();
+    NiftiImage sourceB, sourceC;
+    sourceA.load(a);
+    sourceB.load(b);
+    sourceC.load(c);
+    cache.store(a, "", sourceA);
+    const size_t entryBytes = cache.usedBytes();
+    cache.setBudget(2 * entryBytes + entryBytes / 2);
+    cache.store(b, "", sourceB);
+    NiftiImage touched;
+    cache.load(a, "", touched);
+    check(cache.store(c, "", sourceC) && cache.usedBytes() <= cache.budget(), "budget: store c evicts");
+    NiftiImage hitA, hitB, hitC;
+    check(cache.load(a, "", hitA) && !cache.load(b, "", hitB) && cache.load(c, "", hitC),
+          "budget: least recently used (b) evicted");
+    check(sameVoxels(sourceC, hitC), "budget: c intact");
+
+    std::filesystem::remove_all(dir, ec);
+    std::printf("%s\n", failures == 0 ? "ALL OK" : "FAILURES");
+    return failures == 0 ? 0 : 1;
+}